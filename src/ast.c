@@ -11,7 +11,12 @@ void function_init(Function *function) {
   function->name = NULL;
   function->retVal.kind = 0;
   function->retVal.inner = NULL;
+  function->filename = NULL;
+  function->source = NULL;
   function->start = NULL;
+  function->end = NULL;
+  function->body = NULL;
+  function->callSites = 0;
 }
 
 int functionlist_indexof(const FunctionList *list, const char *name) {
@@ -156,6 +161,169 @@ int ast_precedence(AstNodeType type) {
   exit(17);
 }
 
+void ast_count_calls(const AstNode *node) {
+  switch (node->type) {
+  case op_nop:
+  case op_value_constant:
+  case op_value_string:
+  case op_value_variable:
+  case op_value_global:
+  case op_value_let:
+    return;
+  case op_function:
+    node->function->callSites++;
+    for (int i = 0; i < node->function->arguments.len; ++i) {
+      ast_count_calls(&node->arguments[i]);
+    }
+    return;
+  case cf_if:
+  case cf_while:
+    ast_count_calls(node->condition);
+    for (int i = 0; i < node->actions->len; ++i) {
+      ast_count_calls(&node->actions->array[i]);
+    }
+    if (node->type == cf_if && node->alternative != NULL) {
+      for (int i = 0; i < node->alternative->len; ++i) {
+        ast_count_calls(&node->alternative->array[i]);
+      }
+    }
+    return;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_addressof:
+  case op_unary_derefernce:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast:
+  case cf_return:
+    ast_count_calls(node->inner);
+    return;
+  default:
+    ast_count_calls(node->left);
+    ast_count_calls(node->right);
+  }
+}
+
+void ast_collect_calls(const AstNode *node, PtrList *callees) {
+  switch (node->type) {
+  case op_nop:
+  case op_value_constant:
+  case op_value_string:
+  case op_value_variable:
+  case op_value_global:
+  case op_value_let:
+    return;
+  case op_function:
+    if (ptrlist_indexof(callees, node->function) == -1) {
+      ptrlist_add(callees, node->function);
+    }
+    for (int i = 0; i < node->function->arguments.len; ++i) {
+      ast_collect_calls(&node->arguments[i], callees);
+    }
+    return;
+  case cf_if:
+  case cf_while:
+    ast_collect_calls(node->condition, callees);
+    for (int i = 0; i < node->actions->len; ++i) {
+      ast_collect_calls(&node->actions->array[i], callees);
+    }
+    if (node->type == cf_if && node->alternative != NULL) {
+      for (int i = 0; i < node->alternative->len; ++i) {
+        ast_collect_calls(&node->alternative->array[i], callees);
+      }
+    }
+    return;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_addressof:
+  case op_unary_derefernce:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast:
+  case cf_return:
+    ast_collect_calls(node->inner, callees);
+    return;
+  default:
+    ast_collect_calls(node->left, callees);
+    ast_collect_calls(node->right, callees);
+  }
+}
+
+bool ast_names_local(const char *contents, const Function *function, const PtrList *locals, const Token *token) {
+  if (varlist_get_by_token(&function->arguments, contents, token) != NULL)
+    return true;
+  for (int i = 0; i < locals->len; ++i) {
+    const Token *local = locals->array[i];
+    if (local->len == token->len && strncmp(contents + local->index, contents + token->index, token->len) == 0)
+      return true;
+  }
+  return false;
+}
+
+void ast_resolve_globals(const char *contents, const Function *function, const VarList *globals, PtrList *locals,
+                         AstNode *node) {
+  switch (node->type) {
+  case op_nop:
+  case op_value_constant:
+  case op_value_string:
+  case op_value_global:
+    return;
+  case op_value_variable:
+    if (!ast_names_local(contents, function, locals, node->token) &&
+        varlist_get_by_token(globals, contents, node->token) != NULL) {
+      node->type = op_value_global;
+    }
+    return;
+  case op_value_let:
+    ptrlist_add(locals, (void *)node->token);
+    return;
+  case op_function:
+    for (int i = 0; i < node->function->arguments.len; ++i) {
+      ast_resolve_globals(contents, function, globals, locals, &node->arguments[i]);
+    }
+    return;
+  case cf_if:
+  case cf_while:
+    ast_resolve_globals(contents, function, globals, locals, node->condition);
+    for (int i = 0; i < node->actions->len; ++i) {
+      ast_resolve_globals(contents, function, globals, locals, &node->actions->array[i]);
+    }
+    if (node->type == cf_if && node->alternative != NULL) {
+      for (int i = 0; i < node->alternative->len; ++i) {
+        ast_resolve_globals(contents, function, globals, locals, &node->alternative->array[i]);
+      }
+    }
+    return;
+  case op_member_access:
+  case op_deref_member_access:
+    // the right side names a field
+    ast_resolve_globals(contents, function, globals, locals, node->left);
+    return;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_addressof:
+  case op_unary_derefernce:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_cast:
+  case cf_return:
+    ast_resolve_globals(contents, function, globals, locals, node->inner);
+    return;
+  case op_assignment:
+    // `let x = x` reads whatever x meant before the let
+    ast_resolve_globals(contents, function, globals, locals, node->right);
+    ast_resolve_globals(contents, function, globals, locals, node->left);
+    return;
+  default:
+    ast_resolve_globals(contents, function, globals, locals, node->left);
+    ast_resolve_globals(contents, function, globals, locals, node->right);
+  }
+}
+
 Result parse_statement(const char *contents, const Token **token, VarList *globals, FunctionList *functions,
                        const TokenType until, AstNode *node) {
   PtrList values;
@@ -272,6 +440,7 @@ Result parse_statement(const char *contents, const Token **token, VarList *globa
         AstNode *op = operators.array[i];
         op->right = prev;
         op->left = values.array[--values.len];
+        prev = op;
       }
       values.array[values.len++] = prev;
     }
@@ -386,6 +555,22 @@ Result parse_value(const char *contents, const Token **token, VarList *globals,
     return failure(*token, "unkon");
   }
 
+  // fields bind tighter than any prefix operator, so &p->x takes the address of the field rather than reading a
+  // field of &p
+  while (((*token)->next->type == token_period || (*token)->next->type == token_arrow) &&
+         (*token)->next->next->type == token_identifier) {
+    *token = (*token)->next;
+    AstNode *base = malloc(sizeof(AstNode));
+    *base = *node;
+    node->token = *token;
+    node->type = (*token)->type == token_period ? op_member_access : op_deref_member_access;
+    node->left = base;
+    *token = (*token)->next;
+    node->right = malloc(sizeof(AstNode));
+    node->right->type = op_value_variable;
+    node->right->token = *token;
+  }
+
   if ((*token)->next->type == token_keyword_as) {
     *token = (*token)->next;
     AstNode *node1 = malloc(sizeof(AstNode));
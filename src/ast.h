@@ -11,11 +11,21 @@ typedef struct {
 
 LIST_API(Var, var, Variable)
 
+LIST_API(AstNode, astnode, struct AstNode)
+
 typedef struct {
   char *name;
   VarList arguments;
   Type retVal;
+  // the file the function is defined in, both NULL for an extern
+  const char *filename;
+  const char *source;
+  // the braces around the body, NULL for an extern
   const Token *start;
+  const Token *end;
+  AstNodeList *body; // NULLABLE, parsed ahead of code generation
+  // calls to this function across every parsed body
+  int callSites;
 } Function;
 
 LIST_API(Function, function, Function)
@@ -75,7 +85,7 @@ typedef enum {
   op_and,
   // ||
   op_or,
-  // ->
+  // -> (right is only the field's name, and inner is left, so walkers treat both as unary)
   op_deref_member_access,
   // .
   op_member_access,
@@ -119,8 +129,6 @@ typedef enum {
 int ast_operand_count(AstNodeType type);
 int ast_precedence(AstNodeType type);
 
-LIST_API(AstNode, astnode, struct AstNode)
-
 typedef struct AstNode {
   AstNodeType type;
   const Token *token;
@@ -159,6 +167,14 @@ typedef struct AstNode {
   };
 } AstNode;
 
+void ast_count_calls(const AstNode *node);
+// adds each function the node calls to callees, once
+void ast_collect_calls(const AstNode *node, PtrList *callees);
+// the parser only sees names: those that no argument or earlier let of the function declares, but a global does,
+// become op_value_global
+void ast_resolve_globals(const char *contents, const Function *function, const VarList *globals, PtrList *locals,
+                         AstNode *node);
+
 Result parse_value(const char *contents, const Token **token, VarList *globals, FunctionList *functions, AstNode *node);
 Result parse_statement(const char *contents, const Token **token, VarList *globals, FunctionList *functions,
                        TokenType until, AstNode *node);
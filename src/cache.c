@@ -0,0 +1,457 @@
+#include "cache.h"
+
+#include "options.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define mkdir(path, mode) _mkdir(path)
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// bumped whenever code generation changes what it emits for the same input, so that older entries stop matching
+#define CACHE_VERSION 1
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x100000001B3ULL
+
+typedef enum { ENTRY_ASSEMBLY, ENTRY_OBJECT } EntryKind;
+
+uint64_t hash_bytes(uint64_t hash, const void *bytes, const size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ ((const uint8_t *)bytes)[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+uint64_t hash_int(const uint64_t hash, const int64_t value) {
+  return hash_bytes(hash, &value, sizeof(value));
+}
+
+// with its terminator, so that consecutive strings cannot run together
+uint64_t hash_string(const uint64_t hash, const char *string) {
+  return hash_bytes(hash, string, strlen(string) + 1);
+}
+
+uint64_t hash_type(const uint64_t hash, const Type type) {
+  const uint64_t kind = hash_int(hash, type.kind);
+  if (type.kind == aggregate)
+    return hash_string(kind, type.structure->name);
+  return type.kind == ptr ? hash_type(kind, *type.inner) : kind;
+}
+
+// a body names its structs' fields, so where each one is laid out is part of what it compiles to
+uint64_t hash_structs(uint64_t hash) {
+  hash = hash_int(hash, struct_count());
+  for (int i = 0; i < struct_count(); ++i) {
+    const Struct *structure = struct_get(i);
+    hash = hash_string(hash, structure->name);
+    hash = hash_int(hash, structure->size);
+    hash = hash_int(hash, structure->alignment);
+    for (int j = 0; j < structure->fields.len; ++j) {
+      hash = hash_string(hash, structure->fields.array[j].name);
+      hash = hash_int(hash, structure->fields.array[j].offset);
+      hash = hash_type(hash, structure->fields.array[j].type);
+    }
+  }
+  return hash;
+}
+
+uint64_t hash_signature(uint64_t hash, const Function *function) {
+  hash = hash_string(hash, function->name);
+  hash = hash_int(hash, function->start != NULL);
+  hash = hash_int(hash, function->arguments.len);
+  for (int i = 0; i < function->arguments.len; ++i) {
+    hash = hash_string(hash, function->arguments.array[i].name);
+    hash = hash_type(hash, function->arguments.array[i].type);
+  }
+  return hash_type(hash, function->retVal);
+}
+
+// only a body of a single return in the same file is ever inlined (see function_inlinable); one not parsed yet might be
+bool inline_candidate(const Function *function) {
+  return function->start != NULL &&
+         (function->body == NULL || (function->body->len == 1 && function->body->array[0].type == cf_return));
+}
+
+typedef struct {
+  const char *contents;
+  const FunctionList *functions;
+  const VarList *globals;
+  const LiteralPool *literals;
+  // the functions whose bodies are already in the hash
+  PtrList visited;
+} KeyState;
+
+// every token of the body, and what the names among them refer to outside it
+uint64_t hash_body(KeyState *state, uint64_t hash, const Function *function) {
+  ptrlist_add(&state->visited, (void *)function);
+  for (const Token *token = function->start; token != function->end->next; token = token->next) {
+    hash = hash_int(hash, token->type);
+    hash = hash_bytes(hash, state->contents + token->index, token->len);
+    hash = hash_int(hash, token->len);
+
+    if (token->type == token_identifier) {
+      const int index = functionlist_indexof_tok(state->functions, state->contents, token);
+      if (index != -1) {
+        const Function *callee = &state->functions->array[index];
+        hash = hash_signature(hash, callee);
+        hash = hash_int(hash, callee->callSites);
+        if (inline_candidate(callee) && callee->source == state->contents &&
+            ptrlist_indexof(&state->visited, callee) == -1) {
+          hash = hash_body(state, hash, callee);
+        }
+      }
+      const Variable *global = varlist_get_by_token(state->globals, state->contents, token);
+      if (global != NULL) {
+        hash = hash_string(hash, global->name);
+        hash = hash_type(hash, global->type);
+      }
+    } else if (token->type == token_string) {
+      // literals are numbered by where they first appear in the module
+      hash = hash_int(hash, pool_indexof(state->literals, state->contents, token));
+    }
+  }
+  return hash;
+}
+
+uint64_t cache_key(const char *contents, const Function *function, const FunctionList *functions,
+                   const VarList *globals, const LiteralPool *literals, const bool object) {
+  uint64_t hash = hash_int(FNV_OFFSET, CACHE_VERSION);
+  hash = hash_int(hash, object ? ENTRY_OBJECT : ENTRY_ASSEMBLY);
+  hash = hash_int(hash, options.peephole);
+  hash = hash_int(hash, options.tailCalls);
+  hash = hash_int(hash, options.inlineLimit);
+  hash = hash_int(hash, options.gvn);
+  hash = hash_int(hash, options.vectorize);
+  hash = hash_int(hash, options.builtins);
+  hash = hash_int(hash, options.features);
+  hash = hash_signature(hash, function);
+  hash = hash_structs(hash);
+
+  KeyState state;
+  state.contents = contents;
+  state.functions = functions;
+  state.globals = globals;
+  state.literals = literals;
+  ptrlist_init(&state.visited, 4);
+  hash = hash_body(&state, hash, function);
+  free(state.visited.array);
+  return hash;
+}
+
+void entry_path(char *path, const size_t size, const uint64_t key) {
+  snprintf(path, size, "%s/%016llx", options.cacheDir, (unsigned long long)key);
+}
+
+void write_u64(FILE *file, const uint64_t value) {
+  fwrite(&value, sizeof(value), 1, file);
+}
+
+void write_name(FILE *file, const char *name) {
+  write_u64(file, strlen(name));
+  fwrite(name, 1, strlen(name), file);
+}
+
+typedef struct {
+  const uint8_t *bytes;
+  uint64_t len;
+  uint64_t position;
+  // set once a read runs past the end, after which every read gives nothing
+  bool truncated;
+} Reader;
+
+// NULL when the entry ends first
+const uint8_t *read_bytes(Reader *reader, const uint64_t len) {
+  if (reader->truncated || reader->len - reader->position < len) {
+    reader->truncated = true;
+    return NULL;
+  }
+  const uint8_t *bytes = reader->bytes + reader->position;
+  reader->position += len;
+  return bytes;
+}
+
+uint64_t read_u64(Reader *reader) {
+  uint64_t value = 0;
+  const uint8_t *bytes = read_bytes(reader, sizeof(value));
+  if (bytes != NULL) {
+    memcpy(&value, bytes, sizeof(value));
+  }
+  return value;
+}
+
+// NULL when the entry ends first
+char *read_name(Reader *reader) {
+  const uint64_t len = read_u64(reader);
+  const uint8_t *bytes = read_bytes(reader, len);
+  if (bytes == NULL)
+    return NULL;
+  char *name = malloc(len + 1);
+  memcpy(name, bytes, len);
+  name[len] = '\0';
+  return name;
+}
+
+// the entry's code, checked to be the function's own, in case two keys ever collide
+bool read_header(Reader *reader, const Function *function, const EntryKind kind) {
+  char *name = read_name(reader);
+  const bool matches = name != NULL && strcmp(name, function->name) == 0 && read_u64(reader) == kind;
+  free(name);
+  return matches;
+}
+
+// reads the entry into an object of its own, so that a damaged one is a miss rather than half a function
+bool read_object(Reader *reader, ObjectFile *entry) {
+  const uint64_t len = read_u64(reader);
+  const uint8_t *text = read_bytes(reader, len);
+  if (text == NULL)
+    return false;
+  object_append(entry, SECTION_TEXT, text, len);
+
+  const uint64_t symbols = read_u64(reader);
+  for (uint64_t i = 0; i < symbols && !reader->truncated; ++i) {
+    char *name = read_name(reader);
+    if (name == NULL)
+      return false;
+    const uint64_t offset = read_u64(reader);
+    object_define(entry, name, SECTION_TEXT, offset)->size = read_u64(reader);
+    free(name);
+  }
+
+  const uint64_t relocations = read_u64(reader);
+  for (uint64_t i = 0; i < relocations && !reader->truncated; ++i) {
+    char *name = read_name(reader);
+    if (name == NULL)
+      return false;
+    const uint64_t offset = read_u64(reader);
+    const uint64_t type = read_u64(reader);
+    const int64_t addend = (int64_t)read_u64(reader);
+    object_relocate(entry, SECTION_TEXT, offset, name, (uint32_t)type, addend);
+    free(name);
+  }
+  return !reader->truncated;
+}
+
+// as though the entry's function had been encoded onto the end of object
+void merge_object(ObjectFile *object, const ObjectFile *entry) {
+  const uint64_t base = object->sections[SECTION_TEXT].len;
+  object_append(object, SECTION_TEXT, entry->sections[SECTION_TEXT].array, entry->sections[SECTION_TEXT].len);
+  for (int i = 0; i < entry->symbols.len; ++i) {
+    const ObjectSymbol *symbol = &entry->symbols.array[i];
+    if (symbol->section == SECTION_TEXT) {
+      ObjectSymbol *defined = object_define(object, symbol->name, SECTION_TEXT, base + symbol->offset);
+      defined->function = true;
+      defined->size = symbol->size;
+    }
+  }
+  for (int i = 0; i < entry->relocations.len; ++i) {
+    const ObjectRelocation *relocation = &entry->relocations.array[i];
+    object_relocate(object, SECTION_TEXT, base + relocation->offset, entry->symbols.array[relocation->symbol].name,
+                    relocation->type, relocation->addend);
+  }
+}
+
+// the whole of the entry stored under key, or false when there is none
+bool read_entry(const uint64_t key, uint8_t **bytes, uint64_t *len) {
+  char path[4096];
+  entry_path(path, sizeof(path), key);
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+  fseek(file, 0, SEEK_END);
+  const long size = ftell(file);
+  rewind(file);
+  *bytes = size >= 0 ? malloc((size_t)size + 1) : NULL;
+  *len = (uint64_t)size;
+  const bool complete = *bytes != NULL && fread(*bytes, 1, (size_t)size, file) == (size_t)size;
+  fclose(file);
+  if (!complete) {
+    free(*bytes);
+    return false;
+  }
+  return true;
+}
+
+typedef struct {
+  uint64_t key;
+  // NULL for an empty slot
+  uint8_t *bytes;
+  uint64_t len;
+} MemoryEntry;
+
+// the entries a compile server keeps (cache_retain), looked up by key with linear probing and never more than half
+// full
+struct {
+  MemoryEntry *slots;
+  uint64_t capacity;
+  uint64_t count;
+} memory = {NULL, 0, 0};
+
+// the compile server to tell about each entry used, NULL when not compiling for one
+FILE *report = NULL;
+
+MemoryEntry *memory_slot(const uint64_t key) {
+  if (memory.capacity == 0)
+    return NULL;
+  uint64_t i = key & (memory.capacity - 1);
+  while (memory.slots[i].bytes != NULL && memory.slots[i].key != key) {
+    i = (i + 1) & (memory.capacity - 1);
+  }
+  return &memory.slots[i];
+}
+
+void memory_insert(const uint64_t key, uint8_t *bytes, const uint64_t len) {
+  if ((memory.count + 1) * 2 > memory.capacity) {
+    const MemoryEntry *slots = memory.slots;
+    const uint64_t capacity = memory.capacity;
+    memory.capacity = capacity == 0 ? 256 : capacity * 2;
+    memory.slots = calloc(memory.capacity, sizeof(MemoryEntry));
+    for (uint64_t i = 0; i < capacity; ++i) {
+      if (slots[i].bytes != NULL) {
+        *memory_slot(slots[i].key) = slots[i];
+      }
+    }
+    free((void *)slots);
+  }
+  MemoryEntry *slot = memory_slot(key);
+  if (slot->bytes != NULL) {
+    free(slot->bytes);
+  } else {
+    memory.count += 1;
+  }
+  slot->key = key;
+  slot->bytes = bytes;
+  slot->len = len;
+}
+
+void cache_retain(const uint64_t key) {
+  if (options.cacheDir == NULL)
+    return;
+  uint8_t *bytes;
+  uint64_t len;
+  if (read_entry(key, &bytes, &len)) {
+    memory_insert(key, bytes, len);
+  }
+}
+
+void cache_report(FILE *keys) {
+  report = keys;
+}
+
+void report_key(const uint64_t key) {
+  if (report != NULL) {
+    fwrite(&key, sizeof(key), 1, report);
+    fflush(report);
+  }
+}
+
+bool cache_load(const uint64_t key, const Function *function, FILE *output, ObjectFile *object) {
+  const MemoryEntry *retained = memory_slot(key);
+  uint8_t *bytes = NULL;
+  Reader reader = {NULL, 0, 0, false};
+  if (retained != NULL && retained->bytes != NULL) {
+    reader.bytes = retained->bytes;
+    reader.len = retained->len;
+  } else if (read_entry(key, &bytes, &reader.len)) {
+    reader.bytes = bytes;
+  } else {
+    return false;
+  }
+
+  bool loaded = read_header(&reader, function, object != NULL ? ENTRY_OBJECT : ENTRY_ASSEMBLY);
+  if (loaded && object != NULL) {
+    ObjectFile entry;
+    object_init(&entry);
+    loaded = read_object(&reader, &entry);
+    if (loaded) {
+      merge_object(object, &entry);
+    }
+    object_free(&entry);
+  } else if (loaded) {
+    const uint64_t len = read_u64(&reader);
+    const uint8_t *text = read_bytes(&reader, len);
+    loaded = text != NULL;
+    if (loaded) {
+      fwrite(text, 1, len, output);
+    }
+  }
+  if (loaded && bytes != NULL) {
+    report_key(key);
+  }
+  free(bytes);
+  return loaded;
+}
+
+void store_object(FILE *file, const ObjectFile *object, const uint64_t textStart, const int relocationStart) {
+  const ByteList *text = &object->sections[SECTION_TEXT];
+  write_u64(file, text->len - textStart);
+  fwrite(text->array + textStart, 1, text->len - textStart, file);
+
+  uint64_t symbols = 0;
+  for (int i = 0; i < object->symbols.len; ++i) {
+    const ObjectSymbol *symbol = &object->symbols.array[i];
+    symbols += symbol->section == SECTION_TEXT && symbol->offset >= textStart;
+  }
+  write_u64(file, symbols);
+  for (int i = 0; i < object->symbols.len; ++i) {
+    const ObjectSymbol *symbol = &object->symbols.array[i];
+    if (symbol->section == SECTION_TEXT && symbol->offset >= textStart) {
+      write_name(file, symbol->name);
+      write_u64(file, symbol->offset - textStart);
+      write_u64(file, symbol->size);
+    }
+  }
+
+  write_u64(file, (uint64_t)(object->relocations.len - relocationStart));
+  for (int i = relocationStart; i < object->relocations.len; ++i) {
+    const ObjectRelocation *relocation = &object->relocations.array[i];
+    write_name(file, object->symbols.array[relocation->symbol].name);
+    write_u64(file, relocation->offset - textStart);
+    write_u64(file, relocation->type);
+    write_u64(file, (uint64_t)relocation->addend);
+  }
+}
+
+void cache_store(const uint64_t key, const Function *function, const MachineInstructionList *code,
+                 const ObjectFile *object, const uint64_t textStart, const int relocationStart) {
+  char path[4096];
+  char temporary[4200];
+  entry_path(path, sizeof(path), key);
+  // written aside and renamed into place, so that another compiler never reads half an entry
+  snprintf(temporary, sizeof(temporary), "%s.%i", path, (int)getpid());
+  FILE *file = fopen(temporary, "wb");
+  if (file == NULL) {
+    mkdir(options.cacheDir, 0777);
+    file = fopen(temporary, "wb");
+    // the cache only saves time, so one that cannot be written is left alone
+    if (file == NULL)
+      return;
+  }
+
+  write_name(file, function->name);
+  write_u64(file, object != NULL ? ENTRY_OBJECT : ENTRY_ASSEMBLY);
+  if (object != NULL) {
+    store_object(file, object, textStart, relocationStart);
+  } else {
+    // the length of the text goes in front of it, once it is known
+    write_u64(file, 0);
+    const long start = ftell(file);
+    machine_write(code, file);
+    const long end = ftell(file);
+    fseek(file, start - (long)sizeof(uint64_t), SEEK_SET);
+    write_u64(file, (uint64_t)(end - start));
+    fseek(file, end, SEEK_SET);
+  }
+  const bool written = !ferror(file);
+  if (fclose(file) != 0 || !written || rename(temporary, path) != 0) {
+    remove(temporary);
+  } else {
+    report_key(key);
+  }
+}
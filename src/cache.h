@@ -0,0 +1,30 @@
+#ifndef CACHE_H
+#define CACHE_H
+#include "ast.h"
+#include "pool.h"
+#include "machine.h"
+#include "object.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+// the code generated for each function, kept on disk (--cache-dir) under a hash of everything that went into it: its
+// tokens, the signatures of the functions and globals it names (and the bodies of those it may inline), the string
+// literals it uses and the options code generation reads
+
+uint64_t cache_key(const char *contents, const Function *function, const FunctionList *functions,
+                   const VarList *globals, const LiteralPool *literals, bool object);
+// puts the function's cached code onto the end of object, or output when object is NULL. false when there is none
+bool cache_load(uint64_t key, const Function *function, FILE *output, ObjectFile *object);
+// stores the code just generated for the function: its instruction stream as text, or everything encode_function put
+// into object past textStart and relocationStart
+void cache_store(uint64_t key, const Function *function, const MachineInstructionList *code,
+                 const ObjectFile *object, uint64_t textStart, int relocationStart);
+
+// keeps the entry stored under key in memory, where cache_load looks before going to disk
+void cache_retain(uint64_t key);
+// writes the key of each entry cache_load reads from disk or cache_store writes to keys, so that the compile server
+// that forked this compiler can retain them
+void cache_report(FILE *keys);
+
+#endif // CACHE_H
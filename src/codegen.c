@@ -1,18 +1,32 @@
 #include "codegen.h"
 
+#include "options.h"
 #include "register.h"
 
 #include <string.h>
 
-void cullref(Registers *registers, const Instruction *instruction, Reference ref) {
+void mark_killed(MachineInstructionList *output, const int8_t reg) {
+  if (output->len > 0) {
+    output->array[output->len - 1].kills |= 1u << reg;
+  }
+}
+
+void cullref(Registers *registers, const Instruction *instruction, Reference ref, MachineInstructionList *output) {
   if (isAllocated(ref.access) && instruction->id == ref.allocation->lastInstr) {
-    if (registers_get_storage(registers, ref.allocation)->location != L_None) {
+    const Storage *storage = registers_get_storage(registers, ref.allocation);
+    if (storage->location != L_None) {
+      if (storage->location == L_Register) {
+        mark_killed(output, storage->reg);
+      }
       registers_free_register(registers, ref.allocation);
     }
   }
+  if (ref.access == Dereference && ref.index != NULL) {
+    cullref(registers, instruction, reference_direct(ref.index), output);
+  }
 }
 
-void clear_register(const InstructionTable *table, Registers *registers, int8_t reg, FILE *output) {
+void clear_register(const InstructionTable *table, Registers *registers, int8_t reg, MachineInstructionList *output) {
   for (int i = 0; i < table->allocations.len; ++i) {
     if (registers->storage[i].location == L_Register) {
       if (registers->storage[i].reg == reg) {
@@ -22,96 +36,109 @@ void clear_register(const InstructionTable *table, Registers *registers, int8_t
   }
 }
 
-void write_jmp(const InstructionTable *table, const char *op, int label, FILE *output) {
-  fprintf(output, "\t%s .LBL.%s.%i\n", op, table->name, label);
-  fprintf(stdout, "\t%s .LBL.%s.%i\n", op, table->name, label);
+MachineInstruction *write_instruction(MachineInstructionList *output, const MachineOp op, const Width width,
+                                      const int operands, const Operand a, const Operand b) {
+  MachineInstruction *instruction = machine_emit(output, op, width, operands, a, b);
+  machine_write_instruction(instruction, stdout);
+  return instruction;
+}
+
+char *label_name(const InstructionTable *table, const int label) {
+  const int n = snprintf(NULL, 0, ".LBL.%s.%i", table->name, label);
+  char *str = malloc(n + 1);
+  snprintf(str, n + 1, ".LBL.%s.%i", table->name, label);
+  return str;
+}
+
+char *reference_names(const Reference a, const Reference b) {
+  const char *aName = isAllocated(a.access) ? a.allocation->name : "<tmp>";
+  const char *bName = isAllocated(b.access) ? b.allocation->name : "<tmp>";
+  const int n = snprintf(NULL, 0, "%s, %s", aName, bName);
+  char *str = malloc(n + 1);
+  snprintf(str, n + 1, "%s, %s", aName, bName);
+  return str;
+}
+
+void write_jmp(const InstructionTable *table, const Condition cond, const bool conditional, int label,
+               MachineInstructionList *output) {
+  MachineInstruction *instruction =
+      machine_emit(output, conditional ? M_JCC : M_JMP, Quad, 1, operand_label(label_name(table, label)),
+                   operand_none());
+  instruction->cond = cond;
+  machine_write_instruction(instruction, stdout);
 }
 
-void write_unary_op(const Registers *registers, const char *op, const Width width, const Reference ref, FILE *output) {
+bool table_defines_label(const InstructionTable *table, const int label) {
+  for (int i = 0; i < table->instructions.len; ++i) {
+    if (table->instructions.array[i].type == LABEL && table->instructions.array[i].label == label) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void write_unary_op(const Registers *registers, const MachineOp op, const Width width, const Reference ref,
+                    MachineInstructionList *output) {
+  MachineInstruction *instruction =
+      machine_emit(output, op, width, 1, registers_get_operand(registers, ref), operand_none());
   if (isAllocated(ref.access) && ref.allocation->name != NULL) {
-    fprintf(output, "\t%s%c %s # %s\n", op, mnemonic_suffix(width), registers_get_mnemonic(registers, ref),
-            ref.allocation->name);
-    fprintf(stdout, "\t%s%c %s # %s\n", op, mnemonic_suffix(width), registers_get_mnemonic(registers, ref),
-            ref.allocation->name);
-    return;
+    instruction->comment = ref.allocation->name;
   }
-  fprintf(output, "\t%s%c %s\n", op, mnemonic_suffix(width), registers_get_mnemonic(registers, ref));
-  fprintf(stdout, "\t%s%c %s\n", op, mnemonic_suffix(width), registers_get_mnemonic(registers, ref));
+  machine_write_instruction(instruction, stdout);
 }
 
-void write_binary_op(const Registers *registers, const char *op, const Width width, const Reference a,
-                     const Reference b, FILE *output) {
+void write_binary_op(const Registers *registers, const MachineOp op, const Width width, const Reference a,
+                     const Reference b, MachineInstructionList *output) {
   if (isAllocated(a.access) && registers_get_storage(registers, a.allocation)->location == L_None) {
     printf("variable at index %i (%s) not allocated!\n", a.allocation->index, a.allocation->name);
   }
   if (isAllocated(b.access) && registers_get_storage(registers, b.allocation)->location == L_None) {
     printf("variable at index %i (%s) not allocated!\n", b.allocation->index, b.allocation->name);
   }
+  MachineInstruction *instruction = machine_emit(output, op, width, 2, registers_get_operand(registers, a),
+                                                 registers_get_operand(registers, b));
   if ((isAllocated(a.access) && a.allocation->name != NULL) || (isAllocated(b.access) && b.allocation->name != NULL)) {
-    fprintf(output, "\t%s%c %s, %s # %s, %s\n", op, mnemonic_suffix(width), registers_get_mnemonic(registers, a),
-            registers_get_mnemonic(registers, b), isAllocated(a.access) ? a.allocation->name : "<tmp>",
-            isAllocated(b.access) ? b.allocation->name : "<tmp>");
-    fprintf(stdout, "\t%s%c %s, %s # %s, %s\n", op, mnemonic_suffix(width), registers_get_mnemonic(registers, a),
-            registers_get_mnemonic(registers, b), isAllocated(a.access) ? a.allocation->name : "<tmp>",
-            isAllocated(b.access) ? b.allocation->name : "<tmp>");
-    return;
+    instruction->comment = reference_names(a, b);
   }
-  fprintf(output, "\t%s%c %s, %s\n", op, mnemonic_suffix(width), registers_get_mnemonic(registers, a),
-          registers_get_mnemonic(registers, b));
-  fprintf(stdout, "\t%s%c %s, %s\n", op, mnemonic_suffix(width), registers_get_mnemonic(registers, a),
-          registers_get_mnemonic(registers, b));
+  machine_write_instruction(instruction, stdout);
 }
 
-void write_binary_transform_op(const Registers *registers, const char *op, const Width width, const Width width2,
-                               const Reference a, const Reference b, FILE *output) {
+void write_binary_transform_op(const Registers *registers, const Width width, const Width width2, const Reference a,
+                               const Reference b, MachineInstructionList *output) {
   if (isAllocated(a.access) && registers_get_storage(registers, a.allocation)->location == L_None) {
     printf("variable at index %i (%s) not allocated!\n", a.allocation->index, a.allocation->name);
   }
   if (isAllocated(b.access) && registers_get_storage(registers, b.allocation)->location == L_None) {
     printf("variable at index %i (%s) not allocated!\n", b.allocation->index, b.allocation->name);
   }
-  fprintf(output, "\t%s%c%c %s, %s\n", op, mnemonic_suffix(width), mnemonic_suffix(width2),
-          registers_get_mnemonic(registers, a), registers_get_mnemonic(registers, b));
-  fprintf(stdout, "\t%s%c%c %s, %s\n", op, mnemonic_suffix(width), mnemonic_suffix(width2),
-          registers_get_mnemonic(registers, a), registers_get_mnemonic(registers, b));
+  MachineInstruction *instruction = machine_emit(output, M_MOVS, width2, 2, registers_get_operand(registers, a),
+                                                 registers_get_operand(registers, b));
+  instruction->width2 = width;
+  machine_write_instruction(instruction, stdout);
 }
 
 void write_mov_into_register(const Registers *registers, const Type type, const Reference ref, const int8_t reg,
-                             FILE *output) {
+                             MachineInstructionList *output) {
   if (!isAllocated(ref.access) || type_width(ref.allocation->type) == type_width(type)) {
-    fprintf(output, "\tmov%c %s, %s\n", mnemonic_suffix(type_width(type)), registers_get_mnemonic(registers, ref),
-            get_register_mnemonic(type_width(type), reg));
-    fprintf(stdout, "\tmov%c %s, %s\n", mnemonic_suffix(type_width(type)), registers_get_mnemonic(registers, ref),
-            get_register_mnemonic(type_width(type), reg));
+    write_instruction(output, M_MOV, type_width(type), 2, registers_get_operand(registers, ref),
+                      operand_register(type_width(type), reg));
   } else if (type_width(type) <= type_width(ref.allocation->type)) {
     Type type2 = ref.allocation->type;
     ref.allocation->type = type; // todo make nicer
-    fprintf(output, "\tmov%c %s, %s\n", mnemonic_suffix(type_width(type)), registers_get_mnemonic(registers, ref),
-            get_register_mnemonic(type_width(type), reg));
-    fprintf(stdout, "\tmov%c %s, %s\n", mnemonic_suffix(type_width(type)), registers_get_mnemonic(registers, ref),
-            get_register_mnemonic(type_width(type), reg));
+    write_instruction(output, M_MOV, type_width(type), 2, registers_get_operand(registers, ref),
+                      operand_register(type_width(type), reg));
     ref.allocation->type = type2;
   } else {
-    fprintf(output, "\tmov%c%c %s, %s\n", type_width(ref.allocation->type), mnemonic_suffix(type_width(type)),
-            registers_get_mnemonic(registers, ref), get_register_mnemonic(type_width(type), reg));
-    fprintf(stdout, "\tmov%c%c %s, %s\n", type_width(ref.allocation->type), mnemonic_suffix(type_width(type)),
-            registers_get_mnemonic(registers, ref), get_register_mnemonic(type_width(type), reg));
+    MachineInstruction *instruction =
+        machine_emit(output, M_MOVS, type_width(type), 2, registers_get_operand(registers, ref),
+                     operand_register(type_width(type), reg));
+    instruction->width2 = type_width(ref.allocation->type);
+    machine_write_instruction(instruction, stdout);
   }
 }
 
-int16_t registers_find(const InstructionTable *table, Registers *registers, FILE *output) {
-  for (int i = 0; i < 14; ++i) {
-    if (!registers->registers[registerPriority[i]].inUse) {
-      return i;
-    }
-  }
-
-  clear_register(table, registers, registerPriority[7], output);
-  return registerPriority[7];
-}
-
 void registers_move_into_register_tmp(const InstructionTable *table, Registers *registers, Type type, Reference ref,
-                                      int8_t reg, FILE *output) {
+                                      int8_t reg, MachineInstructionList *output) {
   if (!registers->registers[reg].inUse) {
     if (isAllocated(ref.access)) {
       assert(registers_get_storage(registers, ref.allocation)->location != L_None);
@@ -127,10 +154,14 @@ void registers_move_into_register_tmp(const InstructionTable *table, Registers *
     clear_register(table, registers, reg, output);
 
     registers_move_into_register_tmp(table, registers, type, ref, reg, output);
+  } else if (type_width(ref.allocation->type) < type_width(type)) {
+    // already in place, but narrower than the argument
+    write_mov_into_register(registers, type, ref, reg, output);
   }
 }
 
-void write_cmp_op(const Registers *registers, const char *op, const Reference a, const Reference b, FILE *output) {
+void write_cmp_op(const Registers *registers, const MachineOp op, const Reference a, const Reference b,
+                  MachineInstructionList *output) {
   Type type = ref_infer_type(a, b);
   Type aType;
   Type bType;
@@ -142,19 +173,12 @@ void write_cmp_op(const Registers *registers, const char *op, const Reference a,
     bType = b.allocation->type;
     b.allocation->type = type;
   }
+  MachineInstruction *instruction = machine_emit(output, op, type_width(type), 2, registers_get_operand(registers, a),
+                                                 registers_get_operand(registers, b));
   if ((isAllocated(a.access) && a.allocation->name != NULL) || (isAllocated(b.access) && b.allocation->name != NULL)) {
-    fprintf(output, "\t%s%c %s, %s # %s, %s\n", op, mnemonic_suffix(type_width(type)),
-            registers_get_mnemonic(registers, a), registers_get_mnemonic(registers, b),
-            isAllocated(a.access) ? a.allocation->name : "<tmp>", isAllocated(b.access) ? b.allocation->name : "<tmp>");
-    fprintf(stdout, "\t%s%c %s, %s # %s, %s\n", op, mnemonic_suffix(type_width(type)),
-            registers_get_mnemonic(registers, a), registers_get_mnemonic(registers, b),
-            isAllocated(a.access) ? a.allocation->name : "<tmp>", isAllocated(b.access) ? b.allocation->name : "<tmp>");
-  } else {
-    fprintf(output, "\t%s%c %s, %s\n", op, mnemonic_suffix(type_width(type)), registers_get_mnemonic(registers, a),
-            registers_get_mnemonic(registers, b));
-    fprintf(stdout, "\t%s%c %s, %s\n", op, mnemonic_suffix(type_width(type)), registers_get_mnemonic(registers, a),
-            registers_get_mnemonic(registers, b));
+    instruction->comment = reference_names(a, b);
   }
+  machine_write_instruction(instruction, stdout);
 
   if (isAllocated(a.access)) {
     a.allocation->type = aType;
@@ -164,32 +188,24 @@ void write_cmp_op(const Registers *registers, const char *op, const Reference a,
   }
 }
 
-void write_ternary_op(const Registers *registers, const char *op, const Width width, const Reference a,
-                      const Reference b, const Reference c, FILE *output) {
-  fprintf(output, "\t%s%c %s, %s, %s\n", op, mnemonic_suffix(width), registers_get_mnemonic(registers, a),
-          registers_get_mnemonic(registers, b), registers_get_mnemonic(registers, c));
-  fprintf(stdout, "\t%s%c %s, %s, %s\n", op, mnemonic_suffix(width), registers_get_mnemonic(registers, a),
-          registers_get_mnemonic(registers, b), registers_get_mnemonic(registers, c));
-}
-
 void write_mov_into_stack(const Registers *registers, const Width width, const Reference ref, const int16_t offset,
-                          FILE *output) {
+                          MachineInstructionList *output) {
   assert(!isAllocated(ref.access) || registers_get_storage(registers, ref.allocation)->location != L_Stack);
-  fprintf(output, "\tmov%c %s, %i(%%rsp)\n", mnemonic_suffix(width), registers_get_mnemonic(registers, ref), offset);
-  fprintf(stdout, "\tmov%c %s, %i(%%rsp)\n", mnemonic_suffix(width), registers_get_mnemonic(registers, ref), offset);
+  write_instruction(output, M_MOV, width, 2, registers_get_operand(registers, ref), operand_stack(offset));
 }
 
-void write_mov_into_register_FS(const Width width, const int16_t offset, const int8_t reg, FILE *output) {
-  fprintf(output, "\tmov%c %i(%%rsp), %s\n", mnemonic_suffix(width), offset, get_register_mnemonic(width, reg));
-  fprintf(stdout, "\tmov%c %i(%%rsp), %s\n", mnemonic_suffix(width), offset, get_register_mnemonic(width, reg));
+void write_mov_into_register_FS(const Width width, const int16_t offset, const int8_t reg,
+                                MachineInstructionList *output) {
+  write_instruction(output, M_MOV, width, 2, operand_stack(offset), operand_register(width, reg));
 }
 
 void registers_init(Registers *registers, const InstructionTable *table) {
-  for (int i = 0; i < 16; ++i) {
+  for (int i = 0; i < 32; ++i) {
     registers->registers[i].inUse = false;
-    registers->registers[i].mustRestore = calleeSavedRegistersI[i];
+    registers->registers[i].mustRestore = i < 16 && calleeSavedRegistersI[i];
     registers->registers[i].restoreOffset = 0;
   }
+  registers->unordered = false;
   registers->parent = NULL;
   registers->offset = 0;
   registers->storage = malloc(sizeof(Storage) * table->allocations.len);
@@ -199,11 +215,12 @@ void registers_init(Registers *registers, const InstructionTable *table) {
 }
 
 void registers_init_child(Registers *registers, InstructionTable *table, const Registers *parent) {
-  for (int i = 0; i < 16; ++i) {
+  for (int i = 0; i < 32; ++i) {
     registers->registers[i].inUse = parent->registers[i].inUse;
     registers->registers[i].mustRestore = parent->registers[i].inUse;
     registers->registers[i].restoreOffset = 0;
   }
+  registers->unordered = false;
 
   registers->parent = parent;
 
@@ -225,12 +242,13 @@ void registers_free(Registers *registers) {
 
 void registers_claim(Registers *registers, Allocation *allocation) {
   Storage *unknown = registers_get_storage(registers, allocation);
+  const int8_t *priority = is_sse(allocation->type.kind) ? fpRegisterPriority : registerPriority;
 
   assert(unknown->location == L_None);
   switch (allocation->source.prop) {
   case None: {
     for (int i = 0; i < 14; ++i) {
-      const int8_t reg = registerPriority[i];
+      const int8_t reg = priority[i];
       if (!registers->registers[reg].inUse) {
         registers->registers[reg].inUse = true;
         unknown->location = L_Register;
@@ -281,7 +299,7 @@ void registers_claim(Registers *registers, Allocation *allocation) {
   }
   case ForceRegister: {
     for (int i = 0; i < 14; ++i) {
-      const int8_t reg = registerPriority[i];
+      const int8_t reg = priority[i];
       if (!registers->registers[reg].inUse) {
         registers->registers[reg].inUse = true;
         unknown->location = L_Register;
@@ -300,7 +318,7 @@ void registers_claim(Registers *registers, Allocation *allocation) {
   }
 }
 
-void registers_move_to_stack(Registers *registers, Allocation *allocation, FILE *output) {
+void registers_move_to_stack(Registers *registers, Allocation *allocation, MachineInstructionList *output) {
   Storage *unknown = registers_get_storage(registers, allocation);
   switch (unknown->location) {
   case L_None: {
@@ -353,7 +371,7 @@ Storage *registers_get_storage(const Registers *registers, Allocation *allocatio
   return &registers->storage[allocation->index];
 }
 
-void registers_move_tostack(Registers *registers, Allocation *allocation, FILE *output) {
+void registers_move_tostack(Registers *registers, Allocation *allocation, MachineInstructionList *output) {
   Storage *storage = registers_get_storage(registers, allocation);
   if (storage->location == L_Register) {
     registers->offset -= (int16_t)type_size(allocation->type);
@@ -397,26 +415,21 @@ void registers_override(const Registers *registers, Allocation *output, Allocati
   storage->location = L_None;
 }
 
-void registers_force_register(const Registers *registers, const Reference allocation, const int8_t reg, FILE *output) {
+void registers_force_register(const Registers *registers, const Reference allocation, const int8_t reg,
+                              MachineInstructionList *output) {
   // fixme
   write_mov_into_register(registers, (Type){.kind = i64, .inner = NULL}, allocation, reg, output);
 }
 
-char *registers_get_mnemonic(const Registers *registers, const Reference reference) {
+Operand registers_get_operand(const Registers *registers, const Reference reference) {
   switch (reference.access) {
   case Direct: {
-    // return format_str("%i", reference.allocation->index);
     const Storage *storage = registers_get_storage(registers, reference.allocation);
     switch (storage->location) {
-    case L_Stack: {
-      char *str = malloc(1 + (abs(storage->offset) / 10 + 1 + (abs(storage->offset) < 0 ? 1 : 0)) + 6 + 1);
-      sprintf(str, "%i(%%rsp)", storage->offset);
-      str[1 + (abs(storage->offset) / 10 + 1 + (abs(storage->offset) < 0 ? 1 : 0)) + 6] = '\0';
-      return str;
-    }
-    case L_Register: {
-      return strdup(get_register_mnemonic(type_width(reference.allocation->type), storage->reg));
-    }
+    case L_Stack:
+      return operand_stack(storage->offset);
+    case L_Register:
+      return operand_register(type_width(reference.allocation->type), storage->reg);
     default: {
       assert(false);
       break;
@@ -425,23 +438,18 @@ char *registers_get_mnemonic(const Registers *registers, const Reference referen
     break;
   }
   case Dereference: {
-    // return format_str("(%i)", reference.allocation->index);
-
     const Storage *storage = registers_get_storage(registers, reference.allocation);
-    switch (storage->location) {
-    case L_Stack: {
-      char *str = malloc(abs(storage->offset) / 10 + 1 + (abs(storage->offset) < 0 ? 1 : 0) + 7 + 1);
-      sprintf(str, "%i(%%rsp)", storage->offset); // todo fixme oh no
-      str[1 + (abs(storage->offset) / 10 + 1 + (abs(storage->offset) < 0 ? 1 : 0)) + 6] = '\0';
-      return str;
-    }
-    case L_Register: {
-      const char *register_mnemonic = get_register_mnemonic(Quad, storage->reg);
-      char *str = malloc(1 + sizeof(register_mnemonic) + 1 + 1);
-      sprintf(str, "(%s)", register_mnemonic);
-      str[1 + sizeof(register_mnemonic) + 1] = '\0';
-      return str;
+    int8_t index = -1;
+    if (reference.index != NULL) {
+      const Storage *indexStorage = registers_get_storage(registers, reference.index);
+      assert(indexStorage->location == L_Register);
+      index = indexStorage->reg;
     }
+    switch (storage->location) {
+    case L_Stack:
+      return operand_stack(storage->offset); // todo fixme oh no
+    case L_Register:
+      return operand_memory(storage->reg, index, reference.scale, reference.disp);
     default: {
       assert(false);
       break;
@@ -449,66 +457,42 @@ char *registers_get_mnemonic(const Registers *registers, const Reference referen
     }
     break;
   }
-  case ConstantI: {
-    const size_t len = strlen(reference.value);
-    char *str = malloc(1 + len + 1);
-    sprintf(str, "$%s", reference.value);
-    str[1 + len] = '\0';
-    return str;
-  }
+  case ConstantI:
+    return operand_immediate(strtoll(reference.value, NULL, 10));
   case ConstantS: {
-    char *str = malloc(7 + (reference.str / 10 + 1) + 1);
-    sprintf(str, "$.L.STR%i", reference.str);
-    str[7 + (reference.str / 10 + 1)] = '\0';
-    return str;
-  }
-  case Global: {
-    const size_t len = strlen(reference.value);
-    char *str = malloc(len + 6 + 1);
-    sprintf(str, "%s(%%rip)", reference.value);
-    str[1 + len] = '\0';
-    return str;
-  }
-  case GlobalRef: {
-    const size_t len = strlen(reference.value);
-    char *str = malloc(1 + len + 1);
-    sprintf(str, "$%s", reference.value);
-    str[1 + len] = '\0';
-    return str;
+    const int n = snprintf(NULL, 0, ".L.STR%i", reference.str);
+    char *str = malloc(n + 1);
+    snprintf(str, n + 1, ".L.STR%i", reference.str);
+    return operand_symbol(str);
   }
+  case Global:
+    return operand_rip(reference.value);
+  case GlobalRef:
+    return operand_symbol(reference.value);
   default: {
     assert(false);
     break;
   }
   }
-  return NULL;
+  return operand_none();
 }
 
-void binary_lea(Registers *registers, Instruction *instruction, FILE *output) {
-  if (registers_get_storage(registers, instruction->output.allocation)->location == L_None) {
-    registers_claim(registers, instruction->output.allocation);
-  }
-  if (registers_get_storage(registers, instruction->inputs[0].allocation)->location != L_Stack) {
-    registers_move_to_stack(registers, instruction->inputs[0].allocation, output);
-  }
-
-  write_binary_op(registers, "lea", type_width(instruction->output.allocation->type), instruction->inputs[0],
-                  instruction->output, output);
-
-  if (isAllocated(instruction->inputs[0].access) && instruction->inputs[0].allocation->lastInstr == instruction->id) {
-    registers_free_register(registers, instruction->inputs[0].allocation);
-  }
+char *registers_get_mnemonic(const Registers *registers, const Reference reference) {
+  return operand_format(registers_get_operand(registers, reference));
 }
 
-void cmp_output(const char *op, Registers *registers, Instruction *instruction, FILE *output) {
+void cmp_output(const Condition cond, Registers *registers, Instruction *instruction, MachineInstructionList *output) {
   if (registers_get_storage(registers, instruction->output.allocation)->location == L_None) {
     registers_claim(registers, instruction->output.allocation);
   }
-  write_unary_op(registers, op, Byte, instruction->output, output);
+  MachineInstruction *set = machine_emit(output, M_SET, Byte, 1,
+                                         registers_get_operand(registers, instruction->output), operand_none());
+  set->cond = cond;
+  machine_write_instruction(set, stdout);
 }
 
 void registers_move_into_register(const InstructionTable *table, Registers *registers, Type type, Reference ref,
-                                  int8_t reg, FILE *output) {
+                                  int8_t reg, MachineInstructionList *output) {
   if (!registers->registers[reg].inUse) {
     if (isAllocated(ref.access)) {
       assert(registers_get_storage(registers, ref.allocation)->location != L_None);
@@ -527,7 +511,8 @@ void registers_move_into_register(const InstructionTable *table, Registers *regi
   }
 }
 
-void registers_move_into_stack(Registers *registers, Allocation *allocation, int16_t offset, FILE *output) {
+void registers_move_into_stack(Registers *registers, Allocation *allocation, int16_t offset,
+                               MachineInstructionList *output) {
   Storage *storage = registers_get_storage(registers, allocation);
   if (storage->location == L_Stack && storage->offset == offset)
     return;
@@ -542,16 +527,19 @@ void registers_move_into_stack(Registers *registers, Allocation *allocation, int
 }
 
 int16_t push_function_arguments(const InstructionTable *table, Registers *registers, Instruction *instruction,
-                                FILE *output) {
-  for (int i = 0; i < instruction->function->arguments.len && i < 6; ++i) {
-    assert(instruction->arguments[i].access <= 6);
+                                MachineInstructionList *output) {
+  for (int i = 0; i < instruction->function->arguments.len; ++i) {
+    const int8_t reg = argument_register(instruction->function, i);
+    if (reg == -1)
+      continue;
+    assert(instruction->arguments[i].access <= Global);
     registers_move_into_register_tmp(table, registers, instruction->function->arguments.array[i].type,
-                                     instruction->arguments[i], argumentRegisters[i], output);
+                                     instruction->arguments[i], reg, output);
   }
 
   int16_t offset = registers->offset;
 
-  fputs("#STOR\n", output);
+  machine_emit_comment(output, "#STOR");
   for (int i = 0; i < table->allocations.len; ++i) {
     if (registers->storage[i].location == L_Register &&
         ((Allocation *)table->allocations.array[i])->lastInstr != instruction->id) {
@@ -569,29 +557,848 @@ int16_t push_function_arguments(const InstructionTable *table, Registers *regist
                            reference_direct(table->allocations.array[i]), offset, output);
     }
   }
-  fputs("#eSTOR\n", output);
+  machine_emit_comment(output, "#eSTOR");
 
   const int16_t base = offset;
 
-  for (int i = instruction->function->arguments.len - 1; i >= 6; --i) {
+  for (int i = instruction->function->arguments.len - 1; i >= 0; --i) {
+    if (argument_register(instruction->function, i) != -1)
+      continue;
     offset -= (int16_t)type_size(instruction->function->arguments.array[i].type);
     write_mov_into_stack(registers, type_width(instruction->function->arguments.array[i].type),
                          instruction->arguments[i], offset, output);
   }
 
-  fprintf(output, "\tsubq $%i, %%rsp\n", (-base / 16 + 1) * 16 + 8);
-  fprintf(stdout, "\tsubq $%i, %%rsp\n", (-base / 16 + 1) * 16 + 8);
+  write_instruction(output, M_SUB, Quad, 2, operand_immediate((-base / 16 + 1) * 16 + 8), operand_register(Quad, rsp));
 
   return base;
 }
 
-void write_op_no_args(Registers *registers, char *str, FILE *file) {
-  fprintf(stdout, "\t%s\n", str);
-  fprintf(file, "\t%s\n", str);
+typedef struct {
+  Allocation *allocation;
+  Storage storage;
+  int8_t reg;
+  // the register had to be taken from another allocation, whose value is parked at `saved` until the load ends
+  bool borrowed;
+  int16_t saved;
+} AddressLoad;
+
+// registers that are never implicitly clobbered by an instruction (idiv uses rax and rdx)
+int8_t addressRegisters[7] = {r11, r10, r9, r8, rdi, rsi, rcx};
+
+// memory operands can only address through registers, so a stack-resident pointer or index is loaded into a free
+// register for the duration of the instruction
+int8_t registers_find_scratch(const Registers *registers) {
+  for (int i = 0; i < 7; ++i) {
+    if (!registers->registers[addressRegisters[i]].inUse) {
+      return addressRegisters[i];
+    }
+  }
+  return -1;
+}
+
+bool reference_in_register(const Registers *registers, const Reference ref, const int8_t reg) {
+  if (!isAllocated(ref.access))
+    return false;
+  const Storage *storage = registers_get_storage(registers, ref.allocation);
+  if (storage->location == L_Register && storage->reg == reg)
+    return true;
+  if (ref.access == Dereference && ref.index != NULL) {
+    storage = registers_get_storage(registers, ref.index);
+    return storage->location == L_Register && storage->reg == reg;
+  }
+  return false;
+}
+
+// with every address register taken, one the instruction does not touch is lent out instead
+int8_t registers_find_borrowable(const Registers *registers, const Instruction *instruction) {
+  for (int i = 0; i < 7; ++i) {
+    const int8_t reg = addressRegisters[i];
+    if (!reference_in_register(registers, instruction->inputs[0], reg) &&
+        !reference_in_register(registers, instruction->inputs[1], reg) &&
+        !reference_in_register(registers, instruction->output, reg)) {
+      return reg;
+    }
+  }
+  return -1;
+}
+
+int load_address_register(Registers *registers, const Instruction *instruction, Allocation *allocation,
+                          AddressLoad *loads, int count, MachineInstructionList *output) {
+  Storage *storage = registers_get_storage(registers, allocation);
+  if (storage->location != L_Stack)
+    return count;
+  int8_t reg = registers_find_scratch(registers);
+  loads[count].borrowed = reg == -1;
+  if (reg == -1) {
+    reg = registers_find_borrowable(registers, instruction);
+    if (reg == -1)
+      return count;
+    registers->offset -= 8;
+    loads[count].saved = registers->offset;
+    write_instruction(output, M_MOV, Quad, 2, operand_register(Quad, reg), operand_stack(registers->offset));
+  }
+  write_mov_into_register_FS(Quad, storage->offset, reg, output);
+  loads[count].reg = reg;
+  loads[count].allocation = allocation;
+  loads[count].storage = *storage;
+  registers->registers[reg].inUse = true;
+  storage->location = L_Register;
+  storage->reg = reg;
+  return count + 1;
+}
+
+int load_address(Registers *registers, const Instruction *instruction, const Reference ref, AddressLoad *loads,
+                 int count, MachineInstructionList *output) {
+  if (ref.access != Dereference)
+    return count;
+  count = load_address_register(registers, instruction, ref.allocation, loads, count, output);
+  if (ref.index != NULL) {
+    count = load_address_register(registers, instruction, ref.index, loads, count, output);
+  }
+  return count;
+}
+
+void release_addresses(Registers *registers, const AddressLoad *loads, const int count,
+                       MachineInstructionList *output) {
+  for (int i = count - 1; i >= 0; --i) {
+    Storage *storage = registers_get_storage(registers, loads[i].allocation);
+    if (storage->location == L_Register && storage->reg == loads[i].reg) {
+      *storage = loads[i].storage;
+      registers->registers[loads[i].reg].inUse = false;
+    }
+    if (loads[i].borrowed) {
+      write_mov_into_register_FS(Quad, loads[i].saved, loads[i].reg, output);
+      registers->registers[loads[i].reg].inUse = true;
+    }
+  }
+}
+
+// a general purpose register for the duration of one instruction, taking r11 from its allocation when none is free
+int8_t registers_take_scratch(const InstructionTable *table, Registers *registers, MachineInstructionList *output) {
+  const int8_t reg = registers_find_scratch(registers);
+  if (reg != -1)
+    return reg;
+  clear_register(table, registers, r11, output);
+  return r11;
+}
+
+// lea only writes a register and has no 8-bit form, so an address (or a product) is computed in at least 32 bits,
+// through a scratch register when the output is on the stack
+void binary_lea(const InstructionTable *table, Registers *registers, Instruction *instruction,
+                MachineInstructionList *output) {
+  if (registers_get_storage(registers, instruction->output.allocation)->location == L_None) {
+    registers_claim(registers, instruction->output.allocation);
+  }
+  const bool address = instruction->inputs[0].access == Dereference;
+  if (!address && registers_get_storage(registers, instruction->inputs[0].allocation)->location != L_Stack) {
+    registers_move_to_stack(registers, instruction->inputs[0].allocation, output);
+  }
+  const Width width = type_width(instruction->output.allocation->type);
+  const Width computed = width < Long ? Long : width;
+  const bool spill = registers_get_operand(registers, instruction->output).type != O_Register;
+  const int8_t reg = spill ? registers_take_scratch(table, registers, output)
+                           : registers_get_operand(registers, instruction->output).reg;
+  MachineInstruction *lea = machine_emit(output, M_LEA, computed, 2,
+                                         registers_get_operand(registers, instruction->inputs[0]),
+                                         operand_register(computed, reg));
+  if ((isAllocated(instruction->inputs[0].access) && instruction->inputs[0].allocation->name != NULL) ||
+      instruction->output.allocation->name != NULL) {
+    lea->comment = reference_names(instruction->inputs[0], instruction->output);
+  }
+  machine_write_instruction(lea, stdout);
+  if (spill) {
+    write_instruction(output, M_MOV, width, 2, operand_register(width, reg),
+                      registers_get_operand(registers, instruction->output))
+        ->kills = 1u << reg;
+  }
+  if (address) {
+    cullref(registers, instruction, instruction->inputs[0], output);
+  } else if (instruction->inputs[0].allocation->lastInstr == instruction->id) {
+    registers_free_register(registers, instruction->inputs[0].allocation);
+  }
+}
+
+// only a mov into a register takes a 64-bit immediate, so anywhere else a constant outside 32 bits is moved into a
+// scratch register first
+bool reference_wide_immediate(const Reference reference, const Width width) {
+  int64_t value;
+  return width == Quad && reference_constant(reference, &value) && (value < INT32_MIN || value > INT32_MAX);
+}
+
+// a scratch register holding the source, kept from other scratch uses until the caller has written the instruction
+int8_t write_scratch_source(const InstructionTable *table, Registers *registers, const Width width,
+                            const Reference source, MachineInstructionList *output) {
+  const int8_t scratch = registers_take_scratch(table, registers, output);
+  write_instruction(output, M_MOV, width, 2, registers_get_operand(registers, source), operand_register(width, scratch));
+  registers->registers[scratch].inUse = true;
+  return scratch;
+}
+
+// add, sub, imul, and, or and xor into the output. a wide constant or a memory source with a memory output goes
+// through a scratch register, and so does the product of an imul, which can only be written to a register
+void write_integer_op(const InstructionTable *table, Registers *registers, const MachineOp op,
+                      const Instruction *instruction, MachineInstructionList *output) {
+  const Width width = type_width(instruction->output.allocation->type);
+  const bool memory = registers_get_operand(registers, instruction->output).type != O_Register;
+  const bool bounce = reference_wide_immediate(instruction->inputs[0], width) ||
+                      (memory && registers_get_operand(registers, instruction->inputs[0]).type == O_Memory);
+  if (!bounce && (op != M_IMUL || !memory)) {
+    write_binary_op(registers, op, width, instruction->inputs[0], instruction->output, output);
+    return;
+  }
+  int8_t scratch = -1;
+  Operand source = registers_get_operand(registers, instruction->inputs[0]);
+  if (bounce) {
+    scratch = write_scratch_source(table, registers, width, instruction->inputs[0], output);
+    source = operand_register(width, scratch);
+  }
+  const uint32_t kills = bounce ? 1u << scratch : 0;
+  const Operand destination = registers_get_operand(registers, instruction->output);
+  if (op != M_IMUL || destination.type == O_Register) {
+    write_instruction(output, op, width, 2, source, destination)->kills = kills;
+  } else {
+    const int8_t product = registers_take_scratch(table, registers, output);
+    write_instruction(output, M_MOV, width, 2, destination, operand_register(width, product));
+    write_instruction(output, M_IMUL, width, 2, source, operand_register(width, product))->kills = kills;
+    write_instruction(output, M_MOV, width, 2, operand_register(width, product), destination)->kills = 1u << product;
+  }
+  if (bounce) {
+    registers->registers[scratch].inUse = false;
+  }
+}
+
+// shifts the output in place by inputs[0]. a variable count has to be in %cl, except for BMI2's shlx/sarx/shrx,
+// which take it from any register (ignoring all but its low bits, as the hardware masks the count either way)
+void write_shift(const InstructionTable *table, Registers *registers, const Instruction *instruction,
+                 const MachineOp op, MachineInstructionList *output) {
+  const Width width = type_width(instruction->output.allocation->type);
+  const Reference count = instruction->inputs[0];
+  if (!isAllocated(count.access)) {
+    write_binary_op(registers, op, width, count, instruction->output, output);
+    return;
+  }
+  const Operand amount = registers_get_operand(registers, count);
+  const Operand value = registers_get_operand(registers, instruction->output);
+  if ((options.features & FEATURE_BMI2) && width >= Long && amount.type == O_Register &&
+      value.type == O_Register) {
+    const MachineOp bmi = op == M_SAL ? M_SHLX : op == M_SAR ? M_SARX : M_SHRX;
+    MachineInstruction *shift =
+        machine_emit(output, bmi, width, 3, operand_register(width, amount.reg), operand_register(width, value.reg));
+    shift->args[2] = operand_register(width, value.reg);
+    machine_write_instruction(shift, stdout);
+    return;
+  }
+  const bool counter = amount.type == O_Register && amount.reg == rcx;
+  if (!counter) {
+    clear_register(table, registers, rcx, output);
+    const Width countWidth = type_width(reference_type(count));
+    write_instruction(output, M_MOV, countWidth, 2, registers_get_operand(registers, count),
+                      operand_register(countWidth, rcx));
+  }
+  write_instruction(output, op, width, 2, operand_register(Byte, rcx),
+                    registers_get_operand(registers, instruction->output));
+  if (!counter) {
+    mark_killed(output, rcx);
+  }
+}
+
+// the count instructions only write registers, so a stack-resident output is counted in a scratch register. the input
+// is widened to 64 bits there first, like the argument of the library call would be
+void write_bit_count(const InstructionTable *table, Registers *registers, const Instruction *instruction,
+                     MachineInstructionList *output) {
+  if (registers_get_storage(registers, instruction->output.allocation)->location == L_None) {
+    registers_claim(registers, instruction->output.allocation);
+  }
+  const bool spill = registers_get_operand(registers, instruction->output).type != O_Register;
+  const int8_t reg = spill ? registers_take_scratch(table, registers, output)
+                           : registers_get_operand(registers, instruction->output).reg;
+  const MachineOp op = instruction->type == POPCNT ? M_POPCNT : instruction->type == TZCNT ? M_TZCNT : M_LZCNT;
+  const Operand count = operand_register(Quad, reg);
+  const Operand value = registers_get_operand(registers, instruction->inputs[0]);
+  if (type_width(reference_type(instruction->inputs[0])) == Quad) {
+    write_instruction(output, op, Quad, 2, value.type == O_Register ? operand_register(Quad, value.reg) : value, count);
+  } else {
+    write_mov_into_register(registers, (Type){.kind = i64}, instruction->inputs[0], reg, output);
+    write_instruction(output, op, Quad, 2, count, count);
+  }
+  if (spill) {
+    const Width width = type_width(instruction->output.allocation->type);
+    write_instruction(output, M_MOV, width, 2, operand_register(width, reg),
+                      registers_get_operand(registers, instruction->output))
+        ->kills = 1u << reg;
+  }
+}
+
+// the condition to test after ucomis, which sets the carry flag rather than the sign and overflow flags
+Condition condition_fp(const Condition cond) {
+  switch (cond) {
+  case CC_L:
+    return CC_B;
+  case CC_G:
+    return CC_A;
+  case CC_LE:
+    return CC_BE;
+  case CC_GE:
+    return CC_AE;
+  default:
+    return cond;
+  }
+}
+
+// unordered operands set the parity flag (along with ZF and CF), so floating point equality also checks it:
+// equal only when ordered, not equal when unordered
+void write_set(const InstructionTable *table, const Condition cond, Registers *registers, Instruction *instruction,
+               MachineInstructionList *output) {
+  if (!registers->unordered) {
+    cmp_output(cond, registers, instruction, output);
+    return;
+  }
+  cmp_output(condition_fp(cond), registers, instruction, output);
+  if (cond != CC_E && cond != CC_NE)
+    return;
+  const int8_t scratch = registers_take_scratch(table, registers, output);
+  MachineInstruction *parity = machine_emit(output, M_SET, Byte, 1, operand_register(Byte, scratch), operand_none());
+  parity->cond = cond == CC_E ? CC_NP : CC_P;
+  machine_write_instruction(parity, stdout);
+  write_instruction(output, cond == CC_E ? M_AND : M_OR, Byte, 2, operand_register(Byte, scratch),
+                    registers_get_operand(registers, instruction->output))
+      ->kills = 1u << scratch;
+}
+
+void write_branch(const InstructionTable *table, const Registers *registers, const Condition cond, const int label,
+                  MachineInstructionList *output) {
+  if (!registers->unordered) {
+    write_jmp(table, cond, true, label, output);
+  } else if (cond == CC_E) {
+    // jp 1f; je label; 1:
+    MachineInstruction *parity = machine_emit(output, M_JCC, Quad, 1, operand_label("1f"), operand_none());
+    parity->cond = CC_P;
+    machine_write_instruction(parity, stdout);
+    write_jmp(table, CC_E, true, label, output);
+    machine_write_instruction(machine_emit_label(output, "1"), stdout);
+  } else if (cond == CC_NE) {
+    write_jmp(table, CC_P, true, label, output);
+    write_jmp(table, CC_NE, true, label, output);
+  } else {
+    write_jmp(table, condition_fp(cond), true, label, output);
+  }
+}
+
+// scalar sse arithmetic only writes xmm registers, so a result kept in memory is computed in %xmm1
+void write_fp_op(const InstructionTable *table, Registers *registers, const MachineOp op, const Reference source,
+                 const Reference destination, MachineInstructionList *output) {
+  const Width width = type_width(reference_type(destination));
+  if (registers_get_operand(registers, destination).type == O_Register) {
+    write_binary_op(registers, op, width, source, destination, output);
+    return;
+  }
+  clear_register(table, registers, xmm1, output);
+  const Operand scratch = operand_register(width, xmm1);
+  write_instruction(output, M_MOV, width, 2, registers_get_operand(registers, destination), scratch);
+  write_instruction(output, op, width, 2, registers_get_operand(registers, source), scratch);
+  write_instruction(output, M_MOV, width, 2, scratch, registers_get_operand(registers, destination))->kills =
+      1u << xmm1;
+}
+
+// flips the sign bit, in place for memory and through a mask register otherwise
+void write_fp_negate(const InstructionTable *table, Registers *registers, const Reference value,
+                     MachineInstructionList *output) {
+  const Width width = type_width(reference_type(value));
+  const int8_t scratch = registers_take_scratch(table, registers, output);
+  const Operand destination = registers_get_operand(registers, value);
+  write_instruction(output, M_MOV, width, 2, operand_immediate(width == Quad ? INT64_MIN : INT32_MIN),
+                    operand_register(width, scratch));
+  if (destination.type != O_Register) {
+    write_instruction(output, M_XOR, width, 2, operand_register(width, scratch), destination)->kills = 1u << scratch;
+    return;
+  }
+  const int8_t mask = destination.reg == xmm1 ? xmm0 : xmm1;
+  clear_register(table, registers, mask, output);
+  write_instruction(output, M_MOV, width, 2, operand_register(width, scratch), operand_register(width, mask))->kills =
+      1u << scratch;
+  write_instruction(output, M_XORP, width, 2, operand_register(width, mask), registers_get_operand(registers, value))
+      ->kills = 1u << mask;
+}
+
+// ucomis only compares into a register
+void write_fp_compare(const InstructionTable *table, Registers *registers, const Reference source,
+                      const Reference destination, MachineInstructionList *output) {
+  const Width width = type_width(reference_type(destination));
+  Operand left = registers_get_operand(registers, destination);
+  if (left.type != O_Register) {
+    clear_register(table, registers, xmm1, output);
+    write_instruction(output, M_MOV, width, 2, registers_get_operand(registers, destination),
+                      operand_register(width, xmm1));
+    left = operand_register(width, xmm1);
+  }
+  write_instruction(output, M_UCOMIS, width, 2, registers_get_operand(registers, source), left)->kills =
+      left.reg == xmm1 ? 1u << xmm1 : 0;
+}
+
+// the constant as a `kind` value: integers by value, floating point types by their bit pattern
+int64_t constant_bits(const Reference constant, const TypeKind kind) {
+  int64_t integer;
+  double value;
+  if (!is_fp(kind) && reference_constant(constant, &integer))
+    return integer;
+  reference_constant_f(constant, &value);
+  if (!is_fp(kind))
+    return (int64_t)value;
+  if (kind == f32) {
+    const float single = (float)value;
+    int32_t pattern;
+    memcpy(&pattern, &single, sizeof(pattern));
+    return pattern;
+  }
+  memcpy(&integer, &value, sizeof(integer));
+  return integer;
+}
+
+// moves between integers and floating point values, or the two precisions, that have to convert. literals are
+// written out as their bit pattern, and as the conversions only write registers, memory destinations go through
+// scratch registers
+void write_fp_convert(const InstructionTable *table, Registers *registers, const Reference from, const Reference to,
+                      MachineInstructionList *output) {
+  const Type toType = reference_type(to);
+  const Width width = type_width(toType);
+  if (!isAllocated(from.access)) {
+    const int64_t bits = constant_bits(from, toType.kind);
+    if (!is_fp(toType.kind)) {
+      write_instruction(output, M_MOV, width, 2, operand_immediate(bits), registers_get_operand(registers, to));
+      return;
+    }
+    const int8_t scratch = registers_take_scratch(table, registers, output);
+    write_instruction(output, M_MOV, width, 2, operand_immediate(bits), operand_register(width, scratch));
+    write_instruction(output, M_MOV, width, 2, operand_register(width, scratch), registers_get_operand(registers, to))
+        ->kills = 1u << scratch;
+    return;
+  }
+
+  const Type fromType = reference_type(from);
+  if (!is_fp(toType.kind)) {
+    // truncating, into a full register when the destination cannot take it directly
+    const Operand destination = registers_get_operand(registers, to);
+    if (destination.type == O_Register && width >= Long) {
+      MachineInstruction *convert = machine_emit(output, M_CVTTS2SI, width, 2, registers_get_operand(registers, from),
+                                                 destination);
+      convert->width2 = type_width(fromType);
+      machine_write_instruction(convert, stdout);
+      return;
+    }
+    const int8_t scratch = registers_take_scratch(table, registers, output);
+    MachineInstruction *convert = machine_emit(output, M_CVTTS2SI, Quad, 2, registers_get_operand(registers, from),
+                                               operand_register(Quad, scratch));
+    convert->width2 = type_width(fromType);
+    machine_write_instruction(convert, stdout);
+    write_instruction(output, M_MOV, width, 2, operand_register(width, scratch), registers_get_operand(registers, to))
+        ->kills = 1u << scratch;
+    return;
+  }
+
+  const bool spill = registers_get_operand(registers, to).type != O_Register;
+  if (spill) {
+    clear_register(table, registers, xmm1, output);
+  }
+  const Operand destination = spill ? operand_register(width, xmm1) : registers_get_operand(registers, to);
+  Operand source = registers_get_operand(registers, from);
+  Width sourceWidth = type_width(fromType);
+  MachineOp op = M_CVTS2S;
+  uint32_t kills = 0;
+  if (!is_fp(fromType.kind)) {
+    op = M_CVTSI2S;
+    // cvtsi2s reads signed 32 or 64-bit integers, anything narrower or unsigned 32-bit is extended first
+    if (sourceWidth < Long || (sourceWidth == Long && typekind_unsigned(fromType.kind))) {
+      const int8_t scratch = registers_take_scratch(table, registers, output);
+      source = registers_get_operand(registers, from);
+      MachineInstruction *extend;
+      if (sourceWidth == Long) {
+        extend = machine_emit(output, M_MOV, Long, 2, source, operand_register(Long, scratch));
+      } else {
+        extend = machine_emit(output, M_MOVS, Quad, 2, source, operand_register(Quad, scratch));
+        extend->width2 = sourceWidth;
+      }
+      machine_write_instruction(extend, stdout);
+      source = operand_register(Quad, scratch);
+      sourceWidth = Quad;
+      kills = 1u << scratch;
+    }
+  }
+  MachineInstruction *convert = machine_emit(output, op, width, 2, source, destination);
+  convert->width2 = sourceWidth;
+  convert->kills = kills;
+  machine_write_instruction(convert, stdout);
+  if (spill) {
+    write_instruction(output, M_MOV, width, 2, destination, registers_get_operand(registers, to))->kills = 1u << xmm1;
+  }
+}
+
+// the VEX (AVX) form of a packed instruction: source, second source, destination
+MachineInstruction *write_vex_instruction(MachineInstructionList *output, const MachineOp op, const Width lanes,
+                                          const Operand source, const Operand second, const Operand destination) {
+  MachineInstruction *instruction = machine_emit(output, op, lanes, 3, source, second);
+  instruction->args[2] = destination;
+  machine_write_instruction(instruction, stdout);
+  return instruction;
+}
+
+// %xmm0 or, for 32-byte vectors, %ymm0
+Width vector_width(const Instruction *instruction) {
+  int64_t bytes = 16;
+  reference_constant(instruction->inputs[1], &bytes);
+  return bytes == 32 ? Yword : Oword;
+}
+
+void write_vector_op(const Registers *registers, const Instruction *instruction, MachineInstructionList *output) {
+  const Width vector = vector_width(instruction);
+  MachineOp op;
+  switch (instruction->type) {
+  case VADD:
+    op = M_PADD;
+    break;
+  case VSUB:
+    op = M_PSUB;
+    break;
+  case VMULL:
+    op = M_PMULL;
+    break;
+  case VAND:
+    op = M_PAND;
+    break;
+  case VOR:
+    op = M_POR;
+    break;
+  case VXOR:
+    op = M_PXOR;
+    break;
+  case VZERO:
+    op = M_PXOR;
+    break;
+  default:
+    write_instruction(output, M_MOVDQU, Quad, 2, registers_get_operand(registers, instruction->inputs[0]),
+                      operand_vector(vector, 0));
+    return;
+  }
+  const Width lanes = instruction->type == VZERO ? Quad : type_width(reference_type(instruction->inputs[0]));
+  const Operand source =
+      instruction->type == VZERO ? operand_vector(vector, 0) : registers_get_operand(registers, instruction->inputs[0]);
+  if (vector == Yword) {
+    // the VEX forms take unaligned memory operands and a separate destination
+    write_vex_instruction(output, op, lanes, source, operand_vector(vector, 0), operand_vector(vector, 0));
+    return;
+  }
+  if (instruction->type == VZERO) {
+    write_instruction(output, op, lanes, 2, source, operand_vector(vector, 0));
+    return;
+  }
+  // the packed arithmetic only takes aligned memory operands, so the other vector goes through %xmm1
+  write_instruction(output, M_MOVDQU, Quad, 2, source, operand_vector(vector, 1));
+  write_instruction(output, op, lanes, 2, operand_vector(vector, 1), operand_vector(vector, 0));
+}
+
+// an xmm register for the duration of one instruction, taking %xmm15 from its allocation when none is free
+int8_t registers_take_vector_scratch(const InstructionTable *table, Registers *registers,
+                                     MachineInstructionList *output) {
+  for (int i = 13; i >= 0; --i) {
+    if (!registers->registers[fpRegisterPriority[i]].inUse) {
+      return fpRegisterPriority[i];
+    }
+  }
+  clear_register(table, registers, xmm15, output);
+  return xmm15;
+}
+
+MachineInstruction *write_shuffle(MachineInstructionList *output, const int64_t order, const Operand source,
+                                  const Operand destination) {
+  MachineInstruction *instruction = machine_emit(output, M_PSHUFD, Oword, 3, operand_immediate(order), source);
+  instruction->args[2] = destination;
+  machine_write_instruction(instruction, stdout);
+  return instruction;
+}
+
+// packed arithmetic only writes xmm registers and faults on unaligned memory sources, so memory operands go
+// through %xmm0 (source) and %xmm1 (destination)
+void write_packed_op(const InstructionTable *table, Registers *registers, const MachineOp op, const Width lanes,
+                     const Reference source, const Reference destination, MachineInstructionList *output) {
+  if (type_width(reference_type(destination)) == Yword) {
+    // the VEX forms take unaligned memory sources and a separate destination, so only a destination in memory goes
+    // through %ymm1
+    const Operand to = registers_get_operand(registers, destination);
+    if (to.type == O_Register) {
+      write_vex_instruction(output, op, lanes, registers_get_operand(registers, source), to, to);
+      return;
+    }
+    clear_register(table, registers, xmm1, output);
+    const Operand scratch = operand_register(Yword, xmm1);
+    write_instruction(output, M_MOV, Yword, 2, registers_get_operand(registers, destination), scratch);
+    write_vex_instruction(output, op, lanes, registers_get_operand(registers, source), scratch, scratch);
+    write_instruction(output, M_MOV, Yword, 2, scratch, registers_get_operand(registers, destination))->kills =
+        1u << xmm1;
+    return;
+  }
+  if (registers_get_operand(registers, source).type == O_Register &&
+      registers_get_operand(registers, destination).type == O_Register) {
+    write_binary_op(registers, op, lanes, source, destination, output);
+    return;
+  }
+  clear_register(table, registers, xmm0, output);
+  clear_register(table, registers, xmm1, output);
+  Operand from = registers_get_operand(registers, source);
+  const Operand to = registers_get_operand(registers, destination);
+  uint32_t kills = 0;
+  if (from.type != O_Register) {
+    write_instruction(output, M_MOV, Oword, 2, from, operand_register(Oword, xmm0));
+    from = operand_register(Oword, xmm0);
+    kills = 1u << xmm0;
+  }
+  if (to.type == O_Register) {
+    write_instruction(output, op, lanes, 2, from, to)->kills = kills;
+    return;
+  }
+  const Operand scratch = operand_register(Oword, xmm1);
+  write_instruction(output, M_MOV, Oword, 2, to, scratch);
+  write_instruction(output, op, lanes, 2, from, scratch)->kills = kills;
+  write_instruction(output, M_MOV, Oword, 2, scratch, to)->kills = 1u << xmm1;
+}
+
+// SSE2 only multiplies the even 32-bit lanes (into 64-bit products), so the odd lanes are shuffled down and
+// multiplied separately, and the low halves of both interleaved back together
+void write_packed_multiply(const InstructionTable *table, Registers *registers, const Reference source,
+                           const Reference destination, MachineInstructionList *output) {
+  clear_register(table, registers, xmm0, output);
+  clear_register(table, registers, xmm1, output);
+  const bool spill = registers_get_operand(registers, destination).type != O_Register;
+  const int8_t scratch = spill ? registers_take_vector_scratch(table, registers, output) : -1;
+  const Operand to = registers_get_operand(registers, destination);
+  const Operand product = spill ? operand_register(Oword, scratch) : to;
+  const Operand factor = operand_register(Oword, xmm0);
+  const Operand odd = operand_register(Oword, xmm1);
+  if (spill) {
+    write_instruction(output, M_MOV, Oword, 2, to, product);
+  }
+  write_instruction(output, M_MOV, Oword, 2, registers_get_operand(registers, source), factor);
+  write_shuffle(output, 0xF5, product, odd);
+  write_instruction(output, M_PMULUDQ, Oword, 2, factor, product);
+  write_shuffle(output, 0xF5, factor, factor);
+  write_instruction(output, M_PMULUDQ, Oword, 2, factor, odd)->kills = 1u << xmm0;
+  write_shuffle(output, 0x08, product, product);
+  write_shuffle(output, 0x08, odd, odd);
+  write_instruction(output, M_PUNPCKL, Long, 2, odd, product)->kills = 1u << xmm1;
+  if (spill) {
+    write_instruction(output, M_MOV, Oword, 2, product, to)->kills = 1u << scratch;
+  }
+}
+
+void write_packed_arithmetic(const InstructionTable *table, Registers *registers, const Instruction *instruction,
+                             MachineInstructionList *output) {
+  const TypeKind lane = vector_lane(reference_type(instruction->output).kind);
+  MachineOp op;
+  switch (instruction->type) {
+  case ADD:
+    op = is_fp(lane) ? M_ADDP : M_PADD;
+    break;
+  case SUB:
+    op = is_fp(lane) ? M_SUBP : M_PSUB;
+    break;
+  case IMUL:
+    // the 256-bit vectors always have AVX2's vpmulld
+    if (lane == i32 && !(options.features & FEATURE_SSE4_2) &&
+        type_width(reference_type(instruction->output)) == Oword) {
+      write_packed_multiply(table, registers, instruction->inputs[0], instruction->output, output);
+      return;
+    }
+    op = is_fp(lane) ? M_MULP : M_PMULL;
+    break;
+  case FDIV:
+    op = M_DIVP;
+    break;
+  case AND:
+    op = M_PAND;
+    break;
+  case OR:
+    op = M_POR;
+    break;
+  default:
+    op = M_PXOR;
+    break;
+  }
+  write_packed_op(table, registers, op, typekind_width(lane), instruction->inputs[0], instruction->output, output);
+}
+
+// copies a scalar into every lane: the value goes into the low lane, narrow lanes are doubled up with punpckl until
+// they fill 32 bits, and pshufd repeats the low 32 (or 64) bits across the register (vpbroadcast across a ymm one)
+void write_splat(const InstructionTable *table, Registers *registers, const Reference from, const Reference to,
+                 MachineInstructionList *output) {
+  const TypeKind lane = vector_lane(reference_type(to).kind);
+  const Width width = typekind_width(lane);
+  const Width moved = width == Quad ? Quad : Long;
+  const bool spill = registers_get_operand(registers, to).type != O_Register;
+  if (spill) {
+    clear_register(table, registers, xmm1, output);
+  }
+  const int8_t vector = spill ? xmm1 : registers_get_operand(registers, to).reg;
+  const Width size = type_width(reference_type(to));
+  const Operand all = operand_register(size, vector);
+
+  int64_t bits = 0;
+  if (!isAllocated(from.access) && (bits = constant_bits(from, lane)) == 0) {
+    if (size == Yword) {
+      // the legacy form would leave the upper half alone
+      write_vex_instruction(output, M_PXOR, Quad, all, all, all);
+    } else {
+      write_instruction(output, M_PXOR, Oword, 2, all, all);
+    }
+  } else {
+    if (!isAllocated(from.access)) {
+      const int8_t scratch = registers_take_scratch(table, registers, output);
+      write_instruction(output, M_MOV, moved, 2, operand_immediate(bits), operand_register(moved, scratch));
+      write_instruction(output, M_MOV, moved, 2, operand_register(moved, scratch), operand_register(moved, vector))
+          ->kills = 1u << scratch;
+    } else {
+      const Operand source = registers_get_operand(registers, from);
+      if (source.type == O_Register) {
+        // whatever is above the lane in the register is never repeated
+        write_instruction(output, M_MOV, moved, 2, operand_register(moved, source.reg),
+                          operand_register(moved, vector));
+      } else if (width >= Long) {
+        write_instruction(output, M_MOV, width, 2, source, operand_register(width, vector));
+      } else {
+        // a 32-bit load could reach past the end of the value
+        const int8_t scratch = registers_take_scratch(table, registers, output);
+        MachineInstruction *extend = machine_emit(output, M_MOVS, Long, 2, registers_get_operand(registers, from),
+                                                  operand_register(Long, scratch));
+        extend->width2 = width;
+        machine_write_instruction(extend, stdout);
+        write_instruction(output, M_MOV, Long, 2, operand_register(Long, scratch), operand_register(Long, vector))
+            ->kills = 1u << scratch;
+      }
+    }
+    if (size == Yword) {
+      // the ymm vectors only have 32 and 64-bit lanes
+      write_instruction(output, M_PBROADCAST, moved, 2, operand_register(Oword, vector), all);
+    } else {
+      if (width == Byte) {
+        write_instruction(output, M_PUNPCKL, Byte, 2, all, all);
+      }
+      if (width <= Word) {
+        write_instruction(output, M_PUNPCKL, Word, 2, all, all);
+      }
+      write_shuffle(output, width == Quad ? 0x44 : 0x00, all, all);
+    }
+  }
+  if (spill) {
+    write_instruction(output, M_MOV, size, 2, all, registers_get_operand(registers, to))->kills = 1u << xmm1;
+  }
+}
+
+void write_vector_mov(const InstructionTable *table, Registers *registers, const Reference from, const Reference to,
+                      MachineInstructionList *output) {
+  if (!isAllocated(from.access) || !is_vector(reference_type(from).kind)) {
+    write_splat(table, registers, from, to, output);
+    return;
+  }
+  const Width size = type_width(reference_type(to));
+  if (registers_get_operand(registers, from).type == O_Register ||
+      registers_get_operand(registers, to).type == O_Register) {
+    write_binary_op(registers, M_MOV, size, from, to, output);
+    return;
+  }
+  clear_register(table, registers, xmm0, output);
+  write_instruction(output, M_MOV, size, 2, registers_get_operand(registers, from), operand_register(size, xmm0));
+  write_instruction(output, M_MOV, size, 2, operand_register(size, xmm0), registers_get_operand(registers, to))
+      ->kills = 1u << xmm0;
+}
+
+// a single lane between an xmm register, memory and a general purpose register. xmm registers only move 32 or 64
+// bits at a time to the others, and memory to memory goes through a general purpose register
+void write_lane_move(const InstructionTable *table, Registers *registers, const Width width, Operand from,
+                     Operand to, MachineInstructionList *output) {
+  const Width moved = width == Quad ? Quad : Long;
+  if (from.type == O_Register) {
+    from = operand_register(operand_is_fp(from) || operand_is_fp(to) ? moved : width, from.reg);
+  }
+  if (to.type == O_Register) {
+    to = operand_register(operand_is_fp(from) || operand_is_fp(to) ? moved : width, to.reg);
+  }
+  if ((from.type == O_Register && to.type == O_Register) ||
+      (from.type == O_Register && !(operand_is_fp(from) && width < Long)) || to.type == O_Register) {
+    write_instruction(output, M_MOV, from.type == O_Register ? from.width : to.width, 2, from, to);
+    return;
+  }
+  const int8_t scratch = registers_take_scratch(table, registers, output);
+  write_instruction(output, M_MOV, operand_is_fp(from) ? moved : width, 2, from,
+                    operand_register(operand_is_fp(from) ? moved : width, scratch));
+  write_instruction(output, M_MOV, width, 2, operand_register(width, scratch), to)->kills = 1u << scratch;
+}
+
+// parks a vector held in a register in a fresh stack slot, so that its lanes can be addressed
+Operand write_vector_slot(Registers *registers, const Operand vector, MachineInstructionList *output) {
+  if (vector.type != O_Register)
+    return vector;
+  registers->offset -= (int16_t)size_bytes(vector.width);
+  write_instruction(output, M_MOV, vector.width, 2, vector, operand_stack(registers->offset));
+  return operand_stack(registers->offset);
+}
+
+// the lane `index` (a constant or an i64 allocation) of the vector in memory at `vector`. a variable index is
+// loaded into a general purpose register, which is returned in `indexReg` (-1 otherwise)
+Operand vector_lane_operand(const InstructionTable *table, Registers *registers, Operand vector, const Reference index,
+                            const int size, int8_t *indexReg, MachineInstructionList *output) {
+  int64_t lane;
+  *indexReg = -1;
+  if (reference_constant(index, &lane)) {
+    vector.disp += (int32_t)(lane * size);
+    return vector;
+  }
+  const Operand operand = registers_get_operand(registers, index);
+  if (operand.type == O_Register) {
+    vector.index = operand.reg;
+  } else {
+    *indexReg = registers_take_scratch(table, registers, output);
+    write_instruction(output, M_MOV, Quad, 2, operand, operand_register(Quad, *indexReg));
+    vector.index = *indexReg;
+  }
+  vector.scale = (uint8_t)size;
+  return vector;
+}
+
+void write_op_no_args(Registers *registers, const MachineOp op, MachineInstructionList *output) {
+  write_instruction(output, op, Quad, 0, operand_none(), operand_none());
+}
+
+// whether a ymm register has been written since the last vzeroupper
+bool upper_halves_dirty(const MachineInstructionList *output) {
+  for (int i = output->len - 1; i >= 0; --i) {
+    if (output->array[i].op == M_VZEROUPPER)
+      return false;
+    if (machine_is_vex(&output->array[i]))
+      return true;
+  }
+  return false;
+}
+
+bool type_is_ymm(const Type type) {
+  return is_vector(type.kind) && type_width(type) == Yword;
+}
+
+bool function_takes_ymm(const Function *function) {
+  for (int i = 0; i < function->arguments.len; ++i) {
+    if (type_is_ymm(function->arguments.array[i].type))
+      return true;
+  }
+  return false;
+}
+
+// legacy SSE code stalls on dirty upper halves, so they are cleared before control leaves for other code, unless a
+// 256-bit value is being handed over in them. any other value in a vector register is saved around a call or kept
+void write_upper_clear(Registers *registers, const bool handed, MachineInstructionList *output) {
+  if (!handed && upper_halves_dirty(output)) {
+    write_op_no_args(registers, M_VZEROUPPER, output);
+  }
 }
 
 void generate_statement(Registers *registers, const char *contents, InstructionTable *table, VarList *globals,
-                        FunctionList *functions, StrList *literals, FILE *output) {
+                        FunctionList *functions, LiteralPool *literals, MachineInstructionList *output) {
   for (int i = 0; i < table->allocations.len; ++i) {
     Allocation *allocation = table->allocations.array[i];
     if (allocation->index >= table->parentCutoff && allocation->source.prop == FnArgument) {
@@ -603,42 +1410,74 @@ void generate_statement(Registers *registers, const char *contents, InstructionT
   for (int i = 0; i < table->instructions.len; ++i) {
     printf("\n--- Instruction %i ---\n", i);
     Instruction *instruction = table->instructions.array + i;
+    AddressLoad loads[6];
+    int loaded = 0;
+    switch (instruction->type) {
+    case LABEL:
+    case JMP:
+    case JE:
+    case JNE:
+    case JG:
+    case JL:
+    case JGE:
+    case JLE:
+    case CALL:
+    case TAILCALL:
+      break;
+    default:
+      loaded = load_address(registers, instruction, instruction->inputs[0], loads, loaded, output);
+      loaded = load_address(registers, instruction, instruction->inputs[1], loads, loaded, output);
+      loaded = load_address(registers, instruction, instruction->output, loads, loaded, output);
+      break;
+    }
     switch (instruction->type) {
     case NEG:
-      write_unary_op(registers, "neg", type_width(instruction->output.allocation->type), instruction->output, output);
+      if (is_fp(instruction->output.allocation->type.kind)) {
+        write_fp_negate(table, registers, instruction->output, output);
+        break;
+      }
+      write_unary_op(registers, M_NEG, type_width(instruction->output.allocation->type), instruction->output, output);
       break;
     case SETE:
-      cmp_output("sete", registers, instruction, output);
+      write_set(table, CC_E, registers, instruction, output);
       break;
     case SETL:
-      cmp_output("setl", registers, instruction, output);
+      write_set(table, CC_L, registers, instruction, output);
       break;
     case SETG:
-      cmp_output("setg", registers, instruction, output);
+      write_set(table, CC_G, registers, instruction, output);
       break;
     case SETNE:
-      cmp_output("setne", registers, instruction, output);
+      write_set(table, CC_NE, registers, instruction, output);
       break;
     case SETLE:
-      cmp_output("setle", registers, instruction, output);
+      write_set(table, CC_LE, registers, instruction, output);
       break;
     case SETGE:
-      cmp_output("setge", registers, instruction, output);
+      write_set(table, CC_GE, registers, instruction, output);
       break;
     case CALL: {
+      const bool fpResult = is_sse(instruction->function->retVal.kind);
       clear_register(table, registers, rax, output);
-      fputs("\tmovq $0, %rax\n", output);
-      fputs("\tmovq $0, %rax\n", stdout);
+      if (fpResult) {
+        clear_register(table, registers, xmm0, output);
+      }
+      // variadic callees take the number of vector registers used in %al
+      int floats = 0;
+      for (int j = 0; j < instruction->function->arguments.len; ++j) {
+        floats += argument_register(instruction->function, j) >= xmm0;
+      }
+      write_instruction(output, M_MOV, Quad, 2, operand_immediate(floats), operand_register(Quad, rax));
 
       const int16_t base = push_function_arguments(table, registers, instruction, output);
+      write_upper_clear(registers, function_takes_ymm(instruction->function), output);
 
-      fprintf(output, "\tcall %s\n", instruction->function->name);
-      fprintf(stdout, "\tcall %s\n", instruction->function->name);
+      write_instruction(output, M_CALL, Quad, 1, operand_label(instruction->function->name), operand_none());
 
-      fprintf(output, "\taddq $%i, %%rsp\n", (-base / 16 + 1) * 16 + 8);
-      fprintf(stdout, "\taddq $%i, %%rsp\n", (-base / 16 + 1) * 16 + 8);
+      write_instruction(output, M_ADD, Quad, 2, operand_immediate((-base / 16 + 1) * 16 + 8),
+                        operand_register(Quad, rsp));
 
-      fputs("#RST\n", output);
+      machine_emit_comment(output, "#RST");
       int16_t offset = base;
       for (int j = table->allocations.len - 1; j >= 0; --j) {
         if (registers->storage[j].location == L_Register &&
@@ -658,21 +1497,25 @@ void generate_statement(Registers *registers, const char *contents, InstructionT
           offset += (int16_t)type_size(((Allocation *)table->allocations.array[j])->type);
         }
       }
-      fputs("#eRST\n", output);
+      machine_emit_comment(output, "#eRST");
+      for (int j = 0; j < instruction->function->arguments.len; ++j) {
+        cullref(registers, instruction, instruction->arguments[j], output);
+      }
       if (instruction->function->retVal.kind != 0 && instruction->retVal.allocation->lastInstr != -1) {
-        registers_claim_register(registers, instruction->retVal.allocation, rax);
+        registers_claim_register(registers, instruction->retVal.allocation, fpResult ? xmm0 : rax);
       }
       break;
     }
     case MOV: {
       Reference from = instruction->inputs[0];
       Reference to = instruction->output;
-      if (from.access == to.access && from.allocation == to.allocation) {
+      if (reference_equals(from, to)) {
         break;
       }
       if (isAllocated(from.access) && from.access == Direct && from.allocation->lastInstr == instruction->id &&
-          to.allocation->index >= table->parentCutoff &&
-          type_width(to.allocation->type) == type_width(from.allocation->type)) {
+          to.access == Direct && to.allocation->index >= table->parentCutoff &&
+          type_width(to.allocation->type) == type_width(from.allocation->type) &&
+          is_fp(to.allocation->type.kind) == is_fp(from.allocation->type.kind)) {
         registers_override(registers, to.allocation, from.allocation);
         printf("Inlined MOV from %i (%s) to %i (%s)\n", from.allocation->index,
                from.allocation->name != NULL ? from.allocation->name : "null", to.allocation->index,
@@ -684,47 +1527,101 @@ void generate_statement(Registers *registers, const char *contents, InstructionT
       if (registers_get_storage(registers, to.allocation)->location == L_None) {
         registers_claim(registers, to.allocation);
       }
-      fflush(output);
-      fflush(stdout);
-      if (!isAllocated(from.access) ||
-          (to.access == Dereference ? to.allocation->type.inner->kind : to.allocation->type.kind) ==
-              from.allocation->type.kind) {
-        write_binary_op(registers, "mov",
-                        type_width(to.access == Dereference ? *to.allocation->type.inner : to.allocation->type), from,
-                        to, output);
-      } else if (type_width(to.access == Dereference ? *to.allocation->type.inner : to.allocation->type) <=
-                 type_width(from.allocation->type)) {
-        Type type = from.allocation->type;
-        from.allocation->type =
-            to.access == Dereference ? *to.allocation->type.inner : to.allocation->type; // todo make nicer
-        write_binary_op(registers, "mov", type_width(from.allocation->type), from, to, output);
-        from.allocation->type = type;
+      const Type toType = reference_type(to);
+      const int8_t bounce = registers_find_scratch(registers);
+      if (is_vector(toType.kind)) {
+        write_vector_mov(table, registers, from, to, output);
+      } else if ((reference_is_fp(from) || reference_is_fp(to)) &&
+          (!isAllocated(from.access) || reference_type(from).kind != toType.kind)) {
+        write_fp_convert(table, registers, from, to, output);
+      } else if (registers_get_operand(registers, from).type == O_Memory &&
+          registers_get_operand(registers, to).type == O_Memory && toType.kind == reference_type(from).kind &&
+          bounce != -1) {
+        // x86 has no memory to memory mov, so element copies go through a free register
+        const Width width = type_width(toType);
+        write_instruction(output, M_MOV, width, 2, registers_get_operand(registers, from), operand_register(width, bounce));
+        write_instruction(output, M_MOV, width, 2, operand_register(width, bounce), registers_get_operand(registers, to))
+            ->kills = 1 << bounce;
+      } else if (reference_wide_immediate(from, type_width(toType)) &&
+                 registers_get_operand(registers, to).type != O_Register) {
+        const int8_t scratch = write_scratch_source(table, registers, Quad, from, output);
+        write_instruction(output, M_MOV, Quad, 2, operand_register(Quad, scratch), registers_get_operand(registers, to))
+            ->kills = 1u << scratch;
+        registers->registers[scratch].inUse = false;
+      } else if (!isAllocated(from.access) || toType.kind == reference_type(from).kind) {
+        write_binary_op(registers, M_MOV, type_width(toType), from, to, output);
+      } else if (type_width(toType) <= type_width(reference_type(from))) {
+        if (from.access == Direct) {
+          Type type = from.allocation->type;
+          from.allocation->type = toType; // todo make nicer
+          write_binary_op(registers, M_MOV, type_width(toType), from, to, output);
+          from.allocation->type = type;
+        } else {
+          write_binary_op(registers, M_MOV, type_width(toType), from, to, output);
+        }
       } else {
-        write_binary_transform_op(
-            registers, "movs", type_width(from.allocation->type),
-            type_width(to.access == Dereference ? *to.allocation->type.inner : to.allocation->type), from, to, output);
+        const Width width = type_width(toType);
+        const int8_t scratch = registers_find_scratch(registers);
+        if (registers_get_operand(registers, to).type == O_Memory && scratch != -1) {
+          // movs can only extend into a register
+          MachineInstruction *extend = machine_emit(output, M_MOVS, width, 2, registers_get_operand(registers, from),
+                                                    operand_register(width, scratch));
+          extend->width2 = type_width(reference_type(from));
+          machine_write_instruction(extend, stdout);
+          write_instruction(output, M_MOV, width, 2, operand_register(width, scratch),
+                            registers_get_operand(registers, to))
+              ->kills = 1 << scratch;
+        } else {
+          write_binary_transform_op(registers, type_width(reference_type(from)), width, from, to, output);
+        }
+      }
+      cullref(registers, instruction, from, output);
+      if (to.access == Dereference) {
+        cullref(registers, instruction, to, output);
       }
-      cullref(registers, instruction, from);
       break;
     }
     case LEA: {
-      binary_lea(registers, instruction, output);
+      binary_lea(table, registers, instruction, output);
       break;
     }
     case ADD:
-      write_binary_op(registers, "add", type_width(instruction->output.allocation->type), instruction->inputs[0],
-                      instruction->output, output);
-      cullref(registers, instruction, instruction->inputs[0]);
+      if (reference_is_vector(instruction->output)) {
+        write_packed_arithmetic(table, registers, instruction, output);
+      } else if (is_fp(reference_type(instruction->output).kind)) {
+        write_fp_op(table, registers, M_ADDS, instruction->inputs[0], instruction->output, output);
+      } else {
+        write_integer_op(table, registers, M_ADD, instruction, output);
+      }
+      cullref(registers, instruction, instruction->inputs[0], output);
       break;
     case SUB:
-      write_binary_op(registers, "sub", type_width(instruction->output.allocation->type), instruction->inputs[0],
-                      instruction->output, output);
-      cullref(registers, instruction, instruction->inputs[0]);
+      if (reference_is_vector(instruction->output)) {
+        write_packed_arithmetic(table, registers, instruction, output);
+      } else if (is_fp(reference_type(instruction->output).kind)) {
+        write_fp_op(table, registers, M_SUBS, instruction->inputs[0], instruction->output, output);
+      } else {
+        write_integer_op(table, registers, M_SUB, instruction, output);
+      }
+      cullref(registers, instruction, instruction->inputs[0], output);
       break;
     case IMUL:
-      write_binary_op(registers, "imul", type_width(instruction->output.allocation->type), instruction->inputs[0],
-                      instruction->output, output);
-      cullref(registers, instruction, instruction->inputs[0]);
+      if (reference_is_vector(instruction->output)) {
+        write_packed_arithmetic(table, registers, instruction, output);
+      } else if (is_fp(reference_type(instruction->output).kind)) {
+        write_fp_op(table, registers, M_MULS, instruction->inputs[0], instruction->output, output);
+      } else {
+        write_integer_op(table, registers, M_IMUL, instruction, output);
+      }
+      cullref(registers, instruction, instruction->inputs[0], output);
+      break;
+    case FDIV:
+      if (reference_is_vector(instruction->output)) {
+        write_packed_arithmetic(table, registers, instruction, output);
+      } else {
+        write_fp_op(table, registers, M_DIVS, instruction->inputs[0], instruction->output, output);
+      }
+      cullref(registers, instruction, instruction->inputs[0], output);
       break;
     case IDIV:
       clear_register(table, registers, rax, output);
@@ -732,13 +1629,14 @@ void generate_statement(Registers *registers, const char *contents, InstructionT
 
       registers_move_into_register_tmp(table, registers, instruction->inputs[0].allocation->type,
                                        instruction->inputs[0], rax, output);
-      write_op_no_args(registers, "cqto", output);
+      write_instruction(output, M_CQTO, type_width(instruction->inputs[0].allocation->type), 0, operand_none(),
+                        operand_none());
 
-      write_unary_op(registers, "idiv", type_width(instruction->inputs[0].allocation->type), instruction->inputs[1],
+      write_unary_op(registers, M_IDIV, type_width(instruction->inputs[0].allocation->type), instruction->inputs[1],
                      output);
       registers_claim_register(registers, instruction->output.allocation, rax);
-      cullref(registers, instruction, instruction->inputs[0]);
-      cullref(registers, instruction, instruction->inputs[1]);
+      cullref(registers, instruction, instruction->inputs[0], output);
+      cullref(registers, instruction, instruction->inputs[1], output);
       break;
     case IDIV_mod:
       clear_register(table, registers, rax, output);
@@ -746,58 +1644,326 @@ void generate_statement(Registers *registers, const char *contents, InstructionT
 
       registers_move_into_register_tmp(table, registers, instruction->inputs[0].allocation->type,
                                        instruction->inputs[0], rax, output);
-      write_op_no_args(registers, "cqto", output);
+      write_instruction(output, M_CQTO, type_width(instruction->inputs[0].allocation->type), 0, operand_none(),
+                        operand_none());
 
-      write_unary_op(registers, "idiv", type_width(instruction->inputs[0].allocation->type), instruction->inputs[1],
+      write_unary_op(registers, M_IDIV, type_width(instruction->inputs[0].allocation->type), instruction->inputs[1],
                      output);
       registers_claim_register(registers, instruction->output.allocation, rdx);
-      cullref(registers, instruction, instruction->inputs[0]);
-      cullref(registers, instruction, instruction->inputs[1]);
+      cullref(registers, instruction, instruction->inputs[0], output);
+      cullref(registers, instruction, instruction->inputs[1], output);
       break;
     case OR:
-      write_binary_op(registers, "or", type_width(instruction->output.allocation->type), instruction->inputs[0],
-                      instruction->output, output);
-      cullref(registers, instruction, instruction->inputs[0]);
+      if (reference_is_vector(instruction->output)) {
+        write_packed_arithmetic(table, registers, instruction, output);
+      } else {
+        write_integer_op(table, registers, M_OR, instruction, output);
+      }
+      cullref(registers, instruction, instruction->inputs[0], output);
       break;
     case XOR:
-      write_binary_op(registers, "xor", type_width(instruction->output.allocation->type), instruction->inputs[0],
-                      instruction->output, output);
-      cullref(registers, instruction, instruction->inputs[0]);
+      if (reference_is_vector(instruction->output)) {
+        write_packed_arithmetic(table, registers, instruction, output);
+      } else {
+        write_integer_op(table, registers, M_XOR, instruction, output);
+      }
+      cullref(registers, instruction, instruction->inputs[0], output);
       break;
     case AND:
-      write_binary_op(registers, "and", type_width(instruction->output.allocation->type), instruction->inputs[0],
-                      instruction->output, output);
-      cullref(registers, instruction, instruction->inputs[0]);
+      if (reference_is_vector(instruction->output)) {
+        write_packed_arithmetic(table, registers, instruction, output);
+      } else {
+        write_integer_op(table, registers, M_AND, instruction, output);
+      }
+      cullref(registers, instruction, instruction->inputs[0], output);
       break;
     case NOT:
-      write_unary_op(registers, "not", type_width(instruction->output.allocation->type), instruction->inputs[0],
+      write_unary_op(registers, M_NOT, type_width(instruction->output.allocation->type), instruction->inputs[0],
                      output);
       break;
     case SAL:
-      write_binary_op(registers, "sal", type_width(instruction->output.allocation->type), instruction->inputs[0],
-                      instruction->output, output);
-      cullref(registers, instruction, instruction->inputs[0]);
+      write_shift(table, registers, instruction, M_SAL, output);
+      cullref(registers, instruction, instruction->inputs[0], output);
       break;
     case SAR:
-      write_binary_op(registers, "sar", type_width(instruction->output.allocation->type), instruction->inputs[0],
-                      instruction->output, output);
-      cullref(registers, instruction, instruction->inputs[0]);
+      write_shift(table, registers, instruction, M_SAR, output);
+      cullref(registers, instruction, instruction->inputs[0], output);
+      break;
+    case SHR:
+      write_shift(table, registers, instruction, M_SHR, output);
+      cullref(registers, instruction, instruction->inputs[0], output);
+      break;
+    case POPCNT:
+    case TZCNT:
+    case LZCNT:
+      write_bit_count(table, registers, instruction, output);
+      cullref(registers, instruction, instruction->inputs[0], output);
+      break;
+    case MULH:
+    case UMULH:
+      clear_register(table, registers, rax, output);
+      clear_register(table, registers, rdx, output);
+
+      write_instruction(output, M_MOV, Quad, 2, registers_get_operand(registers, instruction->inputs[1]),
+                        operand_register(Quad, rax));
+      write_unary_op(registers, instruction->type == MULH ? M_IMUL : M_MUL, Quad, instruction->inputs[0], output);
+      mark_killed(output, rax);
+      registers_claim_register(registers, instruction->output.allocation, rdx);
+      cullref(registers, instruction, instruction->inputs[0], output);
       break;
     case CMP:
-      write_cmp_op(registers, "cmp", instruction->inputs[0], instruction->inputs[1], output);
-      cullref(registers, instruction, instruction->inputs[0]);
-      cullref(registers, instruction, instruction->inputs[1]);
+      registers->unordered = reference_is_fp(instruction->inputs[1]);
+      if (registers->unordered) {
+        write_fp_compare(table, registers, instruction->inputs[0], instruction->inputs[1], output);
+      } else {
+        write_cmp_op(registers, M_CMP, instruction->inputs[0], instruction->inputs[1], output);
+      }
+      cullref(registers, instruction, instruction->inputs[0], output);
+      cullref(registers, instruction, instruction->inputs[1], output);
       break;
     case TEST:
-      write_cmp_op(registers, "test", instruction->inputs[0], instruction->inputs[1], output);
+      registers->unordered = false;
+      write_cmp_op(registers, M_TEST, instruction->inputs[0], instruction->inputs[1], output);
+      break;
+    case VZERO:
+      clear_register(table, registers, xmm0, output);
+      write_vector_op(registers, instruction, output);
+      break;
+    case VLOAD:
+      clear_register(table, registers, xmm0, output);
+      write_vector_op(registers, instruction, output);
+      cullref(registers, instruction, instruction->inputs[0], output);
       break;
+    case VADD:
+    case VSUB:
+    case VMULL:
+    case VAND:
+    case VOR:
+    case VXOR:
+      clear_register(table, registers, xmm1, output);
+      write_vector_op(registers, instruction, output);
+      cullref(registers, instruction, instruction->inputs[0], output);
+      break;
+    case VCLEAR: {
+      // a 256-bit vector still held in a register would lose its upper half
+      bool held = false;
+      for (int j = 0; j < table->allocations.len; ++j) {
+        held |= registers->storage[j].location == L_Register &&
+                type_is_ymm(((Allocation *)table->allocations.array[j])->type);
+      }
+      if (!held) {
+        write_op_no_args(registers, M_VZEROUPPER, output);
+      }
+      break;
+    }
+    case VSTORE:
+      write_instruction(output, M_MOVDQU, Quad, 2, operand_vector(vector_width(instruction), 0),
+                        registers_get_operand(registers, instruction->output));
+      cullref(registers, instruction, instruction->output, output);
+      break;
+    case EXTRACT: {
+      if (registers_get_storage(registers, instruction->output.allocation)->location == L_None) {
+        registers_claim(registers, instruction->output.allocation);
+      }
+      const Width width = typekind_width(vector_lane(reference_type(instruction->inputs[0]).kind));
+      const Width packed = type_width(reference_type(instruction->inputs[0]));
+      const int size = size_bytes(width);
+      int64_t lane;
+      const bool constant = reference_constant(instruction->inputs[1], &lane);
+      Operand vector = registers_get_operand(registers, instruction->inputs[0]);
+      uint32_t kills = 0;
+      // psrldq only shifts within each 16 bytes, so the lanes of a ymm register past the first are read from memory
+      if (vector.type == O_Register && constant && lane > 0 && packed == Oword) {
+        clear_register(table, registers, xmm0, output);
+        vector = registers_get_operand(registers, instruction->inputs[0]);
+        if (vector.type == O_Register) {
+          // shifted down rather than stored, so the lane is the low one
+          write_instruction(output, M_MOV, Oword, 2, vector, operand_register(Oword, xmm0));
+          write_instruction(output, M_PSRLDQ, Oword, 2, operand_immediate(lane * size), operand_register(Oword, xmm0));
+          vector = operand_register(Oword, xmm0);
+          kills = 1u << xmm0;
+        }
+      }
+      int8_t indexReg = -1;
+      if (!constant || vector.type != O_Register || (packed == Yword && lane > 0)) {
+        if (!constant && vector.type == O_Memory && vector.index != -1) {
+          // the element address already has an index, so the vector is copied somewhere that does not
+          clear_register(table, registers, xmm0, output);
+          write_instruction(output, M_MOV, packed, 2, registers_get_operand(registers, instruction->inputs[0]),
+                            operand_register(packed, xmm0));
+          vector = operand_register(packed, xmm0);
+          kills = 1u << xmm0;
+        }
+        vector = vector_lane_operand(table, registers, write_vector_slot(registers, vector, output),
+                                     instruction->inputs[1], size, &indexReg, output);
+      }
+      if (indexReg != -1) {
+        registers->registers[indexReg].inUse = true;
+        kills |= 1u << indexReg;
+      }
+      write_lane_move(table, registers, width, vector, registers_get_operand(registers, instruction->output), output);
+      if (indexReg != -1) {
+        registers->registers[indexReg].inUse = false;
+      }
+      output->array[output->len - 1].kills |= kills;
+      cullref(registers, instruction, instruction->inputs[0], output);
+      cullref(registers, instruction, instruction->inputs[1], output);
+      break;
+    }
+    case INSERT: {
+      const TypeKind kind = vector_lane(reference_type(instruction->output).kind);
+      const Width width = typekind_width(kind);
+      const Operand vector = registers_get_operand(registers, instruction->output);
+      const Operand slot = write_vector_slot(registers, vector, output);
+      int8_t indexReg;
+      const Operand lane =
+          vector_lane_operand(table, registers, slot, instruction->inputs[1], size_bytes(width), &indexReg, output);
+      if (indexReg != -1) {
+        registers->registers[indexReg].inUse = true;
+      }
+      const Reference value = instruction->inputs[0];
+      if (isAllocated(value.access)) {
+        write_lane_move(table, registers, width, registers_get_operand(registers, value), lane, output);
+      } else {
+        const int64_t bits = constant_bits(value, kind);
+        if (width == Quad && (bits < INT32_MIN || bits > INT32_MAX)) {
+          const int8_t scratch = registers_take_scratch(table, registers, output);
+          write_instruction(output, M_MOV, Quad, 2, operand_immediate(bits), operand_register(Quad, scratch));
+          write_instruction(output, M_MOV, Quad, 2, operand_register(Quad, scratch), lane)->kills = 1u << scratch;
+        } else {
+          write_instruction(output, M_MOV, width, 2, operand_immediate(bits), lane);
+        }
+      }
+      if (indexReg != -1) {
+        registers->registers[indexReg].inUse = false;
+        mark_killed(output, indexReg);
+      }
+      if (vector.type == O_Register) {
+        write_instruction(output, M_MOV, vector.width, 2, slot, vector);
+      }
+      cullref(registers, instruction, instruction->inputs[0], output);
+      cullref(registers, instruction, instruction->inputs[1], output);
+      break;
+    }
+    case REDUCE_ADD:
+    case REDUCE_MIN:
+    case REDUCE_MAX: {
+      // halves the vector onto itself until the low lane has combined every lane
+      if (registers_get_storage(registers, instruction->output.allocation)->location == L_None) {
+        registers_claim(registers, instruction->output.allocation);
+      }
+      const TypeKind kind = vector_lane(reference_type(instruction->inputs[0]).kind);
+      const Width width = typekind_width(kind);
+      const Width packed = type_width(reference_type(instruction->inputs[0]));
+      clear_register(table, registers, xmm0, output);
+      clear_register(table, registers, xmm1, output);
+      const Operand accumulator = operand_register(Oword, xmm0);
+      const Operand shifted = operand_register(Oword, xmm1);
+      // integer min and max select through a comparison mask where there is no pmins/pmaxs: SSE2 only has them for
+      // 16-bit lanes and SSE4.1 adds 8 and 32-bit ones, leaving 64-bit lanes to SSE4.2's pcmpgtq. every AVX2 core
+      // has SSE4.2
+      const bool sse4 = (options.features & FEATURE_SSE4_2) != 0 || packed == Yword;
+      const bool select = !is_fp(kind) && instruction->type != REDUCE_ADD && width != Word && (!sse4 || width == Quad);
+      const int8_t maskReg = select ? registers_take_vector_scratch(table, registers, output) : -1;
+      const Operand mask = operand_register(Oword, maskReg);
+      Operand vector = registers_get_operand(registers, instruction->inputs[0]);
+      if (vector.type == O_Register) {
+        vector = operand_register(Oword, vector.reg);
+      }
+      write_instruction(output, M_MOV, Oword, 2, vector, accumulator);
+      for (int bytes = size_bytes(packed) / 2; bytes >= size_bytes(width); bytes /= 2) {
+        if (bytes == 16 && vector.type == O_Register) {
+          // the upper half of a ymm register
+          write_vex_instruction(output, M_EXTRACTI128, Quad, operand_immediate(1), operand_register(Yword, vector.reg),
+                                shifted);
+        } else if (bytes == 16) {
+          Operand upper = vector;
+          upper.disp += 16;
+          write_instruction(output, M_MOV, Oword, 2, upper, shifted);
+        } else {
+          write_instruction(output, M_MOV, Oword, 2, accumulator, shifted);
+          write_instruction(output, M_PSRLDQ, Oword, 2, operand_immediate(bytes), shifted);
+        }
+        if (instruction->type == REDUCE_ADD) {
+          write_instruction(output, is_fp(kind) ? M_ADDP : M_PADD, width, 2, shifted, accumulator);
+        } else if (!select && is_fp(kind)) {
+          write_instruction(output, instruction->type == REDUCE_MIN ? M_MINP : M_MAXP, width, 2, shifted,
+                            accumulator);
+        } else if (!select) {
+          write_instruction(output, instruction->type == REDUCE_MIN ? M_PMINS : M_PMAXS, width, 2, shifted,
+                            accumulator);
+        } else {
+          const bool min = instruction->type == REDUCE_MIN;
+          write_instruction(output, M_MOV, Oword, 2, min ? accumulator : shifted, mask);
+          write_instruction(output, M_PCMPGT, width, 2, min ? shifted : accumulator, mask);
+          write_instruction(output, M_PAND, width, 2, mask, shifted);
+          write_instruction(output, M_PANDN, width, 2, accumulator, mask);
+          write_instruction(output, M_POR, width, 2, mask, shifted);
+          write_instruction(output, M_MOV, Oword, 2, shifted, accumulator);
+        }
+      }
+      mark_killed(output, xmm1);
+      if (select) {
+        mark_killed(output, maskReg);
+      }
+      write_lane_move(table, registers, width, accumulator, registers_get_operand(registers, instruction->output),
+                      output);
+      mark_killed(output, xmm0);
+      cullref(registers, instruction, instruction->inputs[0], output);
+      break;
+    }
+    case REP_STOS:
+    case REP_MOVS: {
+      const bool copy = instruction->type == REP_MOVS;
+      const int8_t source = copy ? rsi : rax;
+      clear_register(table, registers, rdi, output);
+      clear_register(table, registers, rcx, output);
+      clear_register(table, registers, source, output);
+
+      registers_move_into_register_tmp(table, registers, reference_type(instruction->inputs[0]),
+                                       instruction->inputs[0], rdi, output);
+      registers_move_into_register_tmp(table, registers,
+                                       copy ? reference_type(instruction->inputs[1]) : (Type){.kind = u8, .inner = NULL},
+                                       instruction->inputs[1], source, output);
+      write_instruction(output, M_MOV, Quad, 2, registers_get_operand(registers, instruction->output),
+                        operand_register(Quad, rcx));
+      write_instruction(output, copy ? M_REP_MOVS : M_REP_STOS, Byte, 0, operand_none(), operand_none())->kills =
+          1 << rdi | 1 << rcx | 1 << source;
+      cullref(registers, instruction, instruction->inputs[0], output);
+      cullref(registers, instruction, instruction->inputs[1], output);
+      break;
+    }
+    case TAILCALL: {
+      clear_register(table, registers, rax, output);
+      int floats = 0;
+      for (int j = 0; j < instruction->function->arguments.len; ++j) {
+        const int8_t reg = argument_register(instruction->function, j);
+        registers_move_into_register_tmp(table, registers, instruction->function->arguments.array[j].type,
+                                         instruction->arguments[j], reg, output);
+        floats += reg >= xmm0;
+      }
+      write_instruction(output, M_MOV, Quad, 2, operand_immediate(floats), operand_register(Quad, rax));
+      write_upper_clear(registers, function_takes_ymm(instruction->function), output);
+      write_instruction(output, M_JMP, Quad, 1, operand_label(instruction->function->name), operand_none());
+
+      for (int j = table->parentCutoff; j < table->allocations.len; ++j) {
+        registers_free_register(registers, table->allocations.array[j]);
+      }
+      break;
+    }
     case RET:
       write_mov_into_register(registers,
                               isAllocated(instruction->inputs[0].access) ? instruction->inputs[0].allocation->type
                                                                          : (Type){.kind = i64, .inner = NULL},
-                              instruction->inputs[0], rax, output);
-      fputs("\tret\n", output);
-      fputs("\tret\n", stdout);
+                              instruction->inputs[0],
+                              reference_is_fp(instruction->inputs[0]) || reference_is_vector(instruction->inputs[0])
+                                  ? xmm0
+                                  : rax,
+                              output);
+      write_upper_clear(registers, isAllocated(instruction->inputs[0].access) &&
+                                       type_is_ymm(reference_type(instruction->inputs[0])),
+                        output);
+      write_op_no_args(registers, M_RET, output);
 
       puts("Leaked allocations:");
       for (int j = 0; j < table->allocations.len; ++j) {
@@ -830,7 +1996,6 @@ void generate_statement(Registers *registers, const char *contents, InstructionT
           break;
         }
         fflush(stdout);
-        fflush(output);
       }
 
       for (int j = 0; j < table->allocations.len; ++j) {
@@ -839,12 +2004,12 @@ void generate_statement(Registers *registers, const char *contents, InstructionT
         }
       }
 
-      fprintf(output, ".LBL.%s.%i:\n", table->name, instruction->label);
-      fprintf(stdout, ".LBL.%s.%i:\n", table->name, instruction->label);
+      machine_write_instruction(machine_emit_label(output, label_name(table, instruction->label)), stdout);
       break;
     case JMP:
-      if (registers->parent != NULL) {
-        fputs("#restore frame\n", output);
+      // jumps within the same table keep the current frame
+      if (registers->parent != NULL && !table_defines_label(table, instruction->label)) {
+        machine_emit_comment(output, "#restore frame");
         for (int j = 0; j < table->allocations.len; ++j) {
           Allocation *allocation = table->allocations.array[j];
           if (allocation->index < table->parentCutoff) {
@@ -869,31 +2034,31 @@ void generate_statement(Registers *registers, const char *contents, InstructionT
             break;
           }
         }
-        fputs("#end restore frame\n", output);
+        machine_emit_comment(output, "#end restore frame");
       }
 
-      write_jmp(table, "jmp", instruction->label, output);
+      write_jmp(table, CC_E, false, instruction->label, output);
       break;
     case JE:
-      write_jmp(table, "je", instruction->label, output);
+      write_branch(table, registers, CC_E, instruction->label, output);
       break;
     case JNE:
-      write_jmp(table, "jne", instruction->label, output);
+      write_branch(table, registers, CC_NE, instruction->label, output);
       break;
     case JG:
-      write_jmp(table, "jg", instruction->label, output);
+      write_branch(table, registers, CC_G, instruction->label, output);
       break;
     case JL:
-      write_jmp(table, "jl", instruction->label, output);
+      write_branch(table, registers, CC_L, instruction->label, output);
       break;
     case JGE:
-      write_jmp(table, "jge", instruction->label, output);
+      write_branch(table, registers, CC_GE, instruction->label, output);
       break;
     case JLE:
-      write_jmp(table, "jle", instruction->label, output);
+      write_branch(table, registers, CC_LE, instruction->label, output);
       break;
     }
-    fflush(output);
+    release_addresses(registers, loads, loaded, output);
   }
 
   for (int i = 0; i < table->instructions.len; ++i) {
@@ -1,8 +1,8 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 #include "ir.h"
+#include "machine.h"
 
-#include <stdio.h>
 typedef enum {
   L_None,
   L_Stack,
@@ -26,7 +26,10 @@ typedef struct {
 LIST_API(Storage, storage, Storage)
 
 typedef struct Registers {
-  RegisterState registers[16];
+  // general purpose registers, then xmm0 through xmm15
+  RegisterState registers[32];
+  // the flags were last set by ucomis, which compares like unsigned integers and flags NaN operands with parity
+  bool unordered;
   int16_t offset;
   Storage *storage;
   const struct Registers *parent;
@@ -37,17 +40,19 @@ void registers_init_child(Registers *registers, InstructionTable *table, const R
 void registers_free(Registers *registers);
 
 void registers_claim(Registers *registers, Allocation *allocation);
-void registers_move_to_stack(Registers *registers, Allocation *allocation, FILE *output);
+void registers_move_to_stack(Registers *registers, Allocation *allocation, MachineInstructionList *output);
 void registers_free_register(Registers *registers, Allocation *allocation);
 
 Storage *registers_get_storage(const Registers *registers, Allocation *allocation);
-void registers_move_tostack(Registers *registers, Allocation *allocation, FILE *output);
+void registers_move_tostack(Registers *registers, Allocation *allocation, MachineInstructionList *output);
 void registers_claim_register(Registers *registers, Allocation *output, int8_t reg);
 void registers_claim_stack(const Registers *registers, Allocation *output, int16_t offset);
-void registers_force_register(const Registers *registers, Reference allocation, int8_t reg, FILE *output);
+void registers_force_register(const Registers *registers, Reference allocation, int8_t reg,
+                              MachineInstructionList *output);
 void registers_override(const Registers *registers, Allocation *output, Allocation *from);
 
+Operand registers_get_operand(const Registers *registers, Reference reference);
 char *registers_get_mnemonic(const Registers *registers, Reference reference);
 void generate_statement(Registers *registers, const char *contents, InstructionTable *table, VarList *globals,
-                        FunctionList *functions, StrList *literals, FILE *output);
+                        FunctionList *functions, LiteralPool *literals, MachineInstructionList *output);
 #endif // CODEGEN_H
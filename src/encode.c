@@ -0,0 +1,786 @@
+#include "encode.h"
+
+#include "register.h"
+
+#include <string.h>
+
+// x86 numbers the general purpose registers rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi, r8..., unlike Register64
+const uint8_t hardwareRegisters[16] = {0, 3, 1, 2, 6, 7, 5, 4, 8, 9, 10, 11, 12, 13, 14, 15};
+
+// set in the reg field of ModRM instead of a register's number, for opcodes that select their operation there
+#define EXTENSION 0x10
+
+typedef struct {
+  uint8_t bytes[24];
+  int len;
+  // a field at `fixup` the linker fills in with the address of `symbol` (NULL for none)
+  int fixup;
+  const char *symbol;
+  uint32_t type;
+  int64_t addend;
+  // a jmp/jcc to a label of the function itself, written once the layout is known: as rel8 when `near`
+  int target;
+  bool near;
+} Encoded;
+
+uint8_t hardware_register(const int8_t reg) {
+  return reg >= xmm0 ? (uint8_t)(reg - xmm0) : hardwareRegisters[reg];
+}
+
+// vector operands hold the xmm/ymm number itself
+uint8_t operand_number(const Operand operand) {
+  return operand.type == O_Vector ? (uint8_t)operand.reg : hardware_register(operand.reg);
+}
+
+bool is_gpr(const Operand operand) {
+  return operand.type == O_Register && operand.reg < xmm0;
+}
+
+bool is_xmm(const Operand operand) {
+  return (operand.type == O_Register && operand.reg >= xmm0) || operand.type == O_Vector;
+}
+
+bool fits_int8(const int64_t value) {
+  return value >= -128 && value <= 127;
+}
+
+bool fits_int32(const int64_t value) {
+  return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+void unencodable(const MachineInstruction *instruction) {
+  printf("cannot encode instruction: ");
+  machine_write_instruction(instruction, stdout);
+  exit(25);
+}
+
+void put_byte(Encoded *encoded, const uint8_t byte) {
+  encoded->bytes[encoded->len++] = byte;
+}
+
+void put_value(Encoded *encoded, const int64_t value, const int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    put_byte(encoded, (uint8_t)((uint64_t)value >> (i * 8)));
+  }
+}
+
+// a 32-bit field for the linker to fill in
+void put_fixup(Encoded *encoded, const char *symbol, const uint32_t type, const int64_t addend) {
+  encoded->fixup = encoded->len;
+  encoded->symbol = symbol;
+  encoded->type = type;
+  encoded->addend = addend;
+  put_value(encoded, 0, 4);
+}
+
+void put_immediate(Encoded *encoded, const Operand immediate, const int bytes, const uint32_t type) {
+  if (immediate.symbol != NULL) {
+    put_fixup(encoded, immediate.symbol, type, immediate.value);
+  } else {
+    put_value(encoded, immediate.value, bytes);
+  }
+}
+
+// the R, X and B bits extending the ModRM and SIB fields to 16 registers
+uint8_t rex_bits(const int reg, const Operand rm) {
+  uint8_t rex = (reg & EXTENSION) == 0 && (reg & 8) ? 4 : 0;
+  if (rm.type == O_Register || rm.type == O_Vector) {
+    rex |= operand_number(rm) >> 3;
+  } else if (rm.type == O_Memory) {
+    if (rm.index != -1)
+      rex |= (hardware_register(rm.index) >> 3) << 1;
+    if (rm.base != -1)
+      rex |= hardware_register(rm.base) >> 3;
+  }
+  return rex;
+}
+
+// ModRM, SIB and displacement for rm, with reg in the middle bits. a rip-relative displacement is measured from the
+// end of the instruction, which `immediate` bytes still follow
+void put_modrm(Encoded *encoded, const int reg, const Operand rm, const int immediate) {
+  const uint8_t middle = (uint8_t)((reg & 7) << 3);
+  if (rm.type == O_Register || rm.type == O_Vector) {
+    put_byte(encoded, 0xC0 | middle | (operand_number(rm) & 7));
+    return;
+  }
+  if (rm.base == -1 && rm.index == -1 && rm.symbol != NULL) {
+    put_byte(encoded, middle | 5);
+    put_fixup(encoded, rm.symbol, R_X86_64_PC32, rm.disp - 4 - immediate);
+    return;
+  }
+  const uint8_t base = rm.base == -1 ? 5 : hardware_register(rm.base) & 7;
+  const bool sib = rm.index != -1 || rm.base == -1 || base == 4;
+  int mod;
+  if (rm.base == -1) {
+    mod = 0;
+  } else if (rm.symbol != NULL || !fits_int8(rm.disp)) {
+    mod = 2;
+  } else if (rm.disp != 0 || base == 5) {
+    mod = 1;
+  } else {
+    mod = 0;
+  }
+  put_byte(encoded, (uint8_t)(mod << 6) | middle | (sib ? 4 : base));
+  if (sib) {
+    const uint8_t scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+    const uint8_t index = rm.index == -1 ? 4 : hardware_register(rm.index) & 7;
+    put_byte(encoded, (uint8_t)(scale << 6 | index << 3 | base));
+  }
+  if (mod == 1) {
+    put_value(encoded, rm.disp, 1);
+  } else if (rm.symbol != NULL) {
+    put_fixup(encoded, rm.symbol, R_X86_64_32S, rm.disp);
+  } else if (mod == 2 || rm.base == -1) {
+    put_value(encoded, rm.disp, 4);
+  }
+}
+
+bool byte_register(const int reg) {
+  return (reg & EXTENSION) == 0 && reg >= 4 && reg <= 7;
+}
+
+// [prefix] [REX] opcode ModRM, where opcode is one to three bytes (0x0F escapes included) and `bytes` marks 8-bit
+// operands, whose spl/bpl/sil/dil need a REX prefix to tell them from ah/ch/dh/bh
+void put_legacy(Encoded *encoded, const uint8_t prefix, const bool wide, const bool bytes, const uint32_t opcode,
+                const int reg, const Operand rm, const int immediate) {
+  if (prefix != 0) {
+    put_byte(encoded, prefix);
+  }
+  uint8_t rex = rex_bits(reg, rm) | (wide ? 8 : 0);
+  if (bytes && (byte_register(reg) || (rm.type == O_Register && byte_register(hardware_register(rm.reg))))) {
+    rex |= 0x40;
+  }
+  if (rex != 0) {
+    put_byte(encoded, 0x40 | rex);
+  }
+  if (opcode > 0xFFFF)
+    put_byte(encoded, (uint8_t)(opcode >> 16));
+  if (opcode > 0xFF)
+    put_byte(encoded, (uint8_t)(opcode >> 8));
+  put_byte(encoded, (uint8_t)opcode);
+  put_modrm(encoded, reg, rm, immediate);
+}
+
+// the short forms of an operation on the accumulator with an immediate, which have no ModRM byte
+void put_accumulator(Encoded *encoded, const uint8_t prefix, const bool wide, const uint8_t opcode) {
+  if (prefix != 0) {
+    put_byte(encoded, prefix);
+  }
+  if (wide) {
+    put_byte(encoded, 0x48);
+  }
+  put_byte(encoded, opcode);
+}
+
+// the implied prefix of VEX encoded instructions
+#define VEX_NONE 0
+#define VEX_66 1
+#define VEX_F3 2
+#define VEX_F2 3
+// the 0x0F, 0x0F38 and 0x0F3A opcode maps
+#define MAP_0F 1
+#define MAP_0F38 2
+#define MAP_0F3A 3
+
+// AVX and BMI2: the prefix, REX and escape bytes folded into two or three bytes, with room for a third register
+void put_vex(Encoded *encoded, const int implied, const int map, const bool wide, const bool ymm, const int source,
+             const uint8_t opcode, const int reg, const Operand rm, const int immediate) {
+  const uint8_t rex = rex_bits(reg, rm);
+  const uint8_t tail = (uint8_t)((~source & 15) << 3 | (ymm ? 4 : 0) | implied);
+  if (map == MAP_0F && !wide && (rex & 3) == 0) {
+    put_byte(encoded, 0xC5);
+    put_byte(encoded, (uint8_t)((rex & 4 ? 0 : 0x80) | tail));
+  } else {
+    put_byte(encoded, 0xC4);
+    put_byte(encoded, (uint8_t)((~rex & 7) << 5 | map));
+    put_byte(encoded, (uint8_t)((wide ? 0x80 : 0) | tail));
+  }
+  put_byte(encoded, opcode);
+  put_modrm(encoded, reg, rm, immediate);
+}
+
+int register_field(const Operand operand) {
+  return operand_number(operand);
+}
+
+// the 0x66-prefixed 0x0F opcodes of the packed integer instructions (0x0F38 ones as 0x0F38xx), by lane size
+uint32_t packed_opcode(const MachineInstruction *instruction) {
+  const Width lanes = instruction->width;
+  switch (instruction->op) {
+  case M_PADD:
+    return lanes == Byte ? 0x0FFC : lanes == Word ? 0x0FFD : lanes == Long ? 0x0FFE : 0x0FD4;
+  case M_PSUB:
+    return lanes == Byte ? 0x0FF8 : lanes == Word ? 0x0FF9 : lanes == Long ? 0x0FFA : 0x0FFB;
+  case M_PMULL:
+    return lanes == Word ? 0x0FD5 : 0x0F3840;
+  case M_PCMPGT:
+    return lanes == Byte ? 0x0F64 : lanes == Word ? 0x0F65 : lanes == Long ? 0x0F66 : 0x0F3837;
+  case M_PMINS:
+    return lanes == Byte ? 0x0F3838 : lanes == Word ? 0x0FEA : 0x0F3839;
+  case M_PMAXS:
+    return lanes == Byte ? 0x0F383C : lanes == Word ? 0x0FEE : 0x0F383D;
+  case M_PUNPCKL:
+    return lanes == Byte ? 0x0F60 : lanes == Word ? 0x0F61 : lanes == Long ? 0x0F62 : 0x0F6C;
+  case M_PAND:
+    return 0x0FDB;
+  case M_POR:
+    return 0x0FEB;
+  case M_PXOR:
+    return 0x0FEF;
+  case M_PANDN:
+    return 0x0FDF;
+  case M_PMULUDQ:
+    return 0x0FF4;
+  default:
+    return 0;
+  }
+}
+
+// the condition codes in the low bits of setcc and jcc
+uint8_t condition_code(const Condition cond) {
+  switch (cond) {
+  case CC_E:
+    return 0x4;
+  case CC_NE:
+    return 0x5;
+  case CC_L:
+    return 0xC;
+  case CC_G:
+    return 0xF;
+  case CC_LE:
+    return 0xE;
+  case CC_GE:
+    return 0xD;
+  case CC_A:
+    return 0x7;
+  case CC_B:
+    return 0x2;
+  case CC_AE:
+    return 0x3;
+  case CC_BE:
+    return 0x6;
+  case CC_P:
+    return 0xA;
+  case CC_NP:
+    return 0xB;
+  }
+  return 0;
+}
+
+// add, or, and, sub, xor and cmp share their encodings, told apart by the opcode's base and the extension of the
+// immediate forms
+void encode_arithmetic(Encoded *encoded, const MachineInstruction *instruction, const uint8_t base,
+                       const int extension) {
+  const Width width = instruction->width;
+  const Operand source = instruction->args[0];
+  const Operand destination = instruction->args[1];
+  const uint8_t prefix = width == Word ? 0x66 : 0;
+  const bool wide = width == Quad;
+  const bool bytes = width == Byte;
+  // %al, %ax, %eax and %rax have shorter forms for an immediate that needs more than a byte, which assemblers pick
+  const bool accumulator = destination.type == O_Register && destination.reg == rax;
+  if (source.type == O_Immediate) {
+    if (wide && source.symbol == NULL && !fits_int32(source.value)) {
+      // sign-extended from 32 bits, so codegen moves wider constants into a register first
+      unencodable(instruction);
+    } else if (bytes) {
+      if (accumulator) {
+        put_accumulator(encoded, prefix, false, base + 4);
+      } else {
+        put_legacy(encoded, prefix, wide, bytes, 0x80, extension | EXTENSION, destination, 1);
+      }
+      put_immediate(encoded, source, 1, R_X86_64_32);
+    } else if (source.symbol == NULL && fits_int8(source.value)) {
+      put_legacy(encoded, prefix, wide, bytes, 0x83, extension | EXTENSION, destination, 1);
+      put_value(encoded, source.value, 1);
+    } else {
+      const int size = width == Word ? 2 : 4;
+      if (accumulator) {
+        put_accumulator(encoded, prefix, wide, base + 5);
+      } else {
+        put_legacy(encoded, prefix, wide, bytes, 0x81, extension | EXTENSION, destination, size);
+      }
+      put_immediate(encoded, source, size, wide ? R_X86_64_32S : R_X86_64_32);
+    }
+  } else if (is_gpr(source)) {
+    put_legacy(encoded, prefix, wide, bytes, base + (bytes ? 0 : 1), register_field(source), destination, 0);
+  } else if (is_gpr(destination)) {
+    put_legacy(encoded, prefix, wide, bytes, base + (bytes ? 2 : 3), register_field(destination), source, 0);
+  } else {
+    unencodable(instruction);
+  }
+}
+
+// not, neg, mul, imul and idiv of a single operand
+void encode_unary(Encoded *encoded, const MachineInstruction *instruction, const int extension) {
+  const Width width = instruction->width;
+  put_legacy(encoded, width == Word ? 0x66 : 0, width == Quad, width == Byte, width == Byte ? 0xF6 : 0xF7,
+             extension | EXTENSION, instruction->args[0], 0);
+}
+
+void encode_mov(Encoded *encoded, const MachineInstruction *instruction) {
+  const Width width = instruction->width;
+  const Operand source = instruction->args[0];
+  const Operand destination = instruction->args[1];
+  const uint8_t prefix = width == Word ? 0x66 : 0;
+  const bool wide = width == Quad;
+  const bool bytes = width == Byte;
+  if (width == Yword) {
+    if (is_xmm(source) && is_xmm(destination)) {
+      put_vex(encoded, VEX_66, MAP_0F, false, true, 0, 0x6F, register_field(destination), source, 0);
+    } else if (is_xmm(destination)) {
+      put_vex(encoded, VEX_F3, MAP_0F, false, true, 0, 0x6F, register_field(destination), source, 0);
+    } else {
+      put_vex(encoded, VEX_F3, MAP_0F, false, true, 0, 0x7F, register_field(source), destination, 0);
+    }
+  } else if (width == Oword) {
+    // movdqa between registers, movdqu to and from memory
+    if (is_xmm(source) && is_xmm(destination)) {
+      put_legacy(encoded, 0x66, false, false, 0x0F6F, register_field(destination), source, 0);
+    } else if (is_xmm(destination)) {
+      put_legacy(encoded, 0xF3, false, false, 0x0F6F, register_field(destination), source, 0);
+    } else {
+      put_legacy(encoded, 0xF3, false, false, 0x0F7F, register_field(source), destination, 0);
+    }
+  } else if (is_xmm(source) || is_xmm(destination)) {
+    if (source.type == O_Register && destination.type == O_Register && is_xmm(source) != is_xmm(destination)) {
+      // movd/movq
+      if (is_xmm(destination)) {
+        put_legacy(encoded, 0x66, wide, false, 0x0F6E, register_field(destination), source, 0);
+      } else {
+        put_legacy(encoded, 0x66, wide, false, 0x0F7E, register_field(source), destination, 0);
+      }
+    } else if (is_xmm(destination)) {
+      put_legacy(encoded, wide ? 0xF2 : 0xF3, false, false, 0x0F10, register_field(destination), source, 0);
+    } else {
+      put_legacy(encoded, wide ? 0xF2 : 0xF3, false, false, 0x0F11, register_field(source), destination, 0);
+    }
+  } else if (source.type == O_Immediate) {
+    if (is_gpr(destination) && source.symbol == NULL && (!wide || !fits_int32(source.value))) {
+      // the register in the opcode, with an immediate as wide as it (movabs for 64 bits)
+      const uint8_t reg = hardware_register(destination.reg);
+      if (prefix != 0) {
+        put_byte(encoded, prefix);
+      }
+      if (wide || reg >= 8 || (bytes && reg >= 4)) {
+        put_byte(encoded, (uint8_t)(0x40 | (wide ? 8 : 0) | reg >> 3));
+      }
+      put_byte(encoded, (uint8_t)((bytes ? 0xB0 : 0xB8) + (reg & 7)));
+      put_value(encoded, source.value, size_bytes(width));
+    } else if (wide && source.symbol == NULL && !fits_int32(source.value)) {
+      unencodable(instruction);
+    } else {
+      const int size = width == Byte ? 1 : width == Word ? 2 : 4;
+      put_legacy(encoded, prefix, wide, bytes, bytes ? 0xC6 : 0xC7, EXTENSION, destination, size);
+      put_immediate(encoded, source, size, wide ? R_X86_64_32S : R_X86_64_32);
+    }
+  } else if (is_gpr(source)) {
+    put_legacy(encoded, prefix, wide, bytes, bytes ? 0x88 : 0x89, register_field(source), destination, 0);
+  } else if (is_gpr(destination)) {
+    put_legacy(encoded, prefix, wide, bytes, bytes ? 0x8A : 0x8B, register_field(destination), source, 0);
+  } else {
+    unencodable(instruction);
+  }
+}
+
+// the scalar and packed sse arithmetic: `single` and `dual` prefix the single and double precision forms
+void encode_sse(Encoded *encoded, const MachineInstruction *instruction, const uint8_t single, const uint8_t dual,
+                const uint32_t opcode) {
+  const uint8_t prefix = instruction->width == Quad ? dual : single;
+  const Operand *args = instruction->args;
+  if (instruction->operands == 3) {
+    // source, second source, destination: only the packed forms, which have no prefix or 0x66
+    put_vex(encoded, prefix == 0x66 ? VEX_66 : VEX_NONE, MAP_0F, false, args[2].width == Yword,
+            register_field(args[1]), (uint8_t)opcode, register_field(args[2]), args[0], 0);
+  } else {
+    put_legacy(encoded, prefix, false, false, opcode, register_field(args[1]), args[0], 0);
+  }
+}
+
+void encode_instruction(Encoded *encoded, const MachineInstruction *instruction) {
+  const Width width = instruction->width;
+  const Operand *args = instruction->args;
+  const bool wide = width == Quad;
+  switch (instruction->op) {
+  case M_LABEL:
+  case M_COMMENT:
+    break;
+  case M_MOV:
+    encode_mov(encoded, instruction);
+    break;
+  case M_MOVS:
+    // movsx, or movsxd from 32 bits
+    put_legacy(encoded, width == Word ? 0x66 : 0, wide, instruction->width2 == Byte,
+               instruction->width2 == Byte   ? 0x0FBE
+               : instruction->width2 == Word ? 0x0FBF
+                                             : 0x63,
+               register_field(args[1]), args[0], 0);
+    break;
+  case M_LEA:
+    put_legacy(encoded, width == Word ? 0x66 : 0, wide, false, 0x8D, register_field(args[1]), args[0], 0);
+    break;
+  case M_ADD:
+    encode_arithmetic(encoded, instruction, 0x00, 0);
+    break;
+  case M_OR:
+    encode_arithmetic(encoded, instruction, 0x08, 1);
+    break;
+  case M_AND:
+    encode_arithmetic(encoded, instruction, 0x20, 4);
+    break;
+  case M_SUB:
+    encode_arithmetic(encoded, instruction, 0x28, 5);
+    break;
+  case M_XOR:
+    encode_arithmetic(encoded, instruction, 0x30, 6);
+    break;
+  case M_CMP:
+    encode_arithmetic(encoded, instruction, 0x38, 7);
+    break;
+  case M_TEST:
+    if (args[0].type == O_Immediate) {
+      if (wide && args[0].symbol == NULL && !fits_int32(args[0].value)) {
+        unencodable(instruction);
+      }
+      const int size = width == Byte ? 1 : width == Word ? 2 : 4;
+      if (args[1].type == O_Register && args[1].reg == rax) {
+        put_accumulator(encoded, width == Word ? 0x66 : 0, wide, width == Byte ? 0xA8 : 0xA9);
+      } else {
+        put_legacy(encoded, width == Word ? 0x66 : 0, wide, width == Byte, width == Byte ? 0xF6 : 0xF7, EXTENSION,
+                   args[1], size);
+      }
+      put_immediate(encoded, args[0], size, R_X86_64_32S);
+    } else {
+      // either way round
+      const bool flipped = !is_gpr(args[0]);
+      put_legacy(encoded, width == Word ? 0x66 : 0, wide, width == Byte, width == Byte ? 0x84 : 0x85,
+                 register_field(flipped ? args[1] : args[0]), flipped ? args[0] : args[1], 0);
+    }
+    break;
+  case M_IMUL:
+    if (instruction->operands == 1) {
+      encode_unary(encoded, instruction, 5);
+    } else if (args[0].type == O_Immediate) {
+      // the three-operand form, reading and writing the same register
+      if (!is_gpr(args[1]) || (wide && !fits_int32(args[0].value))) {
+        unencodable(instruction);
+      }
+      const bool small = fits_int8(args[0].value);
+      put_legacy(encoded, width == Word ? 0x66 : 0, wide, false, small ? 0x6B : 0x69, register_field(args[1]),
+                 args[1], small ? 1 : width == Word ? 2 : 4);
+      put_value(encoded, args[0].value, small ? 1 : width == Word ? 2 : 4);
+    } else if (is_gpr(args[1])) {
+      put_legacy(encoded, width == Word ? 0x66 : 0, wide, false, 0x0FAF, register_field(args[1]), args[0], 0);
+    } else {
+      unencodable(instruction);
+    }
+    break;
+  case M_MUL:
+    encode_unary(encoded, instruction, 4);
+    break;
+  case M_IDIV:
+    encode_unary(encoded, instruction, 7);
+    break;
+  case M_NOT:
+    encode_unary(encoded, instruction, 2);
+    break;
+  case M_NEG:
+    encode_unary(encoded, instruction, 3);
+    break;
+  case M_CQTO:
+    if (width == Word) {
+      put_byte(encoded, 0x66);
+    } else if (wide) {
+      put_byte(encoded, 0x48);
+    }
+    put_byte(encoded, 0x99);
+    break;
+  case M_SAL:
+  case M_SAR:
+  case M_SHR: {
+    const int extension = instruction->op == M_SAL ? 4 : instruction->op == M_SAR ? 7 : 5;
+    const uint8_t prefix = width == Word ? 0x66 : 0;
+    if (args[0].type == O_Immediate && args[0].value == 1) {
+      put_legacy(encoded, prefix, wide, width == Byte, width == Byte ? 0xD0 : 0xD1, extension | EXTENSION, args[1],
+                 0);
+    } else if (args[0].type == O_Immediate) {
+      put_legacy(encoded, prefix, wide, width == Byte, width == Byte ? 0xC0 : 0xC1, extension | EXTENSION, args[1],
+                 1);
+      put_value(encoded, args[0].value, 1);
+    } else {
+      // by %cl
+      put_legacy(encoded, prefix, wide, width == Byte, width == Byte ? 0xD2 : 0xD3, extension | EXTENSION, args[1],
+                 0);
+    }
+    break;
+  }
+  case M_SHLX:
+  case M_SARX:
+  case M_SHRX:
+    put_vex(encoded,
+            instruction->op == M_SHLX   ? VEX_66
+            : instruction->op == M_SARX ? VEX_F3
+                                        : VEX_F2,
+            MAP_0F38, wide, false, register_field(args[0]), 0xF7, register_field(args[2]), args[1], 0);
+    break;
+  case M_POPCNT:
+  case M_TZCNT:
+  case M_LZCNT:
+    put_legacy(encoded, 0xF3, wide, false,
+               instruction->op == M_POPCNT  ? 0x0FB8
+               : instruction->op == M_TZCNT ? 0x0FBC
+                                            : 0x0FBD,
+               register_field(args[1]), args[0], 0);
+    break;
+  case M_SET:
+    put_legacy(encoded, 0, false, true, 0x0F90 | condition_code(instruction->cond), EXTENSION, args[0], 0);
+    break;
+  case M_JMP:
+  case M_JCC:
+    // written once the layout is known, or relocated against a function (a tail call)
+    encoded->target = -1;
+    if (instruction->op == M_JMP) {
+      put_byte(encoded, 0xE9);
+    } else {
+      put_byte(encoded, 0x0F);
+      put_byte(encoded, 0x80 | condition_code(instruction->cond));
+    }
+    put_fixup(encoded, args[0].symbol, R_X86_64_PLT32, -4);
+    break;
+  case M_CALL:
+    put_byte(encoded, 0xE8);
+    put_fixup(encoded, args[0].symbol, R_X86_64_PLT32, -4);
+    break;
+  case M_RET:
+    put_byte(encoded, 0xC3);
+    break;
+  case M_REP_STOS:
+  case M_REP_MOVS:
+    put_byte(encoded, 0xF3);
+    if (wide) {
+      put_byte(encoded, 0x48);
+    }
+    put_byte(encoded, (uint8_t)((instruction->op == M_REP_STOS ? 0xAA : 0xA4) + (width == Byte ? 0 : 1)));
+    break;
+  case M_MOVDQU: {
+    const bool load = is_xmm(args[1]);
+    const Operand reg = load ? args[1] : args[0];
+    const Operand rm = load ? args[0] : args[1];
+    if (machine_is_vex(instruction)) {
+      put_vex(encoded, VEX_F3, MAP_0F, false, true, 0, load ? 0x6F : 0x7F, register_field(reg), rm, 0);
+    } else {
+      put_legacy(encoded, 0xF3, false, false, load ? 0x0F6F : 0x0F7F, register_field(reg), rm, 0);
+    }
+    break;
+  }
+  case M_PADD:
+  case M_PSUB:
+  case M_PMULL:
+  case M_PAND:
+  case M_POR:
+  case M_PXOR:
+  case M_PANDN:
+  case M_PMULUDQ:
+  case M_PCMPGT:
+  case M_PUNPCKL:
+  case M_PMINS:
+  case M_PMAXS: {
+    const uint32_t opcode = packed_opcode(instruction);
+    if (instruction->operands == 3) {
+      // source, second source, destination
+      put_vex(encoded, VEX_66, opcode > 0xFFFF ? MAP_0F38 : MAP_0F, false, args[2].width == Yword,
+              register_field(args[1]), (uint8_t)opcode, register_field(args[2]), args[0], 0);
+    } else {
+      put_legacy(encoded, 0x66, false, false, opcode, register_field(args[1]), args[0], 0);
+    }
+    break;
+  }
+  case M_ADDS:
+    encode_sse(encoded, instruction, 0xF3, 0xF2, 0x0F58);
+    break;
+  case M_SUBS:
+    encode_sse(encoded, instruction, 0xF3, 0xF2, 0x0F5C);
+    break;
+  case M_MULS:
+    encode_sse(encoded, instruction, 0xF3, 0xF2, 0x0F59);
+    break;
+  case M_DIVS:
+    encode_sse(encoded, instruction, 0xF3, 0xF2, 0x0F5E);
+    break;
+  case M_UCOMIS:
+    encode_sse(encoded, instruction, 0, 0x66, 0x0F2E);
+    break;
+  case M_XORP:
+    encode_sse(encoded, instruction, 0, 0x66, 0x0F57);
+    break;
+  case M_ADDP:
+    encode_sse(encoded, instruction, 0, 0x66, 0x0F58);
+    break;
+  case M_SUBP:
+    encode_sse(encoded, instruction, 0, 0x66, 0x0F5C);
+    break;
+  case M_MULP:
+    encode_sse(encoded, instruction, 0, 0x66, 0x0F59);
+    break;
+  case M_DIVP:
+    encode_sse(encoded, instruction, 0, 0x66, 0x0F5E);
+    break;
+  case M_MINP:
+    encode_sse(encoded, instruction, 0, 0x66, 0x0F5D);
+    break;
+  case M_MAXP:
+    encode_sse(encoded, instruction, 0, 0x66, 0x0F5F);
+    break;
+  case M_CVTSI2S:
+    put_legacy(encoded, wide ? 0xF2 : 0xF3, instruction->width2 == Quad, false, 0x0F2A, register_field(args[1]),
+               args[0], 0);
+    break;
+  case M_CVTTS2SI:
+    put_legacy(encoded, instruction->width2 == Quad ? 0xF2 : 0xF3, wide, false, 0x0F2C, register_field(args[1]),
+               args[0], 0);
+    break;
+  case M_CVTS2S:
+    put_legacy(encoded, instruction->width2 == Quad ? 0xF2 : 0xF3, false, false, 0x0F5A, register_field(args[1]),
+               args[0], 0);
+    break;
+  case M_PSHUFD:
+    put_legacy(encoded, 0x66, false, false, 0x0F70, register_field(args[2]), args[1], 1);
+    put_value(encoded, args[0].value, 1);
+    break;
+  case M_PSRLDQ:
+    put_legacy(encoded, 0x66, false, false, 0x0F73, 3 | EXTENSION, args[1], 1);
+    put_value(encoded, args[0].value, 1);
+    break;
+  case M_VZEROUPPER:
+    put_byte(encoded, 0xC5);
+    put_byte(encoded, 0xF8);
+    put_byte(encoded, 0x77);
+    break;
+  case M_PBROADCAST:
+    put_vex(encoded, VEX_66, MAP_0F38, false, true, 0, wide ? 0x59 : 0x58, register_field(args[1]), args[0], 0);
+    break;
+  case M_EXTRACTI128:
+    put_vex(encoded, VEX_66, MAP_0F3A, false, true, 0, 0x39, register_field(args[1]), args[2], 1);
+    put_value(encoded, args[0].value, 1);
+    break;
+  }
+}
+
+// a local label (.L...) or numbered one (1:, jumped to as 1f or 1b), which only means something within the function
+bool label_local(const char *name) {
+  return strncmp(name, ".L", 2) == 0 || (name[0] >= '0' && name[0] <= '9');
+}
+
+// the label instruction a jump from index lands on, or -1 for a jump out of the function
+int find_label(const MachineInstructionList *code, const int index, const char *name) {
+  const size_t len = strlen(name);
+  if (len > 1 && name[0] >= '0' && name[0] <= '9' && (name[len - 1] == 'f' || name[len - 1] == 'b')) {
+    const int step = name[len - 1] == 'f' ? 1 : -1;
+    for (int i = index + step; i >= 0 && i < code->len; i += step) {
+      const MachineInstruction *label = &code->array[i];
+      if (label->op == M_LABEL && strncmp(label->args[0].symbol, name, len - 1) == 0 &&
+          label->args[0].symbol[len - 1] == '\0')
+        return i;
+    }
+    return -1;
+  }
+  for (int i = 0; i < code->len; ++i) {
+    if (code->array[i].op == M_LABEL && strcmp(code->array[i].args[0].symbol, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+int branch_size(const MachineInstruction *instruction, const Encoded *encoded) {
+  if (encoded->target == -1 || encoded->symbol != NULL)
+    return encoded->len;
+  if (encoded->near)
+    return 2;
+  return instruction->op == M_JMP ? 5 : 6;
+}
+
+void layout(const MachineInstructionList *code, const Encoded *encoded, int *offsets) {
+  int offset = 0;
+  for (int i = 0; i < code->len; ++i) {
+    offsets[i] = offset;
+    offset += branch_size(&code->array[i], &encoded[i]);
+  }
+  offsets[code->len] = offset;
+}
+
+void encode_function(ObjectFile *object, const MachineInstructionList *code) {
+  Encoded *encoded = calloc(code->len, sizeof(Encoded));
+  int *offsets = malloc(sizeof(int) * (code->len + 1));
+  for (int i = 0; i < code->len; ++i) {
+    encoded[i].target = -1;
+    encode_instruction(&encoded[i], &code->array[i]);
+    const MachineOp op = code->array[i].op;
+    if ((op == M_JMP || op == M_JCC) && label_local(code->array[i].args[0].symbol)) {
+      encoded[i].target = find_label(code, i, code->array[i].args[0].symbol);
+      if (encoded[i].target == -1) {
+        printf("undefined label %s\n", code->array[i].args[0].symbol);
+        exit(25);
+      }
+      encoded[i].symbol = NULL;
+    }
+  }
+
+  // every branch starts out with a rel32, and those whose target turns out to be in reach of a rel8 are shortened.
+  // that only ever brings other targets closer, so this stops once no more branches shrink
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    layout(code, encoded, offsets);
+    for (int i = 0; i < code->len; ++i) {
+      if (encoded[i].target == -1 || encoded[i].near)
+        continue;
+      const int displacement = offsets[encoded[i].target] - (offsets[i] + branch_size(&code->array[i], &encoded[i]));
+      // a forward target moves closer by the bytes saved, a backward one stays put while the end of the branch moves
+      const int saved = branch_size(&code->array[i], &encoded[i]) - 2;
+      if (fits_int8(displacement + (encoded[i].target > i ? 0 : saved))) {
+        encoded[i].near = true;
+        changed = true;
+      }
+    }
+  }
+
+  const uint64_t base = object->sections[SECTION_TEXT].len;
+  for (int i = 0; i < code->len; ++i) {
+    const MachineInstruction *instruction = &code->array[i];
+    Encoded *current = &encoded[i];
+    if (instruction->op == M_LABEL && !label_local(instruction->args[0].symbol)) {
+      object_define(object, instruction->args[0].symbol, SECTION_TEXT, base + offsets[i])->function = true;
+    }
+    if (current->target != -1) {
+      const int end = offsets[i] + branch_size(instruction, current);
+      const int displacement = offsets[current->target] - end;
+      const uint8_t cond = condition_code(instruction->cond);
+      if (current->near) {
+        object_append_int(object, SECTION_TEXT, instruction->op == M_JMP ? 0xEB : 0x70 | cond, 1);
+        object_append_int(object, SECTION_TEXT, (uint64_t)displacement, 1);
+      } else {
+        if (instruction->op == M_JMP) {
+          object_append_int(object, SECTION_TEXT, 0xE9, 1);
+        } else {
+          object_append_int(object, SECTION_TEXT, 0x0F, 1);
+          object_append_int(object, SECTION_TEXT, 0x80 | cond, 1);
+        }
+        object_append_int(object, SECTION_TEXT, (uint64_t)displacement, 4);
+      }
+      continue;
+    }
+    if (current->symbol != NULL) {
+      object_relocate(object, SECTION_TEXT, base + offsets[i] + current->fixup, current->symbol, current->type,
+                      current->addend);
+    }
+    object_append(object, SECTION_TEXT, current->bytes, current->len);
+  }
+
+  // the function's own label comes first
+  if (code->len > 0 && code->array[0].op == M_LABEL) {
+    const int symbol = object_symbol(object, code->array[0].args[0].symbol);
+    object->symbols.array[symbol].size = object->sections[SECTION_TEXT].len - base;
+  }
+  free(encoded);
+  free(offsets);
+}
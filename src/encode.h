@@ -0,0 +1,11 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+#include "machine.h"
+#include "object.h"
+
+// assembles a function's instruction stream onto the end of the object's .text. its labels are resolved within the
+// function, except for those that name functions, which become symbols; calls and jumps to anything else are
+// relocated against the symbol they name
+void encode_function(ObjectFile *object, const MachineInstructionList *code);
+
+#endif // ENCODE_H
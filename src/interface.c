@@ -0,0 +1,246 @@
+#include "interface.h"
+
+#include "object.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define INTERFACE_VERSION 1
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t types;
+  uint32_t functions;
+  uint32_t arguments;
+  uint32_t globals;
+  // bytes of names
+  uint32_t strings;
+} InterfaceHeader;
+
+// a pointer's pointee always comes before it
+typedef struct {
+  uint32_t kind;
+  int32_t inner;
+} InterfaceType;
+
+typedef struct {
+  uint32_t name;
+  // -1 for a function that returns nothing
+  int32_t type;
+  uint32_t arguments;
+  uint32_t argumentCount;
+} InterfaceFunction;
+
+// an argument or a global
+typedef struct {
+  uint32_t name;
+  int32_t type;
+} InterfaceVariable;
+
+LIST_API(InterfaceType, itype, InterfaceType)
+LIST_IMPL(InterfaceType, itype, InterfaceType)
+LIST_API(InterfaceFunction, ifunction, InterfaceFunction)
+LIST_IMPL(InterfaceFunction, ifunction, InterfaceFunction)
+LIST_API(InterfaceVariable, ivariable, InterfaceVariable)
+LIST_IMPL(InterfaceVariable, ivariable, InterfaceVariable)
+
+typedef struct {
+  InterfaceTypeList types;
+  InterfaceFunctionList functions;
+  InterfaceVariableList arguments;
+  InterfaceVariableList globals;
+  ByteList strings;
+} InterfaceWriter;
+
+uint32_t write_string(InterfaceWriter *writer, const char *string) {
+  const uint32_t offset = (uint32_t)writer->strings.len;
+  for (const char *c = string; *c != '\0'; ++c) {
+    bytelist_add(&writer->strings, (uint8_t)*c);
+  }
+  bytelist_add(&writer->strings, 0);
+  return offset;
+}
+
+// the index of the type, shared with any identical one already written. structs are not part of an interface, so a
+// pointer to one is written as a pointer to bytes
+int32_t write_type(InterfaceWriter *writer, const Type type) {
+  if (type.kind == aggregate)
+    return write_type(writer, (Type){.kind = u8});
+  const InterfaceType record = {type.kind, type.kind == ptr ? write_type(writer, *type.inner) : -1};
+  for (int i = 0; i < writer->types.len; ++i) {
+    if (writer->types.array[i].kind == record.kind && writer->types.array[i].inner == record.inner)
+      return i;
+  }
+  itypelist_add(&writer->types, record);
+  return writer->types.len - 1;
+}
+
+InterfaceVariable write_variable(InterfaceWriter *writer, const Variable *variable) {
+  const InterfaceVariable record = {write_string(writer, variable->name), write_type(writer, variable->type)};
+  return record;
+}
+
+void interface_write(const FunctionList *functions, const VarList *globals, FILE *output) {
+  InterfaceWriter writer;
+  itypelist_init(&writer.types, 16);
+  ifunctionlist_init(&writer.functions, functions->len + 1);
+  ivariablelist_init(&writer.arguments, 16);
+  ivariablelist_init(&writer.globals, globals->len + 1);
+  bytelist_init(&writer.strings, 256);
+
+  for (int i = 0; i < functions->len; ++i) {
+    const Function *function = &functions->array[i];
+    InterfaceFunction record;
+    record.name = write_string(&writer, function->name);
+    record.type = function->retVal.kind != 0 ? write_type(&writer, function->retVal) : -1;
+    record.arguments = (uint32_t)writer.arguments.len;
+    record.argumentCount = (uint32_t)function->arguments.len;
+    for (int j = 0; j < function->arguments.len; ++j) {
+      ivariablelist_add(&writer.arguments, write_variable(&writer, &function->arguments.array[j]));
+    }
+    ifunctionlist_add(&writer.functions, record);
+  }
+  for (int i = 0; i < globals->len; ++i) {
+    ivariablelist_add(&writer.globals, write_variable(&writer, &globals->array[i]));
+  }
+
+  const InterfaceHeader header = {{'C', 'R', 'S', 'I'},
+                                  INTERFACE_VERSION,
+                                  (uint32_t)writer.types.len,
+                                  (uint32_t)writer.functions.len,
+                                  (uint32_t)writer.arguments.len,
+                                  (uint32_t)writer.globals.len,
+                                  (uint32_t)writer.strings.len};
+  fwrite(&header, sizeof(header), 1, output);
+  fwrite(writer.types.array, sizeof(InterfaceType), writer.types.len, output);
+  fwrite(writer.functions.array, sizeof(InterfaceFunction), writer.functions.len, output);
+  fwrite(writer.arguments.array, sizeof(InterfaceVariable), writer.arguments.len, output);
+  fwrite(writer.globals.array, sizeof(InterfaceVariable), writer.globals.len, output);
+  fwrite(writer.strings.array, 1, writer.strings.len, output);
+
+  free(writer.types.array);
+  free(writer.functions.array);
+  free(writer.arguments.array);
+  free(writer.globals.array);
+  free(writer.strings.array);
+}
+
+// the interface's bytes, which stay mapped for as long as the compiler runs: the names of what it declares point into
+// them
+const uint8_t *map_interface(const char *path, size_t *size) {
+#ifndef _WIN32
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat status;
+  if (fstat(fd, &status) != 0 || status.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  *size = (size_t)status.st_size;
+  void *bytes = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  return bytes != MAP_FAILED ? bytes : NULL;
+#else
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return NULL;
+  fseek(file, 0, SEEK_END);
+  const long len = ftell(file);
+  rewind(file);
+  uint8_t *bytes = len > 0 ? malloc((size_t)len) : NULL;
+  if (bytes != NULL && fread(bytes, 1, (size_t)len, file) != (size_t)len) {
+    free(bytes);
+    bytes = NULL;
+  }
+  fclose(file);
+  *size = (size_t)len;
+  return bytes;
+#endif
+}
+
+bool interface_import(const char *path, FunctionList *functions, VarList *globals, FILE *output) {
+  size_t size;
+  const uint8_t *bytes = map_interface(path, &size);
+  if (bytes == NULL || size < sizeof(InterfaceHeader))
+    return false;
+  InterfaceHeader header;
+  memcpy(&header, bytes, sizeof(header));
+  const uint64_t recordBytes = (uint64_t)header.types * sizeof(InterfaceType) +
+                               (uint64_t)header.functions * sizeof(InterfaceFunction) +
+                               ((uint64_t)header.arguments + header.globals) * sizeof(InterfaceVariable);
+  if (memcmp(header.magic, "CRSI", 4) != 0 || header.version != INTERFACE_VERSION ||
+      sizeof(header) + recordBytes + header.strings != size || header.strings == 0 || bytes[size - 1] != '\0')
+    return false;
+
+  // the records are 4-byte fields and the header is a multiple of 4 bytes, so they are aligned as they lie
+  const InterfaceType *types = (const InterfaceType *)(bytes + sizeof(header));
+  const InterfaceFunction *records = (const InterfaceFunction *)(types + header.types);
+  const InterfaceVariable *arguments = (const InterfaceVariable *)(records + header.functions);
+  const InterfaceVariable *variables = arguments + header.arguments;
+  char *strings = (char *)(variables + header.globals);
+
+  Type *resolved = malloc(sizeof(Type) * (header.types + 1));
+  for (uint32_t i = 0; i < header.types; ++i) {
+    if (types[i].kind < i8 || types[i].kind > f64x4 || (types[i].kind == ptr) != (types[i].inner != -1) ||
+        (types[i].inner != -1 && (types[i].inner < 0 || (uint32_t)types[i].inner >= i))) {
+      free(resolved);
+      return false;
+    }
+    resolved[i].kind = (TypeKind)types[i].kind;
+    resolved[i].inner = types[i].inner != -1 ? &resolved[types[i].inner] : NULL;
+  }
+  // checked in full before anything is declared
+  for (uint32_t i = 0; i < header.functions + header.arguments + header.globals; ++i) {
+    const InterfaceVariable *variable = i < header.functions ? NULL : &arguments[i - header.functions];
+    const uint32_t name = variable != NULL ? variable->name : records[i].name;
+    const int32_t type = variable != NULL ? variable->type : records[i].type;
+    const bool argumentsFit = variable != NULL || (uint64_t)records[i].arguments + records[i].argumentCount <=
+                                                      header.arguments;
+    if (name >= header.strings || type < -1 || type >= (int32_t)header.types || (variable != NULL && type == -1) ||
+        !argumentsFit) {
+      free(resolved);
+      return false;
+    }
+  }
+
+  for (uint32_t i = 0; i < header.functions; ++i) {
+    const InterfaceFunction *record = &records[i];
+    if (functionlist_indexof(functions, strings + record->name) != -1)
+      continue;
+    Function function;
+    function_init(&function);
+    function.name = strings + record->name;
+    if (record->type != -1) {
+      function.retVal = resolved[record->type];
+    }
+    for (uint32_t j = 0; j < record->argumentCount; ++j) {
+      const InterfaceVariable *argument = &arguments[record->arguments + j];
+      const Variable variable = {strings + argument->name, resolved[argument->type]};
+      varlist_add(&function.arguments, variable);
+    }
+    functionlist_add(functions, function);
+    if (output != NULL) {
+      fprintf(output, ".extern %s\n", function.name);
+    }
+  }
+  for (uint32_t i = 0; i < header.globals; ++i) {
+    if (varlist_indexof(globals, strings + variables[i].name) != -1)
+      continue;
+    const Variable variable = {strings + variables[i].name, resolved[variables[i].type]};
+    varlist_add(globals, variable);
+    if (output != NULL) {
+      fprintf(output, ".extern %s\n", variable.name);
+    }
+  }
+  return true;
+}
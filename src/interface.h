@@ -0,0 +1,18 @@
+#ifndef INTERFACE_H
+#define INTERFACE_H
+#include "ast.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// a module's declarations, written out by --emit=interface and brought in by `import "<path>";` without tokenizing
+// or parsing anything: fixed-size records for the types, functions (and their arguments) and globals, then the
+// names they point into
+
+// writes the signature of every function and global the module knows of
+void interface_write(const FunctionList *functions, const VarList *globals, FILE *output);
+// declares everything in the interface at path as externs, skipping names already declared. false when it cannot be
+// read or is not an interface
+bool interface_import(const char *path, FunctionList *functions, VarList *globals, FILE *output);
+
+#endif // INTERFACE_H
@@ -0,0 +1,849 @@
+#include "interpret.h"
+
+#include "ir.h"
+#include "jit.h"
+#include "options.h"
+#include "parse.h"
+
+#include <signal.h>
+#include <string.h>
+
+// where an operand of an interpreted instruction is
+typedef enum {
+  A_None,
+  // a slot of the frame
+  A_Local,
+  // memory at the pointer in a slot, plus the index slot times scale, plus disp
+  A_Memory,
+  A_Integer,
+  A_Float
+} AccessKind;
+
+typedef struct {
+  AccessKind kind;
+  // the type of the value in the slot or memory
+  TypeKind type;
+  int slot;
+  int index; // -1 without one
+  TypeKind indexType;
+  uint8_t scale;
+  int32_t disp;
+  int64_t integer;
+  double real;
+} Access;
+
+// an instruction of the lowered function with its references resolved to frame slots, its constants parsed and its
+// labels turned into instruction indices
+typedef struct {
+  InstructionType type;
+  Access inputs[2];
+  Access output;
+  // the width compared by CMP and TEST
+  Width width;
+  // where a jump goes
+  int target;
+  // the vector length of the V* instructions, in bytes
+  int bytes;
+  // the function a call goes to, by index, and its arguments
+  int callee;
+  Access *arguments;
+} Op;
+
+LIST_API(Op, op, Op)
+LIST_IMPL(Op, op, Op)
+
+typedef struct {
+  Function *function;
+  OpList code;
+  int slots;
+  bool lowered;
+  // calls to the function, and backwards jumps taken inside it
+  int heat;
+  // the function can only run compiled: it uses vectors or globals
+  bool compileOnly;
+  // the compiled function, or the extern, called in place of interpreting it
+  void *native;
+} Tier;
+
+// the flags of the last comparison. unordered floating point operands set none but `unordered`
+typedef struct {
+  bool less;
+  bool equal;
+  bool greater;
+  bool unordered;
+} Flags;
+
+typedef int64_t (*IntegerCall)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, ...);
+typedef double (*RealCall)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, ...);
+
+struct {
+  const char *contents;
+  VarList *globals;
+  FunctionList *functions;
+  LiteralPool *literals;
+  Tier *tiers;
+  // strings and globals
+  JitImage data;
+  // each batch of compiled functions
+  PtrList images;
+} program;
+
+typedef struct {
+  Tier *tier;
+  // the allocation of each slot
+  PtrList slots;
+  // the instruction index of each label
+  int *labels;
+} Translation;
+
+int translate_slot(Translation *translation, Allocation *allocation) {
+  int slot = ptrlist_indexof(&translation->slots, allocation);
+  if (slot == -1) {
+    ptrlist_add(&translation->slots, allocation);
+    slot = translation->slots.len - 1;
+  }
+  return slot;
+}
+
+Access translate_reference(Translation *translation, const Reference reference) {
+  Access access;
+  memset(&access, 0, sizeof(access));
+  access.index = -1;
+  switch (reference.access) {
+  case Direct:
+  case Dereference:
+    access.kind = reference.access == Direct ? A_Local : A_Memory;
+    // address arithmetic dereferences plain integers, whose "pointee" is never read
+    access.type = reference.access == Dereference && reference.allocation->type.kind != ptr
+                      ? reference.allocation->type.kind
+                      : reference_type(reference).kind;
+    access.slot = translate_slot(translation, reference.allocation);
+    if (reference.access == Dereference && reference.index != NULL) {
+      access.index = translate_slot(translation, reference.index);
+      access.indexType = reference.index->type.kind;
+    }
+    access.scale = reference.scale;
+    access.disp = reference.disp;
+    translation->tier->compileOnly |= is_vector(access.type) || is_vector(reference.allocation->type.kind);
+    break;
+  case ConstantI:
+    access.kind = A_Integer;
+    reference_constant(reference, &access.integer);
+    break;
+  case ConstantF:
+    access.kind = A_Float;
+    reference_constant_f(reference, &access.real);
+    break;
+  case ConstantS: {
+    char name[32];
+    snprintf(name, sizeof(name), ".L.STR%i", reference.str);
+    access.kind = A_Integer;
+    access.integer = (int64_t)(uintptr_t)jit_symbol(&program.data, name);
+    break;
+  }
+  case Global:
+  case GlobalRef:
+    translation->tier->compileOnly = true;
+    break;
+  default:
+    break;
+  }
+  return access;
+}
+
+bool instruction_is_jump(const InstructionType type) {
+  return type == JMP || type == JE || type == JNE || type == JG || type == JL || type == JGE || type == JLE;
+}
+
+// lays the tables out in the order code generation does: the blocks jumped to before a label, then the label
+void translate_table(Translation *translation, InstructionTable *table) {
+  for (int i = 0; i < table->instructions.len; ++i) {
+    Instruction *instruction = &table->instructions.array[i];
+    if (instruction->type == LABEL) {
+      for (int j = 0; j < i; ++j) {
+        Instruction *jump = &table->instructions.array[j];
+        if (instruction_is_jump(jump->type) && jump->instructions.parent != NULL && !jump->processed) {
+          jump->processed = true;
+          translate_table(translation, &jump->instructions);
+        }
+      }
+      translation->labels[instruction->label] = translation->tier->code.len;
+      continue;
+    }
+    Op *op = oplist_grow(&translation->tier->code);
+    memset(op, 0, sizeof(Op));
+    op->type = instruction->type;
+    if (instruction_is_jump(instruction->type)) {
+      op->target = instruction->label;
+      continue;
+    }
+    switch (instruction->type) {
+    case CALL:
+    case TAILCALL: {
+      const Function *function = instruction->function;
+      op->callee = (int)(function - program.functions->array);
+      op->arguments = malloc(sizeof(Access) * (function->arguments.len + 1));
+      for (int j = 0; j < function->arguments.len; ++j) {
+        op->arguments[j] = translate_reference(translation, instruction->arguments[j]);
+      }
+      if (instruction->type == CALL && function->retVal.kind != 0) {
+        op->output = translate_reference(translation, instruction->retVal);
+      }
+      break;
+    }
+    case EXTRACT:
+    case INSERT:
+    case REDUCE_ADD:
+    case REDUCE_MIN:
+    case REDUCE_MAX:
+      translation->tier->compileOnly = true;
+      break;
+    default: {
+      op->inputs[0] = translate_reference(translation, instruction->inputs[0]);
+      op->inputs[1] = translate_reference(translation, instruction->inputs[1]);
+      op->output = translate_reference(translation, instruction->output);
+      if (instruction->type == CMP || instruction->type == TEST) {
+        op->width = type_width(ref_infer_type(instruction->inputs[0], instruction->inputs[1]));
+      }
+      int64_t bytes = 16;
+      reference_constant(instruction->inputs[1], &bytes);
+      op->bytes = (int)bytes;
+      break;
+    }
+    }
+  }
+}
+
+void tier_lower(Tier *tier) {
+  InstructionTable table;
+  jit_redirect_output();
+  const Result result = lower_function(program.contents, tier->function, program.globals, program.functions,
+                                       program.literals, &table);
+  if (!successful(result)) {
+    printf("failed to lower %s\n", tier->function->name);
+    exit(25);
+  }
+
+  Translation translation;
+  translation.tier = tier;
+  ptrlist_init(&translation.slots, table.allocations.len + 1);
+  // the arguments come first, where the caller puts them
+  for (int i = 0; i < tier->function->arguments.len; ++i) {
+    translate_slot(&translation, table.allocations.array[i]);
+  }
+  translation.labels = calloc(*table.sections + 1, sizeof(int));
+  oplist_init(&tier->code, table.instructions.len + 1);
+  translate_table(&translation, &table);
+  for (int i = 0; i < tier->code.len; ++i) {
+    if (instruction_is_jump(tier->code.array[i].type)) {
+      tier->code.array[i].target = translation.labels[tier->code.array[i].target];
+    }
+  }
+  tier->slots = translation.slots.len;
+  tier->lowered = true;
+  free(translation.labels);
+  free(translation.slots.array);
+  instructiontable_free(&table);
+  jit_restore_output();
+}
+
+void *tier_resolve(const char *name, void *context) {
+  void *address = jit_symbol(&program.data, name);
+  for (int i = 0; address == NULL && i < program.functions->len; ++i) {
+    const Tier *tier = &program.tiers[i];
+    if (tier->native != NULL && tier->function->start != NULL && strcmp(tier->function->name, name) == 0) {
+      address = tier->native;
+    }
+  }
+  return address;
+}
+
+// compiles the function along with every function it can reach that is still interpreted, as compiled code only
+// calls compiled code. a call already being interpreted carries on there, the next one runs the compiled function
+void tier_compile(const int index) {
+  PtrList closure;
+  ptrlist_init(&closure, 4);
+  ptrlist_add(&closure, program.tiers[index].function);
+  for (int i = 0; i < closure.len; ++i) {
+    const Function *function = closure.array[i];
+    PtrList callees;
+    ptrlist_init(&callees, 4);
+    for (int j = 0; j < function->body->len; ++j) {
+      ast_collect_calls(&function->body->array[j], &callees);
+    }
+    for (int j = 0; j < callees.len; ++j) {
+      const Function *callee = callees.array[j];
+      if (callee->start != NULL && program.tiers[callee - program.functions->array].native == NULL &&
+          ptrlist_indexof(&closure, callee) == -1) {
+        ptrlist_add(&closure, callees.array[j]);
+      }
+    }
+    free(callees.array);
+  }
+
+  jit_redirect_output();
+  ObjectFile object;
+  object_init(&object);
+  for (int i = 0; i < closure.len; ++i) {
+    const Result result = parse_function(program.contents, closure.array[i], program.globals, program.functions,
+                                         program.literals, NULL, &object);
+    if (!successful(result)) {
+      printf("failed to compile %s\n", ((Function *)closure.array[i])->name);
+      exit(25);
+    }
+  }
+  JitImage *image = malloc(sizeof(JitImage));
+  jit_load(image, &object, tier_resolve, NULL);
+  ptrlist_add(&program.images, image);
+  for (int i = 0; i < closure.len; ++i) {
+    const Function *function = closure.array[i];
+    program.tiers[function - program.functions->array].native = jit_symbol(image, function->name);
+  }
+  object_free(&object);
+  free(closure.array);
+  jit_restore_output();
+}
+
+int64_t extend(const uint64_t value, const Width width) {
+  switch (width) {
+  case Byte:
+    return (int8_t)value;
+  case Word:
+    return (int16_t)value;
+  case Long:
+    return (int32_t)value;
+  default:
+    return (int64_t)value;
+  }
+}
+
+bool access_allocated(const Access *access) {
+  return access->kind == A_Local || access->kind == A_Memory;
+}
+
+uint8_t *access_address(uint64_t *frame, const Access *access) {
+  if (access->kind == A_Local)
+    return (uint8_t *)&frame[access->slot];
+  uint8_t *address = (uint8_t *)(uintptr_t)frame[access->slot];
+  if (access->index != -1) {
+    address += extend(frame[access->index], typekind_width(access->indexType)) * access->scale;
+  }
+  return address + access->disp;
+}
+
+// the value, sign extended from its width (floating point values as their bits)
+uint64_t load(uint64_t *frame, const Access *access) {
+  switch (access->kind) {
+  case A_Local:
+  case A_Memory: {
+    const uint8_t *address = access_address(frame, access);
+    const int size = typekind_size(access->type);
+    uint64_t value = 0;
+    memcpy(&value, address, size);
+    return (uint64_t)extend(value, typekind_width(access->type));
+  }
+  case A_Integer:
+    return (uint64_t)access->integer;
+  case A_Float:
+    return (uint64_t)(int64_t)access->real;
+  default:
+    return 0;
+  }
+}
+
+// writes the low bytes of the value. slots keep it sign extended, like load returns it
+void store(uint64_t *frame, const Access *access, const uint64_t value) {
+  if (access->kind == A_Local) {
+    frame[access->slot] = (uint64_t)extend(value, typekind_width(access->type));
+  } else if (access->kind == A_Memory) {
+    memcpy(access_address(frame, access), &value, typekind_size(access->type));
+  }
+}
+
+double load_real(uint64_t *frame, const Access *access) {
+  if (access->kind == A_Float)
+    return access->real;
+  if (!access_allocated(access))
+    return (double)(int64_t)load(frame, access);
+  const uint64_t bits = load(frame, access);
+  if (access->type == f32) {
+    const uint32_t single = (uint32_t)bits;
+    float value;
+    memcpy(&value, &single, sizeof(value));
+    return value;
+  }
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void store_real(uint64_t *frame, const Access *access, const double value) {
+  if (access->type == f32) {
+    const float single = (float)value;
+    uint32_t bits;
+    memcpy(&bits, &single, sizeof(bits));
+    store(frame, access, bits);
+    return;
+  }
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  store(frame, access, bits);
+}
+
+// cvtts2si: truncates towards zero, giving the "integer indefinite" value (the lowest one) out of range and for NaN
+int64_t truncate_real(const double value, const Width width) {
+  if (width == Long)
+    return value > -2147483649.0 && value < 2147483648.0 ? (int32_t)value : INT32_MIN;
+  return value >= -9223372036854775808.0 && value < 9223372036854775808.0 ? (int64_t)value : INT64_MIN;
+}
+
+// moves and converts the way code generation's MOV does: integers sign extend (or truncate) to the destination,
+// and only integers to floating point values zero extend an unsigned 32-bit source
+void interpret_move(uint64_t *frame, const Access *from, const Access *to) {
+  const bool fromFp = from->kind == A_Float || (access_allocated(from) && is_fp(from->type));
+  if ((!fromFp && !is_fp(to->type)) || (access_allocated(from) && from->type == to->type)) {
+    store(frame, to, load(frame, from));
+    return;
+  }
+  if (!is_fp(to->type)) {
+    const Width width = typekind_width(to->type);
+    store(frame, to, (uint64_t)truncate_real(load_real(frame, from), width >= Long ? width : Quad));
+    return;
+  }
+  if (fromFp || !access_allocated(from)) {
+    store_real(frame, to, load_real(frame, from));
+    return;
+  }
+  int64_t value = (int64_t)load(frame, from);
+  if (typekind_width(from->type) == Long && typekind_unsigned(from->type)) {
+    value = (int64_t)(uint32_t)value;
+  }
+  if (to->type == f32) {
+    store_real(frame, to, (float)value);
+  } else {
+    store_real(frame, to, (double)value);
+  }
+}
+
+uint64_t arithmetic(const InstructionType type, const uint64_t a, const uint64_t b) {
+  switch (type) {
+  case ADD:
+    return a + b;
+  case SUB:
+    return a - b;
+  case IMUL:
+    return a * b;
+  case AND:
+    return a & b;
+  case OR:
+    return a | b;
+  default:
+    return a ^ b;
+  }
+}
+
+double arithmetic_real(const InstructionType type, const double a, const double b) {
+  switch (type) {
+  case ADD:
+    return a + b;
+  case SUB:
+    return a - b;
+  case IMUL:
+    return a * b;
+  default:
+    return a / b;
+  }
+}
+
+float arithmetic_single(const InstructionType type, const float a, const float b) {
+  switch (type) {
+  case ADD:
+    return a + b;
+  case SUB:
+    return a - b;
+  case IMUL:
+    return a * b;
+  default:
+    return a / b;
+  }
+}
+
+// the high 64 bits of the unsigned 128-bit product, from 32-bit halves
+uint64_t multiply_high(const uint64_t a, const uint64_t b) {
+  const uint64_t low = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+  const uint64_t cross1 = (a >> 32) * (b & 0xFFFFFFFF) + (low >> 32);
+  const uint64_t cross2 = (a & 0xFFFFFFFF) * (b >> 32) + (cross1 & 0xFFFFFFFF);
+  return (a >> 32) * (b >> 32) + (cross1 >> 32) + (cross2 >> 32);
+}
+
+uint64_t shift(const InstructionType type, const uint64_t value, const Width width, const uint64_t amount) {
+  const int count = (int)(amount & (width == Quad ? 63 : 31));
+  switch (type) {
+  case SAL:
+    return value << count;
+  case SAR:
+    return (uint64_t)((int64_t)value >> count);
+  default: {
+    const uint64_t mask = width == Quad ? UINT64_MAX : (1ULL << size_bytes(width) * 8) - 1;
+    return (value & mask) >> count;
+  }
+  }
+}
+
+bool condition(const Flags flags, const InstructionType type) {
+  switch (type) {
+  case SETE:
+  case JE:
+    return flags.equal && !flags.unordered;
+  case SETNE:
+  case JNE:
+    return !flags.equal || flags.unordered;
+  case SETL:
+  case JL:
+    return flags.less || flags.unordered;
+  case SETG:
+  case JG:
+    return flags.greater;
+  case SETLE:
+  case JLE:
+    return flags.less || flags.equal || flags.unordered;
+  default:
+    return flags.greater || flags.equal;
+  }
+}
+
+Flags compare(const int64_t left, const int64_t right) {
+  return (Flags){.less = left < right, .equal = left == right, .greater = left > right, .unordered = false};
+}
+
+void vector_lanes_op(const InstructionType type, uint8_t *vector, const uint8_t *memory, const int bytes,
+                     const int size) {
+  for (int i = 0; i < bytes; i += size) {
+    uint64_t a = 0;
+    uint64_t b = 0;
+    memcpy(&a, vector + i, size);
+    memcpy(&b, memory + i, size);
+    const uint64_t value = arithmetic(type == VADD    ? ADD
+                                      : type == VSUB  ? SUB
+                                      : type == VMULL ? IMUL
+                                      : type == VAND  ? AND
+                                      : type == VOR   ? OR
+                                                      : XOR,
+                                      a, b);
+    memcpy(vector + i, &value, size);
+  }
+}
+
+uint64_t tier_call(int index, const uint64_t *arguments);
+uint64_t call_native(const Tier *tier, const uint64_t *arguments);
+
+// gets a function ready to be called, returning whether it is to be interpreted rather than called natively
+bool tier_enter(const int index) {
+  Tier *tier = &program.tiers[index];
+  if (tier->native == NULL && tier->function->start == NULL) {
+    tier->native = jit_extern(tier->function->name);
+  }
+  if (tier->native == NULL && !tier->lowered && tier->heat < options.tierThreshold) {
+    tier_lower(tier);
+  }
+  if (tier->native == NULL && (tier->compileOnly || tier->heat >= options.tierThreshold)) {
+    tier_compile(index);
+  }
+  if (tier->native != NULL)
+    return false;
+  tier->heat++;
+  return true;
+}
+
+// the value a call passes for the argument: integers sign extended, floating point values as their bits
+uint64_t argument_value(uint64_t *frame, const Access *access, const Type type) {
+  if (is_fp(type.kind) && !access_allocated(access)) {
+    uint64_t bits;
+    if (type.kind == f32) {
+      const float single = (float)load_real(frame, access);
+      uint32_t pattern;
+      memcpy(&pattern, &single, sizeof(pattern));
+      return pattern;
+    }
+    const double value = load_real(frame, access);
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+  return load(frame, access);
+}
+
+uint64_t interpret(int index, const uint64_t *arguments) {
+  Tier *tier = &program.tiers[index];
+  const Function *function = tier->function;
+  uint64_t *frame = calloc(tier->slots + 1, sizeof(uint64_t));
+  memcpy(frame, arguments, sizeof(uint64_t) * function->arguments.len);
+  Flags flags = {false, false, false, false};
+  // %xmm0 or %ymm0, for the V* instructions
+  uint8_t vector[32];
+  uint64_t result = 0;
+
+  for (int pc = 0; pc < tier->code.len;) {
+    const Op *op = &tier->code.array[pc++];
+    switch (op->type) {
+    case NEG:
+      if (is_fp(op->output.type)) {
+        store(frame, &op->output, load(frame, &op->output) ^ (op->output.type == f32 ? 1ULL << 31 : 1ULL << 63));
+      } else {
+        store(frame, &op->output, 0 - load(frame, &op->output));
+      }
+      break;
+    case NOT:
+      store(frame, &op->output, ~load(frame, &op->inputs[0]));
+      break;
+    case SETE:
+    case SETL:
+    case SETG:
+    case SETNE:
+    case SETLE:
+    case SETGE:
+      store(frame, &op->output, condition(flags, op->type));
+      break;
+    case JMP:
+    case JE:
+    case JNE:
+    case JG:
+    case JL:
+    case JGE:
+    case JLE:
+      if (op->type == JMP || condition(flags, op->type)) {
+        if (op->target < pc && tier->native == NULL && ++tier->heat >= options.tierThreshold) {
+          tier_compile(index);
+        }
+        pc = op->target;
+      }
+      break;
+    case CALL:
+    case TAILCALL: {
+      const Function *callee = &program.functions->array[op->callee];
+      uint64_t *values = malloc(sizeof(uint64_t) * (callee->arguments.len + 1));
+      for (int i = 0; i < callee->arguments.len; ++i) {
+        values[i] = argument_value(frame, &op->arguments[i], callee->arguments.array[i].type);
+      }
+      if (op->type == TAILCALL && tier_enter(op->callee)) {
+        // an interpreted tail call takes over this frame, rather than nesting another on the stack
+        index = op->callee;
+        tier = &program.tiers[index];
+        function = tier->function;
+        free(frame);
+        frame = calloc(tier->slots + 1, sizeof(uint64_t));
+        memcpy(frame, values, sizeof(uint64_t) * function->arguments.len);
+        free(values);
+        pc = 0;
+        break;
+      }
+      const uint64_t value = op->type == TAILCALL ? call_native(&program.tiers[op->callee], values)
+                                                  : tier_call(op->callee, values);
+      free(values);
+      if (op->type == TAILCALL) {
+        free(frame);
+        return value;
+      }
+      store(frame, &op->output, value);
+      break;
+    }
+    case RET:
+      result = load(frame, &op->inputs[0]);
+      free(frame);
+      return result;
+    case MOV:
+      interpret_move(frame, &op->inputs[0], &op->output);
+      break;
+    case LEA:
+      store(frame, &op->output, (uint64_t)(uintptr_t)access_address(frame, &op->inputs[0]));
+      break;
+    case ADD:
+    case SUB:
+    case IMUL:
+    case FDIV:
+    case AND:
+    case OR:
+    case XOR:
+      if (op->output.type == f32) {
+        const float value = arithmetic_single(op->type, (float)load_real(frame, &op->output),
+                                              (float)load_real(frame, &op->inputs[0]));
+        store_real(frame, &op->output, value);
+      } else if (op->output.type == f64) {
+        store_real(frame, &op->output,
+                   arithmetic_real(op->type, load_real(frame, &op->output), load_real(frame, &op->inputs[0])));
+      } else {
+        const uint64_t value = arithmetic(op->type, load(frame, &op->output), load(frame, &op->inputs[0]));
+        store(frame, &op->output, value);
+        // the jump that follows a boolean && or || tests the flags the operation itself left behind
+        flags = compare(extend(value, typekind_width(op->output.type)), 0);
+      }
+      break;
+    case IDIV:
+    case IDIV_mod: {
+      const Width width = typekind_width(op->inputs[0].type);
+      const int64_t dividend = extend(load(frame, &op->inputs[0]), width);
+      const int64_t divisor = extend(load(frame, &op->inputs[1]), width);
+      // idiv faults on both, which the program sees as SIGFPE
+      if (divisor == 0 || (divisor == -1 && dividend == extend(1ULL << (size_bytes(width) * 8 - 1), width))) {
+        raise(SIGFPE);
+      }
+      store(frame, &op->output, (uint64_t)(op->type == IDIV ? dividend / divisor : dividend % divisor));
+      break;
+    }
+    case MULH:
+    case UMULH: {
+      const uint64_t a = load(frame, &op->inputs[0]);
+      const uint64_t b = load(frame, &op->inputs[1]);
+      uint64_t high = multiply_high(a, b);
+      if (op->type == MULH) {
+        // the signed product borrows the other operand from the high half for each negative one
+        high -= ((int64_t)a < 0 ? b : 0) + ((int64_t)b < 0 ? a : 0);
+      }
+      store(frame, &op->output, high);
+      break;
+    }
+    case SAL:
+    case SAR:
+    case SHR:
+      store(frame, &op->output,
+            shift(op->type, load(frame, &op->output), typekind_width(op->output.type), load(frame, &op->inputs[0])));
+      break;
+    case POPCNT:
+    case TZCNT:
+    case LZCNT: {
+      const uint64_t value = load(frame, &op->inputs[0]);
+      int count;
+      if (op->type == POPCNT) {
+        count = __builtin_popcountll(value);
+      } else if (value == 0) {
+        count = 64;
+      } else {
+        count = op->type == TZCNT ? __builtin_ctzll(value) : __builtin_clzll(value);
+      }
+      store(frame, &op->output, (uint64_t)count);
+      break;
+    }
+    case CMP:
+      if (access_allocated(&op->inputs[1]) && is_fp(op->inputs[1].type)) {
+        const double left = load_real(frame, &op->inputs[1]);
+        const double right = load_real(frame, &op->inputs[0]);
+        flags = (Flags){.less = left < right,
+                        .equal = left == right,
+                        .greater = left > right,
+                        .unordered = left != left || right != right};
+      } else {
+        flags = compare(extend(load(frame, &op->inputs[1]), op->width), extend(load(frame, &op->inputs[0]), op->width));
+      }
+      break;
+    case TEST:
+      flags = compare(extend(load(frame, &op->inputs[0]) & load(frame, &op->inputs[1]), op->width), 0);
+      break;
+    case VZERO:
+      memset(vector, 0, sizeof(vector));
+      break;
+    case VLOAD:
+      memcpy(vector, access_address(frame, &op->inputs[0]), op->bytes);
+      break;
+    case VADD:
+    case VSUB:
+    case VMULL:
+    case VAND:
+    case VOR:
+    case VXOR:
+      vector_lanes_op(op->type, vector, access_address(frame, &op->inputs[0]), op->bytes,
+                      typekind_size(op->inputs[0].type));
+      break;
+    case VSTORE:
+      memcpy(access_address(frame, &op->output), vector, op->bytes);
+      break;
+    case REP_STOS:
+      memset((void *)(uintptr_t)load(frame, &op->inputs[0]), (int)(load(frame, &op->inputs[1]) & 0xFF),
+             (size_t)op->output.integer);
+      break;
+    case REP_MOVS:
+      memcpy((void *)(uintptr_t)load(frame, &op->inputs[0]), (const void *)(uintptr_t)load(frame, &op->inputs[1]),
+             (size_t)op->output.integer);
+      break;
+    default:
+      break;
+    }
+  }
+  // falling off the end of the function
+  free(frame);
+  return result;
+}
+
+uint64_t call_native(const Tier *tier, const uint64_t *arguments) {
+  const Function *function = tier->function;
+  int64_t integers[6] = {0};
+  double reals[8] = {0};
+  int integerCount = 0;
+  int realCount = 0;
+  for (int i = 0; i < function->arguments.len; ++i) {
+    if (is_sse(function->arguments.array[i].type.kind) ? realCount == 8 : integerCount == 6) {
+      printf("%s takes too many arguments to be called from interpreted code\n", function->name);
+      exit(25);
+    }
+    if (is_sse(function->arguments.array[i].type.kind)) {
+      memcpy(&reals[realCount++], &arguments[i], sizeof(double));
+    } else {
+      integers[integerCount++] = (int64_t)arguments[i];
+    }
+  }
+  // variadic, so that %al says how many vector registers are used, for the callees that need to know
+  if (is_fp(function->retVal.kind)) {
+    RealCall call;
+    memcpy(&call, &tier->native, sizeof(call));
+    const double value = call(integers[0], integers[1], integers[2], integers[3], integers[4], integers[5], reals[0],
+                              reals[1], reals[2], reals[3], reals[4], reals[5], reals[6], reals[7]);
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+  IntegerCall call;
+  memcpy(&call, &tier->native, sizeof(call));
+  return (uint64_t)call(integers[0], integers[1], integers[2], integers[3], integers[4], integers[5], reals[0],
+                        reals[1], reals[2], reals[3], reals[4], reals[5], reals[6], reals[7]);
+}
+
+uint64_t tier_call(const int index, const uint64_t *arguments) {
+  if (tier_enter(index))
+    return interpret(index, arguments);
+  return call_native(&program.tiers[index], arguments);
+}
+
+int interpret_run(const char *contents, VarList *globals, FunctionList *functions, LiteralPool *literals,
+                  const ObjectFile *data, const int argc, char **argv) {
+  program.contents = contents;
+  program.globals = globals;
+  program.functions = functions;
+  program.literals = literals;
+  program.tiers = calloc(functions->len + 1, sizeof(Tier));
+  for (int i = 0; i < functions->len; ++i) {
+    program.tiers[i].function = &functions->array[i];
+  }
+  ptrlist_init(&program.images, 2);
+  jit_load(&program.data, data, NULL, NULL);
+
+  const int entry = functionlist_indexof(functions, "main");
+  if (entry == -1 || functions->array[entry].start == NULL) {
+    puts("no main function to run");
+    exit(25);
+  }
+  uint64_t *arguments = calloc(functions->array[entry].arguments.len + 2, sizeof(uint64_t));
+  arguments[0] = (uint64_t)argc;
+  arguments[1] = (uint64_t)(uintptr_t)argv;
+
+  jit_restore_output();
+  const int result = (int)tier_call(entry, arguments);
+  fflush(stdout);
+
+  free(arguments);
+  for (int i = 0; i < program.images.len; ++i) {
+    jit_unload(program.images.array[i]);
+    free(program.images.array[i]);
+  }
+  jit_unload(&program.data);
+  free(program.images.array);
+  free(program.tiers);
+  return result;
+}
@@ -0,0 +1,13 @@
+#ifndef INTERPRET_H
+#define INTERPRET_H
+#include "ast.h"
+#include "pool.h"
+#include "object.h"
+
+// runs the program from its main by interpreting each function's lowered instructions, compiling a function into
+// memory once it has been called or looped options.tierThreshold times. data holds everything but the functions
+// (strings and globals), and the program's result is returned
+int interpret_run(const char *contents, VarList *globals, FunctionList *functions, LiteralPool *literals,
+                  const ObjectFile *data, int argc, char **argv);
+
+#endif // INTERPRET_H
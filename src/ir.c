@@ -1,13 +1,29 @@
 #include "ir.h"
 
+#include "options.h"
 #include "register.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 int nextInstrId = 0;
 
 LIST_IMPL(Instruction, inst, Instruction)
+LIST_IMPL(Hoisted, hoisted, Hoisted)
+LIST_IMPL(Induction, induction, Induction)
+LIST_IMPL(Available, available, Available)
+
+// state of the while loops currently being lowered, innermost last
+HoistedList hoisted = {.array = NULL};
+InductionList inductions = {.array = NULL};
+// variables whose address is taken inside an enclosing loop
+PtrList addressed = {.array = NULL};
+int loopDepth = 0;
+// functions whose bodies are currently being expanded into the caller, innermost last
+PtrList inlining = {.array = NULL};
+// lowering visits blocks in dominator order, so scoping this to each block body gives dominator-based value numbering
+AvailableList available = {.array = NULL};
 
 bool isAllocated(const AccessType type) {
   return type == Direct || type == Dereference;
@@ -21,6 +37,11 @@ void instructiontable_init(InstructionTable *table, char *name) {
   table->parentCutoff = 0;
   table->sections = malloc(sizeof(int));
   *table->sections = 0;
+  table->addressTaken = false;
+  ptrlist_init(&table->pointedTo, 2);
+  ptrlist_init(&table->escaped, 2);
+  // a new function starts with nothing available
+  available.len = 0;
 }
 
 void instructiontable_child(InstructionTable *table, const InstructionTable *parent, int escape) {
@@ -31,20 +52,39 @@ void instructiontable_child(InstructionTable *table, const InstructionTable *par
   table->sections = parent->sections;
   table->parentCutoff = parent->allocations.len;
   table->escape = escape;
+  table->addressTaken = parent->addressTaken;
+  table->pointedTo = parent->pointedTo;
+  table->escaped = parent->escaped;
   for (int i = 0; i < parent->allocations.len; ++i) {
     ptrlist_add(&table->allocations, parent->allocations.array[i]);
   }
 }
 
+// integers and pointers go in rdi, rsi, rdx, rcx, r8 and r9, floating point values and vectors in xmm0 through
+// xmm7, each in order of appearance, and whatever does not fit on the stack (-1)
+int8_t argument_register(const Function *function, const int index) {
+  int integers = 0;
+  int floats = 0;
+  for (int i = 0; i < index; ++i) {
+    if (is_sse(function->arguments.array[i].type.kind)) {
+      floats++;
+    } else {
+      integers++;
+    }
+  }
+  if (is_sse(function->arguments.array[index].type.kind)) {
+    return floats < 8 ? fpArgumentRegisters[floats] : -1;
+  }
+  return integers < 6 ? argumentRegisters[integers] : -1;
+}
+
 void table_allocate_arguments(InstructionTable *table, const Function *function) {
-  // rdi, rsi, rdx, rcx, r8, r9, <stack>
   int16_t offset = 0;
   for (int i = 0; i < function->arguments.len; i++) {
     Allocation *allocation = table_allocate(table, function->arguments.array[i].type);
     allocation->source.prop = FnArgument;
-    if (i < 6) {
-      allocation->source.reg = argumentRegisters[i];
-    } else {
+    allocation->source.reg = argument_register(function, i);
+    if (allocation->source.reg == -1) {
       offset += (int16_t)size_bytes(type_width(allocation->type));
       allocation->source.offset = offset;
     }
@@ -60,16 +100,36 @@ Reference reference_direct(Allocation *allocation) {
   Reference reference;
   reference.access = Direct;
   reference.allocation = allocation;
+  reference.index = NULL;
+  reference.scale = 1;
+  reference.disp = 0;
   return reference;
 }
 
 Reference reference_deref(Allocation *allocation) {
-  Reference reference;
+  Reference reference = reference_direct(allocation);
   reference.access = Dereference;
-  reference.allocation = allocation;
   return reference;
 }
 
+Type reference_type(const Reference reference) {
+  return reference.access == Dereference ? *reference.allocation->type.inner : reference.allocation->type;
+}
+
+bool reference_is_fp(const Reference reference) {
+  return reference.access == ConstantF || (isAllocated(reference.access) && is_fp(reference_type(reference).kind));
+}
+
+bool reference_is_vector(const Reference reference) {
+  return isAllocated(reference.access) && is_vector(reference_type(reference).kind);
+}
+
+bool reference_equals(const Reference a, const Reference b) {
+  if (a.access != b.access || !isAllocated(a.access) || a.allocation != b.allocation)
+    return false;
+  return a.access == Direct || (a.index == b.index && a.scale == b.scale && a.disp == b.disp);
+}
+
 void instruction_init(Instruction *instruction) {
   instruction->type = -1;
   instruction->inputs[0].access = UNINIT;
@@ -224,7 +284,7 @@ Allocation *table_get_allocation_by_token(InstructionTable *table, const char *c
 }
 
 void update_reference(const InstructionTable *table, const Instruction *instruction, const Reference reference) {
-  assert(reference.access <= 6);
+  assert(reference.access <= ConstantF);
   if (isAllocated(reference.access)) {
     printf("instr %i reads ref %i (%s)\n", instruction->id, reference.allocation->index,
            reference.allocation->name == NULL ? "null" : reference.allocation->name);
@@ -233,21 +293,40 @@ void update_reference(const InstructionTable *table, const Instruction *instruct
     } else {
       reference.allocation->lastInstr = table->escape;
     }
+    if (reference.access == Dereference && reference.index != NULL) {
+      update_reference(table, instruction, reference_direct(reference.index));
+    }
   }
 }
 
-void update_reference_out(const Instruction *instruction, const Reference reference) {
-  if (isAllocated(reference.access)) {
+void update_reference_out(const InstructionTable *table, const Instruction *instruction, const Reference reference) {
+  if (reference.access == Dereference) {
+    // storing through a pointer reads the pointer
+    update_reference(table, instruction, reference);
+  } else if (isAllocated(reference.access)) {
     printf("instr %i writes ref %i (%s)\n", instruction->id, reference.allocation->index,
            reference.allocation->name == NULL ? "null" : reference.allocation->name);
   }
 }
 
-Reference instruction_mov(InstructionTable *table, const Reference from, Reference to, char *comment) {
+Reference instruction_mov(InstructionTable *table, Reference from, Reference to, char *comment) {
   assert(isAllocated(to.access));
 
-  // SSA
-  if (to.allocation->name != NULL && to.allocation->index >= table->parentCutoff) {
+  const Type target = reference_type(to);
+  if (reference_is_vector(from) && reference_type(from).kind != target.kind) {
+    puts("vectors only turn into other values through a lane or a reduction");
+    exit(25);
+  }
+  // a scalar stored to a vector is copied into every lane, once it has the lane type
+  if (is_vector(target.kind) && isAllocated(from.access) && !is_vector(reference_type(from).kind) &&
+      reference_type(from).kind != vector_lane(target.kind)) {
+    const Type lane = {.kind = vector_lane(target.kind)};
+    from = instruction_mov(table, from, reference_direct(table_allocate(table, lane)), "convert");
+  }
+
+  // SSA (storing through a pointer leaves the pointer itself alone, and a variable that is pointed to stays put)
+  if (to.access == Direct && to.allocation->name != NULL && !to.allocation->lvalue &&
+      to.allocation->index >= table->parentCutoff) {
     printf("ref %i is dead\n", to.allocation->index);
     to.allocation =
         table_allocate_variable(table, (Variable){.name = strdup(to.allocation->name), .type = to.allocation->type});
@@ -261,7 +340,7 @@ Reference instruction_mov(InstructionTable *table, const Reference from, Referen
   instruction->comment = comment;
 
   update_reference(table, instruction, from);
-  update_reference_out(instruction, to);
+  update_reference_out(table, instruction, to);
   return to;
 }
 
@@ -275,14 +354,106 @@ Reference instruction_lea(InstructionTable *table, const Reference from, const R
   instruction->comment = comment;
 
   update_reference(table, instruction, from);
-  update_reference_out(instruction, to);
+  update_reference_out(table, instruction, to);
   return to;
 }
 
-Reference instruction_basic_op(InstructionTable *table, const InstructionType type, const Reference a,
-                               const Reference b, char *comment) {
-  const Reference output = instruction_mov(table, a, reference_direct(table_allocate_infer_types(table, a, b)), NULL);
+bool reference_constant(const Reference reference, int64_t *value) {
+  if (reference.access != ConstantI)
+    return false;
+  *value = strtoll(reference.value, NULL, 10);
+  return true;
+}
+
+Reference reference_constant_i(const int64_t value) {
+  const int n = snprintf(NULL, 0, "%lli", (long long)value);
+  char *str = malloc(n + 1);
+  snprintf(str, n + 1, "%lli", (long long)value);
+  return (Reference){.access = ConstantI, .value = str};
+}
+
+bool reference_constant_f(const Reference reference, double *value) {
+  int64_t integer;
+  if (reference_constant(reference, &integer)) {
+    *value = (double)integer;
+    return true;
+  }
+  if (reference.access != ConstantF)
+    return false;
+  *value = strtod(reference.value, NULL);
+  return true;
+}
+
+Reference reference_constant_fp(const double value) {
+  const int n = snprintf(NULL, 0, "%.17g", value);
+  char *str = malloc(n + 1);
+  snprintf(str, n + 1, "%.17g", value);
+  return (Reference){.access = ConstantF, .value = str};
+}
+
+// evaluates an operation on two constants at compile time, with the wrapping 64-bit semantics of the emitted code
+bool fold_constants(const InstructionType type, const Reference a, const Reference b, Reference *out) {
+  int64_t x;
+  int64_t y;
+  if (!reference_constant(a, &x) || !reference_constant(b, &y))
+    return false;
+  const uint64_t ux = (uint64_t)x;
+  const uint64_t uy = (uint64_t)y;
+  int64_t value;
+  switch (type) {
+  case ADD:
+    value = (int64_t)(ux + uy);
+    break;
+  case SUB:
+    value = (int64_t)(ux - uy);
+    break;
+  case IMUL:
+    value = (int64_t)(ux * uy);
+    break;
+  case AND:
+    value = x & y;
+    break;
+  case OR:
+    value = x | y;
+    break;
+  case XOR:
+    value = x ^ y;
+    break;
+  case SAL:
+  case SAR:
+  case SHR:
+    if (y < 0 || y > 63)
+      return false;
+    value = type == SAL ? (int64_t)(ux << y) : type == SAR ? x >> y : (int64_t)(ux >> y);
+    break;
+  case SETE:
+    value = x == y;
+    break;
+  case SETNE:
+    value = x != y;
+    break;
+  case SETL:
+    value = x < y;
+    break;
+  case SETG:
+    value = x > y;
+    break;
+  case SETLE:
+    value = x <= y;
+    break;
+  case SETGE:
+    value = x >= y;
+    break;
+  default:
+    return false;
+  }
+  *out = reference_constant_i(value);
+  return true;
+}
 
+// output = output <op> b
+void instruction_in_place(InstructionTable *table, const InstructionType type, const Reference output,
+                          const Reference b, char *comment) {
   Instruction *instruction = table_next(table);
   instruction->type = type;
   instruction->inputs[0] = b;
@@ -290,10 +461,142 @@ Reference instruction_basic_op(InstructionTable *table, const InstructionType ty
   instruction->comment = comment;
 
   update_reference(table, instruction, b);
-  update_reference_out(instruction, output);
+  update_reference_out(table, instruction, output);
+}
+
+// operations mixing floating point and integer values take the wider floating point type among them
+Type fp_operation_type(const Reference a, const Reference b) {
+  const bool fpA = isAllocated(a.access) && is_fp(reference_type(a).kind);
+  const bool fpB = isAllocated(b.access) && is_fp(reference_type(b).kind);
+  if (fpA && (!fpB || reference_type(a).kind >= reference_type(b).kind))
+    return reference_type(a);
+  if (fpB)
+    return reference_type(b);
+  return (Type){.kind = f64, .inner = NULL};
+}
+
+// the value as an allocation of the floating point `type`, converting integers and the other precision
+Reference reference_to_fp(InstructionTable *table, const Reference value, const Type type) {
+  if (isAllocated(value.access) && reference_type(value).kind == type.kind)
+    return value;
+  return instruction_mov(table, value, reference_direct(table_allocate(table, type)), "convert");
+}
+
+Reference instruction_fp_op(InstructionTable *table, const InstructionType type, const Reference a, const Reference b,
+                            char *comment) {
+  if (type != ADD && type != SUB && type != IMUL && type != FDIV) {
+    puts("floating point values only support +, -, *, / and comparisons");
+    exit(25);
+  }
+  double x;
+  double y;
+  if (reference_constant_f(a, &x) && reference_constant_f(b, &y)) {
+    return reference_constant_fp(type == ADD ? x + y : type == SUB ? x - y : type == IMUL ? x * y : x / y);
+  }
+  const Type fp = fp_operation_type(a, b);
+  const Reference output = instruction_mov(table, a, reference_direct(table_allocate(table, fp)), NULL);
+  instruction_in_place(table, type, output, reference_to_fp(table, b, fp), comment);
+  return output;
+}
+
+// the value as an allocation of the vector `type`, broadcasting scalars to every lane
+Reference reference_to_vector(InstructionTable *table, const Reference value, const Type type) {
+  if (isAllocated(value.access) && reference_type(value).kind == type.kind)
+    return value;
+  return instruction_mov(table, value, reference_direct(table_allocate(table, type)), "broadcast");
+}
+
+void instruction_lanes(InstructionTable *table, const InstructionType type, const Reference output, const Reference a,
+                       const Reference b, char *comment) {
+  Instruction *instruction = table_next(table);
+  instruction->type = type;
+  instruction->inputs[0] = a;
+  instruction->inputs[1] = b;
+  instruction->output = output;
+  instruction->comment = comment;
+
+  update_reference(table, instruction, a);
+  update_reference(table, instruction, b);
+  if (type == INSERT) {
+    // the other lanes are kept
+    update_reference(table, instruction, output);
+  }
+  update_reference_out(table, instruction, output);
+}
+
+// lane by lane arithmetic, with a scalar operand standing for a vector of copies of it
+Reference instruction_packed_op(InstructionTable *table, const InstructionType type, const Reference a,
+                                const Reference b, char *comment) {
+  const Type vector = reference_is_vector(a) ? reference_type(a) : reference_type(b);
+  const TypeKind lane = vector_lane(vector.kind);
+  bool supported;
+  switch (type) {
+  case ADD:
+  case SUB:
+  case AND:
+  case OR:
+  case XOR:
+    supported = true;
+    break;
+  case IMUL:
+    // SSE2 has no 8 or 64-bit lane multiply
+    supported = is_fp(lane) || lane == i16 || lane == i32;
+    break;
+  case FDIV:
+    supported = is_fp(lane);
+    break;
+  default:
+    supported = false;
+    break;
+  }
+  if (!supported) {
+    puts("vectors only support +, -, *, &, | and ^ (and / on floating point lanes)");
+    exit(25);
+  }
+  const Reference output = instruction_mov(table, a, reference_direct(table_allocate(table, vector)), NULL);
+  instruction_in_place(table, type, output, reference_to_vector(table, b, vector), comment);
+  return output;
+}
+
+Reference instruction_basic_op(InstructionTable *table, const InstructionType type, const Reference a,
+                               const Reference b, char *comment) {
+  if (reference_is_vector(a) || reference_is_vector(b)) {
+    return instruction_packed_op(table, type, a, b, comment);
+  }
+  if (reference_is_fp(a) || reference_is_fp(b)) {
+    return instruction_fp_op(table, type, a, b, comment);
+  }
+  Reference folded;
+  if (fold_constants(type, a, b, &folded)) {
+    return folded;
+  }
+  const Reference output = instruction_mov(table, a, reference_direct(table_allocate_infer_types(table, a, b)), NULL);
+  instruction_in_place(table, type, output, b, comment);
   return output;
 }
 
+// a lane number of the vector `kind`. constant lanes are checked, and variable ones wrap around rather than reach
+// past the vector
+Reference vector_lane_index(InstructionTable *table, const TypeKind kind, const Reference index) {
+  int64_t value;
+  if (reference_constant(index, &value)) {
+    if (value < 0 || value >= vector_lanes(kind)) {
+      puts("vector lane out of range");
+      exit(25);
+    }
+    return index;
+  }
+  if (!isAllocated(index.access) || is_sse(reference_type(index).kind)) {
+    puts("vector lanes are indexed by integers");
+    exit(25);
+  }
+  Reference wide = index;
+  if (index.access != Direct || type_width(reference_type(index)) != Quad) {
+    wide = instruction_mov(table, index, reference_direct(table_allocate(table, (Type){.kind = i64})), "lane");
+  }
+  return instruction_basic_op(table, AND, wide, reference_constant_i(vector_lanes(kind) - 1), "lane");
+}
+
 Reference instruction_sp_out_op(InstructionTable *table, const InstructionType type, const Reference a,
                                 const Reference b, char *comment) {
   const Reference output = reference_direct(table_allocate_infer_types(table, a, b));
@@ -307,7 +610,7 @@ Reference instruction_sp_out_op(InstructionTable *table, const InstructionType t
 
   update_reference(table, instruction, a);
   update_reference(table, instruction, b);
-  update_reference_out(instruction, output);
+  update_reference_out(table, instruction, output);
   return output;
 }
 
@@ -346,7 +649,7 @@ Reference instruction_call(InstructionTable *table, Function *function, Referenc
   }
 
   for (int i = 0; i < instruction->function->arguments.len && i < 6; ++i) {
-    assert(instruction->arguments[i].access <= 6);
+    assert(instruction->arguments[i].access <= Global);
     if (isAllocated(instruction->arguments[i].access))
       printf("%i: %i\n", instruction->arguments[i].allocation->index, instruction->arguments[i].access);
   }
@@ -354,6 +657,19 @@ Reference instruction_call(InstructionTable *table, Function *function, Referenc
   return output;
 }
 
+void instruction_tail_call(InstructionTable *table, Function *function, Reference *arguments) {
+  Instruction *instruction = table_next(table);
+  instruction->type = TAILCALL;
+  instruction->arguments = arguments;
+  instruction->function = function;
+  instruction->retVal.access = UNINIT;
+  instruction->comment = "tail call";
+
+  for (int i = 0; i < function->arguments.len; i++) {
+    update_reference(table, instruction, arguments[i]);
+  }
+}
+
 Reference instruction_sp_reg_read(InstructionTable *table, const InstructionType type, char *comment) {
   const Type typ = {.kind = u8, .inner = NULL};
   Instruction *instruction = table_next(table);
@@ -362,7 +678,7 @@ Reference instruction_sp_reg_read(InstructionTable *table, const InstructionType
   instruction->output = reference_direct(allocation);
   instruction->comment = comment;
 
-  update_reference_out(instruction, instruction->output);
+  update_reference_out(table, instruction, instruction->output);
 
   return instruction->output;
 }
@@ -383,34 +699,97 @@ Allocation *table_get_variable_by_token(const InstructionTable *table, const cha
 }
 
 Reference ast_basic_op(const InstructionType type, const char *contents, InstructionTable *table, VarList *globals,
-                       FunctionList *functions, StrList *literals, const AstNode *node, char *comment) {
+                       FunctionList *functions, LiteralPool *literals, const AstNode *node, char *comment) {
   return instruction_basic_op(table, type, solve_ast_node(contents, table, globals, functions, literals, node->left),
                               solve_ast_node(contents, table, globals, functions, literals, node->right), comment);
 }
 
-Reference ast_sp_out_op(const InstructionType type, const char *contents, InstructionTable *table, VarList *globals,
-                        FunctionList *functions, StrList *literals, const AstNode *node, char *comment) {
-  return instruction_sp_out_op(table, type, solve_ast_node(contents, table, globals, functions, literals, node->left),
-                               solve_ast_node(contents, table, globals, functions, literals, node->right), comment);
+InstructionType instruction_compare_ordered(InstructionTable *table, InstructionType type, Reference left,
+                                            Reference right, char *comment);
+
+void reference_require_scalar(const Reference reference) {
+  if (reference_is_vector(reference)) {
+    puts("vectors cannot be compared or tested");
+    exit(25);
+  }
 }
 
 Reference instr_test_self(InstructionTable *table, const InstructionType type, const Reference ref, char *comment) {
+  reference_require_scalar(ref);
+  Reference folded;
+  if (fold_constants(type, ref, reference_constant_i(0), &folded)) {
+    return folded;
+  }
+  if (reference_is_fp(ref)) {
+    return instruction_sp_reg_read(
+        table, instruction_compare_ordered(table, type, ref, reference_constant_i(0), NULL), comment);
+  }
   instruction_no_output(table, TEST, ref, ref, NULL);
 
   return instruction_sp_reg_read(table, type, comment);
 }
 
-Reference instr_cmp_chk(InstructionTable *table, const InstructionType type, Reference left, Reference right,
-                        char *comment) {
+bool reference_is_imm32(const Reference reference) {
+  if (reference.access != ConstantI)
+    return false;
+  const long long value = strtoll(reference.value, NULL, 10);
+  return value >= INT32_MIN && value <= INT32_MAX;
+}
 
-  if (!isAllocated(right.access)) {
+void instruction_compare(InstructionTable *table, Reference left, Reference right, char *comment) {
+  // cmp can only take an immediate as its source (right), and the destination (left) must be allocated
+  if (!isAllocated(left.access)) {
+    Allocation *allocation = table_allocate(table, (Type){.kind = i64, .inner = NULL});
+    instruction_mov(table, left, reference_direct(allocation), NULL);
+    left = reference_direct(allocation);
+  }
+  if (!isAllocated(right.access) && !reference_is_imm32(right)) {
     Allocation *allocation = table_allocate(table, (Type){.kind = i64, .inner = NULL});
     instruction_mov(table, right, reference_direct(allocation), NULL);
     right = reference_direct(allocation);
   }
-  instruction_no_output(table, CMP, right, left, NULL);
+  instruction_no_output(table, CMP, right, left, comment);
+}
 
-  return instruction_sp_reg_read(table, type, comment);
+// ucomis orders its operands like an unsigned compare, where an unordered (NaN) result looks like "below". `a < b`
+// is tested as `b > a` instead, so that every ordered comparison is false for NaN and the inverted branches are true.
+// returns the set/jump type to use after the comparison
+InstructionType instruction_compare_ordered(InstructionTable *table, InstructionType type, Reference left,
+                                            Reference right, char *comment) {
+  reference_require_scalar(left);
+  reference_require_scalar(right);
+  if (!reference_is_fp(left) && !reference_is_fp(right)) {
+    instruction_compare(table, left, right, comment);
+    return type;
+  }
+  const Type fp = fp_operation_type(left, right);
+  left = reference_to_fp(table, left, fp);
+  right = reference_to_fp(table, right, fp);
+  switch (type) {
+  case SETL:
+  case SETLE:
+  case JL:
+  case JLE: {
+    const Reference swap = left;
+    left = right;
+    right = swap;
+    type = type == SETL ? SETG : type == SETLE ? SETGE : type == JL ? JG : JGE;
+    break;
+  }
+  default:
+    break;
+  }
+  instruction_no_output(table, CMP, right, left, comment);
+  return type;
+}
+
+Reference instr_cmp_chk(InstructionTable *table, const InstructionType type, Reference left, Reference right,
+                        char *comment) {
+  Reference folded;
+  if (fold_constants(type, left, right, &folded)) {
+    return folded;
+  }
+  return instruction_sp_reg_read(table, instruction_compare_ordered(table, type, left, right, NULL), comment);
 }
 
 void instruction_unary(InstructionTable *table, InstructionType type, Reference reference, char *comment) {
@@ -423,19 +802,256 @@ void instruction_unary(InstructionTable *table, InstructionType type, Reference
   update_reference(table, instruction, reference);
 }
 
+bool typekind_unsigned(const TypeKind kind) {
+  return kind >= u8 && kind <= u64;
+}
+
+// log2 of value, or -1 if it is not a power of two
+int power_of_two(const int64_t value) {
+  if (value <= 0 || (value & (value - 1)) != 0)
+    return -1;
+  int shift = 0;
+  while ((1LL << shift) != value)
+    shift++;
+  return shift;
+}
+
+Reference instruction_multiply(InstructionTable *table, const Reference a, const Reference b, char *comment) {
+  if (reference_is_vector(a) || reference_is_vector(b)) {
+    return instruction_packed_op(table, IMUL, a, b, comment);
+  }
+  if (reference_is_fp(a) || reference_is_fp(b)) {
+    return instruction_fp_op(table, IMUL, a, b, comment);
+  }
+  int64_t factor;
+  Reference value;
+  if (reference_constant(b, &factor) && isAllocated(a.access)) {
+    value = a;
+  } else if (reference_constant(a, &factor) && isAllocated(b.access)) {
+    value = b;
+  } else {
+    return instruction_basic_op(table, IMUL, a, b, comment);
+  }
+  if (factor == 1) {
+    return value;
+  }
+
+  int shift = 0;
+  while (factor > 1 && factor % 2 == 0) {
+    factor /= 2;
+    shift++;
+  }
+  Reference out = value;
+  if (factor == 3 || factor == 5 || factor == 9) {
+    // x * (1 + 2^n) == lea (x,x,2^n), which needs x in a register
+    if (out.access != Direct || out.allocation->lvalue) {
+      out = instruction_mov(table, out, reference_direct(table_allocate_infer_type(table, out)), NULL);
+    }
+    Reference address = reference_deref(out.allocation);
+    address.index = out.allocation;
+    address.scale = (uint8_t)(factor - 1);
+    out = instruction_lea(table, address, reference_direct(table_allocate(table, out.allocation->type)), comment);
+  } else if (factor != 1) {
+    return instruction_basic_op(table, IMUL, a, b, comment);
+  }
+  if (shift > 0) {
+    out = instruction_basic_op(table, SAL, out, reference_constant_i(shift), comment);
+  }
+  return out;
+}
+
+// Granlund-Montgomery: n / d == ((n * multiplier) >> (64 + shift)), corrected for negative multipliers and n.
+// see Hacker's Delight, 10-4
+void magic_signed(const int64_t d, int64_t *multiplier, int *shift) {
+  const uint64_t two63 = 1ULL << 63;
+  const uint64_t ad = (uint64_t)d;
+  const uint64_t anc = two63 - 1 - two63 % ad;
+  int p = 63;
+  uint64_t q1 = two63 / anc;
+  uint64_t r1 = two63 - q1 * anc;
+  uint64_t q2 = two63 / ad;
+  uint64_t r2 = two63 - q2 * ad;
+  uint64_t delta;
+  do {
+    p++;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= anc) {
+      q1++;
+      r1 -= anc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= ad) {
+      q2++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  *multiplier = (int64_t)(q2 + 1);
+  *shift = p - 64;
+}
+
+// see Hacker's Delight, 10-8. when add is set the multiplier needs 65 bits, so the sum is shifted in two steps
+void magic_unsigned(const uint64_t d, uint64_t *multiplier, bool *add, int *shift) {
+  const uint64_t two63 = 1ULL << 63;
+  const uint64_t nc = -1 - (-d) % d;
+  int p = 63;
+  uint64_t q1 = two63 / nc;
+  uint64_t r1 = two63 - q1 * nc;
+  uint64_t q2 = (two63 - 1) / d;
+  uint64_t r2 = (two63 - 1) - q2 * d;
+  uint64_t delta;
+  *add = false;
+  do {
+    p++;
+    if (r1 >= nc - r1) {
+      q1 = 2 * q1 + 1;
+      r1 = 2 * r1 - nc;
+    } else {
+      q1 = 2 * q1;
+      r1 = 2 * r1;
+    }
+    if (r2 + 1 >= d - r2) {
+      if (q2 >= two63 - 1)
+        *add = true;
+      q2 = 2 * q2 + 1;
+      r2 = 2 * r2 + 1 - d;
+    } else {
+      if (q2 >= two63)
+        *add = true;
+      q2 = 2 * q2;
+      r2 = 2 * r2 + 1;
+    }
+    delta = d - 1 - r2;
+  } while (p < 128 && (q1 < delta || (q1 == delta && r1 == 0)));
+  *multiplier = q2 + 1;
+  *shift = p - 64;
+}
+
+Reference instruction_divide_constant(InstructionTable *table, const Reference value, const int64_t divisor,
+                                      const bool modulo, const bool isUnsigned, char *comment) {
+  const int k = power_of_two(divisor);
+  Reference quotient;
+  if (k != -1 && isUnsigned) {
+    if (modulo) {
+      return instruction_basic_op(table, AND, value, reference_constant_i(divisor - 1), comment);
+    }
+    return instruction_basic_op(table, SHR, value, reference_constant_i(k), comment);
+  }
+  if (k != -1) {
+    // round towards zero by adding divisor - 1 to negative values first
+    Reference bias = instruction_basic_op(table, SAR, value, reference_constant_i(63), NULL);
+    bias = instruction_basic_op(table, SHR, bias, reference_constant_i(64 - k), NULL);
+    Reference sum = instruction_basic_op(table, ADD, bias, value, NULL);
+    if (modulo) {
+      Reference multiple = instruction_basic_op(table, AND, sum, reference_constant_i(-divisor), NULL);
+      return instruction_basic_op(table, SUB, value, multiple, comment);
+    }
+    return instruction_basic_op(table, SAR, sum, reference_constant_i(k), comment);
+  }
+
+  int shift;
+  if (isUnsigned) {
+    uint64_t multiplier;
+    bool add;
+    magic_unsigned((uint64_t)divisor, &multiplier, &add, &shift);
+    quotient = instruction_sp_out_op(table, UMULH, value, reference_constant_i((int64_t)multiplier), NULL);
+    if (add) {
+      Reference difference = instruction_basic_op(table, SUB, value, quotient, NULL);
+      difference = instruction_basic_op(table, SHR, difference, reference_constant_i(1), NULL);
+      quotient = instruction_basic_op(table, ADD, difference, quotient, NULL);
+      shift--;
+    }
+    if (shift > 0) {
+      quotient = instruction_basic_op(table, SHR, quotient, reference_constant_i(shift), NULL);
+    }
+  } else {
+    int64_t multiplier;
+    magic_signed(divisor, &multiplier, &shift);
+    quotient = instruction_sp_out_op(table, MULH, value, reference_constant_i(multiplier), NULL);
+    if (multiplier < 0) {
+      quotient = instruction_basic_op(table, ADD, quotient, value, NULL);
+    }
+    if (shift > 0) {
+      quotient = instruction_basic_op(table, SAR, quotient, reference_constant_i(shift), NULL);
+    }
+    Reference sign = instruction_basic_op(table, SHR, value, reference_constant_i(63), NULL);
+    quotient = instruction_basic_op(table, ADD, quotient, sign, NULL);
+  }
+  if (modulo) {
+    Reference multiple = instruction_multiply(table, quotient, reference_constant_i(divisor), NULL);
+    return instruction_basic_op(table, SUB, value, multiple, comment);
+  }
+  return quotient;
+}
+
+Reference instruction_divide(InstructionTable *table, const Reference a, Reference b, const bool modulo,
+                             char *comment) {
+  if (reference_is_vector(a) || reference_is_vector(b)) {
+    return instruction_packed_op(table, modulo ? IDIV_mod : FDIV, a, b, comment);
+  }
+  if (reference_is_fp(a) || reference_is_fp(b)) {
+    return instruction_fp_op(table, modulo ? IDIV_mod : FDIV, a, b, comment);
+  }
+  int64_t dividend;
+  int64_t divisor;
+  if (reference_constant(a, &dividend) && reference_constant(b, &divisor) && divisor != 0 &&
+      (dividend != INT64_MIN || divisor != -1)) {
+    return reference_constant_i(modulo ? dividend % divisor : dividend / divisor);
+  }
+  if (isAllocated(a.access) && reference_constant(b, &divisor) && divisor > 0 && divisor <= INT32_MAX) {
+    const Type type = reference_type(a);
+    const bool isUnsigned = typekind_unsigned(type.kind);
+    if (divisor == 1) {
+      return modulo ? reference_constant_i(0) : a;
+    }
+    // the sequences work on full registers, narrower signed values are sign extended first
+    if (type_width(type) == Quad || !isUnsigned) {
+      Reference value = a;
+      if (type_width(type) != Quad) {
+        value = instruction_mov(table, a, reference_direct(table_allocate(table, (Type){.kind = i64, .inner = NULL})),
+                                NULL);
+      }
+      Reference out = instruction_divide_constant(table, value, divisor, modulo, isUnsigned, comment);
+      if (type_width(type) != Quad) {
+        out = instruction_mov(table, out, reference_direct(table_allocate(table, type)), NULL);
+      }
+      return out;
+    }
+  }
+  // idivb leaves the remainder in %ah, so 8-bit values are divided as 32-bit ones
+  if (isAllocated(a.access) && type_width(reference_type(a)) == Byte) {
+    const Type wide = {.kind = i32, .inner = NULL};
+    const Reference value = instruction_mov(table, a, reference_direct(table_allocate(table, wide)), NULL);
+    const Reference by = instruction_mov(table, b, reference_direct(table_allocate(table, wide)), NULL);
+    const Reference out = instruction_sp_out_op(table, modulo ? IDIV_mod : IDIV, value, by, comment);
+    return instruction_mov(table, out, reference_direct(table_allocate(table, reference_type(a))), NULL);
+  }
+  // idiv cannot take an immediate
+  if (!isAllocated(b.access)) {
+    b = instruction_mov(table, b, reference_direct(table_allocate_infer_type(table, a)), NULL);
+  }
+  return instruction_sp_out_op(table, modulo ? IDIV_mod : IDIV, a, b, comment);
+}
+
 int table_allocate_label(InstructionTable *table) {
   *table->sections = *table->sections + 1;
   return *table->sections;
 }
 
-void instruction_jump(InstructionTable *table, int label) {
+void instruction_branch(InstructionTable *table, const InstructionType type, int label) {
   Instruction *instruction = table_next(table);
-  instruction->type = JMP;
+  instruction->type = type;
   instruction->label = label;
   instruction->instructions.parent = NULL;
   instruction->processed = false;
 }
 
+void instruction_jump(InstructionTable *table, int label) {
+  instruction_branch(table, JMP, label);
+}
+
 int instruction_label(InstructionTable *table, int label) {
   Instruction *instruction = table_next(table);
   instruction->type = LABEL;
@@ -445,31 +1061,45 @@ int instruction_label(InstructionTable *table, int label) {
   return instruction->id;
 }
 
-Instruction *instruction_jump_code(InstructionTable *table, const char *contents, VarList *globals,
-                                   FunctionList *functions, StrList *literals, InstructionType type, int label,
-                                   AstNodeList *actions) {
+// a jump to `self`, which starts a block of code lowered into its own table
+Instruction *instruction_block(InstructionTable *table, const InstructionType type, const int self) {
   Instruction *instruction = table_next(table);
   instruction->type = type;
   instruction->processed = false;
-  instruction->label = table_allocate_label(table);
+  instruction->label = self;
 
   instructiontable_child(&instruction->instructions, table, -1);
+  instruction_label(&instruction->instructions, instruction->label);
+  return instruction;
+}
 
+Instruction *instruction_jump_code_labelled(InstructionTable *table, const char *contents, VarList *globals,
+                                            FunctionList *functions, LiteralPool *literals, InstructionType type, int self,
+                                            int label, AstNodeList *actions) {
+  Instruction *instruction = instruction_block(table, type, self);
   printf("JC process label .LBL.%s.%i:\n", table->name, instruction->label);
 
-  instruction_label(&instruction->instructions, instruction->label);
-
+  // nothing computed in the body is available once control flow rejoins
+  const int scope = available.len;
   for (int i = 0; i < actions->len; ++i) {
     solve_ast_node(contents, &instruction->instructions, globals, functions, literals, &actions->array[i]);
   }
+  available.len = scope;
 
   instruction_jump(&instruction->instructions, label);
   printf("JC end process label .LBL.%s.%i\n", table->name, instruction->label);
   return instruction;
 }
 
+Instruction *instruction_jump_code(InstructionTable *table, const char *contents, VarList *globals,
+                                   FunctionList *functions, LiteralPool *literals, InstructionType type, int label,
+                                   AstNodeList *actions) {
+  return instruction_jump_code_labelled(table, contents, globals, functions, literals, type,
+                                        table_allocate_label(table), label, actions);
+}
+
 Instruction *instruction_jump_code_self(InstructionTable *table, const char *contents, VarList *globals,
-                                        FunctionList *functions, StrList *literals, InstructionType type, int label,
+                                        FunctionList *functions, LiteralPool *literals, InstructionType type, int label,
                                         AstNodeList *actions) {
   Instruction *instruction = table_next(table);
   instruction->type = type;
@@ -482,90 +1112,1806 @@ Instruction *instruction_jump_code_self(InstructionTable *table, const char *con
 
   instruction_label(&instruction->instructions, instruction->label);
 
+  // nothing computed in the body is available once control flow rejoins
+  const int scope = available.len;
   for (int i = 0; i < actions->len; ++i) {
     solve_ast_node(contents, &instruction->instructions, globals, functions, literals, &actions->array[i]);
   }
+  available.len = scope;
 
   instruction_jump(&instruction->instructions, label);
   printf("JCS end process label .LBL.%s.%i\n", table->name, instruction->label);
   return instruction;
 }
 
-Reference solve_ast_node(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
-                         StrList *literals, AstNode *node) {
-  switch (node->type) {
-  case op_nop:
-    exit(112);
-  case op_array_index: {
-    Reference array = solve_ast_node(contents, table, globals, functions, literals, node->left);
-    int dz = isAllocated(array.access) ? type_size(*array.allocation->type.inner) : 1;
-    int n = snprintf(NULL, 0, "%i", dz);
-    char *str = malloc(n + 2);
-    snprintf(str, n + 1, "%i", dz);
-    str[n + 1] = '\0';
-
-    Reference idx =
-        instruction_basic_op(table, IMUL, (Reference){.access = ConstantI, .value = str},
-                             solve_ast_node(contents, table, globals, functions, literals, node->right), "array index");
-    Reference out = instruction_basic_op(table, ADD, idx, array, "array index");
-    out.access = Dereference;
-    return out;
+Hoisted *hoisted_get(const AstNode *node) {
+  for (int i = hoisted.len - 1; i >= 0; --i) {
+    if (hoisted.array[i].node == node) {
+      return &hoisted.array[i];
+    }
   }
-  case op_comma: {
-    // discard left, keep right
-    solve_ast_node(contents, table, globals, functions, literals, node->left);
-    return solve_ast_node(contents, table, globals, functions, literals, node->right);
+  return NULL;
+}
+
+int64_t ast_constant_value(const char *contents, const AstNode *node) {
+  char *copy = token_copy(node->token, contents);
+  const int64_t value = strtoll(copy, NULL, 10);
+  free(copy);
+  return value;
+}
+
+// a[i] as (a + i * size), for bases that cannot be addressed directly
+Reference array_index_arithmetic(const char *contents, InstructionTable *table, VarList *globals,
+                                 FunctionList *functions, LiteralPool *literals, AstNode *node, const Reference array) {
+  int dz = isAllocated(array.access) ? type_size(*array.allocation->type.inner) : 1;
+  int n = snprintf(NULL, 0, "%i", dz);
+  char *str = malloc(n + 2);
+  snprintf(str, n + 1, "%i", dz);
+  str[n + 1] = '\0';
+
+  Reference idx =
+      instruction_basic_op(table, IMUL, (Reference){.access = ConstantI, .value = str},
+                           solve_ast_node(contents, table, globals, functions, literals, node->right), "array index");
+  Reference out = instruction_basic_op(table, ADD, idx, array, "array index");
+  out.access = Dereference;
+  return out;
+}
+
+// a[i] as a single base + index * scale + disp memory operand.
+// constant terms of the index fold into the displacement, and only sizes x86 can scale by skip the multiply
+Reference array_index_address(const char *contents, InstructionTable *table, VarList *globals,
+                              FunctionList *functions, LiteralPool *literals, AstNode *node, const Reference array) {
+  const int size = type_size(*array.allocation->type.inner);
+  int64_t disp = 0;
+  AstNode *index = node->right;
+  while (hoisted_get(index) == NULL) {
+    if (index->type == op_value_constant) {
+      disp += ast_constant_value(contents, index);
+      index = NULL;
+      break;
+    }
+    if ((index->type == op_add || index->type == op_subtract) && index->right->type == op_value_constant) {
+      const int64_t value = ast_constant_value(contents, index->right);
+      disp += index->type == op_add ? value : -value;
+      index = index->left;
+    } else if (index->type == op_add && index->left->type == op_value_constant) {
+      disp += ast_constant_value(contents, index->left);
+      index = index->right;
+    } else {
+      break;
+    }
   }
-  case op_unary_negate: {
-    Reference inner = solve_ast_node(contents, table, globals, functions, literals, node->inner);
-    Reference reference =
-        instruction_mov(table, inner, reference_direct(table_allocate_infer_type(table, inner)), NULL);
-    instruction_unary(table, NEG, reference, "negate");
-    return reference;
+  disp *= size;
+  if (disp < INT32_MIN || disp > INT32_MAX) {
+    return array_index_arithmetic(contents, table, globals, functions, literals, node, array);
   }
-  case op_unary_plus: {
-    return solve_ast_node(contents, table, globals, functions, literals, node->inner); // no effect
+
+  Reference out = reference_deref(array.allocation);
+  out.disp = (int32_t)disp;
+  if (index == NULL) {
+    return out;
   }
-  case op_unary_addressof: {
-    Reference inner = solve_ast_node(contents, table, globals, functions, literals, node->inner);
-    assert(isAllocated(inner.access));
 
-    if (inner.access == Dereference) {
-      inner.access = Direct;
-      return inner;
-    }
-    if (inner.access == Global) {
-      inner.access = GlobalRef;
-      return inner;
-    }
-    Type type = {.kind = ptr, .inner = &inner.allocation->type};
-    Allocation *output = table_allocate(table, type);
-    instruction_lea(table, inner, reference_direct(output), "addressof");
-    return reference_direct(output);
+  Reference idx = solve_ast_node(contents, table, globals, functions, literals, index);
+  // address registers are always 64-bit
+  if (idx.access != Direct || type_width(idx.allocation->type) != Quad) {
+    idx = instruction_mov(table, idx, reference_direct(table_allocate(table, (Type){.kind = i64, .inner = NULL})),
+                          "array index");
   }
-  case op_unary_derefernce: {
-    Reference inner = solve_ast_node(contents, table, globals, functions, literals, node->inner);
-    switch (inner.access) {
-    case Direct:
-      inner.access = Dereference;
-      return inner;
-    case Dereference: {
-      return reference_deref(
-          instruction_mov(table, inner, reference_direct(table_allocate(table, *inner.allocation->type.inner)), NULL)
-              .allocation);
-    }
-      // case ConstantS:
-      //   break;
-    default:
-      assert(false);
-    }
-  } break;
-  case op_unary_not: {
-    return instr_test_self(table, SETE, solve_ast_node(contents, table, globals, functions, literals, node->inner),
-                           "not");
+  if (size == 1 || size == 2 || size == 4 || size == 8) {
+    out.scale = (uint8_t)size;
+  } else {
+    int n = snprintf(NULL, 0, "%i", size);
+    char *str = malloc(n + 1);
+    snprintf(str, n + 1, "%i", size);
+    idx = instruction_basic_op(table, IMUL, (Reference){.access = ConstantI, .value = str}, idx, "array index");
+  }
+  out.index = idx.allocation;
+  return out;
+}
+
+InstructionType compare_jump_type(const AstNodeType type) {
+  switch (type) {
+  case op_compare_equals:
+    return JE;
+  case op_compare_not_equals:
+    return JNE;
+  case op_less_than:
+    return JL;
+  case op_greater_than:
+    return JG;
+  case op_less_than_equal:
+    return JLE;
+  case op_greater_than_equal:
+    return JGE;
+  default:
+    return LABEL; // not a comparison
+  }
+}
+
+InstructionType jump_invert(const InstructionType type) {
+  switch (type) {
+  case JE:
+    return JNE;
+  case JNE:
+    return JE;
+  case JL:
+    return JGE;
+  case JG:
+    return JLE;
+  case JLE:
+    return JG;
+  case JGE:
+    return JL;
+  default:
+    exit(24);
+  }
+}
+
+// whether evaluating the node only claims new registers, leaving every live allocation where it is.
+// the skipped operand of a short-circuited && or || must satisfy this so both paths meet with the same register state
+bool ast_is_straight_line(const AstNode *node) {
+  switch (node->type) {
+  case op_value_constant:
+  case op_value_string:
+  case op_value_variable:
+  case op_value_global:
+    return true;
+  case op_function:
+  case op_divide:
+  case op_modulo:
+  case op_assignment:
+  case op_value_let:
+  case cf_if:
+  case cf_while:
+  case cf_return:
+  case op_nop:
+    return false;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_addressof:
+  case op_unary_derefernce:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast:
+    return ast_is_straight_line(node->inner);
+  default:
+    return ast_is_straight_line(node->left) && ast_is_straight_line(node->right);
+  }
+}
+
+bool ast_can_short_circuit(const AstNode *node) {
+  return (node->type == op_and || node->type == op_or) && ast_is_straight_line(node->right);
+}
+
+// emits a flags-setting comparison for the node, returning the jump taken when it is true
+InstructionType solve_flags(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                            LiteralPool *literals, AstNode *node) {
+  const InstructionType type = compare_jump_type(node->type);
+  if (type != LABEL) {
+    Reference left = solve_ast_node(contents, table, globals, functions, literals, node->left);
+    Reference right = solve_ast_node(contents, table, globals, functions, literals, node->right);
+    return instruction_compare_ordered(table, type, left, right, NULL);
+  }
+  return instruction_compare_ordered(table, JNE, solve_ast_node(contents, table, globals, functions, literals, node),
+                                     (Reference){.access = ConstantI, .value = strdup("0")}, NULL);
+}
+
+// jumps to `target` when the condition evaluates to `when`, otherwise falls through
+void solve_branch(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                  LiteralPool *literals, AstNode *node, const bool when, const int target) {
+  if (node->type == op_unary_not) {
+    solve_branch(contents, table, globals, functions, literals, node->inner, !when, target);
+  } else if (node->type == op_unary_plus) {
+    solve_branch(contents, table, globals, functions, literals, node->inner, when, target);
+  } else if (ast_can_short_circuit(node)) {
+    // a && b jumps when false as soon as either side is false, a || b jumps when true as soon as either side is
+    const bool decisive = node->type == op_or;
+    const int skip = when == decisive ? target : table_allocate_label(table);
+    solve_branch(contents, table, globals, functions, literals, node->left, decisive, skip);
+    // the right side only runs on some paths
+    const int scope = available.len;
+    solve_branch(contents, table, globals, functions, literals, node->right, when, target);
+    available.len = scope;
+    if (when != decisive) {
+      instruction_label(table, skip);
+    }
+  } else {
+    const InstructionType type = solve_flags(contents, table, globals, functions, literals, node);
+    instruction_branch(table, when ? type : jump_invert(type), target);
+  }
+}
+
+// emits everything but the final jump into the body (labelled `body`), returning that jump's type.
+// paths that decide the condition is false early jump straight to `skip`
+InstructionType solve_condition(const char *contents, InstructionTable *table, VarList *globals,
+                                FunctionList *functions, LiteralPool *literals, AstNode *node, const bool negate,
+                                const int body, const int skip) {
+  if (node->type == op_unary_not) {
+    return solve_condition(contents, table, globals, functions, literals, node->inner, !negate, body, skip);
+  }
+  if (node->type == op_unary_plus) {
+    return solve_condition(contents, table, globals, functions, literals, node->inner, negate, body, skip);
+  }
+  if (ast_can_short_circuit(node)) {
+    // !(a && b) == !a || !b and !(a || b) == !a && !b
+    if ((node->type == op_and) != negate) {
+      solve_branch(contents, table, globals, functions, literals, node->left, negate, skip);
+    } else {
+      solve_branch(contents, table, globals, functions, literals, node->left, !negate, body);
+    }
+    const int scope = available.len;
+    const InstructionType type =
+        solve_condition(contents, table, globals, functions, literals, node->right, negate, body, skip);
+    available.len = scope;
+    return type;
+  }
+  const InstructionType type = solve_flags(contents, table, globals, functions, literals, node);
+  return negate ? jump_invert(type) : type;
+}
+
+// the value of an && or || whose right side is not straight-line code. the right side is lowered into a block of its
+// own, entered only when the left side leaves the result open, which stores its truth over the left side's verdict
+Reference solve_short_circuit(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                              LiteralPool *literals, AstNode *node) {
+  const bool decisive = node->type == op_or;
+  const Reference result = instruction_mov(table, reference_constant_i(decisive),
+                                           reference_direct(table_allocate(table, (Type){.kind = u8, .inner = NULL})),
+                                           decisive ? "or" : "and");
+  const int label = table_allocate_label(table);
+  const int body = table_allocate_label(table);
+  const InstructionType type =
+      solve_condition(contents, table, globals, functions, literals, node->left, decisive, body, label);
+  Instruction *block = instruction_block(table, type, body);
+
+  // the right side only runs on some paths
+  const int scope = available.len;
+  const Reference right = solve_ast_node(contents, &block->instructions, globals, functions, literals, node->right);
+  instruction_mov(&block->instructions, instr_test_self(&block->instructions, SETNE, right, NULL), result, NULL);
+  available.len = scope;
+
+  instruction_jump(&block->instructions, label);
+  instruction_jump(table, label);
+  block->instructions.escape = instruction_label(table, label);
+  return result;
+}
+
+bool tokens_equal(const char *contents, const Token *a, const Token *b) {
+  return a->len == b->len && strncmp(contents + a->index, contents + b->index, a->len) == 0;
+}
+
+int tokens_count(const char *contents, const PtrList *tokens, const Token *token) {
+  int count = 0;
+  for (int i = 0; i < tokens->len; ++i) {
+    if (tokens_equal(contents, tokens->array[i], token)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+// structural equality of two side-effect free expressions
+bool ast_equals(const char *contents, const AstNode *a, const AstNode *b) {
+  if (a->type != b->type)
+    return false;
+  switch (a->type) {
+  case op_value_constant:
+  case op_value_string:
+  case op_value_variable:
+  case op_value_global:
+    return tokens_equal(contents, a->token, b->token);
+  case op_cast:
+    if (a->val_type.kind != b->val_type.kind || a->val_type.kind == ptr)
+      return false;
+    return ast_equals(contents, a->inner, b->inner);
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_derefernce:
+  case op_unary_bitwise_not:
+    return ast_equals(contents, a->inner, b->inner);
+  case op_array_index:
+  case op_add:
+  case op_subtract:
+  case op_multiply:
+  case op_divide:
+  case op_modulo:
+  case op_bitwise_or:
+  case op_bitwise_xor:
+  case op_bitwise_and:
+  case op_bitwise_left_shift:
+  case op_bitwise_right_shift:
+    return ast_equals(contents, a->left, b->left) && ast_equals(contents, a->right, b->right);
+  default:
+    return false;
+  }
+}
+
+bool ast_reads_token(const char *contents, const AstNode *node, const Token *token) {
+  switch (node->type) {
+  case op_value_variable:
+    return tokens_equal(contents, node->token, token);
+  case op_value_constant:
+  case op_value_string:
+  case op_value_global:
+    return false;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_derefernce:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast:
+    return ast_reads_token(contents, node->inner, token);
+  default:
+    return ast_reads_token(contents, node->left, token) || ast_reads_token(contents, node->right, token);
+  }
+}
+
+// side effect free expressions built only from operators that lower to straight-line code
+bool ast_numberable(const AstNode *node) {
+  switch (node->type) {
+  case op_value_constant:
+  case op_value_string:
+  case op_value_variable:
+  case op_value_global:
+    return true;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_derefernce:
+  case op_unary_bitwise_not:
+    return ast_numberable(node->inner);
+  case op_cast:
+    return node->val_type.kind != ptr && ast_numberable(node->inner);
+  case op_array_index:
+  case op_add:
+  case op_subtract:
+  case op_multiply:
+  case op_divide:
+  case op_modulo:
+  case op_bitwise_or:
+  case op_bitwise_xor:
+  case op_bitwise_and:
+  case op_bitwise_left_shift:
+  case op_bitwise_right_shift:
+    return ast_numberable(node->left) && ast_numberable(node->right);
+  default:
+    return false;
+  }
+}
+
+bool table_pointed_to(const char *contents, const InstructionTable *table, const Token *token) {
+  return tokens_count(contents, &table->pointedTo, token) != 0;
+}
+
+bool table_escaped(const char *contents, const InstructionTable *table, const Token *token) {
+  return table_pointed_to(contents, table, token) && tokens_count(contents, &table->escaped, token) != 0;
+}
+
+// whether the expression reads memory at all (`escaped` false), or memory a callee can write (`escaped` true)
+bool ast_reads_memory(const char *contents, const InstructionTable *table, const AstNode *node, const bool escaped) {
+  switch (node->type) {
+  case op_value_variable:
+    return escaped ? table_escaped(contents, table, node->token) : table_pointed_to(contents, table, node->token);
+  case op_value_constant:
+  case op_value_string:
+    return false;
+  case op_value_global:
+  case op_unary_derefernce:
+  case op_array_index:
+  case op_deref_member_access:
+    return true;
+  case op_member_access:
+    // a struct's field is memory, a vector's reduction is not
+    return ast_reads_memory(contents, table, node->left, escaped) || node->left->type != op_value_variable;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_bitwise_not:
+  case op_cast:
+    return ast_reads_memory(contents, table, node->inner, escaped);
+  default:
+    return ast_reads_memory(contents, table, node->left, escaped) ||
+           ast_reads_memory(contents, table, node->right, escaped);
+  }
+}
+
+bool value_numbered(const AstNode *node) {
+  if (!options.gvn || inlining.len != 0) {
+    // an inlined body names the callee's parameters, which mean something else in the caller
+    return false;
+  }
+  switch (node->type) {
+  case op_value_constant:
+  case op_value_string:
+  case op_value_variable:
+  case op_value_global:
+  case op_unary_plus:
+    return false;
+  default:
+    return ast_numberable(node);
+  }
+}
+
+const Available *available_get(const char *contents, const AstNode *node) {
+  for (int i = available.len - 1; i >= 0; --i) {
+    if (available.array[i].node != NULL && ast_equals(contents, available.array[i].node, node)) {
+      return &available.array[i];
+    }
+  }
+  return NULL;
+}
+
+bool ast_address_reads_memory(const char *contents, const InstructionTable *table, const AstNode *node,
+                              const bool escaped) {
+  // an element or dereference is kept as its address, which stores do not move. the load happens at each use
+  if (node->type == op_array_index) {
+    return ast_reads_memory(contents, table, node->left, escaped) ||
+           ast_reads_memory(contents, table, node->right, escaped);
+  }
+  if (node->type == op_unary_derefernce) {
+    return ast_reads_memory(contents, table, node->inner, escaped);
+  }
+  return ast_reads_memory(contents, table, node, escaped);
+}
+
+void available_add(const char *contents, const InstructionTable *table, const AstNode *node, const Reference value) {
+  if (available.array == NULL) {
+    availablelist_init(&available, 16);
+  }
+  availablelist_add(&available, (Available){.node = node,
+                                            .value = value,
+                                            .load = ast_address_reads_memory(contents, table, node, false),
+                                            .escapes = ast_address_reads_memory(contents, table, node, true)});
+}
+
+// forgets every available expression that reads `token`
+void available_kill(const char *contents, const Token *token) {
+  for (int i = 0; i < available.len; ++i) {
+    Available *entry = &available.array[i];
+    if (entry->node != NULL && ast_reads_token(contents, entry->node, token)) {
+      entry->node = NULL;
+    }
+  }
+}
+
+// forgets every available expression that a store through a pointer, or a call, could change
+void available_clobber(const bool call) {
+  for (int i = 0; i < available.len; ++i) {
+    Available *entry = &available.array[i];
+    if (entry->node != NULL && (call ? entry->escapes : entry->load)) {
+      entry->node = NULL;
+    }
+  }
+}
+
+// the C library's memset and memcpy, which write to nothing but the bytes at their first argument and keep none of
+// their arguments, unlike a call to arbitrary code
+bool function_is_memory_builtin(const Function *function) {
+  return function->start == NULL && function->arguments.len == 3 && function->arguments.array[0].type.kind == ptr &&
+         (strcmp(function->name, "memset") == 0 || strcmp(function->name, "memcpy") == 0);
+}
+
+typedef struct {
+  // variables assigned, declared or address-taken anywhere in the loop (once per occurrence)
+  PtrList writes;
+  // calls or stores through a pointer, either of which may change any address-taken variable
+  bool clobbers;
+  // stores through a pointer, which may change even the address-taken variables no callee can reach
+  bool stores;
+} Loop;
+
+// `vector[index]` on a local vector variable, which names a lane rather than memory
+bool ast_vector_lane(const char *contents, const InstructionTable *table, const AstNode *node) {
+  if (node->type != op_array_index || node->left->type != op_value_variable)
+    return false;
+  const Allocation *allocation = table_get_variable_by_token(table, contents, node->left->token);
+  return allocation != NULL && is_vector(allocation->type.kind);
+}
+
+void loop_collect(const char *contents, const InstructionTable *table, Loop *loop, const AstNode *node) {
+  switch (node->type) {
+  case op_nop:
+  case op_value_constant:
+  case op_value_string:
+  case op_value_variable:
+  case op_value_global:
+    return;
+  case op_value_let:
+    ptrlist_add(&loop->writes, (void *)node->token);
+    return;
+  case op_assignment:
+    if (node->left->type == op_value_variable || node->left->type == op_value_let) {
+      ptrlist_add(&loop->writes, (void *)node->left->token);
+    } else if (ast_vector_lane(contents, table, node->left)) {
+      // a lane store only changes the vector variable itself
+      ptrlist_add(&loop->writes, (void *)node->left->left->token);
+      loop_collect(contents, table, loop, node->left->right);
+    } else {
+      loop->clobbers = true;
+      loop->stores = true;
+      loop_collect(contents, table, loop, node->left);
+    }
+    loop_collect(contents, table, loop, node->right);
+    return;
+  case op_unary_addressof:
+    if (node->inner->type == op_value_variable) {
+      ptrlist_add(&loop->writes, (void *)node->inner->token);
+      ptrlist_add(&addressed, (void *)node->inner->token);
+    }
+    loop_collect(contents, table, loop, node->inner);
+    return;
+  case op_function:
+    loop->clobbers = true;
+    // a store through the destination, which may reach address-taken locals no callee can
+    loop->stores |= function_is_memory_builtin(node->function);
+    for (int i = 0; i < node->function->arguments.len; ++i) {
+      loop_collect(contents, table, loop, &node->arguments[i]);
+    }
+    return;
+  case cf_if:
+  case cf_while:
+    loop_collect(contents, table, loop, node->condition);
+    for (int i = 0; i < node->actions->len; ++i) {
+      loop_collect(contents, table, loop, &node->actions->array[i]);
+    }
+    if (node->type == cf_if && node->alternative != NULL) {
+      for (int i = 0; i < node->alternative->len; ++i) {
+        loop_collect(contents, table, loop, &node->alternative->array[i]);
+      }
+    }
+    return;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_derefernce:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast:
+  case cf_return:
+    loop_collect(contents, table, loop, node->inner);
+    return;
+  default:
+    loop_collect(contents, table, loop, node->left);
+    loop_collect(contents, table, loop, node->right);
+  }
+}
+
+// whether the loop may write the variable through a pointer
+bool loop_variable_aliased(const char *contents, const InstructionTable *table, const Loop *loop,
+                           const Allocation *allocation, const Token *token) {
+  if (!allocation->lvalue && tokens_count(contents, &addressed, token) == 0) {
+    return false;
+  }
+  return loop->stores || (loop->clobbers && table_escaped(contents, table, token));
+}
+
+bool loop_variable_invariant(const char *contents, const InstructionTable *table, const Loop *loop,
+                             const Token *token) {
+  const Allocation *allocation = table_get_variable_by_token(table, contents, token);
+  return allocation != NULL && tokens_count(contents, &loop->writes, token) == 0 &&
+         !loop_variable_aliased(contents, table, loop, allocation, token);
+}
+
+// whether the node computes the same value on every iteration, without reading memory or trapping
+bool loop_invariant(const char *contents, const InstructionTable *table, const Loop *loop, const AstNode *node) {
+  const Hoisted *entry = hoisted_get(node);
+  if (entry != NULL) {
+    return !entry->induction || entry->depth != loopDepth;
+  }
+  switch (node->type) {
+  case op_value_constant:
+    return true;
+  case op_value_variable:
+    return loop_variable_invariant(contents, table, loop, node->token);
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_bitwise_not:
+  case op_cast:
+    return loop_invariant(contents, table, loop, node->inner);
+  case op_add:
+  case op_subtract:
+  case op_multiply:
+  case op_bitwise_or:
+  case op_bitwise_xor:
+  case op_bitwise_and:
+  case op_bitwise_left_shift:
+  case op_bitwise_right_shift:
+    return loop_invariant(contents, table, loop, node->left) && loop_invariant(contents, table, loop, node->right);
+  case op_divide:
+  case op_modulo:
+    // the preheader runs even if the loop does not, so only divisors that cannot fault are hoisted
+    return node->right->type == op_value_constant && ast_constant_value(contents, node->right) > 0 &&
+           loop_invariant(contents, table, loop, node->left);
+  default:
+    return false;
+  }
+}
+
+bool ast_reads_variable(const AstNode *node) {
+  switch (node->type) {
+  case op_value_variable:
+    return true;
+  case op_value_constant:
+    return false;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast:
+    return ast_reads_variable(node->inner);
+  default:
+    return ast_reads_variable(node->left) || ast_reads_variable(node->right);
+  }
+}
+
+// whether the multiply would be emitted as an imul rather than shifts and leas
+bool multiply_is_expensive(const char *contents, const AstNode *factor) {
+  if (factor->type != op_value_constant)
+    return true;
+  int64_t value = ast_constant_value(contents, factor);
+  while (value > 1 && value % 2 == 0) {
+    value /= 2;
+  }
+  return value != 1 && value != 3 && value != 5 && value != 9;
+}
+
+// shares the value of an identical expression already hoisted for this loop
+bool loop_reuse_value(const char *contents, const AstNode *node, const bool induction) {
+  for (int i = 0; i < hoisted.len; ++i) {
+    if (hoisted.array[i].depth == loopDepth && hoisted.array[i].induction == induction &&
+        ast_equals(contents, hoisted.array[i].node, node)) {
+      const Reference value = hoisted.array[i].value;
+      hoistedlist_add(&hoisted, (Hoisted){.node = node, .value = value, .induction = induction, .depth = loopDepth});
+      return true;
+    }
+  }
+  return false;
+}
+
+// `i = i + c` or `i = i - c`, returning c
+bool ast_induction_increment(const char *contents, const AstNode *node, int64_t *stride) {
+  if (node->type != op_assignment || node->left->type != op_value_variable)
+    return false;
+  const AstNode *value = node->right;
+  if (value->type != op_add && value->type != op_subtract)
+    return false;
+  if (value->left->type == op_value_variable && tokens_equal(contents, value->left->token, node->left->token) &&
+      value->right->type == op_value_constant) {
+    *stride = ast_constant_value(contents, value->right);
+    if (value->type == op_subtract) {
+      *stride = -*stride;
+    }
+    return true;
+  }
+  if (value->type == op_add && value->right->type == op_value_variable &&
+      tokens_equal(contents, value->right->token, node->left->token) && value->left->type == op_value_constant) {
+    *stride = ast_constant_value(contents, value->left);
+    return true;
+  }
+  return false;
+}
+
+// replaces every `i * e` (e invariant) with a running product that the increment of i advances by stride * e
+void loop_reduce_products(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                          LiteralPool *literals, const Loop *loop, const AstNode *increment, const int64_t stride,
+                          AstNode *node, int *budget) {
+  if (*budget == 0 || hoisted_get(node) != NULL)
+    return;
+  switch (node->type) {
+  case op_nop:
+  case op_value_constant:
+  case op_value_string:
+  case op_value_variable:
+  case op_value_global:
+  case op_value_let:
+    return;
+  case op_multiply: {
+    const Token *variable = increment->left->token;
+    AstNode *factor = NULL;
+    if (node->left->type == op_value_variable && tokens_equal(contents, node->left->token, variable)) {
+      factor = node->right;
+    } else if (node->right->type == op_value_variable && tokens_equal(contents, node->right->token, variable)) {
+      factor = node->left;
+    }
+    if (factor != NULL && multiply_is_expensive(contents, factor) && loop_invariant(contents, table, loop, factor) &&
+        (factor->type == op_value_constant || factor->type == op_value_variable || hoisted_get(factor) != NULL)) {
+      if (loop_reuse_value(contents, node, true))
+        return;
+      // constants, variables and hoisted values all solve without emitting anything
+      const Reference e = solve_ast_node(contents, table, globals, functions, literals, factor);
+      const Reference i = reference_direct(table_get_variable_by_token(table, contents, variable));
+      Reference step;
+      int64_t value;
+      if (reference_constant(e, &value)) {
+        if (value > INT32_MAX / (stride < 0 ? -stride : stride))
+          return; // the step must fit an immediate
+        step = reference_constant_i(value * stride);
+      } else if (e.access != Direct || type_width(e.allocation->type) != type_width(i.allocation->type) ||
+                 reference_is_fp(e)) {
+        // a running floating point sum would not round like the product
+        return;
+      } else if (stride == 1) {
+        step = e;
+      } else {
+        step = instruction_multiply(table, e, reference_constant_i(stride), "induction");
+      }
+      const Reference product = instruction_basic_op(table, IMUL, i, e, "induction");
+      hoistedlist_add(&hoisted, (Hoisted){.node = node, .value = product, .induction = true, .depth = loopDepth});
+      inductionlist_add(&inductions,
+                        (Induction){.assignment = increment, .product = product.allocation, .step = step});
+      (*budget)--;
+      return;
+    }
+    break;
+  }
+  case op_function:
+    for (int i = 0; i < node->function->arguments.len; ++i) {
+      loop_reduce_products(contents, table, globals, functions, literals, loop, increment, stride,
+                           &node->arguments[i], budget);
+    }
+    return;
+  case cf_if:
+  case cf_while:
+    loop_reduce_products(contents, table, globals, functions, literals, loop, increment, stride, node->condition,
+                         budget);
+    for (int i = 0; i < node->actions->len; ++i) {
+      loop_reduce_products(contents, table, globals, functions, literals, loop, increment, stride,
+                           &node->actions->array[i], budget);
+    }
+    if (node->type == cf_if && node->alternative != NULL) {
+      for (int i = 0; i < node->alternative->len; ++i) {
+        loop_reduce_products(contents, table, globals, functions, literals, loop, increment, stride,
+                             &node->alternative->array[i], budget);
+      }
+    }
+    return;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_addressof:
+  case op_unary_derefernce:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast:
+  case cf_return:
+    loop_reduce_products(contents, table, globals, functions, literals, loop, increment, stride, node->inner, budget);
+    return;
+  default:
+    break;
+  }
+  loop_reduce_products(contents, table, globals, functions, literals, loop, increment, stride, node->left, budget);
+  loop_reduce_products(contents, table, globals, functions, literals, loop, increment, stride, node->right, budget);
+}
+
+// evaluates the largest invariant expressions once, ahead of the loop
+void loop_hoist(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                LiteralPool *literals, const Loop *loop, AstNode *node, int *budget) {
+  if (*budget == 0 || hoisted_get(node) != NULL)
+    return;
+  if (loop_invariant(contents, table, loop, node) && node->type != op_value_variable &&
+      node->type != op_unary_plus && ast_reads_variable(node)) {
+    if (!loop_reuse_value(contents, node, false)) {
+      const Reference value = solve_ast_node(contents, table, globals, functions, literals, node);
+      hoistedlist_add(&hoisted, (Hoisted){.node = node, .value = value, .induction = false, .depth = loopDepth});
+      (*budget)--;
+    }
+    return;
+  }
+  switch (node->type) {
+  case op_nop:
+  case op_value_constant:
+  case op_value_string:
+  case op_value_variable:
+  case op_value_global:
+  case op_value_let:
+    return;
+  case op_assignment:
+    if (node->left->type != op_value_variable && node->left->type != op_value_let) {
+      loop_hoist(contents, table, globals, functions, literals, loop, node->left, budget);
+    }
+    loop_hoist(contents, table, globals, functions, literals, loop, node->right, budget);
+    return;
+  case op_function:
+    for (int i = 0; i < node->function->arguments.len; ++i) {
+      loop_hoist(contents, table, globals, functions, literals, loop, &node->arguments[i], budget);
+    }
+    return;
+  case cf_if:
+  case cf_while:
+    loop_hoist(contents, table, globals, functions, literals, loop, node->condition, budget);
+    for (int i = 0; i < node->actions->len; ++i) {
+      loop_hoist(contents, table, globals, functions, literals, loop, &node->actions->array[i], budget);
+    }
+    if (node->type == cf_if && node->alternative != NULL) {
+      for (int i = 0; i < node->alternative->len; ++i) {
+        loop_hoist(contents, table, globals, functions, literals, loop, &node->alternative->array[i], budget);
+      }
+    }
+    return;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_addressof:
+  case op_unary_derefernce:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast:
+  case cf_return:
+    loop_hoist(contents, table, globals, functions, literals, loop, node->inner, budget);
+    return;
+  default:
+    loop_hoist(contents, table, globals, functions, literals, loop, node->left, budget);
+    loop_hoist(contents, table, globals, functions, literals, loop, node->right, budget);
+  }
+}
+
+// loop-invariant code motion and induction variable strength reduction, emitted ahead of the loop's condition.
+// the hoisted values stay in `hoisted` until the loop is fully lowered
+// loads address-taken variables that the loop reads but cannot change ahead of it
+void loop_promote(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                  LiteralPool *literals, const Loop *loop, AstNode *node, int *budget) {
+  if (*budget == 0) {
+    return;
+  }
+  switch (node->type) {
+  case op_nop:
+  case op_value_constant:
+  case op_value_string:
+  case op_value_global:
+  case op_value_let:
+    return;
+  case op_value_variable: {
+    const Allocation *allocation = table_get_variable_by_token(table, contents, node->token);
+    if (allocation != NULL && allocation->lvalue && available_get(contents, node) == NULL &&
+        loop_variable_invariant(contents, table, loop, node->token)) {
+      solve_ast_node(contents, table, globals, functions, literals, node);
+      (*budget)--;
+    }
+    return;
+  }
+  case op_function:
+    for (int i = 0; i < node->function->arguments.len; ++i) {
+      loop_promote(contents, table, globals, functions, literals, loop, &node->arguments[i], budget);
+    }
+    return;
+  case cf_if:
+  case cf_while:
+    loop_promote(contents, table, globals, functions, literals, loop, node->condition, budget);
+    for (int i = 0; i < node->actions->len; ++i) {
+      loop_promote(contents, table, globals, functions, literals, loop, &node->actions->array[i], budget);
+    }
+    if (node->type == cf_if && node->alternative != NULL) {
+      for (int i = 0; i < node->alternative->len; ++i) {
+        loop_promote(contents, table, globals, functions, literals, loop, &node->alternative->array[i], budget);
+      }
+    }
+    return;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_addressof:
+  case op_unary_derefernce:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast:
+  case cf_return:
+    loop_promote(contents, table, globals, functions, literals, loop, node->inner, budget);
+    return;
+  default:
+    loop_promote(contents, table, globals, functions, literals, loop, node->left, budget);
+    loop_promote(contents, table, globals, functions, literals, loop, node->right, budget);
+  }
+}
+
+void loop_preheader(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                    LiteralPool *literals, AstNode *node) {
+  if (hoisted.array == NULL) {
+    hoistedlist_init(&hoisted, 8);
+    inductionlist_init(&inductions, 4);
+    ptrlist_init(&addressed, 8);
+  }
+
+  Loop loop;
+  ptrlist_init(&loop.writes, 8);
+  loop.clobbers = false;
+  loop.stores = false;
+  loop_collect(contents, table, &loop, node);
+
+  int budget = 4;
+  loop_hoist(contents, table, globals, functions, literals, &loop, node->condition, &budget);
+  for (int i = 0; i < node->actions->len; ++i) {
+    loop_hoist(contents, table, globals, functions, literals, &loop, &node->actions->array[i], &budget);
+  }
+
+  budget = 2;
+  for (int i = 0; i < node->actions->len; ++i) {
+    const AstNode *increment = &node->actions->array[i];
+    int64_t stride;
+    if (!ast_induction_increment(contents, increment, &stride) || stride == 0) {
+      continue;
+    }
+    const Token *variable = increment->left->token;
+    const Allocation *allocation = table_get_variable_by_token(table, contents, variable);
+    if (allocation == NULL || is_fp(allocation->type.kind) || tokens_count(contents, &loop.writes, variable) != 1 ||
+        loop_variable_aliased(contents, table, &loop, allocation, variable)) {
+      continue;
+    }
+    loop_reduce_products(contents, table, globals, functions, literals, &loop, increment, stride, node->condition,
+                         &budget);
+    for (int j = 0; j < node->actions->len; ++j) {
+      loop_reduce_products(contents, table, globals, functions, literals, &loop, increment, stride,
+                           &node->actions->array[j], &budget);
+    }
+  }
+
+  // expressions from before the loop (or its preheader) only stay available if the loop leaves their inputs alone
+  for (int i = 0; i < loop.writes.len; ++i) {
+    available_kill(contents, loop.writes.array[i]);
+  }
+  if (loop.stores) {
+    available_clobber(false);
+  }
+  if (loop.clobbers) {
+    available_clobber(true);
+  }
+
+  budget = 2;
+  loop_promote(contents, table, globals, functions, literals, &loop, node->condition, &budget);
+  for (int i = 0; i < node->actions->len; ++i) {
+    loop_promote(contents, table, globals, functions, literals, &loop, &node->actions->array[i], &budget);
+  }
+  free(loop.writes.array);
+}
+
+// keeps the running products of an induction variable in step with it
+void loop_advance_inductions(InstructionTable *table, const AstNode *assignment) {
+  for (int i = 0; i < inductions.len; ++i) {
+    if (inductions.array[i].assignment == assignment) {
+      instruction_in_place(table, ADD, reference_direct(inductions.array[i].product), inductions.array[i].step,
+                           "induction");
+    }
+  }
+}
+
+// `dst[i] = a[i] op b[i]; i = i + 1;` under `while (i < n)`, over pointer locals with integer elements of one size.
+// also matches the copy `dst[i] = a[i]` and the zero fill `dst[i] = 0`
+typedef struct {
+  const Token *counter;
+  AstNode *bound;
+  const AstNode *store;
+  // element reads; sources[1] is NULL for a plain copy and both are NULL for a fill
+  const AstNode *sources[2];
+  // VLOAD for a copy, VZERO for a fill, otherwise the packed arithmetic
+  InstructionType operation;
+} VectorLoop;
+
+// `array[counter]` where array is a pointer local that nothing else points to
+bool vector_element(const char *contents, const InstructionTable *table, const AstNode *node, const Token *counter,
+                    Width *width) {
+  if (node->type != op_array_index || node->left->type != op_value_variable ||
+      node->right->type != op_value_variable || !tokens_equal(contents, node->right->token, counter) ||
+      tokens_equal(contents, node->left->token, counter) || table_pointed_to(contents, table, node->left->token))
+    return false;
+  const Allocation *array = table_get_variable_by_token(table, contents, node->left->token);
+  if (array == NULL || array->type.kind != ptr || array->type.inner->kind < i8 || array->type.inner->kind > u64)
+    return false;
+  *width = type_width(*array->type.inner);
+  return true;
+}
+
+bool loop_vectorizable(const char *contents, const InstructionTable *table, const AstNode *node, VectorLoop *loop) {
+  const AstNode *condition = node->condition;
+  while (condition->type == op_unary_plus) {
+    condition = condition->inner;
+  }
+  if (!options.vectorize || condition->type != op_less_than || node->actions->len != 2)
+    return false;
+  const AstNode *counter = condition->left;
+  AstNode *bound = condition->right;
+  if (counter->type != op_value_variable || table_pointed_to(contents, table, counter->token))
+    return false;
+  const Allocation *index = table_get_variable_by_token(table, contents, counter->token);
+  if (index == NULL || index->type.kind != i64)
+    return false;
+  if (bound->type == op_value_variable) {
+    const Allocation *limit = table_get_variable_by_token(table, contents, bound->token);
+    if (limit == NULL || limit->type.kind != i64 || tokens_equal(contents, bound->token, counter->token) ||
+        table_pointed_to(contents, table, bound->token))
+      return false;
+  } else if (bound->type != op_value_constant) {
+    return false;
+  }
+
+  int64_t stride;
+  const AstNode *increment = &node->actions->array[1];
+  if (!ast_induction_increment(contents, increment, &stride) || stride != 1 ||
+      !tokens_equal(contents, increment->left->token, counter->token))
+    return false;
+
+  const AstNode *store = &node->actions->array[0];
+  Width width;
+  if (store->type != op_assignment || !vector_element(contents, table, store->left, counter->token, &width))
+    return false;
+  const AstNode *value = store->right;
+  loop->sources[0] = value;
+  loop->sources[1] = NULL;
+  switch (value->type) {
+  case op_value_constant:
+    if (ast_constant_value(contents, value) != 0)
+      return false;
+    loop->operation = VZERO;
+    loop->sources[0] = NULL;
+    break;
+  case op_array_index:
+    loop->operation = VLOAD;
+    break;
+  case op_add:
+    loop->operation = VADD;
+    break;
+  case op_subtract:
+    loop->operation = VSUB;
+    break;
+  case op_multiply:
+    // SSE2 only multiplies 16-bit lanes, SSE4.1 adds pmulld
+    if (width != Word && !(width == Long && (options.features & FEATURE_SSE4_2)))
+      return false;
+    loop->operation = VMULL;
+    break;
+  case op_bitwise_and:
+    loop->operation = VAND;
+    break;
+  case op_bitwise_or:
+    loop->operation = VOR;
+    break;
+  case op_bitwise_xor:
+    loop->operation = VXOR;
+    break;
+  default:
+    return false;
+  }
+  if (loop->operation != VLOAD && loop->operation != VZERO) {
+    loop->sources[0] = value->left;
+    loop->sources[1] = value->right;
+  }
+  for (int i = 0; i < 2 && loop->sources[i] != NULL; ++i) {
+    Width source;
+    if (!vector_element(contents, table, loop->sources[i], counter->token, &source) || source != width)
+      return false;
+  }
+  loop->counter = counter->token;
+  loop->bound = bound;
+  loop->store = store;
+  return true;
+}
+
+void instruction_vector(InstructionTable *table, const InstructionType type, const Reference element, const int bytes) {
+  Instruction *instruction = table_next(table);
+  instruction->type = type;
+  instruction->inputs[1] = reference_constant_i(bytes);
+  if (type == VSTORE) {
+    instruction->output = element;
+    update_reference_out(table, instruction, element);
+  } else {
+    instruction->inputs[0] = element;
+    update_reference(table, instruction, element);
+  }
+}
+
+Reference vector_element_reference(const char *contents, const InstructionTable *table, const AstNode *node,
+                                   Allocation *counter) {
+  Allocation *array = table_get_variable_by_token(table, contents, node->left->token);
+  Reference element = reference_deref(array);
+  element.index = counter;
+  element.scale = (uint8_t)type_size(*array->type.inner);
+  return element;
+}
+
+// runs a VectorLoop 16 bytes (32 with AVX2) at a time for as long as a whole vector remains, leaving the rest to the
+// scalar loop that follows it
+void loop_vectorize(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                    LiteralPool *literals, const VectorLoop *loop) {
+  Allocation *counter = table_get_variable_by_token(table, contents, loop->counter);
+  const Reference destination = vector_element_reference(contents, table, loop->store->left, counter);
+  const bool wide = (options.features & FEATURE_AVX2) != 0;
+  const int bytes = wide ? 32 : 16;
+  const int lanes = bytes / destination.scale;
+  const int skip = table_allocate_label(table);
+
+  // storing up to a vector past a source would change lanes of it that were already loaded
+  for (int i = 0; i < 2 && loop->sources[i] != NULL; ++i) {
+    const Reference source = vector_element_reference(contents, table, loop->sources[i], counter);
+    if (source.allocation == destination.allocation)
+      continue;
+    Reference distance = instruction_basic_op(table, SUB, reference_direct(destination.allocation),
+                                              reference_direct(source.allocation), "overlap");
+    distance = instruction_basic_op(table, SUB, distance, reference_constant_i(1), NULL);
+    distance = instruction_basic_op(table, SHR, distance, reference_constant_i(wide ? 5 : 4), NULL);
+    instruction_compare(table, distance, reference_constant_i(0), NULL);
+    instruction_branch(table, JE, skip);
+  }
+  const Reference limit =
+      instruction_basic_op(table, SUB, solve_ast_node(contents, table, globals, functions, literals, loop->bound),
+                           reference_constant_i(lanes - 1), NULL);
+
+  const int condLabel = table_allocate_label(table);
+  instruction_jump(table, condLabel);
+  instruction_label(table, condLabel);
+  const int first = nextInstrId;
+  const int live = table->allocations.len;
+  instruction_compare(table, reference_direct(counter), limit, "vector");
+  Instruction *block = instruction_block(table, JL, table_allocate_label(table));
+  InstructionTable *body = &block->instructions;
+  if (loop->operation == VZERO) {
+    instruction_vector(body, VZERO, reference_constant_i(0), bytes);
+  } else {
+    instruction_vector(body, VLOAD, vector_element_reference(contents, table, loop->sources[0], counter), bytes);
+  }
+  if (loop->sources[1] != NULL) {
+    instruction_vector(body, loop->operation, vector_element_reference(contents, table, loop->sources[1], counter),
+                       bytes);
+  }
+  instruction_vector(body, VSTORE, destination, bytes);
+  instruction_in_place(body, ADD, reference_direct(counter), reference_constant_i(lanes), "vector");
+  instruction_jump(body, condLabel);
+  instruction_jump(table, skip);
+  block->instructions.escape = instruction_label(table, skip);
+  if (wide) {
+    instruction_vector(table, VCLEAR, reference_constant_i(0), bytes);
+  }
+
+  for (int j = 0; j < live; ++j) {
+    Allocation *allocation = table->allocations.array[j];
+    if (allocation->lastInstr >= first) {
+      allocation->lastInstr = block->instructions.escape;
+    }
+  }
+  available_kill(contents, loop->counter);
+  available_clobber(false);
+}
+
+void instruction_rep(InstructionTable *table, const InstructionType type, const Reference destination,
+                     const Reference source, const int64_t length) {
+  Instruction *instruction = table_next(table);
+  instruction->type = type;
+  instruction->inputs[0] = destination;
+  instruction->inputs[1] = source;
+  instruction->output = reference_constant_i(length);
+  instruction->comment = NULL;
+  update_reference(table, instruction, destination);
+  update_reference(table, instruction, source);
+}
+
+// the address as a local that can be the base of a memory operand
+Allocation *reference_pointer(InstructionTable *table, const Reference address, const Type type) {
+  if (address.access == Direct && address.allocation->type.kind == ptr)
+    return address.allocation;
+  Allocation *pointer = table_allocate(table, type);
+  instruction_mov(table, address, reference_direct(pointer), NULL);
+  return pointer;
+}
+
+// memset/memcpy of a small constant length, written out in place of the call. copies and zero fills of 16 to 128
+// bytes go through %xmm0 16 bytes at a time, the last store overlapping the one before it when the length is not a
+// multiple of 16, and the rest become a single rep stosb/movsb.
+// returns false for unknown or large lengths, which the library handles better
+bool expand_memory_call(InstructionTable *table, const Function *function, const Reference *arguments) {
+  const bool copy = strcmp(function->name, "memcpy") == 0;
+  int64_t length;
+  int64_t zero;
+  if (!reference_constant(arguments[2], &length) || length < 0 || length > 256)
+    return false;
+  if (length == 0)
+    return true;
+
+  const bool vector = length >= 16 && length <= 128 && (copy || (reference_constant(arguments[1], &zero) && zero == 0));
+  if (!vector) {
+    instruction_rep(table, copy ? REP_MOVS : REP_STOS, arguments[0], arguments[1], length);
+    return true;
+  }
+  Allocation *destination = reference_pointer(table, arguments[0], function->arguments.array[0].type);
+  Allocation *source = copy ? reference_pointer(table, arguments[1], function->arguments.array[1].type) : NULL;
+  if (!copy) {
+    instruction_vector(table, VZERO, reference_constant_i(0), 16);
+  }
+  for (int64_t offset = 0; offset < length; offset += 16) {
+    const int32_t disp = (int32_t)(offset + 16 > length ? length - 16 : offset);
+    if (copy) {
+      Reference from = reference_deref(source);
+      from.disp = disp;
+      instruction_vector(table, VLOAD, from, 16);
+    }
+    Reference to = reference_deref(destination);
+    to.disp = disp;
+    instruction_vector(table, VSTORE, to, 16);
+  }
+  return true;
+}
+
+// libgcc's __popcountdi2, __ctzdi2 and __clzdi2 (behind __builtin_popcountll and friends), which are written out as
+// popcnt, tzcnt and lzcnt for targets that have them. NOT for any other function
+InstructionType function_bit_builtin(const Function *function) {
+  if (!options.builtins || function->start != NULL || function->arguments.len != 1 ||
+      is_sse(function->arguments.array[0].type.kind))
+    return NOT;
+  if (strcmp(function->name, "__popcountdi2") == 0 && (options.features & FEATURE_POPCNT))
+    return POPCNT;
+  if (strcmp(function->name, "__ctzdi2") == 0 && (options.features & FEATURE_BMI1))
+    return TZCNT;
+  if (strcmp(function->name, "__clzdi2") == 0 && (options.features & FEATURE_LZCNT))
+    return LZCNT;
+  return NOT;
+}
+
+Reference expand_bit_call(InstructionTable *table, const Function *function, const Reference value) {
+  const InstructionType type = function_bit_builtin(function);
+  int64_t constant;
+  if (reference_constant(value, &constant)) {
+    const uint64_t bits = (uint64_t)constant;
+    int64_t count = 0;
+    for (int i = 0; i < 64; ++i) {
+      if (type == POPCNT) {
+        count += (bits >> i) & 1;
+      } else if ((bits >> (type == TZCNT ? i : 63 - i)) & 1) {
+        break;
+      } else {
+        count++;
+      }
+    }
+    return reference_constant_i(count);
+  }
+  const Reference output = reference_direct(table_allocate(table, function->retVal));
+  Instruction *instruction = table_next(table);
+  instruction->type = type;
+  instruction->inputs[0] = value;
+  instruction->inputs[1] = reference_constant_i(0);
+  instruction->output = output;
+  instruction->comment = function->name;
+  update_reference(table, instruction, value);
+  update_reference_out(table, instruction, output);
+  return output;
+}
+
+Reference *solve_arguments(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                           LiteralPool *literals, AstNode *node) {
+  Reference *references = malloc(sizeof(Reference) * (node->function->arguments.len + 1));
+  for (int i = 0; i < node->function->arguments.len; ++i) {
+    references[i] = solve_ast_node(contents, table, globals, functions, literals, &node->arguments[i]);
+    if (references[i].access == Dereference) {
+      // loading the arguments may clobber the registers the address is built from
+      references[i] = instruction_mov(
+          table, references[i], reference_direct(table_allocate(table, *references[i].allocation->type.inner)), NULL);
+    }
+    // floating point arguments travel in xmm registers, so they are converted here rather than by the call
+    const Type type = node->function->arguments.array[i].type;
+    if (is_vector(type.kind)) {
+      references[i] = reference_to_vector(table, references[i], type);
+    } else if (is_fp(type.kind)) {
+      references[i] = reference_to_fp(table, references[i], type);
+    } else if (reference_is_fp(references[i])) {
+      references[i] = instruction_mov(table, references[i], reference_direct(table_allocate(table, type)), "convert");
+    }
+  }
+  return references;
+}
+
+bool ast_takes_address(const AstNode *node) {
+  switch (node->type) {
+  case op_nop:
+  case op_value_constant:
+  case op_value_string:
+  case op_value_variable:
+  case op_value_global:
+  case op_value_let:
+    return false;
+  case op_unary_addressof:
+    return node->inner->type == op_value_variable || ast_takes_address(node->inner);
+  case op_function:
+    for (int i = 0; i < node->function->arguments.len; ++i) {
+      if (ast_takes_address(&node->arguments[i]))
+        return true;
+    }
+    return false;
+  case cf_if:
+  case cf_while:
+    if (ast_takes_address(node->condition))
+      return true;
+    for (int i = 0; i < node->actions->len; ++i) {
+      if (ast_takes_address(&node->actions->array[i]))
+        return true;
+    }
+    if (node->type == cf_if && node->alternative != NULL) {
+      for (int i = 0; i < node->alternative->len; ++i) {
+        if (ast_takes_address(&node->alternative->array[i]))
+          return true;
+      }
+    }
+    return false;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_derefernce:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast:
+  case cf_return:
+    return ast_takes_address(node->inner);
+  default:
+    return ast_takes_address(node->left) || ast_takes_address(node->right);
+  }
+}
+
+// assignments `target = ...source...` between locals, through which an address may be copied
+typedef struct {
+  PtrList targets;
+  PtrList sources;
+} AddressFlows;
+
+void address_flow_value(const char *contents, InstructionTable *table, AddressFlows *flows, const Token *token,
+                        const Token *into, const bool escapes) {
+  if (escapes) {
+    ptrlist_add(&table->escaped, (void *)token);
+  } else if (into != NULL) {
+    ptrlist_add(&flows->targets, (void *)into);
+    ptrlist_add(&flows->sources, (void *)token);
+  }
+}
+
+// follows the value of `node` to where it ends up: assigned to the local `into`, consumed by a dereference, or
+// (`escapes`) handed to a callee, stored to memory or returned
+void address_flow(const char *contents, InstructionTable *table, AddressFlows *flows, const AstNode *node,
+                  const Token *into, const bool escapes) {
+  switch (node->type) {
+  case op_nop:
+  case op_value_constant:
+  case op_value_string:
+  case op_value_global:
+  case op_value_let:
+    return;
+  case op_value_variable:
+    address_flow_value(contents, table, flows, node->token, into, escapes);
+    return;
+  case op_unary_addressof:
+    if (node->inner->type == op_value_variable) {
+      ptrlist_add(&table->pointedTo, (void *)node->inner->token);
+      address_flow_value(contents, table, flows, node->inner->token, into, escapes);
+    } else {
+      address_flow(contents, table, flows, node->inner, into, escapes);
+    }
+    return;
+  case op_unary_derefernce:
+  case op_member_access:
+  case op_deref_member_access:
+    address_flow(contents, table, flows, node->inner, NULL, false);
+    return;
+  case op_array_index:
+    address_flow(contents, table, flows, node->left, NULL, false);
+    address_flow(contents, table, flows, node->right, NULL, false);
+    return;
+  case op_assignment:
+    if (node->left->type == op_value_variable || node->left->type == op_value_let) {
+      address_flow(contents, table, flows, node->right, node->left->token, false);
+    } else {
+      address_flow(contents, table, flows, node->left, NULL, false);
+      address_flow(contents, table, flows, node->right, NULL, true);
+    }
+    return;
+  case op_function:
+    if (function_is_memory_builtin(node->function)) {
+      // both return their destination
+      address_flow(contents, table, flows, &node->arguments[0], into, escapes);
+      address_flow(contents, table, flows, &node->arguments[1], NULL, false);
+      address_flow(contents, table, flows, &node->arguments[2], NULL, false);
+      return;
+    }
+    for (int i = 0; i < node->function->arguments.len; ++i) {
+      address_flow(contents, table, flows, &node->arguments[i], NULL, true);
+    }
+    return;
+  case cf_return:
+    address_flow(contents, table, flows, node->inner, NULL, true);
+    return;
+  case cf_if:
+  case cf_while:
+    address_flow(contents, table, flows, node->condition, NULL, false);
+    for (int i = 0; i < node->actions->len; ++i) {
+      address_flow(contents, table, flows, &node->actions->array[i], NULL, false);
+    }
+    if (node->type == cf_if && node->alternative != NULL) {
+      for (int i = 0; i < node->alternative->len; ++i) {
+        address_flow(contents, table, flows, &node->alternative->array[i], NULL, false);
+      }
+    }
+    return;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_cast:
+    address_flow(contents, table, flows, node->inner, into, escapes);
+    return;
+  default:
+    address_flow(contents, table, flows, node->left, into, escapes);
+    address_flow(contents, table, flows, node->right, into, escapes);
+  }
+}
+
+// escape analysis: which locals are pointed to, and which of those a callee or a store through memory could write
+void table_analyse_addresses(InstructionTable *table, const char *contents, const AstNodeList *nodes) {
+  AddressFlows flows;
+  ptrlist_init(&flows.targets, 4);
+  ptrlist_init(&flows.sources, 4);
+  for (int i = 0; i < nodes->len; ++i) {
+    address_flow(contents, table, &flows, &nodes->array[i], NULL, false);
+  }
+  // an address copied into a local escapes along with that local
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int i = 0; i < flows.targets.len; ++i) {
+      if (tokens_count(contents, &table->escaped, flows.targets.array[i]) != 0 &&
+          tokens_count(contents, &table->escaped, flows.sources.array[i]) == 0) {
+        ptrlist_add(&table->escaped, flows.sources.array[i]);
+        changed = true;
+      }
+    }
+  }
+  free(flows.targets.array);
+  free(flows.sources.array);
+}
+
+// locals live below the stack pointer and arguments past the sixth above the return address, so `return f(...)`
+// can hand our return address to f as long as f takes no stack arguments and nothing points into our frame
+bool ast_is_tail_call(const InstructionTable *table, const FunctionList *functions, const AstNode *call) {
+  if (!options.tailCalls || table->addressTaken || call->function->retVal.kind == 0)
+    return false;
+  for (int i = 0; i < call->function->arguments.len; ++i) {
+    if (argument_register(call->function, i) == -1)
+      return false;
+  }
+  const int caller = functionlist_indexof(functions, table->name);
+  return caller != -1 && type_width(functions->array[caller].retVal) == type_width(call->function->retVal) &&
+         is_fp(functions->array[caller].retVal.kind) == is_fp(call->function->retVal.kind);
+}
+
+// size of a callee's return expression in AST nodes, or -1 when it writes memory, takes an address or reads anything
+// other than its parameters and globals
+int ast_inline_cost(const char *contents, const Function *function, const AstNode *node) {
+  switch (node->type) {
+  case op_value_constant:
+  case op_value_string:
+  case op_value_global:
+    return 1;
+  case op_value_variable:
+    return varlist_get_by_token(&function->arguments, contents, node->token) != NULL ? 1 : -1;
+  case op_function: {
+    int cost = 1;
+    for (int i = 0; i < node->function->arguments.len; ++i) {
+      const int argument = ast_inline_cost(contents, function, &node->arguments[i]);
+      if (argument == -1)
+        return -1;
+      cost += argument;
+    }
+    return cost;
+  }
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_derefernce:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast: {
+    const int inner = ast_inline_cost(contents, function, node->inner);
+    return inner == -1 ? -1 : inner + 1;
+  }
+  case op_array_index:
+  case op_add:
+  case op_subtract:
+  case op_multiply:
+  case op_divide:
+  case op_modulo:
+  case op_bitwise_or:
+  case op_bitwise_xor:
+  case op_bitwise_and:
+  case op_and:
+  case op_or:
+  case op_bitwise_left_shift:
+  case op_bitwise_right_shift:
+  case op_compare_equals:
+  case op_compare_not_equals:
+  case op_less_than:
+  case op_greater_than:
+  case op_less_than_equal:
+  case op_greater_than_equal: {
+    const int left = ast_inline_cost(contents, function, node->left);
+    const int right = ast_inline_cost(contents, function, node->right);
+    return left == -1 || right == -1 ? -1 : left + right + 1;
+  }
+  default:
+    return -1;
+  }
+}
+
+// only callees whose body is a single `return <expression>` are expanded, so no control flow or locals have to be
+// carried over. a function with one call site may be twice the size, as its out-of-line copy is then never called.
+// the callee's tokens only mean something in its own file, so it must share the caller's
+bool function_inlinable(const char *contents, const InstructionTable *table, const Function *function) {
+  if (options.inlineLimit <= 0 || function->source != contents || function->body == NULL || function->body->len != 1 ||
+      function->body->array[0].type != cf_return || function->retVal.kind == 0 ||
+      strcmp(function->name, table->name) == 0 || inlining.len >= 8)
+    return false;
+  for (int i = 0; i < inlining.len; ++i) {
+    if (inlining.array[i] == function)
+      return false;
+  }
+  const int cost = ast_inline_cost(contents, function, function->body->array[0].inner);
+  const int limit = function->callSites == 1 ? options.inlineLimit * 2 : options.inlineLimit;
+  return cost != -1 && cost <= limit;
+}
+
+// a callee whose body is `return g(...)`: expanded in tail position it would turn its own tail call into a call and a
+// ret, so there it is jumped to instead
+bool function_returns_call(const Function *function) {
+  return function->body != NULL && function->body->len == 1 && function->body->array[0].type == cf_return &&
+         function->body->array[0].inner->type == op_function;
+}
+
+bool types_equal(const Type a, const Type b) {
+  if (a.kind != b.kind)
+    return false;
+  return a.kind != ptr || types_equal(*a.inner, *b.inner);
+}
+
+// substitutes the caller's argument for every use of a parameter in the callee's expression
+void inline_bind(const char *contents, const Function *function, const AstNode *node, const Reference *arguments) {
+  switch (node->type) {
+  case op_value_constant:
+  case op_value_string:
+  case op_value_global:
+    return;
+  case op_value_variable: {
+    const Hoisted entry = {
+        .node = node,
+        .value = arguments[varlist_get_by_token(&function->arguments, contents, node->token) -
+                           function->arguments.array],
+        .induction = false,
+        .depth = loopDepth};
+    hoistedlist_add(&hoisted, entry);
+    return;
+  }
+  case op_function:
+    for (int i = 0; i < node->function->arguments.len; ++i) {
+      inline_bind(contents, function, &node->arguments[i], arguments);
+    }
+    return;
+  case op_unary_negate:
+  case op_unary_plus:
+  case op_unary_derefernce:
+  case op_unary_not:
+  case op_unary_bitwise_not:
+  case op_member_access:
+  case op_deref_member_access:
+  case op_cast:
+    inline_bind(contents, function, node->inner, arguments);
+    return;
+  default:
+    inline_bind(contents, function, node->left, arguments);
+    inline_bind(contents, function, node->right, arguments);
+  }
+}
+
+Reference inline_call(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                      LiteralPool *literals, Function *function, Reference *arguments) {
+  if (hoisted.array == NULL) {
+    hoistedlist_init(&hoisted, 8);
+  }
+  if (inlining.array == NULL) {
+    ptrlist_init(&inlining, 4);
+  }
+  for (int i = 0; i < function->arguments.len; ++i) {
+    const Type type = function->arguments.array[i].type;
+    int64_t value;
+    if (is_vector(type.kind)) {
+      arguments[i] = reference_to_vector(table, arguments[i], type);
+      continue;
+    }
+    if (reference_constant(arguments[i], &value)) {
+      // constants fold as signed 64-bit values, so only a parameter of exactly that type may stay one. anything
+      // narrower wraps at its own width, and anything unsigned divides differently
+      if (type_width(type) == Quad && !typekind_unsigned(type.kind))
+        continue;
+    } else if (!isAllocated(arguments[i].access) || types_equal(reference_type(arguments[i]), type)) {
+      continue;
+    }
+    arguments[i] = instruction_mov(table, arguments[i], reference_direct(table_allocate(table, type)), "inline");
+  }
+
+  AstNode *expression = function->body->array[0].inner;
+  const int bound = hoisted.len;
+  inline_bind(contents, function, expression, arguments);
+  ptrlist_add(&inlining, function);
+  Reference result = solve_ast_node(contents, table, globals, functions, literals, expression);
+  inlining.len--;
+  hoisted.len = bound;
+  free(arguments);
+
+  if (is_vector(function->retVal.kind)) {
+    result = reference_to_vector(table, result, function->retVal);
+  } else if ((isAllocated(result.access) && !types_equal(reference_type(result), function->retVal)) ||
+             reference_is_fp(result) != is_fp(function->retVal.kind)) {
+    result = instruction_mov(table, result, reference_direct(table_allocate(table, function->retVal)), "inline");
+  }
+  return result;
+}
+
+Reference solve_ast_operation(const char *contents, InstructionTable *table, VarList *globals,
+                              FunctionList *functions, LiteralPool *literals, AstNode *node);
+Reference solve_location(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                         LiteralPool *literals, AstNode *node);
+
+Reference solve_ast_node(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                         LiteralPool *literals, AstNode *node) {
+  const Hoisted *entry = hoisted_get(node);
+  if (entry != NULL) {
+    return entry->value;
+  }
+  if (!value_numbered(node)) {
+    return solve_ast_operation(contents, table, globals, functions, literals, node);
+  }
+  const Available *known = available_get(contents, node);
+  if (known != NULL) {
+    return known->value;
+  }
+  const Reference value = solve_ast_operation(contents, table, globals, functions, literals, node);
+  if (isAllocated(value.access)) {
+    available_add(contents, table, node, value);
+  }
+  return value;
+}
+
+// the storage a node names rather than its value, for assignments and address-of
+Reference solve_location(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
+                         LiteralPool *literals, AstNode *node) {
+  if (node->type == op_value_variable) {
+    return reference_direct(table_get_variable_by_token(table, contents, node->token));
+  }
+  return solve_ast_node(contents, table, globals, functions, literals, node);
+}
+
+// the field of the struct at `base`, as the same memory operand moved along by the field's offset. the base address is
+// copied so that it can take the field's type, which is all a dereference's width is read from
+Reference member_reference(const char *contents, InstructionTable *table, Reference base, const AstNode *name) {
+  const Field *field = name->type == op_value_variable
+                           ? struct_field(reference_type(base).structure, contents, name->token)
+                           : NULL;
+  if (field == NULL) {
+    printf("%s has no such field\n", reference_type(base).structure->name);
+    exit(25);
+  }
+  if ((int64_t)base.disp + field->offset > INT32_MAX) {
+    puts("field offset out of range");
+    exit(25);
+  }
+  Allocation *address = table_allocate(table, (Type){.kind = ptr, .inner = (Type *)&field->type});
+  instruction_mov(table, reference_direct(base.allocation), reference_direct(address), "member");
+  Reference out = base;
+  out.allocation = address;
+  out.disp += field->offset;
+  return out;
+}
+
+Reference solve_ast_operation(const char *contents, InstructionTable *table, VarList *globals,
+                              FunctionList *functions, LiteralPool *literals, AstNode *node) {
+  switch (node->type) {
+  case op_nop:
+    exit(112);
+  case op_array_index: {
+    Reference array = solve_ast_node(contents, table, globals, functions, literals, node->left);
+    if (reference_is_vector(array)) {
+      const Reference index = vector_lane_index(
+          table, reference_type(array).kind, solve_ast_node(contents, table, globals, functions, literals, node->right));
+      const Reference lane =
+          reference_direct(table_allocate(table, (Type){.kind = vector_lane(reference_type(array).kind)}));
+      instruction_lanes(table, EXTRACT, lane, array, index, "lane");
+      return lane;
+    }
+    if (array.access == Dereference) {
+      array = instruction_mov(table, array, reference_direct(table_allocate(table, *array.allocation->type.inner)),
+                              NULL);
+    }
+    if (array.access != Direct) {
+      return array_index_arithmetic(contents, table, globals, functions, literals, node, array);
+    }
+    return array_index_address(contents, table, globals, functions, literals, node, array);
+  }
+  case op_comma: {
+    // discard left, keep right
+    solve_ast_node(contents, table, globals, functions, literals, node->left);
+    return solve_ast_node(contents, table, globals, functions, literals, node->right);
+  }
+  case op_unary_negate: {
+    Reference inner = solve_ast_node(contents, table, globals, functions, literals, node->inner);
+    Reference folded;
+    double value;
+    if (fold_constants(SUB, reference_constant_i(0), inner, &folded)) {
+      return folded;
+    }
+    if (inner.access == ConstantF && reference_constant_f(inner, &value)) {
+      return reference_constant_fp(-value);
+    }
+    if (reference_is_vector(inner)) {
+      // flipping the sign bits leaves NaN payloads and zeroes alone, like the scalar negate
+      if (is_fp(vector_lane(reference_type(inner).kind)))
+        return instruction_packed_op(table, XOR, inner, reference_constant_fp(-0.0), "negate");
+      return instruction_packed_op(table, SUB, reference_constant_i(0), inner, "negate");
+    }
+    Reference reference =
+        instruction_mov(table, inner, reference_direct(table_allocate_infer_type(table, inner)), NULL);
+    instruction_unary(table, NEG, reference, "negate");
+    return reference;
+  }
+  case op_unary_plus: {
+    return solve_ast_node(contents, table, globals, functions, literals, node->inner); // no effect
+  }
+  case op_unary_addressof: {
+    Reference inner = solve_location(contents, table, globals, functions, literals, node->inner);
+    assert(isAllocated(inner.access));
+
+    if (inner.access == Dereference) {
+      if (inner.index == NULL && inner.disp == 0) {
+        inner.access = Direct;
+        return inner;
+      }
+      Allocation *output = table_allocate(table, inner.allocation->type);
+      instruction_lea(table, inner, reference_direct(output), "addressof");
+      return reference_direct(output);
+    }
+    inner.allocation->lvalue = true;
+    Type type = {.kind = ptr, .inner = &inner.allocation->type};
+    Allocation *output = table_allocate(table, type);
+    instruction_lea(table, inner, reference_direct(output), "addressof");
+    return reference_direct(output);
+  }
+  case op_unary_derefernce: {
+    Reference inner = solve_ast_node(contents, table, globals, functions, literals, node->inner);
+    switch (inner.access) {
+    case Direct:
+      return reference_deref(inner.allocation);
+    case Dereference: {
+      return reference_deref(
+          instruction_mov(table, inner, reference_direct(table_allocate(table, *inner.allocation->type.inner)), NULL)
+              .allocation);
+    }
+      // case ConstantS:
+      //   break;
+    default:
+      assert(false);
+    }
+  } break;
+  case op_unary_not: {
+    return instr_test_self(table, SETE, solve_ast_node(contents, table, globals, functions, literals, node->inner),
+                           "not");
   }
   case op_unary_bitwise_not: {
     Reference inner = solve_ast_node(contents, table, globals, functions, literals, node->inner);
+    Reference folded;
+    if (fold_constants(XOR, reference_constant_i(-1), inner, &folded)) {
+      return folded;
+    }
+    if (reference_is_vector(inner)) {
+      if (is_fp(vector_lane(reference_type(inner).kind))) {
+        puts("~ is only defined on integer lanes");
+        exit(25);
+      }
+      return instruction_packed_op(table, XOR, inner, reference_constant_i(-1), "not");
+    }
     Reference reference = reference_direct(table_allocate_infer_type(table, inner));
     instruction_mov(table, inner, reference, NULL);
     instruction_unary(table, NOT, reference, "not");
@@ -578,13 +2924,19 @@ Reference solve_ast_node(const char *contents, InstructionTable *table, VarList
     return ast_basic_op(SUB, contents, table, globals, functions, literals, node, "sub");
   }
   case op_multiply: {
-    return ast_basic_op(IMUL, contents, table, globals, functions, literals, node, "mul");
+    Reference left = solve_ast_node(contents, table, globals, functions, literals, node->left);
+    Reference right = solve_ast_node(contents, table, globals, functions, literals, node->right);
+    return instruction_multiply(table, left, right, "mul");
   }
   case op_divide: {
-    return ast_sp_out_op(IDIV, contents, table, globals, functions, literals, node, "div");
+    Reference left = solve_ast_node(contents, table, globals, functions, literals, node->left);
+    Reference right = solve_ast_node(contents, table, globals, functions, literals, node->right);
+    return instruction_divide(table, left, right, false, "div");
   }
   case op_modulo: {
-    return ast_sp_out_op(IDIV_mod, contents, table, globals, functions, literals, node, "mod");
+    Reference left = solve_ast_node(contents, table, globals, functions, literals, node->left);
+    Reference right = solve_ast_node(contents, table, globals, functions, literals, node->right);
+    return instruction_divide(table, left, right, true, "mod");
   }
   case op_bitwise_or: {
     return ast_basic_op(OR, contents, table, globals, functions, literals, node, "bitwise or");
@@ -596,10 +2948,44 @@ Reference solve_ast_node(const char *contents, InstructionTable *table, VarList
     return ast_basic_op(AND, contents, table, globals, functions, literals, node, "bitwise and");
   }
   case op_assignment: {
-    return instruction_mov(table, solve_ast_node(contents, table, globals, functions, literals, node->right),
-                           solve_ast_node(contents, table, globals, functions, literals, node->left), "assignment");
+    if (ast_vector_lane(contents, table, node->left)) {
+      Reference value = solve_ast_node(contents, table, globals, functions, literals, node->right);
+      const Reference vector = solve_ast_node(contents, table, globals, functions, literals, node->left->left);
+      const Reference index = vector_lane_index(
+          table, reference_type(vector).kind,
+          solve_ast_node(contents, table, globals, functions, literals, node->left->right));
+      Allocation *variable = table_get_variable_by_token(table, contents, node->left->left->token);
+      const Type lane = {.kind = vector_lane(variable->type.kind)};
+      if (isAllocated(value.access) && reference_type(value).kind != lane.kind) {
+        value = instruction_mov(table, value, reference_direct(table_allocate(table, lane)), "convert");
+      }
+      const Reference updated = instruction_mov(table, vector, reference_direct(variable), "lane");
+      instruction_lanes(table, INSERT, updated, value, index, "lane");
+      available_kill(contents, node->left->left->token);
+      if (table_pointed_to(contents, table, node->left->left->token)) {
+        available_clobber(false);
+      }
+      return value;
+    }
+    const Reference reference =
+        instruction_mov(table, solve_ast_node(contents, table, globals, functions, literals, node->right),
+                        solve_location(contents, table, globals, functions, literals, node->left), "assignment");
+    loop_advance_inductions(table, node);
+    if (node->left->type == op_value_variable) {
+      available_kill(contents, node->left->token);
+      if (table_pointed_to(contents, table, node->left->token)) {
+        // it may be read back through a pointer
+        available_clobber(false);
+      }
+    } else if (node->left->type != op_value_let) {
+      available_clobber(false);
+    }
+    return reference;
   }
   case op_and: {
+    if (!ast_is_straight_line(node->right)) {
+      return solve_short_circuit(contents, table, globals, functions, literals, node);
+    }
     const Reference left = solve_ast_node(contents, table, globals, functions, literals, node->left);
     const Reference lhs = instr_test_self(table, SETNE, left, NULL);
 
@@ -609,18 +2995,67 @@ Reference solve_ast_node(const char *contents, InstructionTable *table, VarList
     return instruction_basic_op(table, AND, lhs, rhs, "and");
   }
   case op_or: {
-    ast_basic_op(OR, contents, table, globals, functions, literals, node, "or");
+    if (!ast_is_straight_line(node->right)) {
+      return solve_short_circuit(contents, table, globals, functions, literals, node);
+    }
+    const Reference value = ast_basic_op(OR, contents, table, globals, functions, literals, node, "or");
+    int64_t constant;
+    if (reference_constant(value, &constant)) {
+      return reference_constant_i(constant != 0);
+    }
     return instruction_sp_reg_read(table, SETNE, NULL);
   }
-  case op_deref_member_access:
-    break;
-  case op_member_access:
-    break;
+  case op_deref_member_access: {
+    Reference base = solve_ast_node(contents, table, globals, functions, literals, node->left);
+    if (!isAllocated(base.access) || reference_type(base).kind != ptr ||
+        reference_type(base).inner->kind != aggregate) {
+      puts("-> is only defined on pointers to structs");
+      exit(25);
+    }
+    if (base.access != Direct) {
+      base = instruction_mov(table, base, reference_direct(table_allocate(table, reference_type(base))), NULL);
+    }
+    return member_reference(contents, table, reference_deref(base.allocation), node->right);
+  }
+  case op_member_access: {
+    const Reference vector = solve_ast_node(contents, table, globals, functions, literals, node->left);
+    if (vector.access == Dereference && reference_type(vector).kind == aggregate) {
+      return member_reference(contents, table, vector, node->right);
+    }
+    if (isAllocated(vector.access) && reference_type(vector).kind == ptr &&
+        reference_type(vector).inner->kind == aggregate) {
+      puts("use -> to reach the fields of a struct through a pointer");
+      exit(25);
+    }
+    const bool named = reference_is_vector(vector) && node->right->type == op_value_variable;
+    const TypeKind lane = named ? vector_lane(reference_type(vector).kind) : i64;
+    InstructionType type = NOT;
+    if (named && token_str_cmp(node->right->token, contents, "sum") == 0) {
+      type = REDUCE_ADD;
+    } else if (named && token_str_cmp(node->right->token, contents, "min") == 0) {
+      type = REDUCE_MIN;
+    } else if (named && token_str_cmp(node->right->token, contents, "max") == 0) {
+      type = REDUCE_MAX;
+    }
+    // 64-bit lanes have no signed comparison (pcmpgtq) before SSE4.2
+    if (type == NOT ||
+        (type != REDUCE_ADD && (lane == i64 || lane == u64) && !(options.features & FEATURE_SSE4_2))) {
+      puts("vectors only have .sum, .min and .max (and no .min or .max on 64-bit integer lanes without SSE4.2)");
+      exit(25);
+    }
+    const Reference output = reference_direct(table_allocate(table, (Type){.kind = lane}));
+    instruction_lanes(table, type, output, vector, reference_constant_i(0), "reduce");
+    return output;
+  }
   case op_bitwise_left_shift: {
     return ast_basic_op(SAL, contents, table, globals, functions, literals, node, "lsh");
   }
   case op_bitwise_right_shift: {
-    return ast_basic_op(SAR, contents, table, globals, functions, literals, node, "rsh");
+    // unsigned values shift zeroes in from the top, signed ones copies of their sign
+    const Reference value = solve_ast_node(contents, table, globals, functions, literals, node->left);
+    const bool logical = isAllocated(value.access) && typekind_unsigned(reference_type(value).kind);
+    return instruction_basic_op(table, logical ? SHR : SAR, value,
+                                solve_ast_node(contents, table, globals, functions, literals, node->right), "rsh");
   }
   case op_compare_equals: {
     Reference left = solve_ast_node(contents, table, globals, functions, literals, node->left);
@@ -654,36 +3089,62 @@ Reference solve_ast_node(const char *contents, InstructionTable *table, VarList
   }
   case op_value_constant: {
     Reference reference;
-    reference.access = ConstantI;
     reference.value = token_copy(node->token, contents);
+    reference.access = strchr(reference.value, '.') != NULL ? ConstantF : ConstantI;
     return reference;
   }
   case op_value_string: {
     Reference reference;
     reference.access = ConstantS;
-    char *copy = token_copy(node->token, contents);
-    reference.str = strlist_indexof(literals, copy);
-    free(copy);
+    reference.str = pool_indexof(literals, contents, node->token);
     return reference;
   }
   case op_value_variable: {
-    Reference reference;
-    reference.access = Direct;
-    reference.allocation = table_get_variable_by_token(table, contents, node->token);
-    return reference;
+    Allocation *allocation = table_get_variable_by_token(table, contents, node->token);
+    if (!options.gvn || !allocation->lvalue) {
+      return reference_direct(allocation);
+    }
+    // a variable that is pointed to lives in memory, so its value is kept in a register until something could
+    // write to it
+    const Available *known = available_get(contents, node);
+    if (known != NULL) {
+      return known->value;
+    }
+    const Reference value = instruction_mov(table, reference_direct(allocation),
+                                            reference_direct(table_allocate(table, allocation->type)), "promote");
+    available_add(contents, table, node, value);
+    return value;
   }
   case op_value_global: {
-    Reference reference;
-    reference.access = Global;
-    char *copy = token_copy(node->token, contents);
-    assert(varlist_indexof(globals, copy) != -1);
-    reference.value = copy;
-    return reference;
+    // read and written through its address, like any other memory. the address carries the global's type, which
+    // is all a dereference's width is read from
+    Variable *global = varlist_get_by_token(globals, contents, node->token);
+    assert(global != NULL);
+    Allocation *address = table_allocate(table, (Type){.kind = ptr, .inner = &global->type});
+    instruction_mov(table, (Reference){.access = GlobalRef, .value = strdup(global->name)}, reference_direct(address),
+                    "global");
+    return reference_deref(address);
   }
   case op_cast: {
     Reference inner = solve_ast_node(contents, table, globals, functions, literals, node->inner);
+    if (is_vector(node->val_type.kind)) {
+      return reference_to_vector(table, inner, node->val_type);
+    }
+    if (reference_is_vector(inner)) {
+      puts("vectors only turn into other values through a lane or a reduction");
+      exit(25);
+    }
+    double value;
+    if (is_fp(node->val_type.kind) && reference_constant_f(inner, &value)) {
+      return reference_constant_fp(value);
+    }
+    if (inner.access == ConstantF && reference_constant_f(inner, &value)) {
+      return reference_constant_i((int64_t)value);
+    }
     if (isAllocated(inner.access)) {
-      if (inner.allocation->type.kind != node->val_type.kind) {
+      if (inner.allocation->type.kind != node->val_type.kind ||
+          (node->val_type.kind == ptr && !types_equal(inner.allocation->type, node->val_type))) {
+        // a pointer cast changes what the loads through it read
         Reference reference = reference_direct(table_allocate(table, node->val_type));
         instruction_mov(table, inner, reference, "cast");
         return reference;
@@ -692,23 +3153,41 @@ Reference solve_ast_node(const char *contents, InstructionTable *table, VarList
     return inner;
   }
   case op_value_let:
+    available_kill(contents, node->token);
     return reference_direct(table_allocate_variable(table, node->variable));
   case op_function: {
-    Reference *references = malloc(sizeof(Reference) * (node->function->arguments.len + 1));
-    for (int i = 0; i < node->function->arguments.len; ++i) {
-      references[i] = solve_ast_node(contents, table, globals, functions, literals, &node->arguments[i]);
+    Reference *arguments = solve_arguments(contents, table, globals, functions, literals, node);
+    if (function_inlinable(contents, table, node->function)) {
+      return inline_call(contents, table, globals, functions, literals, node->function, arguments);
+    }
+    if (function_bit_builtin(node->function) != NOT) {
+      return expand_bit_call(table, node->function, arguments[0]);
+    }
+    if (function_is_memory_builtin(node->function)) {
+      available_clobber(false);
+      if (options.builtins && expand_memory_call(table, node->function, arguments)) {
+        return arguments[0];
+      }
+    }
+    const Reference value = instruction_call(table, node->function, arguments,
+                                             reference_direct(table_allocate(table, node->function->retVal)));
+    if (!function_is_memory_builtin(node->function)) {
+      available_clobber(true);
     }
-    return instruction_call(table, node->function, references,
-                            reference_direct(table_allocate(table, node->function->retVal)));
+    return value;
   }
   case cf_if: {
-    instruction_no_output(table, CMP, (Reference){.access = ConstantI, .value = strdup("0")},
-                          solve_ast_node(contents, table, globals, functions, literals, node->condition), NULL);
     int label = table_allocate_label(table);
-    Instruction *i = instruction_jump_code(table, contents, globals, functions, literals, JNE, label, node->actions);
+    int body = table_allocate_label(table);
+    int otherwise = node->alternative != NULL ? table_allocate_label(table) : label;
+    InstructionType type =
+        solve_condition(contents, table, globals, functions, literals, node->condition, false, body, otherwise);
+    Instruction *i = instruction_jump_code_labelled(table, contents, globals, functions, literals, type, body, label,
+                                                    node->actions);
     Instruction *j = NULL;
     if (node->alternative != NULL) {
-      j = instruction_jump_code(table, contents, globals, functions, literals, JMP, label, node->alternative);
+      j = instruction_jump_code_labelled(table, contents, globals, functions, literals, JMP, otherwise, label,
+                                         node->alternative);
     } else {
       instruction_jump(table, label);
     }
@@ -719,22 +3198,70 @@ Reference solve_ast_node(const char *contents, InstructionTable *table, VarList
     return reference_direct(NULL);
   }
   case cf_while: {
+    VectorLoop vector;
+    if (loop_vectorizable(contents, table, node, &vector)) {
+      loop_vectorize(contents, table, globals, functions, literals, &vector);
+    }
     int escLabel = table_allocate_label(table);
     int condLabel = table_allocate_label(table);
+    const int preheader = table->allocations.len;
+    const int outerHoisted = hoisted.len;
+    const int outerInductions = inductions.len;
+    const int outerAddressed = addressed.len;
+    const int outerAvailable = available.len;
+    loopDepth++;
+    loop_preheader(contents, table, globals, functions, literals, node);
     instruction_jump(table, condLabel);
     instruction_label(table, condLabel);
-    instruction_no_output(table, CMP, (Reference){.access = ConstantI, .value = strdup("0")},
-                          solve_ast_node(contents, table, globals, functions, literals, node->condition), NULL);
-    Instruction *i =
-        instruction_jump_code(table, contents, globals, functions, literals, JNE, condLabel, node->actions);
+    const int first = nextInstrId;
+    const int live = table->allocations.len;
+    int body = table_allocate_label(table);
+    InstructionType type =
+        solve_condition(contents, table, globals, functions, literals, node->condition, false, body, escLabel);
+    Instruction *i = instruction_jump_code_labelled(table, contents, globals, functions, literals, type, body,
+                                                    condLabel, node->actions);
 
     instruction_jump(table, escLabel);
     i->instructions.escape = instruction_label(table, escLabel);
 
+    // the condition runs again after the body, so anything it reads must survive until the loop exits.
+    // the same goes for values hoisted into the preheader that only the body reads
+    for (int j = 0; j < live; ++j) {
+      Allocation *allocation = table->allocations.array[j];
+      if (allocation->lastInstr >= first || (j >= preheader && allocation->lastInstr == -1)) {
+        allocation->lastInstr = i->instructions.escape;
+      }
+    }
+
+    loopDepth--;
+    hoisted.len = outerHoisted;
+    inductions.len = outerInductions;
+    addressed.len = outerAddressed;
+    available.len = outerAvailable;
+
     return reference_direct(NULL);
   }
   case cf_return: {
-    return instruction_ret(table, solve_ast_node(contents, table, globals, functions, literals, node->inner));
+    if (node->inner->type == op_function &&
+        (!function_inlinable(contents, table, node->inner->function) ||
+         function_returns_call(node->inner->function)) &&
+        function_bit_builtin(node->inner->function) == NOT && ast_is_tail_call(table, functions, node->inner)) {
+      instruction_tail_call(table, node->inner->function,
+                            solve_arguments(contents, table, globals, functions, literals, node->inner));
+      return reference_direct(NULL);
+    }
+    Reference value = solve_ast_node(contents, table, globals, functions, literals, node->inner);
+    const int function = functionlist_indexof(functions, table->name);
+    if (function != -1 && is_vector(functions->array[function].retVal.kind)) {
+      value = reference_to_vector(table, value, functions->array[function].retVal);
+    } else if (function != -1 && is_fp(functions->array[function].retVal.kind)) {
+      // returned in xmm0
+      value = reference_to_fp(table, value, functions->array[function].retVal);
+    } else if (function != -1 && functions->array[function].retVal.kind != 0 && reference_is_fp(value)) {
+      value = instruction_mov(table, value, reference_direct(table_allocate(table, functions->array[function].retVal)),
+                              "convert");
+    }
+    return instruction_ret(table, value);
   }
   }
   exit(23);
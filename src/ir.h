@@ -1,6 +1,7 @@
 #ifndef IR_H
 #define IR_H
 #include "ast.h"
+#include "pool.h"
 #include "struct/list.h"
 #include "types.h"
 
@@ -32,7 +33,9 @@ typedef enum {
   ConstantI,
   ConstantS,
   GlobalRef,
-  Global
+  Global,
+  // floating point literal, `value` as written
+  ConstantF
 } AccessType;
 
 bool isAllocated(AccessType type);
@@ -45,6 +48,11 @@ typedef struct Reference {
     char *value;
     int str;
   };
+
+  // Dereference only: the address is allocation + index * scale + disp
+  struct Allocation *index; // NULLABLE
+  uint8_t scale;
+  int32_t disp;
 } Reference;
 
 typedef struct Allocation {
@@ -77,6 +85,8 @@ typedef enum {
   JLE,
 
   CALL,
+  // call in tail position: arguments, then a jump the callee returns from on our behalf
+  TAILCALL,
   RET,
 
   MOV,
@@ -87,15 +97,52 @@ typedef enum {
   IMUL,
   IDIV,
   IDIV_mod,
+  // floating point output = output / inputs[0] (+, - and * share ADD, SUB and IMUL)
+  FDIV,
+  // high half of the signed/unsigned 128-bit product
+  MULH,
+  UMULH,
   OR,
   XOR,
   AND,
   NOT,
   SAL,
   SAR,
+  SHR,
+  // the number of set bits, trailing zeros or leading zeros of the 64-bit inputs[0] (64 for no bits set)
+  POPCNT,
+  TZCNT,
+  LZCNT,
   CMP,
 
-  TEST
+  TEST,
+
+  // 16 (or with AVX2 32, the constant inputs[1]) bytes of packed integers in %xmm0/%ymm0: VLOAD fills it from
+  // inputs[0] (VZERO with zeroes), the arithmetic combines it with the vector at inputs[0] lane by lane (lanes sized by
+  // the element type), and VSTORE writes it to output. VCLEAR ends a stretch of 32-byte vectors (vzeroupper)
+  VZERO,
+  VLOAD,
+  VADD,
+  VSUB,
+  VMULL,
+  VAND,
+  VOR,
+  VXOR,
+  VSTORE,
+  VCLEAR,
+
+  // rep stosb/movsb: fills the constant `output` bytes at address inputs[0] with the byte inputs[1], or copies them
+  // from the address inputs[1]
+  REP_STOS,
+  REP_MOVS,
+
+  // lanes of the vector at inputs[0]: EXTRACT reads lane inputs[1] into output, INSERT writes inputs[0] into lane
+  // inputs[1] of the vector at output, and the reductions combine every lane into output
+  EXTRACT,
+  INSERT,
+  REDUCE_ADD,
+  REDUCE_MIN,
+  REDUCE_MAX
 } InstructionType;
 
 LIST_API(Instruction, inst, struct Instruction)
@@ -108,6 +155,12 @@ typedef struct InstructionTable {
   int parentCutoff;
   char *name;
   int escape;
+  // the function takes the address of one of its locals, which a tail call would pull out from under the callee
+  bool addressTaken;
+  // names of the locals whose address is taken, and of the locals (or pointers to them) whose value may reach a
+  // callee, memory or the caller, so that anything but the function itself can write through it
+  PtrList pointedTo;
+  PtrList escaped;
 } InstructionTable;
 
 typedef struct Instruction {
@@ -140,6 +193,15 @@ void instructiontable_free(InstructionTable *table);
 
 Reference reference_direct(Allocation *allocation);
 Reference reference_deref(Allocation *allocation);
+Type reference_type(Reference reference);
+bool reference_equals(Reference a, Reference b);
+bool reference_is_fp(Reference reference);
+bool reference_is_vector(Reference reference);
+bool reference_constant(Reference reference, int64_t *value);
+bool reference_constant_f(Reference reference, double *value);
+
+int8_t argument_register(const Function *function, int index);
+bool typekind_unsigned(TypeKind kind);
 
 void instruction_init(Instruction *instruction);
 
@@ -165,7 +227,43 @@ typedef struct {
 
 void statement_init(Statement *statement);
 
+// a value substituted for every evaluation of `node`: computed once in a loop preheader, or the argument bound to a
+// parameter of an inlined call
+typedef struct {
+  const AstNode *node;
+  Reference value;
+  // induction products change on every iteration of the loop that created them, but are fixed in its inner loops
+  bool induction;
+  int depth;
+} Hoisted;
+
+LIST_API(Hoisted, hoisted, Hoisted)
+
+// advances `product` by `step` whenever the induction variable's increment (`assignment`) runs
+typedef struct {
+  const AstNode *assignment;
+  Allocation *product;
+  Reference step;
+} Induction;
+
+LIST_API(Induction, induction, Induction)
+
+// an expression whose value is known on every path to the code being lowered
+typedef struct {
+  const AstNode *node; // NULL once something it reads has been written
+  Reference value;
+  // depends on memory, so stores through pointers invalidate it
+  bool load;
+  // depends on memory that a callee can reach, so calls invalidate it too
+  bool escapes;
+} Available;
+
+LIST_API(Available, available, Available)
+
+bool ast_takes_address(const AstNode *node);
+void table_analyse_addresses(InstructionTable *table, const char *contents, const AstNodeList *nodes);
+
 Reference solve_ast_node(const char *contents, InstructionTable *table, VarList *globals, FunctionList *functions,
-                         StrList *literals, AstNode *node);
+                         LiteralPool *literals, AstNode *node);
 
 #endif // IR_H
@@ -0,0 +1,258 @@
+#include "jit.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// an indirect jump through the address stored after it: jmp *0(%rip), then the 8 byte address
+#define STUB_SIZE 16
+
+#ifndef _WIN32
+// stdout while jit_redirect_output is in effect, -1 otherwise
+int console = -1;
+
+void jit_redirect_output(void) {
+  if (console != -1)
+    return;
+  fflush(stdout);
+  console = dup(STDOUT_FILENO);
+  dup2(STDERR_FILENO, STDOUT_FILENO);
+}
+
+void jit_restore_output(void) {
+  fflush(stdout);
+  if (console != -1) {
+    dup2(console, STDOUT_FILENO);
+    close(console);
+    console = -1;
+  }
+}
+
+size_t page_align(const size_t size, const size_t page) {
+  return (size + page - 1) / page * page;
+}
+
+int jit_popcountdi2(const long long a) {
+  return __builtin_popcountll((unsigned long long)a);
+}
+
+int jit_ctzdi2(const long long a) {
+  return __builtin_ctzll((unsigned long long)a);
+}
+
+int jit_clzdi2(const long long a) {
+  return __builtin_clzll((unsigned long long)a);
+}
+
+// libgcc is linked in statically, so its helpers are not there for dlsym to find
+const struct {
+  const char *name;
+  int (*function)(long long);
+} helpers[] = {{"__popcountdi2", jit_popcountdi2}, {"__ctzdi2", jit_ctzdi2}, {"__clzdi2", jit_clzdi2}};
+
+void *jit_extern(const char *name) {
+  void *address = dlsym(RTLD_DEFAULT, name);
+  for (size_t i = 0; address == NULL && i < sizeof(helpers) / sizeof(helpers[0]); ++i) {
+    if (strcmp(name, helpers[i].name) == 0) {
+      memcpy(&address, &helpers[i].function, sizeof(address));
+    }
+  }
+  if (address == NULL) {
+    printf("undefined symbol: %s\n", name);
+    exit(25);
+  }
+  return address;
+}
+
+typedef struct {
+  JitResolver resolver;
+  void *context;
+  // the jumps to each extern, by symbol index (NULL until something calls it)
+  uint8_t **stubs;
+  uint8_t *nextStub;
+} Linker;
+
+uint8_t *symbol_address(const JitImage *image, const Linker *linker, const ObjectSymbol *symbol) {
+  if (symbol->section != SECTION_COUNT)
+    return image->sections[symbol->section] + symbol->offset;
+  void *address = linker->resolver != NULL ? linker->resolver(symbol->name, linker->context) : NULL;
+  return address != NULL ? address : jit_extern(symbol->name);
+}
+
+void jit_relocate(const JitImage *image, Linker *linker, const ObjectFile *object,
+                  const ObjectRelocation *relocation) {
+  const ObjectSymbol *symbol = &object->symbols.array[relocation->symbol];
+  uint8_t *place = image->sections[relocation->section] + relocation->offset;
+  uint8_t *target;
+  if (symbol->section == SECTION_COUNT && relocation->type == R_X86_64_PLT32) {
+    // calls and jumps out of the image go through its stubs, the rest of it being in reach of a rel32
+    if (linker->stubs[relocation->symbol] == NULL) {
+      const uint8_t *address = symbol_address(image, linker, symbol);
+      const uint8_t jump[6] = {0xFF, 0x25, 0, 0, 0, 0};
+      uint8_t *stub = linker->stubs[relocation->symbol] = linker->nextStub;
+      memcpy(stub, jump, sizeof(jump));
+      memcpy(stub + sizeof(jump), &address, 8);
+      linker->nextStub += STUB_SIZE;
+    }
+    target = linker->stubs[relocation->symbol];
+  } else {
+    target = symbol_address(image, linker, symbol);
+  }
+  const int64_t value = (int64_t)(intptr_t)target + relocation->addend;
+  int64_t field;
+  switch (relocation->type) {
+  case R_X86_64_64:
+    memcpy(place, &value, 8);
+    return;
+  case R_X86_64_PC32:
+  case R_X86_64_PLT32:
+    field = value - (int64_t)(intptr_t)place;
+    break;
+  case R_X86_64_32:
+    field = value;
+    if (field < 0 || field > UINT32_MAX) {
+      printf("%s is out of reach of a 32-bit address\n", symbol->name);
+      exit(25);
+    }
+    break;
+  default:
+    field = value;
+    break;
+  }
+  if (relocation->type != R_X86_64_32 && (field < INT32_MIN || field > INT32_MAX)) {
+    printf("%s is out of reach of a 32-bit displacement\n", symbol->name);
+    exit(25);
+  }
+  const uint32_t bits = (uint32_t)field;
+  memcpy(place, &bits, 4);
+}
+
+void jit_load(JitImage *image, const ObjectFile *object, const JitResolver resolver, void *context) {
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+  // code and stubs, then read-only data, then .data and .bss: each starting on a page of its own so that they can be
+  // protected apart
+  int externs = 0;
+  for (int i = 0; i < object->symbols.len; ++i) {
+    externs += object->symbols.array[i].section == SECTION_COUNT;
+  }
+  const size_t textSize = page_align(object->sections[SECTION_TEXT].len + (size_t)externs * STUB_SIZE, page);
+  const size_t rodataSize = page_align(object->sections[SECTION_RODATA].len, page);
+  // .bss follows .data, as aligned as anything in it needs
+  const size_t bssStart = page_align(object->sections[SECTION_DATA].len, object->alignment[SECTION_BSS]);
+  const size_t dataSize = page_align(bssStart + object->sections[SECTION_BSS].len, page);
+  // mmap refuses to map nothing
+  image->size = textSize + rodataSize + dataSize == 0 ? page : textSize + rodataSize + dataSize;
+
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_32BIT
+  // `mov $symbol, %reg` takes a sign-extended 32-bit address, as it would in a non-PIE executable
+  flags |= MAP_32BIT;
+#endif
+  image->memory = mmap(NULL, image->size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (image->memory == MAP_FAILED) {
+    puts("failed to map memory for the program");
+    exit(25);
+  }
+
+  image->sections[SECTION_TEXT] = image->memory;
+  image->sections[SECTION_RODATA] = image->memory + textSize;
+  image->sections[SECTION_DATA] = image->memory + textSize + rodataSize;
+  image->sections[SECTION_BSS] = image->sections[SECTION_DATA] + bssStart;
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    if (i != SECTION_BSS) {
+      memcpy(image->sections[i], object->sections[i].array, object->sections[i].len);
+    }
+  }
+
+  osymlist_init(&image->symbols, 8);
+  for (int i = 0; i < object->symbols.len; ++i) {
+    if (object->symbols.array[i].section != SECTION_COUNT) {
+      ObjectSymbol symbol = object->symbols.array[i];
+      symbol.name = strdup(symbol.name);
+      osymlist_add(&image->symbols, symbol);
+    }
+  }
+
+  Linker linker;
+  linker.resolver = resolver;
+  linker.context = context;
+  linker.stubs = calloc(object->symbols.len + 1, sizeof(uint8_t *));
+  linker.nextStub = image->memory + object->sections[SECTION_TEXT].len;
+  for (int i = 0; i < object->relocations.len; ++i) {
+    jit_relocate(image, &linker, object, &object->relocations.array[i]);
+  }
+  free(linker.stubs);
+
+  if (mprotect(image->memory, textSize, PROT_READ | PROT_EXEC) != 0 ||
+      (rodataSize != 0 && mprotect(image->sections[SECTION_RODATA], rodataSize, PROT_READ) != 0)) {
+    puts("failed to protect the program's memory");
+    exit(25);
+  }
+}
+
+void *jit_symbol(const JitImage *image, const char *name) {
+  for (int i = 0; i < image->symbols.len; ++i) {
+    if (strcmp(image->symbols.array[i].name, name) == 0) {
+      return image->sections[image->symbols.array[i].section] + image->symbols.array[i].offset;
+    }
+  }
+  return NULL;
+}
+
+void jit_unload(JitImage *image) {
+  munmap(image->memory, image->size);
+  for (int i = 0; i < image->symbols.len; ++i) {
+    free(image->symbols.array[i].name);
+  }
+  free(image->symbols.array);
+}
+
+int jit_run(const ObjectFile *object, const int argc, char **argv) {
+  JitImage image;
+  jit_load(&image, object, NULL, NULL);
+  const void *entry = jit_symbol(&image, "main");
+  if (entry == NULL) {
+    puts("no main function to run");
+    exit(25);
+  }
+  int (*run)(int, char **);
+  // ISO C only converts between function and object pointers by copying
+  memcpy(&run, &entry, sizeof(run));
+
+  jit_restore_output();
+  const int result = run(argc, argv);
+  fflush(stdout);
+  jit_unload(&image);
+  return result;
+}
+#else
+void jit_redirect_output(void) {}
+
+void jit_restore_output(void) {}
+
+void jit_load(JitImage *image, const ObjectFile *object, const JitResolver resolver, void *context) {
+  puts("loading code into memory is not supported on this platform");
+  exit(25);
+}
+
+void *jit_symbol(const JitImage *image, const char *name) {
+  return NULL;
+}
+
+void *jit_extern(const char *name) {
+  return NULL;
+}
+
+void jit_unload(JitImage *image) {}
+
+int jit_run(const ObjectFile *object, const int argc, char **argv) {
+  puts("--run is not supported on this platform");
+  exit(25);
+}
+#endif
@@ -0,0 +1,35 @@
+#ifndef JIT_H
+#define JIT_H
+#include "object.h"
+
+// sends what the compiler prints to stderr while the program is not running, leaving stdout to the program alone
+void jit_redirect_output(void);
+// gives stdout back to the program, once it is about to run
+void jit_restore_output(void);
+
+// the address of a symbol an object leaves undefined, or NULL to look for it in the libraries the compiler is itself
+// linked with (libc)
+typedef void *(*JitResolver)(const char *name, void *context);
+
+// an object mapped into this process
+typedef struct {
+  uint8_t *memory;
+  size_t size;
+  uint8_t *sections[SECTION_COUNT];
+  // the symbols it defines, by name
+  ObjectSymbolList symbols;
+} JitImage;
+
+// maps the object into memory and links it, asking the resolver (NULLABLE) about the symbols it leaves undefined
+void jit_load(JitImage *image, const ObjectFile *object, JitResolver resolver, void *context);
+// the address of a symbol defined by the image, or NULL
+void *jit_symbol(const JitImage *image, const char *name);
+// the address of a function from outside the program, exiting when there is none
+void *jit_extern(const char *name);
+void jit_unload(JitImage *image);
+
+// loads the object into this process, linking its externs against the libraries the compiler is itself linked with
+// (libc), and returns what its main returns when called with argc and argv
+int jit_run(const ObjectFile *object, int argc, char **argv);
+
+#endif // JIT_H
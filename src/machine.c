@@ -0,0 +1,514 @@
+#include "machine.h"
+
+#include "register.h"
+
+#include <string.h>
+
+LIST_IMPL(MachineInstruction, minst, MachineInstruction)
+
+Operand operand_none(void) {
+  Operand operand;
+  memset(&operand, 0, sizeof(Operand));
+  operand.type = O_None;
+  operand.reg = -1;
+  operand.base = -1;
+  operand.index = -1;
+  operand.scale = 1;
+  operand.symbol = NULL;
+  return operand;
+}
+
+Operand operand_register(const Width width, const int8_t reg) {
+  Operand operand = operand_none();
+  operand.type = O_Register;
+  operand.width = width;
+  operand.reg = reg;
+  return operand;
+}
+
+Operand operand_memory(const int8_t base, const int8_t index, const uint8_t scale, const int32_t disp) {
+  Operand operand = operand_none();
+  operand.type = O_Memory;
+  operand.base = base;
+  operand.index = index;
+  operand.scale = scale;
+  operand.disp = disp;
+  return operand;
+}
+
+Operand operand_stack(const int16_t offset) {
+  return operand_memory(rsp, -1, 1, offset);
+}
+
+Operand operand_rip(const char *symbol) {
+  Operand operand = operand_memory(-1, -1, 1, 0);
+  operand.symbol = symbol;
+  return operand;
+}
+
+Operand operand_immediate(const int64_t value) {
+  Operand operand = operand_none();
+  operand.type = O_Immediate;
+  operand.value = value;
+  return operand;
+}
+
+Operand operand_symbol(const char *symbol) {
+  Operand operand = operand_none();
+  operand.type = O_Immediate;
+  operand.symbol = symbol;
+  return operand;
+}
+
+Operand operand_label(const char *label) {
+  Operand operand = operand_none();
+  operand.type = O_Label;
+  operand.symbol = label;
+  return operand;
+}
+
+Operand operand_vector(const Width width, const int8_t reg) {
+  Operand operand = operand_none();
+  operand.type = O_Vector;
+  operand.width = width;
+  operand.reg = reg;
+  return operand;
+}
+
+bool operand_equals(const Operand a, const Operand b) {
+  if (a.type != b.type)
+    return false;
+  switch (a.type) {
+  case O_None:
+    return true;
+  case O_Register:
+    return a.reg == b.reg && a.width == b.width;
+  case O_Vector:
+    return a.reg == b.reg && a.width == b.width;
+  case O_Memory:
+    if ((a.symbol == NULL) != (b.symbol == NULL) || (a.symbol != NULL && strcmp(a.symbol, b.symbol) != 0))
+      return false;
+    return a.base == b.base && a.index == b.index && a.scale == b.scale && a.disp == b.disp;
+  case O_Immediate:
+  case O_Label:
+    if ((a.symbol == NULL) != (b.symbol == NULL))
+      return false;
+    return a.symbol != NULL ? strcmp(a.symbol, b.symbol) == 0 : a.value == b.value;
+  }
+  return false;
+}
+
+bool operand_is_fp(const Operand operand) {
+  return operand.type == O_Register && operand.reg >= xmm0;
+}
+
+bool operand_reads_register(const Operand operand, const int8_t reg) {
+  switch (operand.type) {
+  case O_Register:
+    return operand.reg == reg;
+  case O_Memory:
+    return operand.base == reg || operand.index == reg;
+  default:
+    return false;
+  }
+}
+
+char *operand_format(const Operand operand) {
+  char buffer[128];
+  switch (operand.type) {
+  case O_None:
+    buffer[0] = '\0';
+    break;
+  case O_Register:
+    snprintf(buffer, sizeof(buffer), "%s", get_register_mnemonic(operand.width, operand.reg));
+    break;
+  case O_Memory: {
+    int len = 0;
+    if (operand.symbol != NULL) {
+      len = snprintf(buffer, sizeof(buffer), "%s", operand.symbol);
+      if (operand.disp != 0)
+        len += snprintf(buffer + len, sizeof(buffer) - len, "%+i", operand.disp);
+    } else if (operand.disp != 0) {
+      len = snprintf(buffer, sizeof(buffer), "%i", operand.disp);
+    }
+    if (operand.base == -1 && operand.index == -1) {
+      if (operand.symbol != NULL)
+        snprintf(buffer + len, sizeof(buffer) - len, "(%%rip)");
+    } else if (operand.index == -1) {
+      snprintf(buffer + len, sizeof(buffer) - len, "(%s)", mnemonic64[operand.base]);
+    } else {
+      snprintf(buffer + len, sizeof(buffer) - len, "(%s,%s,%i)", operand.base == -1 ? "" : mnemonic64[operand.base],
+               mnemonic64[operand.index], operand.scale);
+    }
+    break;
+  }
+  case O_Immediate:
+    if (operand.symbol != NULL) {
+      snprintf(buffer, sizeof(buffer), "$%s", operand.symbol);
+    } else {
+      snprintf(buffer, sizeof(buffer), "$%lli", (long long)operand.value);
+    }
+    break;
+  case O_Label:
+    snprintf(buffer, sizeof(buffer), "%s", operand.symbol);
+    break;
+  case O_Vector:
+    snprintf(buffer, sizeof(buffer), "%%%cmm%i", operand.width == Yword ? 'y' : 'x', operand.reg);
+    break;
+  }
+  return strdup(buffer);
+}
+
+Condition condition_invert(const Condition cond) {
+  switch (cond) {
+  case CC_E:
+    return CC_NE;
+  case CC_NE:
+    return CC_E;
+  case CC_L:
+    return CC_GE;
+  case CC_G:
+    return CC_LE;
+  case CC_LE:
+    return CC_G;
+  case CC_GE:
+    return CC_L;
+  case CC_A:
+    return CC_BE;
+  case CC_B:
+    return CC_AE;
+  case CC_AE:
+    return CC_B;
+  case CC_BE:
+    return CC_A;
+  case CC_P:
+    return CC_NP;
+  case CC_NP:
+    return CC_P;
+  }
+  exit(31);
+}
+
+const char *condition_mnemonic(const Condition cond) {
+  switch (cond) {
+  case CC_E:
+    return "e";
+  case CC_NE:
+    return "ne";
+  case CC_L:
+    return "l";
+  case CC_G:
+    return "g";
+  case CC_LE:
+    return "le";
+  case CC_GE:
+    return "ge";
+  case CC_A:
+    return "a";
+  case CC_B:
+    return "b";
+  case CC_AE:
+    return "ae";
+  case CC_BE:
+    return "be";
+  case CC_P:
+    return "p";
+  case CC_NP:
+    return "np";
+  }
+  exit(31);
+}
+
+const char *machine_mnemonic(const MachineOp op) {
+  switch (op) {
+  case M_MOV:
+    return "mov";
+  case M_MOVS:
+    return "movs";
+  case M_LEA:
+    return "lea";
+  case M_ADD:
+    return "add";
+  case M_SUB:
+    return "sub";
+  case M_IMUL:
+    return "imul";
+  case M_MUL:
+    return "mul";
+  case M_IDIV:
+    return "idiv";
+  case M_CQTO:
+    return "cqto";
+  case M_OR:
+    return "or";
+  case M_XOR:
+    return "xor";
+  case M_AND:
+    return "and";
+  case M_NOT:
+    return "not";
+  case M_NEG:
+    return "neg";
+  case M_SAL:
+    return "sal";
+  case M_SAR:
+    return "sar";
+  case M_SHR:
+    return "shr";
+  case M_SHLX:
+    return "shlx";
+  case M_SARX:
+    return "sarx";
+  case M_SHRX:
+    return "shrx";
+  case M_POPCNT:
+    return "popcnt";
+  case M_TZCNT:
+    return "tzcnt";
+  case M_LZCNT:
+    return "lzcnt";
+  case M_CMP:
+    return "cmp";
+  case M_TEST:
+    return "test";
+  case M_SET:
+    return "set";
+  case M_JMP:
+    return "jmp";
+  case M_JCC:
+    return "j";
+  case M_CALL:
+    return "call";
+  case M_RET:
+    return "ret";
+  case M_MOVDQU:
+    return "movdqu";
+  case M_PADD:
+    return "padd";
+  case M_PSUB:
+    return "psub";
+  case M_PMULL:
+    return "pmull";
+  case M_PAND:
+    return "pand";
+  case M_POR:
+    return "por";
+  case M_PXOR:
+    return "pxor";
+  case M_REP_STOS:
+    return "rep stos";
+  case M_REP_MOVS:
+    return "rep movs";
+  case M_ADDS:
+    return "adds";
+  case M_SUBS:
+    return "subs";
+  case M_MULS:
+    return "muls";
+  case M_DIVS:
+    return "divs";
+  case M_UCOMIS:
+    return "ucomis";
+  case M_XORP:
+    return "xorp";
+  case M_CVTSI2S:
+    return "cvtsi2s";
+  case M_CVTTS2SI:
+    return "cvtts2si";
+  case M_CVTS2S:
+    return "cvts2s";
+  case M_ADDP:
+    return "addp";
+  case M_SUBP:
+    return "subp";
+  case M_MULP:
+    return "mulp";
+  case M_DIVP:
+    return "divp";
+  case M_MINP:
+    return "minp";
+  case M_MAXP:
+    return "maxp";
+  case M_PMULUDQ:
+    return "pmuludq";
+  case M_PCMPGT:
+    return "pcmpgt";
+  case M_PANDN:
+    return "pandn";
+  case M_PUNPCKL:
+    return "punpckl";
+  case M_PSHUFD:
+    return "pshufd";
+  case M_PSRLDQ:
+    return "psrldq";
+  case M_PMINS:
+    return "pmins";
+  case M_PMAXS:
+    return "pmaxs";
+  case M_VZEROUPPER:
+    return "vzeroupper";
+  case M_PBROADCAST:
+    return "pbroadcast";
+  case M_EXTRACTI128:
+    return "extracti128";
+  case M_LABEL:
+  case M_COMMENT:
+    break;
+  }
+  return "";
+}
+
+MachineInstruction *machine_emit(MachineInstructionList *list, const MachineOp op, const Width width,
+                                 const int operands, const Operand a, const Operand b) {
+  MachineInstruction *instruction = minstlist_grow(list);
+  instruction->op = op;
+  instruction->cond = CC_E;
+  instruction->width = width;
+  instruction->width2 = width;
+  instruction->operands = operands;
+  instruction->args[0] = a;
+  instruction->args[1] = b;
+  instruction->args[2] = operand_none();
+  instruction->comment = NULL;
+  instruction->kills = 0;
+  return instruction;
+}
+
+MachineInstruction *machine_emit_label(MachineInstructionList *list, const char *label) {
+  return machine_emit(list, M_LABEL, Quad, 1, operand_label(label), operand_none());
+}
+
+void machine_emit_comment(MachineInstructionList *list, const char *text) {
+  MachineInstruction *instruction = machine_emit(list, M_COMMENT, Quad, 0, operand_none(), operand_none());
+  instruction->comment = text;
+}
+
+// the AVX2 (VEX encoded) form, for instructions on ymm registers
+bool machine_is_vex(const MachineInstruction *instruction) {
+  for (int i = 0; i < instruction->operands; ++i) {
+    if ((instruction->args[i].type == O_Vector || instruction->args[i].type == O_Register) &&
+        instruction->args[i].width == Yword)
+      return true;
+  }
+  return false;
+}
+
+void machine_write_instruction(const MachineInstruction *instruction, FILE *output) {
+  const char *vex = machine_is_vex(instruction) ? "v" : "";
+  switch (instruction->op) {
+  case M_LABEL:
+    fprintf(output, "%s:\n", instruction->args[0].symbol);
+    return;
+  case M_COMMENT:
+    fprintf(output, "%s\n", instruction->comment);
+    return;
+  case M_SET:
+  case M_JCC:
+    fprintf(output, "\t%s%s", machine_mnemonic(instruction->op), condition_mnemonic(instruction->cond));
+    break;
+  case M_MOV:
+    if (instruction->width >= Oword) {
+      // stack slots and vector pointers carry no alignment guarantee
+      fprintf(output, "\t%s%s", vex,
+              instruction->args[0].type == O_Register && instruction->args[1].type == O_Register ? "movdqa"
+                                                                                                 : "movdqu");
+    } else if (operand_is_fp(instruction->args[0]) || operand_is_fp(instruction->args[1])) {
+      // movss/movsd between xmm registers and memory, movd/movq to and from general purpose registers
+      if (instruction->args[0].type == O_Register && instruction->args[1].type == O_Register &&
+          operand_is_fp(instruction->args[0]) != operand_is_fp(instruction->args[1])) {
+        fprintf(output, "\tmov%c", instruction->width == Quad ? 'q' : 'd');
+      } else {
+        fprintf(output, "\tmovs%c", fp_mnemonic_suffix(instruction->width));
+      }
+    } else {
+      fprintf(output, "\tmov%c", mnemonic_suffix(instruction->width));
+    }
+    break;
+  case M_MOVS:
+    fprintf(output, "\tmovs%c%c", mnemonic_suffix(instruction->width2), mnemonic_suffix(instruction->width));
+    break;
+  case M_CQTO:
+    // the sign of %rax, %eax or %ax through %rdx, %edx or %dx
+    fprintf(output, "\t%s", instruction->width == Quad ? "cqto" : instruction->width == Long ? "cltd" : "cwtd");
+    break;
+  case M_ADDS:
+  case M_SUBS:
+  case M_MULS:
+  case M_DIVS:
+  case M_UCOMIS:
+  case M_XORP:
+  case M_ADDP:
+  case M_SUBP:
+  case M_MULP:
+  case M_DIVP:
+  case M_MINP:
+  case M_MAXP:
+    fprintf(output, "\t%s%s%c", vex, machine_mnemonic(instruction->op), fp_mnemonic_suffix(instruction->width));
+    break;
+  case M_CVTSI2S:
+    fprintf(output, "\tcvtsi2s%c%c", fp_mnemonic_suffix(instruction->width), mnemonic_suffix(instruction->width2));
+    break;
+  case M_CVTTS2SI:
+    fprintf(output, "\tcvtts%c2si%c", fp_mnemonic_suffix(instruction->width2), mnemonic_suffix(instruction->width));
+    break;
+  case M_CVTS2S:
+    fprintf(output, "\tcvts%c2s%c", fp_mnemonic_suffix(instruction->width2), fp_mnemonic_suffix(instruction->width));
+    break;
+  case M_JMP:
+  case M_CALL:
+  case M_RET:
+  case M_MOVDQU:
+  case M_PAND:
+  case M_POR:
+  case M_PXOR:
+  case M_PMULUDQ:
+  case M_PANDN:
+  case M_PSHUFD:
+  case M_PSRLDQ:
+  case M_SHLX:
+  case M_SARX:
+  case M_SHRX:
+  case M_VZEROUPPER:
+  case M_EXTRACTI128:
+    fprintf(output, "\t%s%s", vex, machine_mnemonic(instruction->op));
+    break;
+  case M_PUNPCKL:
+    // interleaves lanes into ones twice as wide
+    fprintf(output, "\t%s%s", machine_mnemonic(instruction->op),
+            instruction->width == Byte   ? "bw"
+            : instruction->width == Word ? "wd"
+            : instruction->width == Long ? "dq"
+                                         : "qdq");
+    break;
+  case M_PADD:
+  case M_PSUB:
+  case M_PMULL:
+  case M_PCMPGT:
+  case M_PMINS:
+  case M_PMAXS:
+  case M_PBROADCAST:
+    // packed lanes are b/w/d/q rather than b/w/l/q
+    fprintf(output, "\t%s%s%c", vex, machine_mnemonic(instruction->op),
+            instruction->width == Long ? 'd' : mnemonic_suffix(instruction->width));
+    break;
+  default:
+    fprintf(output, "\t%s%c", machine_mnemonic(instruction->op), mnemonic_suffix(instruction->width));
+    break;
+  }
+
+  for (int i = 0; i < instruction->operands; ++i) {
+    char *operand = operand_format(instruction->args[i]);
+    fprintf(output, i == 0 ? " %s" : ", %s", operand);
+    free(operand);
+  }
+  if (instruction->comment != NULL) {
+    fprintf(output, " # %s", instruction->comment);
+  }
+  fputc('\n', output);
+}
+
+void machine_write(const MachineInstructionList *list, FILE *output) {
+  for (int i = 0; i < list->len; ++i) {
+    machine_write_instruction(&list->array[i], output);
+  }
+}
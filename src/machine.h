@@ -0,0 +1,192 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+#include "struct/list.h"
+#include "types.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+// structured x86-64 instructions, produced by codegen and written out as AT&T text once the function is complete
+
+typedef enum {
+  O_None,
+  O_Register,
+  // disp(base, index, scale) or symbol(%rip) when base == -1 and symbol != NULL
+  O_Memory,
+  // $value or $symbol
+  O_Immediate,
+  // jump/call target
+  O_Label,
+  // %xmm<reg>, or %ymm<reg> when the width is Yword
+  O_Vector
+} OperandType;
+
+typedef struct {
+  OperandType type;
+  Width width;
+  int8_t reg;
+
+  int8_t base;
+  int8_t index;
+  uint8_t scale;
+  int32_t disp;
+
+  int64_t value;
+  const char *symbol; // NULLABLE
+} Operand;
+
+typedef enum {
+  CC_E,
+  CC_NE,
+  CC_L,
+  CC_G,
+  CC_LE,
+  CC_GE,
+  // unsigned orderings and the parity flag, as left by ucomis
+  CC_A,
+  CC_B,
+  CC_AE,
+  CC_BE,
+  CC_P,
+  CC_NP
+} Condition;
+
+typedef enum {
+  M_LABEL,
+  // raw marker line (#STOR, #RST, ...), ignored by the peephole optimizer
+  M_COMMENT,
+
+  M_MOV,
+  M_MOVS,
+  M_LEA,
+
+  M_ADD,
+  M_SUB,
+  M_IMUL,
+  M_MUL,
+  M_IDIV,
+  M_CQTO,
+  M_OR,
+  M_XOR,
+  M_AND,
+  M_NOT,
+  M_NEG,
+  M_SAL,
+  M_SAR,
+  M_SHR,
+  // BMI2 shifts by a count in any register, which write a third operand and leave the flags alone:
+  // count, source, destination
+  M_SHLX,
+  M_SARX,
+  M_SHRX,
+  // the number of set bits, trailing zeros and leading zeros (POPCNT, BMI1 and LZCNT)
+  M_POPCNT,
+  M_TZCNT,
+  M_LZCNT,
+  M_CMP,
+  M_TEST,
+
+  M_SET,
+  M_JMP,
+  M_JCC,
+  M_CALL,
+  M_RET,
+
+  // SSE2 128-bit integer vectors, with the lane size of the packed arithmetic in `width`
+  M_MOVDQU,
+  M_PADD,
+  M_PSUB,
+  M_PMULL,
+  M_PAND,
+  M_POR,
+  M_PXOR,
+
+  // byte string operations on %rdi/%rsi, %rcx times
+  M_REP_STOS,
+  M_REP_MOVS,
+
+  // SSE2 scalar floating point, single or double precision by `width` (Long or Quad). the conversions take the
+  // destination size in `width` and the source size in `width2`
+  M_ADDS,
+  M_SUBS,
+  M_MULS,
+  M_DIVS,
+  M_UCOMIS,
+  M_XORP,
+  M_CVTSI2S,
+  M_CVTTS2SI,
+  M_CVTS2S,
+
+  // SSE2 packed vectors in xmm registers (the integer arithmetic shares M_PADD through M_PXOR). the floating point
+  // forms are single or double precision by `width`, the rest take the lane size in `width`
+  M_ADDP,
+  M_SUBP,
+  M_MULP,
+  M_DIVP,
+  M_MINP,
+  M_MAXP,
+  M_PMULUDQ,
+  M_PCMPGT,
+  M_PANDN,
+  M_PUNPCKL,
+  // $order, source, destination
+  M_PSHUFD,
+  // shifts the whole register right by $bytes
+  M_PSRLDQ,
+  // signed lane minimum and maximum, SSE4.1 for all but 16-bit lanes
+  M_PMINS,
+  M_PMAXS,
+  // clears the upper halves of the ymm registers, which legacy SSE instructions would otherwise stall on
+  M_VZEROUPPER,
+  // AVX2: copies the low lane (32 or 64 bits by `width`) of an xmm register into every lane of a ymm register
+  M_PBROADCAST,
+  // AVX2: $half, ymm source, xmm destination
+  M_EXTRACTI128
+} MachineOp;
+
+typedef struct {
+  MachineOp op;
+  Condition cond;
+  // operand size, and source size for M_MOVS and the conversions
+  Width width;
+  Width width2;
+  int operands;
+  // AT&T order (source first)
+  Operand args[3];
+  const char *comment; // NULLABLE
+  // registers whose value is dead once this instruction completes
+  uint32_t kills;
+} MachineInstruction;
+
+LIST_API(MachineInstruction, minst, MachineInstruction)
+
+Operand operand_none(void);
+Operand operand_register(Width width, int8_t reg);
+Operand operand_memory(int8_t base, int8_t index, uint8_t scale, int32_t disp);
+Operand operand_stack(int16_t offset);
+Operand operand_rip(const char *symbol);
+Operand operand_immediate(int64_t value);
+Operand operand_symbol(const char *symbol);
+Operand operand_label(const char *label);
+Operand operand_vector(Width width, int8_t reg);
+
+bool operand_equals(Operand a, Operand b);
+// an xmm register holding a scalar
+bool operand_is_fp(Operand operand);
+bool operand_reads_register(Operand operand, int8_t reg);
+char *operand_format(Operand operand);
+
+Condition condition_invert(Condition cond);
+const char *condition_mnemonic(Condition cond);
+
+MachineInstruction *machine_emit(MachineInstructionList *list, MachineOp op, Width width, int operands, Operand a,
+                                 Operand b);
+MachineInstruction *machine_emit_label(MachineInstructionList *list, const char *label);
+void machine_emit_comment(MachineInstructionList *list, const char *text);
+
+// the AVX2 (VEX encoded) form, for instructions on ymm registers
+bool machine_is_vex(const MachineInstruction *instruction);
+void machine_write_instruction(const MachineInstruction *instruction, FILE *output);
+void machine_write(const MachineInstructionList *list, FILE *output);
+
+#endif // MACHINE_H
@@ -2,10 +2,19 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "ast.h"
+#include "interface.h"
+#include "interpret.h"
+#include "jit.h"
+#include "object.h"
+#include "options.h"
 #include "parse.h"
+#include "peephole.h"
+#include "pool.h"
 #include "preprocess.h"
+#include "server.h"
 #include "struct/list.h"
 #include "token.h"
 
@@ -38,29 +47,33 @@ int filedata_load(FileData *data, const char *filename) {
   return 0;
 }
 
-int main(const int argc, char **argv) {
-  if (argc < 2) {
-    if (argv[0] != NULL) {
-      printf("Usage: %s <filenames...>\n", argv[0]);
+// compiles the files with the options already parsed
+int compile(const char *program, StrList filenames) {
+  if (filenames.len < 1) {
+    if (program != NULL) {
+      printf("Usage: %s [options] <filenames...>\n", program);
     } else {
-      puts("Usage: clamor <filenames..>");
+      puts("Usage: clamor [options] <filenames..>");
     }
     return 1;
   }
 
-  FileData *files = malloc(sizeof(FileData) * (argc - 1));
-  Token *tokens = malloc(sizeof(Token) * (argc - 1));
-  StrList *strLiterals = malloc(sizeof(StrList) * (argc - 1));
+  const int count = filenames.len;
+  if (options.tiered && count > 1) {
+    puts("--tiered runs a single source file");
+    return 1;
+  }
+  FileData *files = malloc(sizeof(FileData) * count);
+  Token *tokens = malloc(sizeof(Token) * count);
 
-  for (int i = 1; i < argc; i++) {
-    if (filedata_load(&files[i - 1], argv[i]) != 0) {
-      printf("No such file: %s\n", argv[i]);
+  for (int i = 0; i < count; i++) {
+    if (filedata_load(&files[i], filenames.array[i]) != 0) {
+      printf("No such file: %s\n", filenames.array[i]);
       exit(-1);
     }
-    strlist_init(&strLiterals[i - 1], 1);
   }
 
-  for (int i = 0; i < argc - 1; i++) {
+  for (int i = 0; i < count; i++) {
     if (!tokenize(files[i].contents, files[i].len, &tokens[i])) {
       printf("Failed to tokenize %s\n", files[i].filename);
       exit(3);
@@ -69,39 +82,168 @@ int main(const int argc, char **argv) {
 
   FunctionList functions;
   VarList globals;
+  // shared by every file, so that each string is only placed once
+  LiteralPool literals;
   functionlist_init(&functions, 2);
   varlist_init(&globals, 2);
+  pool_init(&literals);
 
-  FILE *output = fopen("output.asm", "wb");
-  for (int i = 0; i < argc - 1; i++) {
+  if (options.run) {
+    jit_redirect_output();
+  }
+
+  // text only goes through output with --emit=asm, otherwise everything is encoded into object
+  const bool assembly = options.emitAssembly && !options.run;
+  FILE *output = assembly ? fopen("output.asm", "wb") : NULL;
+  ObjectFile storage;
+  ObjectFile *object = NULL;
+  if (!assembly) {
+    object_init(&storage);
+    object = &storage;
+  }
+  for (int i = 0; i < count; i++) {
     const Result result =
-        preprocess_globals(files[i].contents, &tokens[i], &strLiterals[i], &globals, &functions, output);
+        preprocess_globals(files[i].filename, files[i].contents, &tokens[i], &literals, &globals, &functions,
+                           output, object);
     if (!successful(result)) {
-      fflush(output);
+      if (output != NULL)
+        fflush(output);
       print_error("Preprocessing", result, files[i].filename, files[i].contents, files[i].len);
       exit(1);
     }
   }
 
-  fputc('\n', output);
+  // globals leave the assembler in their own sections
+  if (output != NULL) {
+    fputs("\t.text\n\n", output);
+  }
 
-  for (int i = 0; i < argc - 1; i++) {
-    for (int j = 0; j < functions.len; ++j) {
-      const Result result =
-          parse_function(files[i].contents, &functions.array[j], &globals, &functions, &strLiterals[i], output);
-      if (!successful(result)) {
+  // the declarations are all an interface holds, so nothing is compiled
+  if (options.emitInterface && !options.run) {
+    output = fopen("output.crsi", "wb");
+    interface_write(&functions, &globals, output);
+    fclose(output);
+    object_free(object);
+    return 0;
+  }
+
+  // every body is parsed before any is compiled, so calls can be inlined. with --gc-functions that starts from main
+  // and the roots, and each function a parsed body calls is parsed in turn: the rest are never parsed or compiled
+  PtrList reachable;
+  ptrlist_init(&reachable, functions.len + 1);
+  for (int j = 0; j < functions.len; ++j) {
+    const char *name = functions.array[j].name;
+    if (!options.gcFunctions || strcmp(name, "main") == 0 || strlist_indexof(&options.gcRoots, name) != -1) {
+      ptrlist_add(&reachable, &functions.array[j]);
+    }
+  }
+  for (int j = 0; j < reachable.len; ++j) {
+    Function *function = reachable.array[j];
+    if (function->source == NULL)
+      continue;
+    const Result result = parse_function_body(function->source, function, &globals, &functions, &literals);
+    if (!successful(result)) {
+      if (output != NULL)
         fflush(output);
-        print_error("Parsing", result, files[i].filename, files[i].contents, files[i].len);
-        exit(1);
+      print_error("Parsing", result, function->filename, function->source, strlen(function->source));
+      exit(1);
+    }
+    for (int k = 0; options.gcFunctions && function->body != NULL && k < function->body->len; ++k) {
+      ast_collect_calls(&function->body->array[k], &reachable);
+    }
+  }
+  free(reachable.array);
+  for (int j = 0; j < functions.len; ++j) {
+    if (functions.array[j].body != NULL) {
+      for (int k = 0; k < functions.array[j].body->len; ++k) {
+        ast_count_calls(&functions.array[j].body->array[k]);
       }
     }
   }
-  fclose(output);
+
+  // the interpreter lowers and compiles functions as the program reaches them
+  for (int j = 0; j < functions.len && !options.tiered; ++j) {
+    Function *function = &functions.array[j];
+    if (function->source == NULL || (options.gcFunctions && function->body == NULL))
+      continue;
+    const Result result =
+        parse_function(function->source, function, &globals, &functions, &literals, output, object);
+    if (!successful(result)) {
+      if (output != NULL)
+        fflush(output);
+      print_error("Parsing", result, function->filename, function->source, strlen(function->source));
+      exit(1);
+    }
+  }
+  // after the functions, and before anything is loaded or written
+  pool_write(&literals, output, object);
+
+  int status = 0;
+  if (options.run) {
+    // the program sees the first source file as its own name
+    char **programArgv = malloc(sizeof(char *) * (options.programArgc + 2));
+    programArgv[0] = filenames.array[0];
+    for (int i = 0; i < options.programArgc; ++i) {
+      programArgv[i + 1] = options.programArgv[i];
+    }
+    programArgv[options.programArgc + 1] = NULL;
+    if (options.tiered) {
+      status = interpret_run(files[0].contents, &globals, &functions, &literals, object,
+                             options.programArgc + 1, programArgv);
+    } else {
+      status = jit_run(object, options.programArgc + 1, programArgv);
+    }
+    free(programArgv);
+    object_free(object);
+  } else if (object != NULL) {
+    output = fopen("output.o", "wb");
+    object_write(object, output);
+    object_free(object);
+    fclose(output);
+  } else {
+    fclose(output);
+  }
+
+  if (options.peepholeStats) {
+    peephole_report(stderr);
+  }
 
   // fixme
   free(files);
   free(tokens);
-  free(strLiterals);
+  free(filenames.array);
 
-  return 0;
+  return status;
+}
+
+// what a compile server runs for each client. --server and --connect mean nothing by then
+int compile_arguments(const int argc, char **argv) {
+  StrList filenames;
+  strlist_init(&filenames, 2);
+  options_init(&options);
+  if (!options_parse(&options, argc, argv, &filenames)) {
+    return 1;
+  }
+  return compile(argv[0], filenames);
+}
+
+int main(const int argc, char **argv) {
+  StrList filenames;
+  strlist_init(&filenames, 2);
+  options_init(&options);
+  if (!options_parse(&options, argc, argv, &filenames)) {
+    return 1;
+  }
+
+  const char *path = options.socket != NULL ? options.socket : server_socket_path();
+  if (options.serve) {
+    return server_run(path, compile_arguments);
+  }
+  if (options.connect) {
+    // without a server to ask, the compile happens here instead
+    const int status = client_run(path, argc, argv);
+    if (status != -1)
+      return status;
+  }
+  return compile(argv[0], filenames);
 }
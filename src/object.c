@@ -0,0 +1,327 @@
+#include "object.h"
+
+#include <string.h>
+
+LIST_IMPL(Byte, byte, uint8_t)
+LIST_IMPL(ObjectSymbol, osym, ObjectSymbol)
+LIST_IMPL(ObjectRelocation, oreloc, ObjectRelocation)
+
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_RELA 4
+#define SHT_NOBITS 8
+
+#define SHF_WRITE 0x1
+#define SHF_ALLOC 0x2
+#define SHF_EXECINSTR 0x4
+#define SHF_INFO_LINK 0x40
+
+#define STB_LOCAL 0
+#define STB_GLOBAL 1
+#define STT_NOTYPE 0
+#define STT_OBJECT 1
+#define STT_FUNC 2
+#define STT_SECTION 3
+
+typedef struct {
+  const char *name;
+  uint32_t type;
+  uint64_t flags;
+  uint64_t alignment;
+} SectionInfo;
+
+const SectionInfo sectionInfo[SECTION_COUNT] = {
+    {".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 16},
+    {".rodata", SHT_PROGBITS, SHF_ALLOC, 16},
+    {".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 16},
+    {".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 16},
+};
+
+void object_init(ObjectFile *object) {
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    bytelist_init(&object->sections[i], 256);
+    object->alignment[i] = sectionInfo[i].alignment;
+  }
+  osymlist_init(&object->symbols, 16);
+  oreloclist_init(&object->relocations, 16);
+}
+
+void object_free(ObjectFile *object) {
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    free(object->sections[i].array);
+  }
+  for (int i = 0; i < object->symbols.len; ++i) {
+    free(object->symbols.array[i].name);
+  }
+  free(object->symbols.array);
+  free(object->relocations.array);
+}
+
+int object_symbol(ObjectFile *object, const char *name) {
+  for (int i = 0; i < object->symbols.len; ++i) {
+    if (strcmp(object->symbols.array[i].name, name) == 0)
+      return i;
+  }
+  ObjectSymbol *symbol = osymlist_grow(&object->symbols);
+  symbol->name = strdup(name);
+  symbol->section = SECTION_COUNT;
+  symbol->offset = 0;
+  symbol->size = 0;
+  symbol->global = false;
+  symbol->function = false;
+  return object->symbols.len - 1;
+}
+
+ObjectSymbol *object_define(ObjectFile *object, const char *name, const SectionKind section, const uint64_t offset) {
+  const int index = object_symbol(object, name);
+  ObjectSymbol *symbol = &object->symbols.array[index];
+  symbol->section = section;
+  symbol->offset = offset;
+  return symbol;
+}
+
+void object_append(ObjectFile *object, const SectionKind section, const void *bytes, const size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    bytelist_add(&object->sections[section], ((const uint8_t *)bytes)[i]);
+  }
+}
+
+void object_append_int(ObjectFile *object, const SectionKind section, const uint64_t value, const int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    bytelist_add(&object->sections[section], (uint8_t)(value >> (i * 8)));
+  }
+}
+
+void object_align(ObjectFile *object, const SectionKind section, const int alignment) {
+  if ((uint64_t)alignment > object->alignment[section]) {
+    object->alignment[section] = (uint64_t)alignment;
+  }
+  while (object->sections[section].len % alignment != 0) {
+    bytelist_add(&object->sections[section], 0);
+  }
+}
+
+void object_relocate(ObjectFile *object, const SectionKind section, const uint64_t offset, const char *symbol,
+                     const uint32_t type, const int64_t addend) {
+  ObjectRelocation *relocation = oreloclist_grow(&object->relocations);
+  relocation->section = section;
+  relocation->offset = offset;
+  relocation->symbol = object_symbol(object, symbol);
+  relocation->type = type;
+  relocation->addend = addend;
+}
+
+void put_int(ByteList *file, const uint64_t value, const int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    bytelist_add(file, (uint8_t)(value >> (i * 8)));
+  }
+}
+
+void put_section_header(ByteList *file, const uint32_t name, const uint32_t type, const uint64_t flags,
+                        const uint64_t offset, const uint64_t size, const uint32_t link, const uint32_t info,
+                        const uint64_t alignment, const uint64_t entrySize) {
+  put_int(file, name, 4);
+  put_int(file, type, 4);
+  put_int(file, flags, 8);
+  put_int(file, 0, 8);
+  put_int(file, offset, 8);
+  put_int(file, size, 8);
+  put_int(file, link, 4);
+  put_int(file, info, 4);
+  put_int(file, alignment, 8);
+  put_int(file, entrySize, 8);
+}
+
+void put_padding(ByteList *file, const int alignment) {
+  while (file->len % alignment != 0) {
+    bytelist_add(file, 0);
+  }
+}
+
+uint32_t put_string(ByteList *table, const char *string) {
+  const uint32_t offset = (uint32_t)table->len;
+  do {
+    bytelist_add(table, (uint8_t)*string);
+  } while (*string++ != '\0');
+  return offset;
+}
+
+// .L labels stay out of the symbol table, as they do with `as`: what refers to them refers to their section instead
+bool symbol_listed(const ObjectSymbol *symbol) {
+  return symbol->global || symbol->section == SECTION_COUNT || strncmp(symbol->name, ".L", 2) != 0;
+}
+
+void put_symbol(ByteList *file, const uint32_t name, const uint8_t binding, const uint8_t type, const uint16_t section,
+                const uint64_t value, const uint64_t size) {
+  put_int(file, name, 4);
+  put_int(file, (uint8_t)(binding << 4 | type), 1);
+  put_int(file, 0, 1);
+  put_int(file, section, 2);
+  put_int(file, value, 8);
+  put_int(file, size, 8);
+}
+
+// sections are numbered null, .text, .rodata, .data, .bss, then the relocations of any section that has some,
+// .note.GNU-stack (marking the stack non-executable), .symtab, .strtab and .shstrtab
+void object_write(const ObjectFile *object, FILE *output) {
+  ByteList file;
+  bytelist_init(&file, 4096);
+  ByteList strings;
+  bytelist_init(&strings, 256);
+  ByteList names;
+  bytelist_init(&names, 128);
+  bytelist_add(&strings, 0);
+  bytelist_add(&names, 0);
+
+  // locals come first in the symbol table, the sections' own symbols at 1 to SECTION_COUNT
+  ByteList symbols;
+  bytelist_init(&symbols, 1024);
+  int *indices = malloc(sizeof(int) * (object->symbols.len + 1));
+  put_symbol(&symbols, 0, STB_LOCAL, STT_NOTYPE, 0, 0, 0);
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    put_symbol(&symbols, 0, STB_LOCAL, STT_SECTION, (uint16_t)(i + 1), 0, 0);
+  }
+  int next = SECTION_COUNT + 1;
+  int firstGlobal = next;
+  for (int pass = 0; pass < 2; ++pass) {
+    if (pass == 1) {
+      firstGlobal = next;
+    }
+    for (int i = 0; i < object->symbols.len; ++i) {
+      const ObjectSymbol *symbol = &object->symbols.array[i];
+      const bool global = symbol->global || symbol->section == SECTION_COUNT;
+      if (global != (pass == 1) || !symbol_listed(symbol)) {
+        continue;
+      }
+      const uint8_t type = symbol->section == SECTION_COUNT ? STT_NOTYPE
+                           : symbol->function                ? STT_FUNC
+                                                             : STT_OBJECT;
+      put_symbol(&symbols, put_string(&strings, symbol->name), global ? STB_GLOBAL : STB_LOCAL, type,
+                 symbol->section == SECTION_COUNT ? 0 : (uint16_t)(symbol->section + 1), symbol->offset,
+                 symbol->size);
+      indices[i] = next++;
+    }
+  }
+
+  // header, filled in at the end
+  for (int i = 0; i < 64; ++i) {
+    bytelist_add(&file, 0);
+  }
+
+  uint64_t offsets[SECTION_COUNT];
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    put_padding(&file, 16);
+    offsets[i] = file.len;
+    if (sectionInfo[i].type != SHT_NOBITS) {
+      for (int j = 0; j < object->sections[i].len; ++j) {
+        bytelist_add(&file, object->sections[i].array[j]);
+      }
+    }
+  }
+
+  uint64_t relocationOffsets[SECTION_COUNT];
+  uint64_t relocationSizes[SECTION_COUNT];
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    put_padding(&file, 8);
+    relocationOffsets[i] = file.len;
+    for (int j = 0; j < object->relocations.len; ++j) {
+      const ObjectRelocation *relocation = &object->relocations.array[j];
+      if (relocation->section != (SectionKind)i)
+        continue;
+      const ObjectSymbol *symbol = &object->symbols.array[relocation->symbol];
+      uint64_t index = symbol_listed(symbol) ? (uint64_t)indices[relocation->symbol] : 0;
+      int64_t addend = relocation->addend;
+      if (!symbol->global && symbol->section != SECTION_COUNT) {
+        // a local is reached through its section
+        index = symbol->section + 1;
+        addend += (int64_t)symbol->offset;
+      }
+      put_int(&file, relocation->offset, 8);
+      put_int(&file, index << 32 | relocation->type, 8);
+      put_int(&file, (uint64_t)addend, 8);
+    }
+    relocationSizes[i] = file.len - relocationOffsets[i];
+  }
+
+  put_padding(&file, 8);
+  const uint64_t symbolsOffset = file.len;
+  for (int i = 0; i < symbols.len; ++i) {
+    bytelist_add(&file, symbols.array[i]);
+  }
+  const uint64_t stringsOffset = file.len;
+  for (int i = 0; i < strings.len; ++i) {
+    bytelist_add(&file, strings.array[i]);
+  }
+
+  int relocationSections = 0;
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    relocationSections += relocationSizes[i] != 0;
+  }
+  const uint32_t symtab = SECTION_COUNT + relocationSections + 2;
+
+  uint32_t sectionNames[SECTION_COUNT];
+  uint32_t relocationNames[SECTION_COUNT];
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    sectionNames[i] = put_string(&names, sectionInfo[i].name);
+    char rela[32];
+    snprintf(rela, sizeof(rela), ".rela%s", sectionInfo[i].name);
+    relocationNames[i] = put_string(&names, rela);
+  }
+  const uint32_t noteName = put_string(&names, ".note.GNU-stack");
+  const uint32_t symtabName = put_string(&names, ".symtab");
+  const uint32_t strtabName = put_string(&names, ".strtab");
+  const uint32_t shstrtabName = put_string(&names, ".shstrtab");
+  const uint64_t namesOffset = file.len;
+  for (int i = 0; i < names.len; ++i) {
+    bytelist_add(&file, names.array[i]);
+  }
+
+  put_padding(&file, 8);
+  const uint64_t headersOffset = file.len;
+  put_section_header(&file, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    put_section_header(&file, sectionNames[i], sectionInfo[i].type, sectionInfo[i].flags, offsets[i],
+                       object->sections[i].len, 0, 0, object->alignment[i], 0);
+  }
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    if (relocationSizes[i] != 0) {
+      put_section_header(&file, relocationNames[i], SHT_RELA, SHF_INFO_LINK, relocationOffsets[i], relocationSizes[i],
+                         symtab, i + 1, 8, 24);
+    }
+  }
+  put_section_header(&file, noteName, SHT_PROGBITS, 0, namesOffset, 0, 0, 0, 1, 0);
+  put_section_header(&file, symtabName, SHT_SYMTAB, 0, symbolsOffset, symbols.len, symtab + 1, firstGlobal, 8, 24);
+  put_section_header(&file, strtabName, SHT_STRTAB, 0, stringsOffset, strings.len, 0, 0, 1, 0);
+  put_section_header(&file, shstrtabName, SHT_STRTAB, 0, namesOffset, names.len, 0, 0, 1, 0);
+  const uint16_t sectionCount = (uint16_t)(symtab + 3);
+
+  ByteList header;
+  bytelist_init(&header, 64);
+  const uint8_t ident[16] = {0x7f, 'E', 'L', 'F', 2 /* 64-bit */, 1 /* little endian */, 1 /* version */};
+  for (int i = 0; i < 16; ++i) {
+    bytelist_add(&header, ident[i]);
+  }
+  put_int(&header, 1, 2);  // relocatable
+  put_int(&header, 62, 2); // x86-64
+  put_int(&header, 1, 4);
+  put_int(&header, 0, 8);
+  put_int(&header, 0, 8);
+  put_int(&header, headersOffset, 8);
+  put_int(&header, 0, 4);
+  put_int(&header, 64, 2);
+  put_int(&header, 0, 2);
+  put_int(&header, 0, 2);
+  put_int(&header, 64, 2);
+  put_int(&header, sectionCount, 2);
+  put_int(&header, sectionCount - 1, 2);
+  memcpy(file.array, header.array, 64);
+
+  fwrite(file.array, 1, file.len, output);
+  free(header.array);
+  free(file.array);
+  free(strings.array);
+  free(names.array);
+  free(symbols.array);
+  free(indices);
+}
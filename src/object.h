@@ -0,0 +1,67 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+#include "struct/list.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// an ELF64 relocatable object, built in memory and written out once the module is complete
+
+typedef enum { SECTION_TEXT, SECTION_RODATA, SECTION_DATA, SECTION_BSS, SECTION_COUNT } SectionKind;
+
+// the relocation types the encoder produces
+#define R_X86_64_64 1
+#define R_X86_64_PC32 2
+#define R_X86_64_PLT32 4
+#define R_X86_64_32 10
+#define R_X86_64_32S 11
+
+typedef struct {
+  char *name;
+  // SECTION_COUNT while the symbol is undefined (an extern, or a function not yet encoded)
+  SectionKind section;
+  uint64_t offset;
+  uint64_t size;
+  bool global;
+  bool function;
+} ObjectSymbol;
+
+typedef struct {
+  SectionKind section;
+  uint64_t offset;
+  int symbol;
+  uint32_t type;
+  int64_t addend;
+} ObjectRelocation;
+
+LIST_API(Byte, byte, uint8_t)
+LIST_API(ObjectSymbol, osym, ObjectSymbol)
+LIST_API(ObjectRelocation, oreloc, ObjectRelocation)
+
+typedef struct {
+  // .bss is kept as zeroes, but written out as its size alone
+  ByteList sections[SECTION_COUNT];
+  // the largest alignment anything placed in each section asks for
+  uint64_t alignment[SECTION_COUNT];
+  ObjectSymbolList symbols;
+  ObjectRelocationList relocations;
+} ObjectFile;
+
+void object_init(ObjectFile *object);
+void object_free(ObjectFile *object);
+
+// the index of the symbol called name, added (undefined) when the object does not know it yet
+int object_symbol(ObjectFile *object, const char *name);
+// places the symbol at offset in the section. the pointer lasts until the next symbol is added
+ObjectSymbol *object_define(ObjectFile *object, const char *name, SectionKind section, uint64_t offset);
+void object_append(ObjectFile *object, SectionKind section, const void *bytes, size_t len);
+void object_append_int(ObjectFile *object, SectionKind section, uint64_t value, int bytes);
+// pads the section out to a multiple of alignment, which the section is then aligned to in memory as well
+void object_align(ObjectFile *object, SectionKind section, int alignment);
+void object_relocate(ObjectFile *object, SectionKind section, uint64_t offset, const char *symbol, uint32_t type,
+                     int64_t addend);
+
+void object_write(const ObjectFile *object, FILE *output);
+
+#endif // OBJECT_H
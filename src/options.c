@@ -0,0 +1,187 @@
+#include "options.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+Options options;
+
+typedef struct {
+  const char *name;
+  unsigned features;
+} FeatureName;
+
+#define LEVEL_V2 (FEATURE_SSE4_2 | FEATURE_POPCNT)
+#define LEVEL_V3 (LEVEL_V2 | FEATURE_AVX2 | FEATURE_BMI1 | FEATURE_BMI2 | FEATURE_LZCNT)
+
+// the psABI microarchitecture levels, and the first Intel cores to reach them
+const FeatureName targetNames[] = {
+    {"x86-64", 0},         {"x86-64-v2", LEVEL_V2}, {"nehalem", LEVEL_V2},
+    {"x86-64-v3", LEVEL_V3}, {"x86-64-v4", LEVEL_V3}, {"haswell", LEVEL_V3},
+};
+
+// toggled one at a time with -m<name> and -mno-<name>
+const FeatureName featureNames[] = {
+    {"sse4.2", FEATURE_SSE4_2}, {"popcnt", FEATURE_POPCNT}, {"avx2", FEATURE_AVX2},
+    {"bmi", FEATURE_BMI1},      {"bmi2", FEATURE_BMI2},     {"lzcnt", FEATURE_LZCNT},
+};
+
+unsigned native_features(void) {
+  unsigned features = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+  if ((ecx & bit_SSE4_1) && (ecx & bit_SSE4_2))
+    features |= FEATURE_SSE4_2;
+  if (ecx & bit_POPCNT)
+    features |= FEATURE_POPCNT;
+  // the ymm registers are only usable once the os saves their upper halves (xcr0 bits 1 and 2)
+  bool avx = false;
+  if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+    unsigned xcr0, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+    avx = (xcr0 & 6) == 6;
+  }
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    if (avx && (ebx & bit_AVX2))
+      features |= FEATURE_AVX2;
+    if (ebx & bit_BMI)
+      features |= FEATURE_BMI1;
+    if (ebx & bit_BMI2)
+      features |= FEATURE_BMI2;
+  }
+  if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (ecx & bit_LZCNT))
+    features |= FEATURE_LZCNT;
+#endif
+  return features;
+}
+
+int options_target_features(const char *name) {
+  if (strcmp(name, "native") == 0)
+    return (int)native_features();
+  for (size_t i = 0; i < sizeof(targetNames) / sizeof(FeatureName); ++i) {
+    if (strcmp(name, targetNames[i].name) == 0)
+      return (int)targetNames[i].features;
+  }
+  return -1;
+}
+
+const FeatureName *find_feature(const char *name) {
+  for (size_t i = 0; i < sizeof(featureNames) / sizeof(FeatureName); ++i) {
+    if (strcmp(name, featureNames[i].name) == 0)
+      return &featureNames[i];
+  }
+  return NULL;
+}
+
+void options_init(Options *options) {
+  options->peephole = true;
+  options->peepholeStats = false;
+  options->tailCalls = true;
+  options->inlineLimit = 16;
+  options->gvn = true;
+  options->vectorize = true;
+  options->builtins = true;
+  options->gcFunctions = false;
+  strlist_init(&options->gcRoots, 1);
+  options->features = 0;
+  options->emitAssembly = false;
+  options->emitInterface = false;
+  options->run = false;
+  options->tiered = false;
+  options->tierThreshold = 1000;
+  options->cacheDir = NULL;
+  options->serve = false;
+  options->connect = false;
+  options->socket = NULL;
+  options->programArgc = 0;
+  options->programArgv = NULL;
+}
+
+bool options_parse(Options *options, const int argc, char **argv, StrList *files) {
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    if (arg[0] != '-') {
+      strlist_add(files, argv[i]);
+    } else if (strcmp(arg, "--") == 0) {
+      options->programArgc = argc - i - 1;
+      options->programArgv = argv + i + 1;
+      break;
+    } else if (strcmp(arg, "-fpeephole") == 0) {
+      options->peephole = true;
+    } else if (strcmp(arg, "-fno-peephole") == 0) {
+      options->peephole = false;
+    } else if (strcmp(arg, "-ftail-calls") == 0) {
+      options->tailCalls = true;
+    } else if (strcmp(arg, "-fno-tail-calls") == 0) {
+      options->tailCalls = false;
+    } else if (strncmp(arg, "-finline-limit=", 15) == 0) {
+      options->inlineLimit = atoi(arg + 15);
+    } else if (strcmp(arg, "-fno-inline") == 0) {
+      options->inlineLimit = 0;
+    } else if (strcmp(arg, "-fgvn") == 0) {
+      options->gvn = true;
+    } else if (strcmp(arg, "-fno-gvn") == 0) {
+      options->gvn = false;
+    } else if (strcmp(arg, "-fvectorize") == 0) {
+      options->vectorize = true;
+    } else if (strcmp(arg, "-fno-vectorize") == 0) {
+      options->vectorize = false;
+    } else if (strcmp(arg, "-fbuiltin") == 0) {
+      options->builtins = true;
+    } else if (strcmp(arg, "-fno-builtin") == 0) {
+      options->builtins = false;
+    } else if (strcmp(arg, "--gc-functions") == 0) {
+      options->gcFunctions = true;
+    } else if (strncmp(arg, "--gc-root=", 10) == 0) {
+      strlist_add(&options->gcRoots, argv[i] + 10);
+    } else if (strncmp(arg, "-march=", 7) == 0 || strncmp(arg, "-mcpu=", 6) == 0) {
+      const char *name = strchr(arg, '=') + 1;
+      const int target = options_target_features(name);
+      if (target == -1) {
+        printf("Unknown target cpu: %s\n", name);
+        return false;
+      }
+      options->features = (unsigned)target;
+    } else if (strncmp(arg, "-mno-", 5) == 0 && find_feature(arg + 5) != NULL) {
+      options->features &= ~find_feature(arg + 5)->features;
+    } else if (strncmp(arg, "-m", 2) == 0 && find_feature(arg + 2) != NULL) {
+      options->features |= find_feature(arg + 2)->features;
+    } else if (strcmp(arg, "--emit=asm") == 0) {
+      options->emitAssembly = true;
+      options->emitInterface = false;
+    } else if (strcmp(arg, "--emit=obj") == 0) {
+      options->emitAssembly = false;
+      options->emitInterface = false;
+    } else if (strcmp(arg, "--emit=interface") == 0) {
+      options->emitAssembly = false;
+      options->emitInterface = true;
+    } else if (strcmp(arg, "--run") == 0) {
+      options->run = true;
+    } else if (strcmp(arg, "--tiered") == 0) {
+      options->run = true;
+      options->tiered = true;
+    } else if (strncmp(arg, "-ftier-threshold=", 17) == 0) {
+      options->tierThreshold = atoi(arg + 17);
+    } else if (strncmp(arg, "--cache-dir=", 12) == 0) {
+      options->cacheDir = arg + 12;
+    } else if (strcmp(arg, "--server") == 0 || strncmp(arg, "--server=", 9) == 0) {
+      options->serve = true;
+      options->socket = arg[8] == '=' ? arg + 9 : options->socket;
+    } else if (strcmp(arg, "--connect") == 0 || strncmp(arg, "--connect=", 10) == 0) {
+      options->connect = true;
+      options->socket = arg[9] == '=' ? arg + 10 : options->socket;
+    } else if (strcmp(arg, "--peephole-stats") == 0) {
+      options->peepholeStats = true;
+    } else {
+      printf("Unknown option: %s\n", arg);
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,69 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+#include "struct/list.h"
+
+#include <stdbool.h>
+
+// instruction set extensions beyond baseline x86-64 (SSE2) that code generation may use
+typedef enum {
+  // SSE4.2 and everything before it (SSE3, SSSE3, SSE4.1)
+  FEATURE_SSE4_2 = 1 << 0,
+  FEATURE_POPCNT = 1 << 1,
+  // AVX and AVX2, 256-bit integer vectors
+  FEATURE_AVX2 = 1 << 2,
+  // BMI1 (tzcnt) and BMI2 (shlx/sarx/shrx)
+  FEATURE_BMI1 = 1 << 3,
+  FEATURE_BMI2 = 1 << 4,
+  FEATURE_LZCNT = 1 << 5
+} Feature;
+
+typedef struct {
+  // run the peephole optimizer over each function's instruction stream
+  bool peephole;
+  // print how often each peephole rule fired
+  bool peepholeStats;
+  // emit `return f(...)` as a jump into f
+  bool tailCalls;
+  // largest callee, in expression nodes, that is inlined at its call sites (0 disables inlining)
+  int inlineLimit;
+  // reuse pure expressions already computed on every path to their use
+  bool gvn;
+  // run element-wise array loops 16 bytes at a time
+  bool vectorize;
+  // write small constant-length memset/memcpy calls out inline
+  bool builtins;
+  // only parse and generate the functions main or a --gc-root function reaches through its calls (--gc-functions)
+  bool gcFunctions;
+  StrList gcRoots;
+  // extensions the target cpu (-march/-mcpu) supports, see Feature
+  unsigned features;
+  // write AT&T text to output.asm (--emit=asm) rather than an ELF object to output.o
+  bool emitAssembly;
+  // write the module's declarations to output.crsi (--emit=interface), for other modules to import, and nothing else
+  bool emitInterface;
+  // load the program into the compiler and call its main, rather than writing anything out
+  bool run;
+  // run (as --run does) by interpreting each function until it has been called or looped this many times, then
+  // compiling it
+  bool tiered;
+  int tierThreshold;
+  // where each function's generated code is kept between compiles (--cache-dir=), NULL for no cache
+  const char *cacheDir;
+  // stay up compiling for clients (--server), or be one (--connect), over a unix socket
+  bool serve;
+  bool connect;
+  // the socket's path, NULL for the default (see server_socket_path)
+  const char *socket;
+  // the arguments after `--`, passed on to main by --run
+  int programArgc;
+  char **programArgv;
+} Options;
+
+extern Options options;
+
+void options_init(Options *options);
+// the extensions of a -march name, or -1 for an unknown one. "native" asks the host's cpuid
+int options_target_features(const char *name);
+bool options_parse(Options *options, int argc, char **argv, StrList *files);
+
+#endif // OPTIONS_H
@@ -1,28 +1,90 @@
 #include "parse.h"
 
+#include "cache.h"
 #include "codegen.h"
+#include "encode.h"
+#include "options.h"
+#include "peephole.h"
+
+Result parse_function_body(const char *contents, Function *function, VarList *globals, FunctionList *functions,
+                           LiteralPool *literals) {
+  assert(contents != NULL);
+  if (function->start != NULL && function->body == NULL) {
+    function->body = malloc(sizeof(AstNodeList));
+    astnodelist_init(function->body, 16);
+    const Token *token = function->start;
+    forward_err(parse_scope(contents, &token, globals, functions, literals, function->body));
+    PtrList locals;
+    ptrlist_init(&locals, 8);
+    for (int i = 0; i < function->body->len; ++i) {
+      ast_resolve_globals(contents, function, globals, &locals, &function->body->array[i]);
+    }
+    free(locals.array);
+  }
+  return success();
+}
+
+Result lower_function(const char *contents, Function *function, VarList *globals, FunctionList *functions,
+                      LiteralPool *literals, InstructionTable *table) {
+  assert(contents != NULL && function->start != NULL);
+  forward_err(parse_function_body(contents, function, globals, functions, literals));
+  const AstNodeList nodes = *function->body;
+  instructiontable_init(table, function->name);
+  table_allocate_arguments(table, function);
+
+  for (int i = 0; i < nodes.len; ++i) {
+    table->addressTaken |= ast_takes_address(&nodes.array[i]);
+  }
+  table_analyse_addresses(table, contents, &nodes);
+  for (int i = 0; i < nodes.len; ++i) {
+    solve_ast_node(contents, table, globals, functions, literals, &nodes.array[i]);
+  }
+  return success();
+}
 
 Result parse_function(const char *contents, Function *function, VarList *globals, FunctionList *functions,
-                      StrList *literals, FILE *output) {
+                      LiteralPool *literals, FILE *output, ObjectFile *object) {
   assert(contents != NULL);
   if (function->start != NULL) {
-    AstNodeList nodes;
-    astnodelist_init(&nodes, 16);
+    // declared only once the function is compiled, so one --gc-functions drops leaves no symbol behind
+    if (object != NULL) {
+      ObjectSymbol *symbol = &object->symbols.array[object_symbol(object, function->name)];
+      symbol->global = true;
+      symbol->function = true;
+    } else {
+      fprintf(output, ".globl %s\n", function->name);
+    }
+    const uint64_t key =
+        options.cacheDir != NULL ? cache_key(contents, function, functions, globals, literals, object != NULL) : 0;
+    if (options.cacheDir != NULL && cache_load(key, function, output, object))
+      return success();
+
     InstructionTable table;
-    instructiontable_init(&table, function->name);
+    forward_err(lower_function(contents, function, globals, functions, literals, &table));
 
-    fprintf(output, "%s:\n", function->name);
-    table_allocate_arguments(&table, function);
-    const Token *token = function->start;
-    forward_err(parse_scope(contents, &token, globals, functions, literals, &nodes));
+    MachineInstructionList code;
+    minstlist_init(&code, 64);
+    machine_emit_label(&code, function->name);
 
-    for (int i = 0; i < nodes.len; ++i) {
-      solve_ast_node(contents, &table, globals, functions, literals, &nodes.array[i]);
-    }
     Registers registers;
 
     registers_init(&registers, &table);
-    generate_statement(&registers, contents, &table, globals, functions, literals, output);
+    generate_statement(&registers, contents, &table, globals, functions, literals, &code);
+
+    if (options.peephole) {
+      peephole_optimize(&code);
+    }
+    const uint64_t textStart = object != NULL ? object->sections[SECTION_TEXT].len : 0;
+    const int relocationStart = object != NULL ? object->relocations.len : 0;
+    if (object != NULL) {
+      encode_function(object, &code);
+    } else {
+      machine_write(&code, output);
+    }
+    if (options.cacheDir != NULL) {
+      cache_store(key, function, &code, object, textStart, relocationStart);
+    }
+    free(code.array);
 
     instructiontable_free(&table);
   }
@@ -30,7 +92,7 @@ Result parse_function(const char *contents, Function *function, VarList *globals
 }
 
 Result parse_scope(const char *contents, const Token **token, VarList *globals, FunctionList *functions,
-                   StrList *literals, AstNodeList *nodes) {
+                   LiteralPool *literals, AstNodeList *nodes) {
   assert(contents != NULL);
   token_matches(*token, token_opening_curly_brace);
   while ((*token)->next != NULL) {
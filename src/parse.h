@@ -2,14 +2,21 @@
 #define PARSE_H
 #include "ast.h"
 #include "ir.h"
+#include "object.h"
 #include "result.h"
 
 #include <stdio.h>
 
+Result parse_function_body(const char *contents, Function *function, VarList *globals, FunctionList *functions,
+                           LiteralPool *literals);
+// lowers the function's body into table, ready for code generation (or interpretation)
+Result lower_function(const char *contents, Function *function, VarList *globals, FunctionList *functions,
+                      LiteralPool *literals, InstructionTable *table);
+// compiles the function onto the end of object, or as AT&T text to output when object is NULL
 Result parse_function(const char *contents, Function *function, VarList *globals, FunctionList *functions,
-                      StrList *str_literals, FILE *output);
+                      LiteralPool *literals, FILE *output, ObjectFile *object);
 
 Result parse_scope(const char *contents, const Token **token, VarList *globals, FunctionList *functions,
-                   StrList *literals, AstNodeList *nodes);
+                   LiteralPool *literals, AstNodeList *nodes);
 
 #endif // PARSE_H
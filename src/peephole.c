@@ -0,0 +1,309 @@
+#include "peephole.h"
+
+#include "register.h"
+
+#include <string.h>
+
+typedef struct {
+  const char *name;
+  // rewrites the instructions starting at index, returns false if the rule does not match
+  bool (*apply)(MachineInstructionList *list, int index);
+  int count;
+} PeepholeRule;
+
+int next_instruction(const MachineInstructionList *list, int index) {
+  for (index++; index < list->len; index++) {
+    if (list->array[index].op != M_COMMENT) {
+      return index;
+    }
+  }
+  return -1;
+}
+
+void remove_instruction(MachineInstructionList *list, const int index) {
+  memmove(list->array + index, list->array + index + 1, (list->len - index - 1) * sizeof(MachineInstruction));
+  list->len--;
+}
+
+bool is_register(const Operand operand, const int8_t reg) {
+  return operand.type == O_Register && operand.reg == reg;
+}
+
+bool is_constant(const Operand operand, const int64_t value) {
+  return operand.type == O_Immediate && operand.symbol == NULL && operand.value == value;
+}
+
+bool kills(const MachineInstruction *instruction, const int8_t reg) {
+  return (instruction->kills & (1u << reg)) != 0;
+}
+
+// whether the flags set before index can be observed by a later instruction
+bool flags_dead(const MachineInstructionList *list, int index) {
+  for (; index < list->len; index++) {
+    const MachineInstruction *instruction = &list->array[index];
+    switch (instruction->op) {
+    case M_COMMENT:
+    case M_MOV:
+    case M_MOVS:
+    case M_LEA:
+    case M_NOT:
+    case M_CQTO:
+    case M_MOVDQU:
+    case M_PADD:
+    case M_PSUB:
+    case M_PMULL:
+    case M_PAND:
+    case M_POR:
+    case M_PXOR:
+    case M_REP_STOS:
+    case M_REP_MOVS:
+    case M_ADDS:
+    case M_SUBS:
+    case M_MULS:
+    case M_DIVS:
+    case M_XORP:
+    case M_CVTSI2S:
+    case M_CVTTS2SI:
+    case M_CVTS2S:
+    case M_ADDP:
+    case M_SUBP:
+    case M_MULP:
+    case M_DIVP:
+    case M_MINP:
+    case M_MAXP:
+    case M_PMULUDQ:
+    case M_PCMPGT:
+    case M_PANDN:
+    case M_PUNPCKL:
+    case M_PSHUFD:
+    case M_PSRLDQ:
+    case M_PMINS:
+    case M_PMAXS:
+    case M_VZEROUPPER:
+    case M_PBROADCAST:
+    case M_EXTRACTI128:
+    case M_SHLX:
+    case M_SARX:
+    case M_SHRX:
+      continue;
+    case M_SAL:
+    case M_SAR:
+    case M_SHR:
+      // shifting by zero leaves the flags untouched
+      if (instruction->args[0].type == O_Immediate && instruction->args[0].value != 0)
+        return true;
+      continue;
+    case M_ADD:
+    case M_SUB:
+    case M_IMUL:
+    case M_MUL:
+    case M_IDIV:
+    case M_OR:
+    case M_XOR:
+    case M_AND:
+    case M_NEG:
+    case M_POPCNT:
+    case M_TZCNT:
+    case M_LZCNT:
+    case M_CMP:
+    case M_TEST:
+    case M_UCOMIS:
+    case M_CALL:
+    case M_RET:
+      return true;
+    case M_SET:
+    case M_JCC:
+    case M_JMP:
+    case M_LABEL:
+      return false;
+    }
+  }
+  return true;
+}
+
+// movq %rax, %rax
+bool rule_self_move(MachineInstructionList *list, const int index) {
+  const MachineInstruction *instruction = &list->array[index];
+  // 32-bit moves clear the upper half of the register
+  if (instruction->op != M_MOV || instruction->width == Long)
+    return false;
+  if (instruction->args[0].type != O_Register || !operand_equals(instruction->args[0], instruction->args[1]))
+    return false;
+
+  const int next = next_instruction(list, index);
+  if (next != -1) {
+    list->array[next].kills |= instruction->kills;
+  }
+  remove_instruction(list, index);
+  return true;
+}
+
+// movq $0, %rax -> xorl %eax, %eax
+bool rule_xor_zero(MachineInstructionList *list, const int index) {
+  MachineInstruction *instruction = &list->array[index];
+  if (instruction->op != M_MOV || !is_constant(instruction->args[0], 0) || instruction->args[1].type != O_Register)
+    return false;
+  if (!flags_dead(list, index + 1))
+    return false;
+
+  const Width width = instruction->width == Quad ? Long : instruction->width;
+  instruction->op = M_XOR;
+  instruction->width = width;
+  instruction->args[0] = operand_register(width, instruction->args[1].reg);
+  instruction->args[1] = operand_register(width, instruction->args[1].reg);
+  return true;
+}
+
+// setl %cl; cmpb $0, %cl; jne .L -> jl .L
+bool rule_fuse_compare_branch(MachineInstructionList *list, const int index) {
+  const MachineInstruction *set = &list->array[index];
+  if (set->op != M_SET || set->args[0].type != O_Register)
+    return false;
+  const int8_t reg = set->args[0].reg;
+
+  const int check = next_instruction(list, index);
+  if (check == -1)
+    return false;
+  const MachineInstruction *cmp = &list->array[check];
+  if (!kills(cmp, reg))
+    return false;
+  if (!(cmp->op == M_CMP && is_constant(cmp->args[0], 0) && is_register(cmp->args[1], reg)) &&
+      !(cmp->op == M_TEST && is_register(cmp->args[0], reg) && is_register(cmp->args[1], reg)))
+    return false;
+
+  const int branch = next_instruction(list, check);
+  if (branch == -1)
+    return false;
+  const MachineInstruction *jcc = &list->array[branch];
+  if (jcc->op != M_JCC || (jcc->cond != CC_NE && jcc->cond != CC_E))
+    return false;
+
+  MachineInstruction fused = *jcc;
+  fused.cond = jcc->cond == CC_NE ? set->cond : condition_invert(set->cond);
+  fused.kills |= set->kills | cmp->kills;
+  list->array[index] = fused;
+  remove_instruction(list, branch);
+  remove_instruction(list, check);
+  return true;
+}
+
+// movq $8, %rcx; imulq %rdx, %rcx; addq %rdi, %rcx; movq (%rcx), %rax -> movq (%rdi,%rdx,8), %rax
+bool rule_fold_address(MachineInstructionList *list, const int index) {
+  const MachineInstruction *scale = &list->array[index];
+  if (scale->op != M_MOV || scale->width != Quad || scale->args[0].type != O_Immediate ||
+      scale->args[0].symbol != NULL || scale->args[1].type != O_Register)
+    return false;
+  const int64_t factor = scale->args[0].value;
+  if (factor != 1 && factor != 2 && factor != 4 && factor != 8)
+    return false;
+  const int8_t reg = scale->args[1].reg;
+
+  const int mul = next_instruction(list, index);
+  if (mul == -1)
+    return false;
+  const MachineInstruction *imul = &list->array[mul];
+  if (imul->op != M_IMUL || imul->width != Quad || imul->args[0].type != O_Register || imul->args[0].reg == reg ||
+      !is_register(imul->args[1], reg))
+    return false;
+  const int8_t index_reg = imul->args[0].reg;
+
+  const int sum = next_instruction(list, mul);
+  if (sum == -1)
+    return false;
+  const MachineInstruction *add = &list->array[sum];
+  if (add->op != M_ADD || add->width != Quad || add->args[0].type != O_Register || add->args[0].reg == reg ||
+      !is_register(add->args[1], reg))
+    return false;
+  const int8_t base_reg = add->args[0].reg;
+  const uint32_t killed = scale->kills | imul->kills | add->kills;
+
+  const int use = next_instruction(list, sum);
+  if (use != -1 && kills(&list->array[use], reg)) {
+    MachineInstruction *instruction = &list->array[use];
+    int memory = -1;
+    bool other = false;
+    for (int i = 0; i < instruction->operands; ++i) {
+      const Operand operand = instruction->args[i];
+      if (operand.type == O_Memory && operand.base == reg && operand.index == -1) {
+        memory = i;
+      } else if (operand_reads_register(operand, reg)) {
+        other = true;
+      }
+    }
+    if (memory != -1 && !other) {
+      instruction->args[memory].base = base_reg;
+      instruction->args[memory].index = index_reg;
+      instruction->args[memory].scale = (uint8_t)factor;
+      instruction->kills |= killed;
+      remove_instruction(list, sum);
+      remove_instruction(list, mul);
+      remove_instruction(list, index);
+      return true;
+    }
+  }
+
+  MachineInstruction *lea = &list->array[index];
+  lea->op = M_LEA;
+  lea->args[0] = operand_memory(base_reg, index_reg, (uint8_t)factor, 0);
+  lea->kills = killed;
+  remove_instruction(list, sum);
+  remove_instruction(list, mul);
+  return true;
+}
+
+// jmp .L; .L:
+bool rule_jump_to_next(MachineInstructionList *list, const int index) {
+  const MachineInstruction *jmp = &list->array[index];
+  if ((jmp->op != M_JMP && jmp->op != M_JCC) || jmp->args[0].type != O_Label)
+    return false;
+  const int next = next_instruction(list, index);
+  if (next == -1 || list->array[next].op != M_LABEL ||
+      strcmp(list->array[next].args[0].symbol, jmp->args[0].symbol) != 0)
+    return false;
+  remove_instruction(list, index);
+  return true;
+}
+
+// jmp .L; <anything but a label>
+bool rule_unreachable(MachineInstructionList *list, const int index) {
+  const MachineOp op = list->array[index].op;
+  if (op != M_JMP && op != M_RET)
+    return false;
+  const int next = next_instruction(list, index);
+  if (next == -1 || list->array[next].op == M_LABEL)
+    return false;
+  remove_instruction(list, next);
+  return true;
+}
+
+PeepholeRule rules[] = {
+    {"self-move", rule_self_move, 0},
+    {"xor-zero", rule_xor_zero, 0},
+    {"fuse-compare-branch", rule_fuse_compare_branch, 0},
+    {"fold-address", rule_fold_address, 0},
+    {"jump-to-next", rule_jump_to_next, 0},
+    {"unreachable", rule_unreachable, 0},
+};
+
+void peephole_optimize(MachineInstructionList *list) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int i = 0; i < list->len; ++i) {
+      for (size_t r = 0; r < sizeof(rules) / sizeof(PeepholeRule); ++r) {
+        if (list->array[i].op != M_COMMENT && rules[r].apply(list, i)) {
+          rules[r].count++;
+          changed = true;
+          if (i >= list->len)
+            break;
+        }
+      }
+    }
+  }
+}
+
+void peephole_report(FILE *output) {
+  for (size_t r = 0; r < sizeof(rules) / sizeof(PeepholeRule); ++r) {
+    fprintf(output, "peephole: %-20s %i\n", rules[r].name, rules[r].count);
+  }
+}
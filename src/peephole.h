@@ -0,0 +1,10 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+#include "machine.h"
+
+#include <stdio.h>
+
+void peephole_optimize(MachineInstructionList *list);
+void peephole_report(FILE *output);
+
+#endif // PEEPHOLE_H
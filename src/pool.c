@@ -0,0 +1,200 @@
+#include "pool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a literal's bytes as they are placed in memory, without the terminator
+typedef struct {
+  int index;
+  ByteList bytes;
+} Decoded;
+
+uint32_t pool_hash(const char *text, const int len) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < len; ++i) {
+    hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// the slot holding the literal with this text, or the empty one it would go in
+int pool_slot(const LiteralPool *pool, const char *text, const int len) {
+  int slot = (int)(pool_hash(text, len) & (uint32_t)(pool->capacity - 1));
+  while (pool->slots[slot] != 0) {
+    const char *literal = pool->literals.array[pool->slots[slot] - 1];
+    if (strncmp(literal, text, len) == 0 && literal[len] == '\0')
+      break;
+    slot = (slot + 1) & (pool->capacity - 1);
+  }
+  return slot;
+}
+
+void pool_init(LiteralPool *pool) {
+  strlist_init(&pool->literals, 16);
+  pool->capacity = 64;
+  pool->slots = calloc(pool->capacity, sizeof(int));
+}
+
+void pool_grow(LiteralPool *pool) {
+  free(pool->slots);
+  pool->capacity *= 2;
+  pool->slots = calloc(pool->capacity, sizeof(int));
+  for (int i = 0; i < pool->literals.len; ++i) {
+    const char *literal = pool->literals.array[i];
+    pool->slots[pool_slot(pool, literal, (int)strlen(literal))] = i + 1;
+  }
+}
+
+int pool_add(LiteralPool *pool, const char *contents, const Token *token) {
+  const int slot = pool_slot(pool, contents + token->index, token->len);
+  if (pool->slots[slot] != 0)
+    return pool->slots[slot] - 1;
+  strlist_add(&pool->literals, token_copy(token, contents));
+  pool->slots[slot] = pool->literals.len;
+  if (pool->literals.len * 4 > pool->capacity * 3) {
+    pool_grow(pool);
+  }
+  return pool->literals.len - 1;
+}
+
+int pool_indexof(const LiteralPool *pool, const char *contents, const Token *token) {
+  return pool->slots[pool_slot(pool, contents + token->index, token->len)] - 1;
+}
+
+// the bytes of a quoted literal, escapes as `.string` reads them
+void decode_literal(const char *literal, ByteList *bytes) {
+  for (const char *c = literal + 1; *c != '"' && *c != '\0'; ++c) {
+    if (*c != '\\') {
+      bytelist_add(bytes, (uint8_t)*c);
+      continue;
+    }
+    ++c;
+    int value;
+    switch (*c) {
+    case 'n':
+      value = '\n';
+      break;
+    case 't':
+      value = '\t';
+      break;
+    case 'r':
+      value = '\r';
+      break;
+    case 'b':
+      value = '\b';
+      break;
+    case 'f':
+      value = '\f';
+      break;
+    case 'x':
+      value = (int)strtol(c + 1, (char **)&c, 16);
+      --c;
+      break;
+    default:
+      if (*c >= '0' && *c <= '7') {
+        value = 0;
+        for (int i = 0; i < 3 && *c >= '0' && *c <= '7'; ++i) {
+          value = value * 8 + *c++ - '0';
+        }
+        --c;
+      } else {
+        value = *c;
+      }
+      break;
+    }
+    bytelist_add(bytes, (uint8_t)value);
+  }
+}
+
+// orders literals by their bytes read from the end, so that each one that ends another sorts right before either
+// that one or one that also ends it. equal literals go from last seen to first, leaving the first to hold the rest
+int compare_tails(const void *a, const void *b) {
+  const Decoded *left = a;
+  const Decoded *right = b;
+  for (int i = 1; i <= left->bytes.len && i <= right->bytes.len; ++i) {
+    const uint8_t l = left->bytes.array[left->bytes.len - i];
+    const uint8_t r = right->bytes.array[right->bytes.len - i];
+    if (l != r)
+      return l < r ? -1 : 1;
+  }
+  if (left->bytes.len != right->bytes.len)
+    return left->bytes.len < right->bytes.len ? -1 : 1;
+  return right->index - left->index;
+}
+
+bool ends_with(const Decoded *literal, const Decoded *tail) {
+  return tail->bytes.len <= literal->bytes.len &&
+         memcmp(literal->bytes.array + literal->bytes.len - tail->bytes.len, tail->bytes.array, tail->bytes.len) == 0;
+}
+
+void pool_write(const LiteralPool *pool, FILE *output, ObjectFile *object) {
+  const int count = pool->literals.len;
+  if (count == 0)
+    return;
+  Decoded *sorted = malloc(sizeof(Decoded) * count);
+  for (int i = 0; i < count; ++i) {
+    sorted[i].index = i;
+    bytelist_init(&sorted[i].bytes, 16);
+    decode_literal(pool->literals.array[i], &sorted[i].bytes);
+  }
+  qsort(sorted, count, sizeof(Decoded), compare_tails);
+
+  // by number: the literal each is placed in (itself when it stands alone), and how far into that one it starts
+  int *owner = malloc(sizeof(int) * count);
+  int *offset = malloc(sizeof(int) * count);
+  const Decoded **decoded = malloc(sizeof(Decoded *) * count);
+  for (int i = count - 1; i >= 0; --i) {
+    const Decoded *literal = &sorted[i];
+    owner[literal->index] = literal->index;
+    offset[literal->index] = 0;
+    decoded[literal->index] = literal;
+    if (i + 1 < count && ends_with(&sorted[i + 1], literal)) {
+      const Decoded *next = &sorted[i + 1];
+      owner[literal->index] = owner[next->index];
+      offset[literal->index] = offset[next->index] + next->bytes.len - literal->bytes.len;
+    }
+  }
+
+  if (object != NULL) {
+    uint64_t *start = malloc(sizeof(uint64_t) * count);
+    for (int i = 0; i < count; ++i) {
+      if (owner[i] != i)
+        continue;
+      char name[32];
+      snprintf(name, sizeof(name), ".L.STR%i", i);
+      start[i] = object->sections[SECTION_RODATA].len;
+      object_define(object, name, SECTION_RODATA, start[i]);
+      object_append(object, SECTION_RODATA, decoded[i]->bytes.array, decoded[i]->bytes.len);
+      object_append_int(object, SECTION_RODATA, 0, 1);
+    }
+    for (int i = 0; i < count; ++i) {
+      if (owner[i] == i)
+        continue;
+      char name[32];
+      snprintf(name, sizeof(name), ".L.STR%i", i);
+      object_define(object, name, SECTION_RODATA, start[owner[i]] + offset[i]);
+    }
+    free(start);
+  } else {
+    fputs("\n\t.section\t.rodata\n", output);
+    for (int i = 0; i < count; ++i) {
+      if (owner[i] == i) {
+        fprintf(output, ".L.STR%i:\n\t.string\t%s\n", i, pool->literals.array[i]);
+      }
+    }
+    for (int i = 0; i < count; ++i) {
+      if (owner[i] != i) {
+        fprintf(output, "\t.set\t.L.STR%i, .L.STR%i + %i\n", i, owner[i], offset[i]);
+      }
+    }
+  }
+
+  for (int i = 0; i < count; ++i) {
+    free(sorted[i].bytes.array);
+  }
+  free(sorted);
+  free(owner);
+  free(offset);
+  free(decoded);
+}
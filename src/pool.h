@@ -0,0 +1,28 @@
+#ifndef POOL_H
+#define POOL_H
+#include <stdio.h>
+
+#include "object.h"
+#include "struct/list.h"
+#include "token.h"
+
+// every string literal in the module, numbered in the order they are first seen (literal i is .L.STR<i>) and found
+// again by a hash of their text. nothing is written until the whole module has been compiled
+
+typedef struct {
+  // the text of each literal, quotes and escapes included
+  StrList literals;
+  // open addressing over literals: each slot holds an index + 1, or 0 when empty
+  int *slots;
+  int capacity;
+} LiteralPool;
+
+void pool_init(LiteralPool *pool);
+// the number of the literal token, which is added when the pool does not hold it yet
+int pool_add(LiteralPool *pool, const char *contents, const Token *token);
+// the number of the literal token, -1 when it was never added
+int pool_indexof(const LiteralPool *pool, const char *contents, const Token *token);
+// writes every literal into .rodata. one whose bytes end another's is placed inside that one instead of on its own
+void pool_write(const LiteralPool *pool, FILE *output, ObjectFile *object);
+
+#endif // POOL_H
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "ast.h"
+#include "interface.h"
 #include "struct/list.h"
 #include "types.h"
 
@@ -41,51 +42,127 @@ Result parse_function_declaration(const char *contents, const Token **token, Fun
 
   if (has_decl) {
     token_matches_ext(*token, token_opening_curly_brace, "-> or {");
+    return success();
+  }
+  token_matches(*token, token_semicolon);
+  return success();
+}
 
-    function->start = *token;
-    int depth = 0;
-    while ((*token)->type != token_eof) {
-      if ((*token)->type == token_opening_curly_brace) {
-        depth += 1;
-      } else if ((*token)->type == token_closing_curly_brace) {
-        if (--depth == 0)
-          return success();
-      } else if ((*token)->type == token_keyword_fn) {
-        return failure(*token, "unexpected function delcaration (expected statement)");
+// finds where the body starting at token ends, taking in its string literals on the way, so that nothing has to
+// look through it again before it is parsed
+Result scan_function_body(char *contents, const Token **token, Function *function, LiteralPool *literals) {
+  function->start = *token;
+  int depth = 0;
+  while ((*token)->type != token_eof) {
+    switch ((*token)->type) {
+    case token_opening_curly_brace:
+      depth += 1;
+      break;
+    case token_closing_curly_brace:
+      if (--depth == 0) {
+        function->end = *token;
+        return success();
       }
-      *token = (*token)->next;
+      break;
+    case token_string:
+      pool_add(literals, contents, *token);
+      break;
+    case token_keyword_fn:
+      return failure(*token, "unexpected function delcaration (expected statement)");
+    default:
+      break;
     }
-    return failure(*token, "unexpected eof ({})");
+    *token = (*token)->next;
   }
-  token_matches(*token, token_semicolon);
+  return failure(*token, "unexpected eof ({})");
+}
+
+#define CACHE_LINE 64
+
+// what the #[...] before a declaration asks of it
+typedef struct {
+  // #[align(N)]: at least this alignment, 0 for just the natural one
+  int align;
+  // #[cacheline]: cache lines of its own, so that writes to it never contend with accesses to anything else
+  bool cacheline;
+  // #[reorder]: a struct's fields are laid out largest alignment first rather than as declared
+  bool reorder;
+} Attributes;
+
+const char *sectionDirectives[SECTION_COUNT] = {".text", ".section\t.rodata", ".data", ".bss"};
+
+// reads #[name, name(argument), ...], token left on the ]
+Result parse_attributes(const char *contents, const Token **token, Attributes *attributes) {
+  *token = (*token)->next;
+  token_matches(*token, token_opening_sqbr);
+  do {
+    *token = (*token)->next;
+    token_matches(*token, token_identifier);
+    if (token_str_cmp(*token, contents, "cacheline") == 0) {
+      attributes->cacheline = true;
+    } else if (token_str_cmp(*token, contents, "reorder") == 0) {
+      attributes->reorder = true;
+    } else if (token_str_cmp(*token, contents, "align") == 0) {
+      *token = (*token)->next;
+      token_matches(*token, token_opening_paren);
+      *token = (*token)->next;
+      token_matches(*token, token_constant);
+      const long align = strtol(contents + (*token)->index, NULL, 0);
+      if (align < 1 || align > 4096 || (align & (align - 1)) != 0)
+        return failure(*token, "alignment must be a power of two, at most 4096");
+      attributes->align = (int)align;
+      *token = (*token)->next;
+      token_matches(*token, token_closing_paren);
+    } else {
+      return failure(*token, "unknown attribute");
+    }
+    *token = (*token)->next;
+  } while ((*token)->type == token_comma);
+  token_matches_ext(*token, token_closing_sqbr, ", or ]");
   return success();
 }
 
-int add_str_literal(const char *contents, const Token *token, StrList *strLiterals, FILE *output) {
-  char *buf = malloc(token->len + 1);
-  memcpy(buf, contents + token->index, token->len);
-  buf[token->len] = '\0';
-  const int index = strlist_indexof(strLiterals, buf);
-  if (index != -1) {
-    free(buf);
-    return index;
+// places a global in the section, aligned to its size or to what its attributes ask for. its value goes in next
+void begin_global(ObjectFile *object, FILE *output, const SectionKind section, const char *name, const int bytes,
+                  const Attributes *attributes) {
+  int alignment = bytes > attributes->align ? bytes : attributes->align;
+  if (attributes->cacheline && alignment < CACHE_LINE) {
+    alignment = CACHE_LINE;
+  }
+  if (object != NULL) {
+    object_align(object, section, alignment);
+    object_define(object, name, section, object->sections[section].len)->size = (uint64_t)bytes;
+  } else {
+    fprintf(output, "\t%s\n\t.balign\t%i\n%s:\n", sectionDirectives[section], alignment, name);
   }
-  fprintf(output, ".L.STR%i:\n\t.string\t%s\n", strLiterals->len, buf);
-  strlist_add(strLiterals, buf);
-  return strLiterals->len - 1;
 }
 
-Result preprocess_globals(char *contents, const Token *token, StrList *strLiterals, VarList *variables,
-                          FunctionList *functions, FILE *output) {
-  const Token *base = token;
-  while (base != NULL) {
-    if (base->type == token_string) {
-      add_str_literal(contents, base, strLiterals, output);
+// pads a global that is to have its cache lines to itself out to the end of the last one
+void end_global(ObjectFile *object, FILE *output, const SectionKind section, const char *name, const int bytes,
+                const Attributes *attributes) {
+  if (object != NULL) {
+    if (attributes->cacheline) {
+      object_align(object, section, CACHE_LINE);
+    }
+  } else {
+    fprintf(output, "\t.size\t%s, %i\n", name, bytes);
+    if (attributes->cacheline) {
+      fprintf(output, "\t.balign\t%i\n", CACHE_LINE);
     }
-    base = base->next;
   }
+}
 
+Result preprocess_globals(const char *filename, char *contents, const Token *token, LiteralPool *literals,
+                          VarList *variables, FunctionList *functions, FILE *output, ObjectFile *object) {
+  // one pass: declarations are read, bodies skipped over (see scan_function_body) and string literals numbered in the
+  // order they appear
+  Attributes attributes = {0, false, false};
+  bool attributed = false;
   while (token != NULL) {
+    if (attributed && token->type != token_hash && token->type != token_keyword_let &&
+        token->type != token_keyword_const && token->type != token_keyword_struct) {
+      return failure(token, "attributes only apply to global and struct definitions");
+    }
     switch (token->type) {
     case token_eof:
       return success();
@@ -95,14 +172,21 @@ Result preprocess_globals(char *contents, const Token *token, StrList *strLitera
       Function function;
       function_init(&function);
       forward_err(parse_function_declaration(contents, &token, &function, true));
+      forward_err(scan_function_body(contents, &token, &function, literals));
+      function.filename = filename;
+      function.source = contents;
 
       if (functionlist_indexof(functions, function.name) != -1) {
         return failure(token, "redefinition of function");
       }
-      fprintf(output, ".globl %s\n", function.name);
       functionlist_add(functions, function);
     } break;
-    case token_keyword_let: {
+    case token_keyword_let:
+    case token_keyword_const: {
+      const bool constant = token->type == token_keyword_const;
+      if (attributes.reorder) {
+        return failure(token, "only a struct can be reordered");
+      }
       Variable variable;
       token = token->next;
       token_matches(token, token_identifier);
@@ -117,40 +201,149 @@ Result preprocess_globals(char *contents, const Token *token, StrList *strLitera
 
       Type type;
       forward_err(parse_type(contents, &token, &type));
+      if (is_vector(type.kind)) {
+        return failure(token, "vectors can only be locals");
+      }
       variable.type = type;
 
       varlist_add(variables, variable);
 
       token = token->next;
-      if (token->type == token_semicolon) {
-        typekind_width(type.kind);
-        fprintf(output, "%s:\n", variable.name);
-        const int bytes = size_bytes(typekind_width(type.kind));
-        fprintf(output, "\t.zero\t%i\n", bytes);
-        fprintf(output, "\t.size\t%s, %i\n", variable.name, bytes);
-      } else {
+      const Token *value = NULL;
+      if (token->type == token_semicolon && constant) {
+        return failure(token, "a constant needs a value");
+      }
+      if (token->type != token_semicolon) {
         token_matches(token, token_equals_assign);
         token = token->next;
-        const Token *value = token;
-        if (token->type == token_constant) {
-          token_matches(token, token_constant);
-          token = token->next;
-          token_matches(token, token_semicolon);
-          const int bytes = size_bytes(typekind_width(type.kind));
-          fprintf(output, "%s:\n", variable.name);
-          fprintf(output, "\t.%s\t%.*s\n", size_mnemonic(typekind_width(type.kind)), value->len,
-                  contents + value->index);
-          fprintf(output, "\t.size\t%s, %i\n", variable.name, bytes);
-        } else if (token->type == token_string) {
-          token_matches(token, token_string);
-          const int index = add_str_literal(contents, token, strLiterals, output);
-          token = token->next;
-          token_matches(token, token_semicolon);
-          fprintf(output, "%s:\n", variable.name);
-          fprintf(output, "\t.quad\t.L.STR%i\n", index);
-        } else {
+        value = token;
+        if (value->type != token_constant && value->type != token_string) {
           return failure(token, "expected constant or string literal");
         }
+        token = token->next;
+        token_matches(token, token_semicolon);
+      }
+
+      uint64_t bits = 0;
+      if (value != NULL && value->type == token_constant) {
+        char *text = token_copy(value, contents);
+        if (type.kind == f64) {
+          const double d = strtod(text, NULL);
+          memcpy(&bits, &d, sizeof(double));
+        } else if (type.kind == f32) {
+          const float f = strtof(text, NULL);
+          uint32_t single;
+          memcpy(&single, &f, sizeof(float));
+          bits = single;
+        } else {
+          bits = (uint64_t)strtoll(text, NULL, 0);
+        }
+        free(text);
+      }
+
+      // zeroes take no space in the file, and anything that is never written can share pages with other constants
+      const bool zero = value == NULL || (value->type == token_constant && bits == 0);
+      const SectionKind section = constant ? SECTION_RODATA : zero ? SECTION_BSS : SECTION_DATA;
+      const int bytes = value != NULL && value->type == token_string ? 8 : size_bytes(typekind_width(type.kind));
+      begin_global(object, output, section, variable.name, bytes, &attributes);
+      if (value != NULL && value->type == token_string) {
+        const int index = pool_add(literals, contents, value);
+        if (object != NULL) {
+          char name[32];
+          snprintf(name, sizeof(name), ".L.STR%i", index);
+          object_relocate(object, section, object->sections[section].len, name, R_X86_64_64, 0);
+          object_append_int(object, section, 0, 8);
+        } else {
+          fprintf(output, "\t.quad\t.L.STR%i\n", index);
+        }
+      } else if (object != NULL) {
+        object_append_int(object, section, bits, bytes);
+      } else if (section == SECTION_BSS) {
+        fprintf(output, "\t.zero\t%i\n", bytes);
+      } else {
+        const char *directive = type.kind == f64   ? "double"
+                                : type.kind == f32 ? "float"
+                                                   : size_mnemonic(typekind_width(type.kind));
+        fprintf(output, "\t.%s\t%.*s\n", directive, value->len, contents + value->index);
+      }
+      end_global(object, output, section, variable.name, bytes, &attributes);
+      attributes = (Attributes){0, false, false};
+      attributed = false;
+    } break;
+    case token_keyword_struct: {
+      token = token->next;
+      token_matches(token, token_identifier);
+      if (struct_find(contents, token) != NULL) {
+        return failure(token, "redefinition of struct");
+      }
+      // declared before its fields are read so that they can point back to it
+      Struct *structure = malloc(sizeof(Struct));
+      structure->name = token_copy(token, contents);
+      fieldlist_init(&structure->fields, 4);
+      structure->size = -1;
+      structure->alignment = 1;
+      struct_declare(structure);
+
+      token = token->next;
+      token_matches(token, token_opening_curly_brace);
+      token = token->next;
+      while (token->type != token_closing_curly_brace) {
+        token_matches(token, token_identifier);
+        if (struct_field(structure, contents, token) != NULL) {
+          return failure(token, "duplicate field");
+        }
+        Field field;
+        field.name = token_copy(token, contents);
+        field.offset = 0;
+        token = token->next;
+        token_matches(token, token_colon);
+        forward_err(parse_field_type(contents, &token, &field.type));
+        if (is_vector(field.type.kind)) {
+          return failure(token, "vectors can only be locals");
+        }
+        if (field.type.kind == aggregate && field.type.structure->size == -1) {
+          return failure(token, "a struct cannot contain itself");
+        }
+        fieldlist_add(&structure->fields, field);
+
+        token = token->next;
+        if (token->type == token_closing_curly_brace)
+          break;
+        token_matches_ext(token, token_comma, ", or }");
+        token = token->next;
+      }
+      if (structure->fields.len == 0) {
+        return failure(token, "a struct needs at least one field");
+      }
+      int alignment = attributes.align;
+      if (attributes.cacheline && alignment < CACHE_LINE) {
+        alignment = CACHE_LINE;
+      }
+      struct_layout(structure, attributes.reorder, alignment);
+      attributes = (Attributes){0, false, false};
+      attributed = false;
+    } break;
+    case token_hash: {
+      forward_err(parse_attributes(contents, &token, &attributes));
+      attributed = true;
+    } break;
+    case token_keyword_import: {
+      token = token->next;
+      token_matches(token, token_string);
+      const Token *name = token;
+      token = token->next;
+      token_matches(token, token_semicolon);
+
+      // the path is taken from where the importing file is, quotes and all left off
+      const char *slash = strrchr(filename, '/');
+      const int directory = slash != NULL ? (int)(slash - filename + 1) : 0;
+      char *path = malloc(directory + name->len);
+      snprintf(path, directory + name->len, "%.*s%.*s", directory, filename, name->len - 2,
+               contents + name->index + 1);
+      const bool imported = interface_import(path, functions, variables, object == NULL ? output : NULL);
+      free(path);
+      if (!imported) {
+        return failure(name, "cannot import interface");
       }
     } break;
     case token_keyword_extern: {
@@ -161,9 +354,13 @@ Result preprocess_globals(char *contents, const Token *token, StrList *strLitera
         function_init(&function);
         forward_err(parse_function_declaration(contents, &token, &function, false));
         functionlist_add(functions, function);
-        fprintf(output, ".extern %s\n", function.name);
+        // an object only lists the externs it refers to
+        if (object == NULL) {
+          fprintf(output, ".extern %s\n", function.name);
+        }
       } break;
-      case token_keyword_let: {
+      case token_keyword_let:
+      case token_keyword_const: {
         Variable variable;
         token = token->next;
         token_matches(token, token_identifier);
@@ -178,10 +375,15 @@ Result preprocess_globals(char *contents, const Token *token, StrList *strLitera
 
         Type type;
         forward_err(parse_type(contents, &token, &type));
+        if (is_vector(type.kind)) {
+          return failure(token, "vectors can only be locals");
+        }
         variable.type = type;
 
         varlist_add(variables, variable);
-        fprintf(output, ".extern %s\n", variable.name);
+        if (object == NULL) {
+          fprintf(output, ".extern %s\n", variable.name);
+        }
       } break;
       default:
         return failure(token, "expected function or variable definition");
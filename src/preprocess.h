@@ -3,10 +3,13 @@
 #include <stdio.h>
 
 #include "ast.h"
+#include "object.h"
+#include "pool.h"
 #include "struct/list.h"
 #include "token.h"
 
-Result preprocess_globals(char *contents, const Token *token, StrList *strLiterals, VarList *variables,
-                          FunctionList *functions, FILE *output);
+// declares the module's functions and globals, and those of the interfaces it imports (relative to filename)
+Result preprocess_globals(const char *filename, char *contents, const Token *token, LiteralPool *literals,
+                          VarList *variables, FunctionList *functions, FILE *output, ObjectFile *object);
 
 #endif // PREPROCESS_H
@@ -13,10 +13,13 @@ const char *get_register_mnemonic(const Width size, const int8_t index) {
       return mnemonic16[index];
     case Byte:
       return mnemonic8[index];
+    case Oword:
+    case Yword:
+      break;
     }
   } else if (index < 32) {
-    assert(size == Quad || size == Long);
-    return mnemonicFP[index - 16];
+    assert(size == Quad || size == Long || size == Oword || size == Yword);
+    return size == Yword ? mnemonicYMM[index - 16] : mnemonicFP[index - 16];
   }
 
   return NULL;
@@ -28,7 +31,7 @@ char mnemonic_suffix(const Width size) {
   case Byte:
     return 'b';
   case Word:
-    return 's';
+    return 'w';
   case Long:
     return 'l';
   case Quad:
@@ -53,6 +56,9 @@ char fp_mnemonic_suffix(const Width size) {
 const char *mnemonicFP[16] = {"%xmm0", "%xmm1", "%xmm2",  "%xmm3",  "%xmm4",  "%xmm5",  "%xmm6",  "%xmm7",
                               "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15"};
 
+const char *mnemonicYMM[16] = {"%ymm0", "%ymm1", "%ymm2",  "%ymm3",  "%ymm4",  "%ymm5",  "%ymm6",  "%ymm7",
+                               "%ymm8", "%ymm9", "%ymm10", "%ymm11", "%ymm12", "%ymm13", "%ymm14", "%ymm15"};
+
 const char *mnemonic64[16] = {"%rax", "%rbx", "%rcx", "%rdx", "%rsi", "%rdi", "%rbp", "%rsp",
                               "%r8",  "%r9",  "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"};
 
@@ -66,8 +72,11 @@ const char *mnemonic8[16] = {"%al",  "%bl",  "%cl",   "%dl",   "%sil",  "%dil",
                              "%r8b", "%r9b", "%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b"};
 
 int8_t argumentRegisters[6] = {rdi, rsi, rdx, rcx, r8, r9};
+int8_t fpArgumentRegisters[8] = {xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7};
 // no rbp, rsp
 int8_t registerPriority[14] = {rcx, rdx, rsi, rdi, r8, r9, r10, r11, rax, r12, r13, r14, r15, rbx};
+// xmm0 and xmm1 are left for the vector loops and as scratch
+int8_t fpRegisterPriority[14] = {xmm2, xmm3, xmm4, xmm5, xmm6, xmm7, xmm8, xmm9, xmm10, xmm11, xmm12, xmm13, xmm14, xmm15};
 
 int8_t calleeSavedRegisters[7] = {rbp, rbx, r12, r13, r14, r15, rsp};
 int8_t callerSavedRegisters[9] = {rax, rcx, rdx, rsi, rdi, r8, r9, r10, r11};
@@ -105,12 +105,15 @@ char fp_mnemonic_suffix(Width size);
 const char *get_register_mnemonic(Width size, int8_t index);
 
 extern const char *mnemonicFP[16];
+extern const char *mnemonicYMM[16];
 extern const char *mnemonic64[16];
 extern const char *mnemonic32[16];
 extern const char *mnemonic16[16];
 extern const char *mnemonic8[16];
 extern int8_t argumentRegisters[6];
+extern int8_t fpArgumentRegisters[8];
 extern int8_t registerPriority[14];
+extern int8_t fpRegisterPriority[14];
 extern int8_t calleeSavedRegisters[7];
 extern int8_t callerSavedRegisters[9];
 extern bool calleeSavedRegistersI[16];
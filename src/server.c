@@ -0,0 +1,390 @@
+#include "server.h"
+
+#include "cache.h"
+#include "options.h"
+#include "struct/list.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// sent ahead of the client's working directory and arguments (each ending in a null), with its stdin, stdout and
+// stderr attached
+typedef struct {
+  uint32_t argc;
+  uint32_t len;
+} RequestHeader;
+
+// a request being compiled
+typedef struct {
+  pid_t pid;
+  int connection;
+  // the keys of the cache entries the compiler uses (see cache_report), and the bytes read of the next one
+  int keys;
+  uint8_t key[8];
+  int keyBytes;
+} Job;
+
+LIST_API(Job, job, Job)
+LIST_IMPL(Job, job, Job)
+
+char socketPath[sizeof(((struct sockaddr_un *)NULL)->sun_path)];
+
+const char *server_socket_path(void) {
+  const char *runtime = getenv("XDG_RUNTIME_DIR");
+  if (runtime != NULL && runtime[0] != '\0') {
+    snprintf(socketPath, sizeof(socketPath), "%s/crust.sock", runtime);
+  } else {
+    snprintf(socketPath, sizeof(socketPath), "/tmp/crust-%u.sock", (unsigned)getuid());
+  }
+  return socketPath;
+}
+
+bool socket_address(struct sockaddr_un *address, const char *path) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address->sun_path)) {
+    printf("socket path too long: %s\n", path);
+    return false;
+  }
+  strcpy(address->sun_path, path);
+  return true;
+}
+
+bool read_fully(const int fd, void *bytes, const size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    const ssize_t n = read(fd, (uint8_t *)bytes + done, len - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    done += (size_t)n;
+  }
+  return true;
+}
+
+bool write_fully(const int fd, const void *bytes, const size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    const ssize_t n = write(fd, (const uint8_t *)bytes + done, len - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    done += (size_t)n;
+  }
+  return true;
+}
+
+bool receive_request(const int connection, RequestHeader *header, int streams[3], char **payload) {
+  union {
+    struct cmsghdr header;
+    char bytes[CMSG_SPACE(sizeof(int) * 3)];
+  } control;
+  struct iovec vector = {header, sizeof(*header)};
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+  message.msg_control = control.bytes;
+  message.msg_controllen = sizeof(control.bytes);
+  if (recvmsg(connection, &message, MSG_WAITALL) != sizeof(*header))
+    return false;
+  const struct cmsghdr *streamsHeader = CMSG_FIRSTHDR(&message);
+  if (streamsHeader == NULL || streamsHeader->cmsg_level != SOL_SOCKET || streamsHeader->cmsg_type != SCM_RIGHTS ||
+      streamsHeader->cmsg_len != CMSG_LEN(sizeof(int) * 3))
+    return false;
+  memcpy(streams, CMSG_DATA(streamsHeader), sizeof(int) * 3);
+
+  *payload = header->argc > 0 && header->len <= 1 << 20 ? malloc(header->len + 1) : NULL;
+  if (*payload == NULL || !read_fully(connection, *payload, header->len)) {
+    for (int i = 0; i < 3; ++i) {
+      close(streams[i]);
+    }
+    free(*payload);
+    return false;
+  }
+  (*payload)[header->len] = '\0';
+  return true;
+}
+
+// in the forked process: becomes the client (its directory and streams), then compiles with its arguments
+int serve(const RequestHeader *header, char *payload, const int streams[3], const int keys, const Compiler compiler) {
+  for (int i = 0; i < 3; ++i) {
+    dup2(streams[i], i);
+    close(streams[i]);
+  }
+  char *directory = payload;
+  if (chdir(directory) != 0) {
+    printf("cannot enter %s\n", directory);
+    return 1;
+  }
+
+  // the server's cache, unless the client names its own (the later --cache-dir= wins)
+  char cacheOption[4096];
+  const bool cached = options.cacheDir != NULL;
+  if (cached) {
+    snprintf(cacheOption, sizeof(cacheOption), "--cache-dir=%s", options.cacheDir);
+  }
+  char **argv = malloc(sizeof(char *) * (header->argc + 2));
+  int argc = 0;
+  char *arg = directory + strlen(directory) + 1;
+  for (uint32_t i = 0; i < header->argc && arg < payload + header->len; ++i) {
+    argv[argc++] = arg;
+    if (i == 0 && cached) {
+      argv[argc++] = cacheOption;
+    }
+    arg += strlen(arg) + 1;
+  }
+  argv[argc] = NULL;
+
+  cache_report(fdopen(keys, "wb"));
+  return compiler(argc, argv);
+}
+
+// the request is read in the forked process, so a client that is slow to send it only holds up its own compile
+void job_start(JobList *jobs, const int listener, const int connection, const Compiler compiler) {
+  int keys[2];
+  if (pipe(keys) != 0) {
+    close(connection);
+    return;
+  }
+
+  // nothing buffered here may be written out a second time by the compiler
+  fflush(stdout);
+  fflush(stderr);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    close(listener);
+    close(keys[0]);
+    for (int i = 0; i < jobs->len; ++i) {
+      close(jobs->array[i].connection);
+      close(jobs->array[i].keys);
+    }
+    signal(SIGPIPE, SIG_DFL);
+    RequestHeader header;
+    int streams[3];
+    char *payload;
+    if (!receive_request(connection, &header, streams, &payload))
+      exit(1);
+    close(connection);
+    exit(serve(&header, payload, streams, keys[1], compiler));
+  }
+
+  close(keys[1]);
+  if (pid < 0) {
+    const int32_t status = 1;
+    write_fully(connection, &status, sizeof(status));
+    close(keys[0]);
+    close(connection);
+    return;
+  }
+  Job *job = joblist_grow(jobs);
+  job->pid = pid;
+  job->connection = connection;
+  job->keys = keys[0];
+  job->keyBytes = 0;
+}
+
+// takes in the keys the compiler has sent, and once it is done, tells the client how it finished
+void job_read(JobList *jobs, const int index) {
+  Job *job = &jobs->array[index];
+  uint8_t bytes[512];
+  const ssize_t n = read(job->keys, bytes, sizeof(bytes));
+  if (n < 0 && errno == EINTR)
+    return;
+  for (ssize_t i = 0; i < n; ++i) {
+    job->key[job->keyBytes++] = bytes[i];
+    if (job->keyBytes == sizeof(job->key)) {
+      uint64_t key;
+      memcpy(&key, job->key, sizeof(key));
+      cache_retain(key);
+      job->keyBytes = 0;
+    }
+  }
+  if (n > 0)
+    return;
+
+  int status;
+  while (waitpid(job->pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  const int32_t result = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  write_fully(job->connection, &result, sizeof(result));
+  close(job->connection);
+  close(job->keys);
+  jobs->array[index] = jobs->array[jobs->len - 1];
+  jobs->len -= 1;
+}
+
+int server_run(const char *path, const Compiler compiler) {
+  struct sockaddr_un address;
+  if (!socket_address(&address, path))
+    return 1;
+  // a socket nothing answers on was left behind by a server that did not shut down cleanly, and is replaced. one
+  // that answers belongs to a running server, and anything else at the path is not the server's to remove
+  const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (probe >= 0) {
+    const bool answered = connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+    const int error = errno;
+    close(probe);
+    if (answered) {
+      printf("a server is already listening on %s\n", path);
+      return 1;
+    }
+    struct stat status;
+    if (error == ECONNREFUSED && lstat(path, &status) == 0 && S_ISSOCK(status.st_mode)) {
+      unlink(path);
+    }
+  }
+  const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    printf("cannot listen on %s\n", path);
+    return 1;
+  }
+  // from here on the socket at the path is this server's own
+  if (listen(listener, 64) != 0) {
+    printf("cannot listen on %s\n", path);
+    close(listener);
+    unlink(path);
+    return 1;
+  }
+  // a client that goes away before hearing back is not the server's problem
+  signal(SIGPIPE, SIG_IGN);
+  printf("listening on %s\n", path);
+  fflush(stdout);
+
+  JobList jobs;
+  joblist_init(&jobs, 8);
+  struct pollfd *polls = NULL;
+  while (true) {
+    polls = realloc(polls, sizeof(struct pollfd) * (jobs.len + 1));
+    polls[0].fd = listener;
+    polls[0].events = POLLIN;
+    for (int i = 0; i < jobs.len; ++i) {
+      polls[i + 1].fd = jobs.array[i].keys;
+      polls[i + 1].events = POLLIN;
+    }
+    const int polled = jobs.len;
+    if (poll(polls, polled + 1, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      puts("poll failed");
+      close(listener);
+      unlink(path);
+      return 1;
+    }
+    // backwards, as a finished job is replaced by the last one
+    for (int i = polled - 1; i >= 0; --i) {
+      if (polls[i + 1].revents != 0) {
+        job_read(&jobs, i);
+      }
+    }
+    if (polls[0].revents & POLLIN) {
+      const int connection = accept(listener, NULL, NULL);
+      if (connection >= 0) {
+        job_start(&jobs, listener, connection, compiler);
+      }
+    }
+  }
+}
+
+int client_run(const char *path, const int argc, char **argv) {
+  struct sockaddr_un address;
+  if (!socket_address(&address, path))
+    return -1;
+  const int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (connection < 0)
+    return -1;
+  if (connect(connection, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(connection);
+    return -1;
+  }
+
+  char directory[4096];
+  if (getcwd(directory, sizeof(directory)) == NULL) {
+    close(connection);
+    return -1;
+  }
+  // the arguments as given, less the --connect that sent them here (but not one meant for the program, after --)
+  RequestHeader header = {0, (uint32_t)strlen(directory) + 1};
+  bool program = false;
+  for (int i = 0; i < argc; ++i) {
+    const bool connectOption =
+        !program && i > 0 && (strcmp(argv[i], "--connect") == 0 || strncmp(argv[i], "--connect=", 10) == 0);
+    program |= strcmp(argv[i], "--") == 0;
+    if (!connectOption) {
+      header.argc += 1;
+      header.len += (uint32_t)strlen(argv[i]) + 1;
+    }
+  }
+  char *payload = malloc(header.len);
+  char *end = payload;
+  memcpy(end, directory, strlen(directory) + 1);
+  end += strlen(directory) + 1;
+  program = false;
+  for (int i = 0; i < argc; ++i) {
+    const bool connectOption =
+        !program && i > 0 && (strcmp(argv[i], "--connect") == 0 || strncmp(argv[i], "--connect=", 10) == 0);
+    program |= strcmp(argv[i], "--") == 0;
+    if (!connectOption) {
+      memcpy(end, argv[i], strlen(argv[i]) + 1);
+      end += strlen(argv[i]) + 1;
+    }
+  }
+
+  const int streams[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  union {
+    struct cmsghdr header;
+    char bytes[CMSG_SPACE(sizeof(streams))];
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct iovec vector = {&header, sizeof(header)};
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+  message.msg_control = control.bytes;
+  message.msg_controllen = sizeof(control.bytes);
+  struct cmsghdr *streamsHeader = CMSG_FIRSTHDR(&message);
+  streamsHeader->cmsg_level = SOL_SOCKET;
+  streamsHeader->cmsg_type = SCM_RIGHTS;
+  streamsHeader->cmsg_len = CMSG_LEN(sizeof(streams));
+  memcpy(CMSG_DATA(streamsHeader), streams, sizeof(streams));
+
+  // anything already written here has to come out before what the server writes to the same streams
+  fflush(stdout);
+  int32_t status;
+  const bool sent = sendmsg(connection, &message, 0) == sizeof(header) && write_fully(connection, payload, header.len);
+  free(payload);
+  if (!sent || !read_fully(connection, &status, sizeof(status))) {
+    printf("the compile server on %s went away\n", path);
+    status = 1;
+  }
+  close(connection);
+  return status;
+}
+#else
+const char *server_socket_path(void) {
+  return "crust.sock";
+}
+
+int server_run(const char *path, const Compiler compiler) {
+  puts("--server is not supported on this platform");
+  return 1;
+}
+
+int client_run(const char *path, const int argc, char **argv) {
+  return -1;
+}
+#endif
@@ -0,0 +1,19 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// reads its arguments and compiles as main would, returning the status to exit with
+typedef int (*Compiler)(int argc, char **argv);
+
+// where --server listens and --connect connects without a path: $XDG_RUNTIME_DIR/crust.sock, or
+// /tmp/crust-<uid>.sock without one
+const char *server_socket_path(void);
+
+// listens on path, compiling each client's request in a process forked off this one, so that every compile starts
+// from the state the server has built up (cache entries kept in memory) rather than from nothing. only returns when
+// the socket cannot be listened on
+int server_run(const char *path, Compiler compiler);
+// has the server on path compile with these arguments, in this process's working directory and with its standard
+// streams, returning the status it finished with. -1 when there is no server to ask
+int client_run(const char *path, int argc, char **argv);
+
+#endif // SERVER_H
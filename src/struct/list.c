@@ -21,3 +21,12 @@ int strlist_indexof(const StrList *list, const char *value) {
   }
   return -1;
 }
+
+int ptrlist_indexof(const PtrList *list, const void *value) {
+  for (int i = 0; i < list->len; i++) {
+    if (list->array[i] == value) {
+      return i;
+    }
+  }
+  return -1;
+}
@@ -63,5 +63,6 @@ LIST_API(Str, str, char *)
 
 int strlist_indexof_after(const StrList *list, int start, const char *value);
 int strlist_indexof(const StrList *list, const char *value);
+int ptrlist_indexof(const PtrList *list, const void *value);
 
 #endif // STRUCT_LIST_H
@@ -58,9 +58,12 @@ bool tokenize(const char *data, const size_t len, Token *head) {
 
     switch (mode) {
     case any: {
-      if (isspace(c) || c == '=' || c == ',' || c == '(' || c == ')' || c == '[' || c == ']' || c == '{' || c == '}' ||
+      if (c == '.' && numeric) {
+        // floating point literal
+        buffer[bufLen++] = (char)c;
+      } else if (isspace(c) || c == '=' || c == ',' || c == '(' || c == ')' || c == '[' || c == ']' || c == '{' || c == '}' ||
           c == '<' || c == '>' || c == '~' || c == '&' || c == '|' || c == '!' || c == '+' || c == '-' || c == '/' ||
-          c == '*' || c == ';' || c == '"' || c == ':' || c == '.' || c == '^' || c == '%') {
+          c == '*' || c == ';' || c == '"' || c == ':' || c == '.' || c == '^' || c == '%' || c == '#') {
         if (bufLen > 0) {
           if (sz_strncmp(buffer, "fn", bufLen) == 0) {
             token_push(&next, token_keyword_fn, i - bufLen, bufLen);
@@ -70,6 +73,12 @@ bool tokenize(const char *data, const size_t len, Token *head) {
             token_push(&next, token_keyword_extern, i - bufLen, bufLen);
           } else if (sz_strncmp(buffer, "as", bufLen) == 0) {
             token_push(&next, token_keyword_as, i - bufLen, bufLen);
+          } else if (sz_strncmp(buffer, "import", bufLen) == 0) {
+            token_push(&next, token_keyword_import, i - bufLen, bufLen);
+          } else if (sz_strncmp(buffer, "const", bufLen) == 0) {
+            token_push(&next, token_keyword_const, i - bufLen, bufLen);
+          } else if (sz_strncmp(buffer, "struct", bufLen) == 0) {
+            token_push(&next, token_keyword_struct, i - bufLen, bufLen);
           } else if (sz_strncmp(buffer, "if", bufLen) == 0) {
             token_push(&next, token_cf_if, i - bufLen, bufLen);
           } else if (sz_strncmp(buffer, "while", bufLen) == 0) {
@@ -166,6 +175,8 @@ bool tokenize(const char *data, const size_t len, Token *head) {
           token_push(&next, token_exclaimation, i - bufLen, bufLen);
         } else if (c == '.') {
           token_push(&next, token_period, i - bufLen, bufLen);
+        } else if (c == '#') {
+          token_push(&next, token_hash, i - bufLen, bufLen);
         } else if (c == '<') {
           if (previous != NULL && previous->type == token_less_than) {
             previous->type = token_left_shift;
@@ -208,7 +219,7 @@ bool tokenize(const char *data, const size_t len, Token *head) {
         if (bufLen == 0)
           numeric = true;
         buffer[bufLen++] = (char)c;
-      } else if (isalpha(c)) {
+      } else if (isalpha(c) || c == '_') {
         if (numeric) {
           puts("Identifier cannot start with number");
           return false;
@@ -309,6 +320,8 @@ const char *token_name(const TokenType type) {
     return "&&";
   case token_period:
     return ".";
+  case token_hash:
+    return "#";
   case token_arrow:
     return "->";
   case token_left_shift:
@@ -323,6 +336,12 @@ const char *token_name(const TokenType type) {
     return "extern";
   case token_keyword_as:
     return "as";
+  case token_keyword_import:
+    return "import";
+  case token_keyword_const:
+    return "const";
+  case token_keyword_struct:
+    return "struct";
   case token_identifier:
     return "<identifier>";
   case token_constant:
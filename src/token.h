@@ -30,6 +30,7 @@ typedef enum {
   token_exclaimation = '!',
 
   token_period = '.',
+  token_hash = '#',
 
   token_equals_assign = '=',
 
@@ -51,6 +52,9 @@ typedef enum {
   token_keyword_let,
   token_keyword_extern,
   token_keyword_as,
+  token_keyword_import,
+  token_keyword_const,
+  token_keyword_struct,
 
   token_identifier,
   token_constant,
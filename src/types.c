@@ -1,12 +1,25 @@
 #include "types.h"
 
+#include "options.h"
+
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+LIST_IMPL(Field, field, Field)
+
+// every struct declared so far, which parse_type finds types by name in
+PtrList structs;
 Width type_width(Type type) {
   return typekind_width(type.kind);
 }
 
 int type_size(Type type) {
-  return typekind_size(type.kind);
+  return type.kind == aggregate ? type.structure->size : typekind_size(type.kind);
+}
+
+int type_alignment(const Type type) {
+  return type.kind == aggregate ? type.structure->alignment : type_size(type);
 }
 
 Width typekind_width(const TypeKind type) {
@@ -28,6 +41,20 @@ Width typekind_width(const TypeKind type) {
     return Long;
   case f64:
     return Quad;
+  case i8x16:
+  case i16x8:
+  case i32x4:
+  case i64x2:
+  case f32x4:
+  case f64x2:
+    return Oword;
+  case i32x8:
+  case f32x8:
+  case f64x4:
+    return Yword;
+  case aggregate:
+    puts("a struct can only be used through its fields");
+    exit(25);
   }
   assert(false);
   return -1;
@@ -47,6 +74,10 @@ int size_bytes(const Width size) {
     return 4;
   case Quad:
     return 8;
+  case Oword:
+    return 16;
+  case Yword:
+    return 32;
   }
   exit(5);
 }
@@ -61,19 +92,58 @@ const char *size_mnemonic(const Width size) {
     return "long";
   case Quad:
     return "quad";
+  case Oword:
+    return "octa";
+  case Yword:
+    break;
   }
   exit(30);
 }
 
 bool is_fp(const TypeKind kind) {
-  return (kind & 0b010000) == 0b010000;
+  return kind == f32 || kind == f64;
 }
 
 bool is_pointer(const TypeKind kind) {
   return kind == ptr;
 }
 
-Result parse_type(const char *contents, const Token **token, Type *type) {
+bool is_vector(const TypeKind kind) {
+  return kind >= i8x16 && kind <= f64x4;
+}
+
+bool is_sse(const TypeKind kind) {
+  return is_fp(kind) || is_vector(kind);
+}
+
+TypeKind vector_lane(const TypeKind kind) {
+  switch (kind) {
+  case i8x16:
+    return i8;
+  case i16x8:
+    return i16;
+  case i32x4:
+  case i32x8:
+    return i32;
+  case i64x2:
+    return i64;
+  case f32x4:
+  case f32x8:
+    return f32;
+  case f64x2:
+  case f64x4:
+    return f64;
+  default:
+    assert(false);
+    return kind;
+  }
+}
+
+int vector_lanes(const TypeKind kind) {
+  return typekind_size(kind) / typekind_size(vector_lane(kind));
+}
+
+Result parse_any_type(const char *contents, const Token **token, Type *type, const bool field) {
   int indirection = 0;
   while (*token != NULL) {
     *token = (*token)->next;
@@ -106,9 +176,35 @@ Result parse_type(const char *contents, const Token **token, Type *type) {
         type->kind = f64;
       } else if (token_value_compare(*token, contents, "f32")) {
         type->kind = f32;
+      } else if (token_value_compare(*token, contents, "i8x16")) {
+        type->kind = i8x16;
+      } else if (token_value_compare(*token, contents, "i16x8")) {
+        type->kind = i16x8;
+      } else if (token_value_compare(*token, contents, "i32x4")) {
+        type->kind = i32x4;
+      } else if (token_value_compare(*token, contents, "i64x2")) {
+        type->kind = i64x2;
+      } else if (token_value_compare(*token, contents, "f32x4")) {
+        type->kind = f32x4;
+      } else if (token_value_compare(*token, contents, "f64x2")) {
+        type->kind = f64x2;
+      } else if (token_value_compare(*token, contents, "i32x8")) {
+        type->kind = i32x8;
+      } else if (token_value_compare(*token, contents, "f32x8")) {
+        type->kind = f32x8;
+      } else if (token_value_compare(*token, contents, "f64x4")) {
+        type->kind = f64x4;
       } else {
-        return failure(*token, "Unknown type");
+        Struct *structure = struct_find(contents, *token);
+        if (structure == NULL)
+          return failure(*token, "Unknown type");
+        if (indirection == 0 && !field)
+          return failure(*token, "structs can only be used through pointers");
+        type->kind = aggregate;
+        type->structure = structure;
       }
+      if (type->kind != aggregate && typekind_width(type->kind) == Yword && !(options.features & FEATURE_AVX2))
+        return failure(*token, "256-bit vectors need AVX2 (-mavx2 or -march=x86-64-v3)");
       break;
     }
   }
@@ -120,3 +216,75 @@ Result parse_type(const char *contents, const Token **token, Type *type) {
   }
   return success();
 }
+
+Result parse_type(const char *contents, const Token **token, Type *type) {
+  return parse_any_type(contents, token, type, false);
+}
+
+Result parse_field_type(const char *contents, const Token **token, Type *type) {
+  return parse_any_type(contents, token, type, true);
+}
+
+void struct_declare(Struct *structure) {
+  if (structs.array == NULL) {
+    ptrlist_init(&structs, 8);
+  }
+  ptrlist_add(&structs, structure);
+}
+
+Struct *struct_find(const char *contents, const Token *token) {
+  for (int i = 0; i < structs.len; ++i) {
+    Struct *structure = structs.array[i];
+    if (token_str_cmp(token, contents, structure->name) == 0)
+      return structure;
+  }
+  return NULL;
+}
+
+const Field *struct_field(const Struct *structure, const char *contents, const Token *token) {
+  for (int i = 0; i < structure->fields.len; ++i) {
+    if (token_str_cmp(token, contents, structure->fields.array[i].name) == 0)
+      return &structure->fields.array[i];
+  }
+  return NULL;
+}
+
+void struct_layout(Struct *structure, const bool reorder, const int alignment) {
+  FieldList *fields = &structure->fields;
+  // the fields in the order they are placed
+  int *order = malloc(sizeof(int) * (fields->len + 1));
+  for (int i = 0; i < fields->len; ++i) {
+    const int align = type_alignment(fields->array[i].type);
+    int j = i;
+    // stable, so that fields of the same alignment keep the order they were declared in
+    while (reorder && j > 0 && type_alignment(fields->array[order[j - 1]].type) < align) {
+      order[j] = order[j - 1];
+      --j;
+    }
+    order[j] = i;
+  }
+
+  int offset = 0;
+  structure->alignment = alignment > 1 ? alignment : 1;
+  for (int i = 0; i < fields->len; ++i) {
+    Field *field = &fields->array[order[i]];
+    const int align = type_alignment(field->type);
+    offset = (offset + align - 1) / align * align;
+    field->offset = offset;
+    offset += type_size(field->type);
+    if (align > structure->alignment) {
+      structure->alignment = align;
+    }
+  }
+  // so that every element of an array of them is aligned too
+  structure->size = (offset + structure->alignment - 1) / structure->alignment * structure->alignment;
+  free(order);
+}
+
+int struct_count(void) {
+  return structs.len;
+}
+
+const Struct *struct_get(const int index) {
+  return structs.array[index];
+}
@@ -11,7 +11,11 @@ typedef enum {
   // 32bit
   Long,
   // 64bit
-  Quad
+  Quad,
+  // 128bit, packed vectors only
+  Oword,
+  // 256bit, AVX2 vectors
+  Yword
 } Width;
 
 typedef enum {
@@ -28,23 +32,83 @@ typedef enum {
   f32,
   f64,
 
-  ptr
+  ptr,
+
+  // 128-bit packed vectors, named by lane type and count
+  i8x16,
+  i16x8,
+  i32x4,
+  i64x2,
+  f32x4,
+  f64x2,
+
+  // 256-bit packed vectors in ymm registers, only with AVX2
+  i32x8,
+  f32x8,
+  f64x4,
+
+  // a struct, only ever reached through a pointer or held inside another struct
+  aggregate
 } TypeKind;
 
+struct Struct;
+
 typedef struct Type {
   TypeKind kind;
 
   union {
-    struct Type *inner; // only valid with PTR
+    struct Type *inner;       // only valid with PTR
+    struct Struct *structure; // only valid with aggregate
   };
 } Type;
 
+typedef struct {
+  char *name;
+  Type type;
+  // bytes from the start of the struct
+  int offset;
+} Field;
+
+LIST_API(Field, field, Field)
+
+typedef struct Struct {
+  char *name;
+  // in the order they were declared, whichever order they are laid out in
+  FieldList fields;
+  // -1 until the fields are laid out
+  int size;
+  int alignment;
+} Struct;
+
+// makes the struct a type parse_type knows by name
+void struct_declare(Struct *structure);
+Struct *struct_find(const char *contents, const Token *token);
+const Field *struct_field(const Struct *structure, const char *contents, const Token *token);
+// places the fields one after another as C would, each at its natural alignment, or (reorder) those with the largest
+// alignment first so that none needs padding before it. the struct is aligned to at least alignment
+void struct_layout(Struct *structure, bool reorder, int alignment);
+// every struct declared, in order
+int struct_count(void);
+const Struct *struct_get(int index);
+
+// the type of a variable, argument or return value, which a struct can only be behind a pointer in
 Result parse_type(const char *contents, const Token **token, Type *type);
+// the type of a struct's field, which may also be a struct
+Result parse_field_type(const char *contents, const Token **token, Type *type);
 
 Width type_width(Type type);
 int type_size(Type type);
 Width typekind_width(TypeKind type);
 int typekind_size(TypeKind type);
+int type_alignment(Type type);
+
+bool is_fp(TypeKind kind);
+bool is_pointer(TypeKind kind);
+bool is_vector(TypeKind kind);
+// held in an xmm register: floating point scalars and vectors
+bool is_sse(TypeKind kind);
+TypeKind vector_lane(TypeKind kind);
+int vector_lanes(TypeKind kind);
 
 int size_bytes(Width size);
 const char *size_mnemonic(Width size);
@@ -0,0 +1,234 @@
+# runs one test program: cmake -DCRUST=<compiler> -DSOURCE=<file.crs> [-DFLAGS=<flags>] -DWORK=<dir> -P run.cmake
+#
+# the program's own comments say what to check:
+#   // expect: <line>   a line of what `crust --run` prints, in order
+#   // absent: <name>   a symbol that must not be in the assembly or in the object's symbol table
+#   // flags: <flags>   passed to every compile of the program, after FLAGS
+#   // arguments: <args> passed to the program that `crust --run` runs
+#   // cache: <dir>     compile through a cache in that directory, emptied first, and run the program a second time
+#                       from the cache alone
+#   // server: <name>   compile through a server listening on <name>.socket, whose own cache in <name>.cache shows
+#                       that it did the compiling
+#   // interface: <file> the --emit=interface output of that file, relative to the program, which is compiled from
+#                       a copy beside it so that it can `import "output.crsi";`
+#   // with: <file>     another source file compiled along with the program, relative to it
+#   // once: <text>     text that is in the assembly exactly once
+#   // emits: <text>    text that is in the assembly
+#   // omits: <text>    text that is nowhere in the assembly
+#   // placed: <name> <section> <alignment>
+#                       a global in that section of both objects, aligned that far within a section aligned as far
+#   // compare: objdump the object disassembles to the same instructions as the assembled --emit=asm output
+
+file(STRINGS ${SOURCE} lines)
+set(expected "")
+set(absent "")
+set(once "")
+set(emits "")
+set(omits "")
+set(placed "")
+set(sources ${SOURCE})
+set(arguments "")
+set(cache "")
+set(server "")
+set(interface "")
+set(compare OFF)
+foreach(line IN LISTS lines)
+  if(line MATCHES "^// expect: (.*)$")
+    string(APPEND expected "${CMAKE_MATCH_1}\n")
+  elseif(line MATCHES "^// absent: (.*)$")
+    list(APPEND absent "${CMAKE_MATCH_1}")
+  elseif(line MATCHES "^// flags: (.*)$")
+    string(APPEND FLAGS " ${CMAKE_MATCH_1}")
+  elseif(line MATCHES "^// arguments: (.*)$")
+    separate_arguments(arguments UNIX_COMMAND "${CMAKE_MATCH_1}")
+  elseif(line MATCHES "^// cache: (.*)$")
+    set(cache ${CMAKE_MATCH_1})
+    string(APPEND FLAGS " --cache-dir=${cache}")
+  elseif(line MATCHES "^// server: (.*)$")
+    set(server ${CMAKE_MATCH_1})
+  elseif(line MATCHES "^// interface: (.*)$")
+    get_filename_component(directory ${SOURCE} DIRECTORY)
+    set(interface ${directory}/${CMAKE_MATCH_1})
+  elseif(line MATCHES "^// with: (.*)$")
+    get_filename_component(directory ${SOURCE} DIRECTORY)
+    list(APPEND sources ${directory}/${CMAKE_MATCH_1})
+  elseif(line MATCHES "^// once: (.*)$")
+    list(APPEND once "${CMAKE_MATCH_1}")
+  elseif(line MATCHES "^// emits: (.*)$")
+    list(APPEND emits "${CMAKE_MATCH_1}")
+  elseif(line MATCHES "^// omits: (.*)$")
+    list(APPEND omits "${CMAKE_MATCH_1}")
+  elseif(line MATCHES "^// placed: ([A-Za-z0-9_]+) ([.a-z]+) ([0-9]+)$")
+    list(APPEND placed "${CMAKE_MATCH_1}:${CMAKE_MATCH_2}:${CMAKE_MATCH_3}")
+  elseif(line MATCHES "^// compare: objdump$")
+    set(compare ON)
+  endif()
+endforeach()
+separate_arguments(flags UNIX_COMMAND "${FLAGS}")
+file(MAKE_DIRECTORY ${WORK})
+if(cache)
+  file(REMOVE_RECURSE ${WORK}/${cache})
+endif()
+if(interface)
+  execute_process(COMMAND ${CRUST} --emit=interface ${interface} WORKING_DIRECTORY ${WORK} RESULT_VARIABLE result
+                  OUTPUT_QUIET ERROR_QUIET)
+  if(NOT result EQUAL 0 OR NOT EXISTS ${WORK}/output.crsi)
+    message(FATAL_ERROR "${SOURCE}: no interface was written for ${interface}")
+  endif()
+  file(COPY ${SOURCE} DESTINATION ${WORK})
+  get_filename_component(name ${SOURCE} NAME)
+  list(REMOVE_AT sources 0)
+  list(INSERT sources 0 ${WORK}/${name})
+endif()
+if(server AND CMAKE_HOST_UNIX)
+  file(REMOVE_RECURSE ${WORK}/${server}.cache)
+  # in the background, and gone within a minute even when a check below fails before it is stopped
+  execute_process(COMMAND sh -c "timeout 60 \"$0\" --server=$1.socket --cache-dir=$1.cache >/dev/null 2>&1 & echo $!"
+                  ${CRUST} ${server} WORKING_DIRECTORY ${WORK} OUTPUT_VARIABLE serverPid
+                  OUTPUT_STRIP_TRAILING_WHITESPACE)
+  # a stale socket is there until the server has replaced it, so wait for a compile that it answered
+  foreach(attempt RANGE 100)
+    execute_process(COMMAND ${CRUST} --connect=${server}.socket --emit=asm ${sources} WORKING_DIRECTORY ${WORK}
+                    OUTPUT_QUIET ERROR_QUIET)
+    if(EXISTS ${WORK}/${server}.cache)
+      break()
+    endif()
+    execute_process(COMMAND ${CMAKE_COMMAND} -E sleep 0.05)
+  endforeach()
+  file(REMOVE_RECURSE ${WORK}/${server}.cache)
+  execute_process(COMMAND timeout 5 ${CRUST} --server=${server}.socket WORKING_DIRECTORY ${WORK}
+                  RESULT_VARIABLE second OUTPUT_QUIET ERROR_QUIET)
+  if(NOT second EQUAL 1)
+    message(FATAL_ERROR "${SOURCE}: a second server on ${server}.socket finished with ${second}")
+  endif()
+  list(APPEND flags --connect=${server}.socket)
+endif()
+
+execute_process(COMMAND ${CRUST} ${flags} --run ${sources} -- ${arguments} WORKING_DIRECTORY ${WORK}
+                RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_QUIET)
+if(NOT result EQUAL 0 OR NOT output STREQUAL expected)
+  message(FATAL_ERROR "${SOURCE} (${result}) printed:\n${output}expected:\n${expected}")
+endif()
+
+if(server AND CMAKE_HOST_UNIX)
+  file(GLOB served ${WORK}/${server}.cache/*)
+  if(NOT served)
+    message(FATAL_ERROR "${SOURCE}: the server on ${server}.socket did not compile the program")
+  endif()
+endif()
+
+if(cache)
+  file(GLOB stored RELATIVE ${WORK}/${cache} ${WORK}/${cache}/*)
+  execute_process(COMMAND ${CRUST} ${flags} --run ${sources} -- ${arguments} WORKING_DIRECTORY ${WORK}
+                  RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_QUIET)
+  if(NOT result EQUAL 0 OR NOT output STREQUAL expected)
+    message(FATAL_ERROR "${SOURCE} (${result}) printed from the cache:\n${output}expected:\n${expected}")
+  endif()
+  file(GLOB reused RELATIVE ${WORK}/${cache} ${WORK}/${cache}/*)
+  if(NOT stored OR NOT reused STREQUAL stored)
+    message(FATAL_ERROR "${SOURCE}: the cache held ${stored} and then ${reused}")
+  endif()
+endif()
+
+find_program(NM nm)
+if(absent)
+  execute_process(COMMAND ${CRUST} ${flags} --emit=asm ${sources} WORKING_DIRECTORY ${WORK} OUTPUT_QUIET ERROR_QUIET)
+  file(READ ${WORK}/output.asm assembly)
+  execute_process(COMMAND ${CRUST} ${flags} ${sources} WORKING_DIRECTORY ${WORK} OUTPUT_QUIET ERROR_QUIET)
+  set(symbols "")
+  if(NM)
+    execute_process(COMMAND ${NM} ${WORK}/output.o OUTPUT_VARIABLE symbols)
+  endif()
+  foreach(name IN LISTS absent)
+    if(assembly MATCHES "[^A-Za-z0-9_.]${name}[^A-Za-z0-9_]" OR symbols MATCHES " ${name}\n")
+      message(FATAL_ERROR "${SOURCE}: ${name} is still in the output")
+    endif()
+  endforeach()
+endif()
+
+if(once OR emits OR omits)
+  execute_process(COMMAND ${CRUST} ${flags} --emit=asm ${sources} WORKING_DIRECTORY ${WORK} OUTPUT_QUIET ERROR_QUIET)
+  file(READ ${WORK}/output.asm assembly)
+  foreach(text IN LISTS emits)
+    string(FIND "${assembly}" "${text}" position)
+    if(position EQUAL -1)
+      message(FATAL_ERROR "${SOURCE}: ${text} is not in the assembly")
+    endif()
+  endforeach()
+  foreach(text IN LISTS omits)
+    string(FIND "${assembly}" "${text}" position)
+    if(NOT position EQUAL -1)
+      message(FATAL_ERROR "${SOURCE}: ${text} is in the assembly")
+    endif()
+  endforeach()
+  string(LENGTH "${assembly}" length)
+  foreach(text IN LISTS once)
+    string(REPLACE "${text}" "" rest "${assembly}")
+    string(LENGTH "${rest}" remaining)
+    string(LENGTH "${text}" size)
+    math(EXPR count "(${length} - ${remaining}) / ${size}")
+    if(NOT count EQUAL 1)
+      message(FATAL_ERROR "${SOURCE}: ${text} is in the assembly ${count} times")
+    endif()
+  endforeach()
+endif()
+
+find_program(READELF readelf)
+find_program(ASSEMBLER NAMES cc gcc)
+if(placed AND NM AND READELF AND ASSEMBLER)
+  execute_process(COMMAND ${CRUST} ${flags} --emit=asm ${sources} WORKING_DIRECTORY ${WORK} OUTPUT_QUIET ERROR_QUIET)
+  file(RENAME ${WORK}/output.asm ${WORK}/placed.s)
+  execute_process(COMMAND ${ASSEMBLER} -c ${WORK}/placed.s -o ${WORK}/placed.o)
+  execute_process(COMMAND ${CRUST} ${flags} ${sources} WORKING_DIRECTORY ${WORK} OUTPUT_QUIET ERROR_QUIET)
+  foreach(object output.o placed.o)
+    execute_process(COMMAND ${NM} ${WORK}/${object} OUTPUT_VARIABLE symbols)
+    execute_process(COMMAND ${READELF} -S -W ${WORK}/${object} OUTPUT_VARIABLE sections)
+    foreach(entry IN LISTS placed)
+      string(REPLACE ":" ";" entry "${entry}")
+      list(GET entry 0 name)
+      list(GET entry 1 section)
+      list(GET entry 2 alignment)
+      string(SUBSTRING ${section} 1 1 letter)
+      string(TOUPPER ${letter} upper)
+      if(NOT symbols MATCHES "([0-9a-f]+) [${letter}${upper}] ${name}\n")
+        message(FATAL_ERROR "${SOURCE}: ${name} is not in ${section} of ${object}")
+      endif()
+      math(EXPR misaligned "0x${CMAKE_MATCH_1} % ${alignment}")
+      string(REGEX MATCH "\\] ${section} [^\n]* ([0-9]+)\n" header "${sections}")
+      if(NOT header OR CMAKE_MATCH_1 LESS alignment OR misaligned)
+        message(FATAL_ERROR "${SOURCE}: ${name} is not aligned to ${alignment} in ${object}")
+      endif()
+    endforeach()
+  endforeach()
+endif()
+
+find_program(OBJDUMP objdump)
+if(compare AND OBJDUMP AND ASSEMBLER)
+  execute_process(COMMAND ${CRUST} ${flags} --emit=asm ${sources} WORKING_DIRECTORY ${WORK} OUTPUT_QUIET ERROR_QUIET)
+  file(RENAME ${WORK}/output.asm ${WORK}/output.s)
+  execute_process(COMMAND ${ASSEMBLER} -c ${WORK}/output.s -o ${WORK}/assembled.o RESULT_VARIABLE result
+                  ERROR_VARIABLE errors)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${SOURCE}: the assembly does not assemble:\n${errors}")
+  endif()
+  execute_process(COMMAND ${CRUST} ${flags} ${sources} WORKING_DIRECTORY ${WORK} OUTPUT_QUIET ERROR_QUIET)
+  # instructions alone: an instruction can have more than one encoding (the assembler shortens jumps to other
+  # functions the object resolves through relocations), which moves the addresses after it
+  execute_process(COMMAND ${OBJDUMP} -d --no-show-raw-insn ${WORK}/assembled.o OUTPUT_VARIABLE assembled)
+  execute_process(COMMAND ${OBJDUMP} -d --no-show-raw-insn ${WORK}/output.o OUTPUT_VARIABLE encoded)
+  foreach(listing assembled encoded)
+    string(REGEX REPLACE "[^\n]*file format[^\n]*\n" "" ${listing} "${${listing}}")
+    string(REGEX REPLACE "\n *[0-9a-f]+:\t" "\n" ${listing} "${${listing}}")
+    string(REGEX REPLACE "\n[0-9a-f]+ <" "\n<" ${listing} "${${listing}}")
+    string(REGEX REPLACE " +[0-9a-f]+ <[^>\n]*>" "" ${listing} "${${listing}}")
+  endforeach()
+  if(NOT assembled STREQUAL encoded)
+    file(WRITE ${WORK}/assembled.txt "${assembled}")
+    file(WRITE ${WORK}/encoded.txt "${encoded}")
+    message(FATAL_ERROR "${SOURCE}: the object differs from the assembler's, see ${WORK}/assembled.txt and encoded.txt")
+  endif()
+endif()
+
+if(server AND CMAKE_HOST_UNIX)
+  execute_process(COMMAND kill ${serverPid})
+endif()